@@ -1,3 +1,28 @@
 C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V Fullscreen.vert -o Compiled/Fullscreen.vert.spv
 C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V Fullscreen.frag -o Compiled/Fullscreen.frag.spv
-C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V Tracer.comp     -o Compiled/Tracer.comp.spv
\ No newline at end of file
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V Tracer.comp     -o Compiled/Tracer.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V -DDYNAMIC_BVH Tracer.comp -o Compiled/TracerDynamic.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V -DWIDE_BVH Tracer.comp -o Compiled/TracerWide.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V --target-env vulkan1.1 -DPERSISTENT_THREADS Tracer.comp -o Compiled/TracerPersistent.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V --target-env vulkan1.1 -DPERSISTENT_THREADS -DDYNAMIC_BVH Tracer.comp -o Compiled/TracerPersistentDynamic.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V --target-env vulkan1.1 -DPERSISTENT_THREADS -DWIDE_BVH Tracer.comp -o Compiled/TracerPersistentWide.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V Temporal.comp -o Compiled/Temporal.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V Variance.comp -o Compiled/Variance.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V Atrous.comp   -o Compiled/Atrous.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V WavefrontGenerate.comp -o Compiled/WavefrontGenerate.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V WavefrontShade.comp    -o Compiled/WavefrontShade.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V WavefrontResolve.comp  -o Compiled/WavefrontResolve.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V WavefrontSortKeys.comp -o Compiled/WavefrontSortKeys.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V WavefrontExtend.comp   -o Compiled/WavefrontExtend.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V WavefrontConnect.comp  -o Compiled/WavefrontConnect.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V -DDYNAMIC_BVH WavefrontExtend.comp  -o Compiled/WavefrontExtendDynamic.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V -DDYNAMIC_BVH WavefrontConnect.comp -o Compiled/WavefrontConnectDynamic.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V -DWIDE_BVH WavefrontExtend.comp  -o Compiled/WavefrontExtendWide.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V -DWIDE_BVH WavefrontConnect.comp -o Compiled/WavefrontConnectWide.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V LBVHBounds.comp     -o Compiled/LBVHBounds.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V LBVHMorton.comp     -o Compiled/LBVHMorton.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V LBVHHierarchy.comp  -o Compiled/LBVHHierarchy.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V LBVHFit.comp        -o Compiled/LBVHFit.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V RadixHistogram.comp -o Compiled/RadixHistogram.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V RadixScan.comp      -o Compiled/RadixScan.comp.spv
+C:/VulkanSDK/1.1.92.1/Bin/glslangValidator.exe -V RadixScatter.comp   -o Compiled/RadixScatter.comp.spv
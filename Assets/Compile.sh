@@ -1,6 +1,45 @@
 #!/usr/bin/env bash
 
-glslangValidator -V Fullscreen.vert -o Compiled/Fullscreen.vert.spv
-glslangValidator -V Fullscreen.frag -o Compiled/Fullscreen.frag.spv
-glslangValidator -V Raytracer.comp  -o Compiled/Raytracer.comp.spv
-glslangValidator -V Tracer.comp     -o Compiled/Tracer.comp.spv
+# Run from anywhere, with the validator on the PATH or given as GLSLANG, as the build does
+
+set -e
+
+cd "$(dirname "$0")"
+
+GLSLANG="${GLSLANG:-glslangValidator}"
+
+mkdir -p Compiled
+
+"$GLSLANG" -V Fullscreen.vert -o Compiled/Fullscreen.vert.spv
+"$GLSLANG" -V Fullscreen.frag -o Compiled/Fullscreen.frag.spv
+"$GLSLANG" -V Raytracer.comp  -o Compiled/Raytracer.comp.spv
+"$GLSLANG" -V Tracer.comp     -o Compiled/Tracer.comp.spv
+"$GLSLANG" -V -DDYNAMIC_BVH Tracer.comp -o Compiled/TracerDynamic.comp.spv
+"$GLSLANG" -V -DWIDE_BVH    Tracer.comp -o Compiled/TracerWide.comp.spv
+"$GLSLANG" -V --target-env vulkan1.1 -DPERSISTENT_THREADS Tracer.comp -o Compiled/TracerPersistent.comp.spv
+"$GLSLANG" -V --target-env vulkan1.1 -DPERSISTENT_THREADS -DDYNAMIC_BVH Tracer.comp -o Compiled/TracerPersistentDynamic.comp.spv
+"$GLSLANG" -V --target-env vulkan1.1 -DPERSISTENT_THREADS -DWIDE_BVH    Tracer.comp -o Compiled/TracerPersistentWide.comp.spv
+
+"$GLSLANG" -V Temporal.comp -o Compiled/Temporal.comp.spv
+"$GLSLANG" -V Variance.comp -o Compiled/Variance.comp.spv
+"$GLSLANG" -V Atrous.comp   -o Compiled/Atrous.comp.spv
+
+"$GLSLANG" -V WavefrontGenerate.comp -o Compiled/WavefrontGenerate.comp.spv
+"$GLSLANG" -V WavefrontShade.comp    -o Compiled/WavefrontShade.comp.spv
+"$GLSLANG" -V WavefrontResolve.comp  -o Compiled/WavefrontResolve.comp.spv
+"$GLSLANG" -V WavefrontSortKeys.comp -o Compiled/WavefrontSortKeys.comp.spv
+"$GLSLANG" -V WavefrontExtend.comp   -o Compiled/WavefrontExtend.comp.spv
+"$GLSLANG" -V WavefrontConnect.comp  -o Compiled/WavefrontConnect.comp.spv
+"$GLSLANG" -V -DDYNAMIC_BVH WavefrontExtend.comp  -o Compiled/WavefrontExtendDynamic.comp.spv
+"$GLSLANG" -V -DDYNAMIC_BVH WavefrontConnect.comp -o Compiled/WavefrontConnectDynamic.comp.spv
+"$GLSLANG" -V -DWIDE_BVH    WavefrontExtend.comp  -o Compiled/WavefrontExtendWide.comp.spv
+"$GLSLANG" -V -DWIDE_BVH    WavefrontConnect.comp -o Compiled/WavefrontConnectWide.comp.spv
+
+"$GLSLANG" -V LBVHBounds.comp    -o Compiled/LBVHBounds.comp.spv
+"$GLSLANG" -V LBVHMorton.comp    -o Compiled/LBVHMorton.comp.spv
+"$GLSLANG" -V LBVHHierarchy.comp -o Compiled/LBVHHierarchy.comp.spv
+"$GLSLANG" -V LBVHFit.comp       -o Compiled/LBVHFit.comp.spv
+
+"$GLSLANG" -V RadixHistogram.comp -o Compiled/RadixHistogram.comp.spv
+"$GLSLANG" -V RadixScan.comp      -o Compiled/RadixScan.comp.spv
+"$GLSLANG" -V RadixScatter.comp   -o Compiled/RadixScatter.comp.spv
@@ -5,27 +5,23 @@ layout(location = 0) in vec2 uv_coords;
 
 layout(location = 0) out vec4 frag_color;
 
+/// @brief Temporally resolved radiance of this frame
 layout(set = 0, binding = 0) uniform sampler2D raytraced_image;
 
-layout(set = 0, binding = 1) uniform sampler2D prev_raytraced_image;
-
-const float inv_size = 1.0 / 2048.0;
+/// @brief Reinhard, then gamma.  The traced images hold linear radiance
+vec3 tonemap(in vec3 color)
+{
+	return pow(color / (color + vec3(1.0)), vec3(1.0 / 2.2));
+}
 
 void main()
 {
 	const vec2 uv = { uv_coords.s, 1.0 - uv_coords.t };
 
-	const vec3 color_0 = texture(raytraced_image, uv).rgb;
-	const vec3 color_1 = texture(prev_raytraced_image, uv).rgb;
-
-	const vec3 N = texture(raytraced_image, uv + vec2(0.0, 1.0)  * inv_size).rgb;
-	const vec3 S = texture(raytraced_image, uv + vec2(0.0, -1.0) * inv_size).rgb;
-	const vec3 E = texture(raytraced_image, uv + vec2(1.0, 0.0)  * inv_size).rgb;
-	const vec3 W = texture(raytraced_image, uv + vec2(-1.0, 0.0) * inv_size).rgb;
-
-	const float vT = dot(color_0 - color_1, color_0 - color_1); // Temporal variance
+	const vec3 final = tonemap(texture(raytraced_image, uv).rgb);
 
-	const vec3 final = (vT > 0.0005 ? (N + S + E + W) / 4.0 : color_0);
+	// Dither away banding before quantizing to the backbuffer
+	const float noise = fract(sin(dot(gl_FragCoord.xy, vec2(12.9898, 78.233))) * 43758.5453);
 
-	frag_color = vec4(final, 1.0);
+	frag_color = vec4(final + noise / 64.0, 1.0);
 }
@@ -0,0 +1,94 @@
+/**
+ * @file   LBVH.glsl
+ * @brief  Resources shared by the kernels which build a linear BVH on the device
+ *
+ * Internal nodes live at [0, n - 1) and leaves at [n - 1, 2n - 1), so the root is always node 0
+ */
+
+/// @brief One vertex and the two edges leaving it, laid out for intersection as in Tracer.comp
+struct Triangle
+{
+	vec3 v0;
+	vec3 e1;
+	vec3 e2;
+};
+
+/**
+ * @struct LBVHNode
+ *
+ * @brief Device-built BVH node.  Children are explicit, since Karras-style hierarchies do not store siblings together
+ *
+ * @note Leaves have `right == LBVH_LEAF`, and `left` is the index of their triangle
+ */
+struct LBVHNode
+{
+	vec3 aabb_min;
+	uint left;
+
+	vec3 aabb_max;
+	uint right;
+};
+
+const uint LBVH_LEAF = 0xFFFFFFFF;
+
+layout (std430, set = 0, binding = 0) readonly buffer SceneData
+{
+	Triangle tris[];
+};
+
+/// @brief Scene centroid bounds, stored as order-preserving uints so they can be reduced with atomics
+layout (std430, set = 0, binding = 1) buffer BuildState
+{
+	uint bounds_min[3];
+	uint bounds_max[3];
+};
+
+/// @brief Morton codes.  Two halves of `tri_count` entries, ping-ponged by the radix sort
+layout (std430, set = 0, binding = 2) buffer MortonCodes
+{
+	uint morton_codes[];
+};
+
+/// @brief Triangle indices, sorted alongside `morton_codes`
+layout (std430, set = 0, binding = 3) buffer TriangleIndices
+{
+	uint tri_indices[];
+};
+
+layout (std430, set = 0, binding = 4) coherent buffer Nodes
+{
+	LBVHNode nodes[];
+};
+
+layout (std430, set = 0, binding = 5) buffer Parents
+{
+	uint parents[];
+};
+
+/// @brief Per internal node arrival counters for the bottom-up bounds pass.  Cleared every build
+layout (std430, set = 0, binding = 6) coherent buffer Flags
+{
+	uint flags[];
+};
+
+layout (push_constant) uniform BuildInfo
+{
+	uint tri_count;
+};
+
+uint float_to_ordered(in float f)
+{
+	const uint u = floatBitsToUint(f);
+
+	return ((u & 0x80000000) != 0) ? ~u : (u | 0x80000000);
+}
+
+float ordered_to_float(in uint u)
+{
+	return uintBitsToFloat(((u & 0x80000000) != 0) ? (u & 0x7FFFFFFF) : ~u);
+}
+
+vec3 centroid(in Triangle tri)
+{
+	return tri.v0 + (tri.e1 + tri.e2) * (1.0 / 3.0);
+}
@@ -0,0 +1,95 @@
+/**
+ * @file   RadixSort.glsl
+ * @brief  Resources shared by the radix sort kernels
+ *
+ * Sorts up to 32-bit keys with 32-bit values, 8 bits per pass.  Keys and values each hold two halves of the sorter's
+ * capacity, and every pass reads from `in_offset` and writes to `out_offset`, so an even number of passes lands back
+ * where it started.  Elements are processed in blocks of 256, one per workgroup
+ *
+ * The number of keys lives in a buffer rather than a push constant, so a kernel can size the sort on the device and
+ * the histogram and scatter passes can be dispatched indirectly from it
+ */
+
+const uint RADIX      = 256;
+const uint BLOCK_SIZE = 256;
+
+layout (std430, set = 0, binding = 0) buffer Keys
+{
+	uint keys[];
+};
+
+layout (std430, set = 0, binding = 1) buffer Values
+{
+	uint values[];
+};
+
+/// @brief Digit-major block histograms, `[digit * block_count + block]`, scanned into offsets within each digit in
+///        place.  The total of every digit follows them, at `[RADIX * block_count + digit]`
+layout (std430, set = 0, binding = 2) buffer Histograms
+{
+	uint histograms[];
+};
+
+/// @brief Keys to sort.  The first three members are the VkDispatchIndirectCommand of one workgroup per block
+layout (std430, set = 0, binding = 3) readonly buffer SortCount
+{
+	uint block_count_x;
+	uint block_count_y;
+	uint block_count_z;
+
+	uint count;
+};
+
+layout (push_constant) uniform SortPass
+{
+	uint shift;
+	uint in_offset;
+	uint out_offset;
+};
+
+shared uint scan_totals[BLOCK_SIZE];
+
+uint block_count()
+{
+	return (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+uint digit_of(in uint key)
+{
+	return (key >> shift) & (RADIX - 1);
+}
+
+/**
+ * @brief Exclusive prefix sum of one value per invocation across the workgroup, in log2(BLOCK_SIZE) shared-memory steps
+ *
+ * @note Must be reached by the whole workgroup
+ */
+uint workgroup_exclusive_scan(in uint value, out uint total)
+{
+	const uint local = gl_LocalInvocationID.x;
+
+	scan_totals[local] = value;
+
+	barrier();
+
+	for (uint stride = 1; stride < BLOCK_SIZE; stride *= 2)
+	{
+		const uint earlier = (local >= stride) ? scan_totals[local - stride] : 0;
+
+		barrier();
+
+		scan_totals[local] += earlier;
+
+		barrier();
+	}
+
+	const uint inclusive = scan_totals[local];
+
+	total = scan_totals[BLOCK_SIZE - 1];
+
+	// The scratch is free for the next scan once everyone has read it
+
+	barrier();
+
+	return inclusive - value;
+}
@@ -0,0 +1,1061 @@
+/**
+ * @file   Tracer.glsl
+ * @brief  Scene, intersection and traversal shared by the megakernel in Tracer.comp and the wavefront kernels
+ *
+ * Define DYNAMIC_BVH or WIDE_BVH to pick how triangle hierarchies are traversed, and WAVEFRONT to extend the push
+ * constants with the wavefront pass indices
+ */
+
+
+
+/**
+ * @struct Camera
+ *
+ * @brief Represents the viewport which is recieving light from the scene
+ */
+struct Camera
+{
+	/// @brief Position of the camera in world-space
+	vec3 pos;
+
+	/// @brief Normalized direction vector that the camera is viewing
+	vec3 dir;
+
+	/// @brief Normalized right-facing direction relative to view direction
+	vec3 right;
+
+	/// @brief Normalized up-facing direction relative to view direction
+	vec3 up;
+};
+
+/**
+ * @struct Ray
+ *
+ * @brief A three-dimentional half-line which may intersect with other geometric primitives
+ */
+struct Ray
+{
+	/// @brief Position where the ray originates in world-space
+	vec3 origin;
+
+	/// @brief Normalized direction vector that the ray is shooting
+	vec3 dir;
+};
+
+const uint MAT_TYPE_DIFFUSE    = 0; // Diffuse and specular
+const uint MAT_TYPE_DIELECTRIC = 1; // Glass, water
+
+/**
+ * @struct Material
+ *
+ * @brief Standard surface material smilar to UE4's metallic PBR pipeline
+ */
+struct Material
+{
+	/// @brief Base color of object
+	vec3 albedo;
+
+	/// @brief Color emissed by object regardless of lighting
+	vec3 emissive;
+
+	/// @brief How rough the surface of the material is
+	float roughness;
+
+	float metalness;
+
+	/// @brief Determines how object-light interactions should be handled
+	uint type;
+};
+
+/**
+ * @struct Intersection
+ *
+ * @brief Information about intersection between a ray and a geometric primitive
+ *
+ * @see Ray
+ */
+struct Intersection
+{
+	Material mat;
+
+	/// @brief Distance from ray origin which intersection occured
+	float t;
+
+	/// @brief Position of ray intersection in world-space
+	vec3 P;
+
+	/// @brief Normal of surface patch which ray collided with
+	vec3 N;
+
+	/// @brief Primitive which was hit: spheres first, then planes, then `OBJECT_TRIANGLES` for any triangle
+	uint object;
+};
+
+/**
+ * @struct Sphere
+ *
+ * @brief Like a ball, but somehow rounder
+ */
+struct Sphere
+{
+	Material mat;
+
+	/// @brief Position of sphere in world-space
+	vec3 P;
+
+	/// @brief Radius of the sphere
+	float r;
+};
+
+/**
+ * @struct Plane
+ *
+ * @brief Flatt primitive which stretches into the   v o i d
+ */
+struct Plane
+{
+	Material mat;
+
+	vec3 N;
+
+	float len;
+};
+
+/**
+ * @struct Triangle
+ *
+ * @brief One vertex and the two edges leaving it, precomputed on upload so intersection tests skip both subtractions
+ *
+ * @note Face normals are stored apart, in `normals`, and only read for the closest hit
+ */
+struct Triangle
+{
+	vec3 v0;
+	vec3 e1;
+	vec3 e2;
+};
+
+/**
+ * @struct BVHNode
+ *
+ * @brief Flattened bounding volume hierarchy node, built on the CPU.  Used by both the per-mesh and the instance level
+ *
+ * @note Interior nodes have `tri_count == 0` and store their children at `left_first` and `left_first + 1`
+ * @note Leaf nodes reference `tri_count` consecutive triangles starting at `left_first`
+ */
+struct BVHNode
+{
+	vec3 aabb_min;
+	uint left_first;
+
+	vec3 aabb_max;
+	uint tri_count;
+};
+
+/**
+ * @struct BVH8Node
+ *
+ * @brief Eight-wide node collapsed from the binary BVH, with child boxes quantized to 8 bits against the node's frame
+ *
+ * @note Bytes are packed four to a uint.  Child `i`'s box is `origin + q * 2^(exponent - 127)` on each axis
+ * @note A meta byte of 0 is an empty slot, `0x80 | k` is the interior node `child_base + k`, and anything else is a
+ *       leaf of that many triangles, stored back to back from `tri_base` in slot order
+ */
+struct BVH8Node
+{
+	vec3 origin;
+	uint exponents_imask;
+
+	uint child_base;
+	uint tri_base;
+
+	uint meta[2];
+
+	uint lo_x[2];
+	uint lo_y[2];
+	uint lo_z[2];
+	uint hi_x[2];
+	uint hi_y[2];
+	uint hi_z[2];
+};
+
+/**
+ * @struct InstanceData
+ *
+ * @brief Placed mesh.  Rays are moved into object space rather than geometry into world space
+ */
+struct InstanceData
+{
+	/// @brief Rows of the world-to-object 3x4 matrix
+	vec4 world_to_object[3];
+
+	/// @brief Root of the instance's mesh in `nodes`
+	uint blas_root;
+};
+
+/**
+ * @struct LBVHNode
+ *
+ * @brief Linear BVH node, built and refitted on the device by the LBVH kernels
+ *
+ * @note Leaves have `right == LBVH_LEAF`, and `left` is the index of their triangle
+ */
+struct LBVHNode
+{
+	vec3 aabb_min;
+	uint left;
+
+	vec3 aabb_max;
+	uint right;
+};
+
+
+
+/////
+// Shader Communication
+/////
+
+
+
+/// @brief Image displayed this frame, written by Temporal.comp.  Tracers only take its size
+layout (set = 0, binding = 0, rgba16f) uniform writeonly image2D render_target;
+
+layout (std430, set = 0, binding = 1) readonly buffer SceneData
+{
+	Triangle tris[];
+};
+
+#ifdef WIDE_BVH
+
+layout (std430, set = 0, binding = 2) readonly buffer BVHData
+{
+	BVH8Node nodes[];
+};
+
+#else
+
+layout (std430, set = 0, binding = 2) readonly buffer BVHData
+{
+	BVHNode nodes[];
+};
+
+#endif
+
+layout (std430, set = 0, binding = 3) readonly buffer LBVHData
+{
+	LBVHNode lbvh_nodes[];
+};
+
+layout (std430, set = 0, binding = 4) readonly buffer TLASData
+{
+	BVHNode tlas_nodes[];
+};
+
+layout (std430, set = 0, binding = 5) readonly buffer Instances
+{
+	InstanceData instances[];
+};
+
+/// @brief Unit face normal of each triangle in `tris`, at the same index
+layout (std430, set = 0, binding = 6) readonly buffer Normals
+{
+	vec4 normals[];
+};
+
+/// @brief Linear radiance traced this frame, before Temporal.comp blends it with the history
+layout (set = 0, binding = 10, rgba16f) uniform writeonly image2D radiance_target;
+
+/// @brief World-space position of each pixel's primary hit, which Temporal.comp reprojects into the previous frame
+layout (set = 0, binding = 11, rgba32f) uniform writeonly image2D position_target;
+
+/// @brief Normal of each pixel's primary hit, and its distance from the camera.  Guides the denoiser's filters
+layout (set = 0, binding = 12, rgba16f) uniform writeonly image2D normal_target;
+
+/// @brief Albedo of each pixel's primary hit, divided out of radiance before it is filtered
+layout (set = 0, binding = 14, rgba16f) uniform writeonly image2D albedo_target;
+
+layout (push_constant) uniform FrameData
+{
+	/// @brief Width-height ratio of rendering media
+	float aspect_ratio;
+
+	/// @brief Value to seed the pseudo-RNG
+	float seed;
+
+	/// @brief Position of the light source in world space
+	/// @deprecated No longer used
+	vec3 light_pos;
+
+	/// @brief Camera viewport object
+	/// @see Camera
+	Camera camera;
+
+#ifdef WAVEFRONT
+	/// @brief Sample being traced, in [0, SAMPLES)
+	uint sample_idx;
+
+	/// @brief Bounce being traced, in [0, DEPTH)
+	uint depth;
+
+	/// @brief Queue WavefrontSortKeys reads from
+	uint sort_queue;
+#endif
+};
+
+
+
+/////
+// Constants
+/////
+
+
+
+const float PI      = 3.14159265359;
+const float EPSILON = 1e-3;
+
+/// @brief Set by the host as specialization constants, so one binary serves every quality setting and the driver can
+/// unroll the loops they bound.  Defaults match `TraceSettings`
+layout (constant_id = 0) const uint DEPTH   = 4;
+layout (constant_id = 1) const uint SAMPLES = 1;
+
+/// @brief Leading spheres and planes of the scene which are traced, at most `MAX_SPHERES` and `MAX_PLANES`
+layout (constant_id = 2) const uint SPHERE_COUNT = 4;
+layout (constant_id = 3) const uint PLANE_COUNT  = 5;
+
+const uint MAX_SPHERES = 4;
+const uint MAX_PLANES  = 5;
+
+const uint OBJECT_TRIANGLES = SPHERE_COUNT + PLANE_COUNT;
+
+const uint BVH_STACK_SIZE = 64;
+
+const uint LBVH_LEAF = 0xFFFFFFFF;
+
+const Material matte_white = { vec3(1.0, 1.0, 1.0),    vec3(0.0), 0.3, 0.7, MAT_TYPE_DIFFUSE};
+const Material matte_red   = { vec3(0.75, 0.25, 0.25), vec3(0.0), 0.4, 0.0, MAT_TYPE_DIFFUSE };
+const Material matte_green = { vec3(0.25, 0.75, 0.25), vec3(0.0), 0.4, 0.0, MAT_TYPE_DIFFUSE };
+const Material matte_blue  = { vec3(0.25, 0.25, 0.75), vec3(0.0), 0.4, 0.0, MAT_TYPE_DIFFUSE };
+
+const Material plastic = { vec3(0.25, 0.25, 0.75), vec3(0.0), 0.3,  0.6, MAT_TYPE_DIFFUSE };
+const Material mirror  = { vec3(1.0, 0.5, 0.5), vec3(0.0),    0.0,  1.0, MAT_TYPE_DIFFUSE};
+const Material glass   = { vec3(1.0, 1.0, 1.0), vec3(0.0),    0.42, 0.0, MAT_TYPE_DIELECTRIC };
+const Material light   = { vec3(1.0, 1.0, 1.0), vec3(128.0),  0.6,  0.0, MAT_TYPE_DIFFUSE };
+
+Sphere spheres[MAX_SPHERES] =
+{
+	{ glass, vec3(42.0, 16.0, 12.0), 16.0 },
+	{ light, vec3(0.0, 96.0, 0.0), 12.0 },
+	{ mirror, vec3(-32.0, 24.0, 24.0), 24.0 },
+	{ plastic, vec3(-24.0, 11.0, -48.0), 11.0 }
+};
+
+Plane planes[MAX_PLANES] =
+{
+	{ matte_white, vec3(0.0, 1.0, 0.0),  0.0 },
+	{ matte_white, vec3(0.0, -1.0, 0.0), 128.0 },
+	{ matte_red,   vec3(1.0, 0.0, 0.0),  64.0 },
+	{ matte_green, vec3(0.0, 0.0, -1.0), 64.0 },
+	{ matte_blue,  vec3(-1.0, 0.0, 0.0), 64.0 }
+};
+
+
+
+/////
+// Functions
+/////
+
+
+
+float rand_salt = 0.0;
+
+vec2 coords = { 0.0, 0.0 };
+
+float rand()
+{
+    const vec2 K1 =
+	{
+        23.14069263277926,
+        2.665144142690225
+	};
+
+    return fract(cos(dot((coords + ++rand_salt) * 5.0, K1)) * 12345.6789);
+}
+
+float max3(in vec3 e)
+{
+	return max(max(e.x, e.y), e.z);
+}
+
+float when_eq(in float x, in float y)
+{
+	return 1.0 - abs(sign(x - y));
+}
+
+float when_neq(in float x, in float y)
+{
+	return abs(sign(x - y));
+}
+
+vec3 when_gt(in vec3 x, in vec3 y)
+{
+	return max(sign(x - y), 0.0);
+}
+
+vec3 jitter(in vec3 d, in float phi, in float sina, in float cosa)
+{
+	const vec3 w = normalize(d);
+	const vec3 u = normalize(cross(w.yzx, w));
+	const vec3 v = cross(w, u);
+
+	return (u * cos(phi) + v * sin(phi)) * sina + w * cosa;
+}
+
+float schlick(in float cosine, in float ior)
+{
+	float r0 = (1.0 - ior) / (1.0 + ior);
+
+	r0 = r0 * r0;
+
+	return r0 + (1.0 - r0) * pow(1.0 - cosine, 5.0);
+}
+
+vec3 fresnel_schlick(float cosTheta, vec3 F0)
+{
+    return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
+}
+
+float distribution_ggx(in vec3 N, in vec3 H, in float roughness)
+{
+    const float a      = roughness * roughness;
+    const float a2     = a * a;
+    const float NdotH  = max(dot(N, H), 0.0);
+    const float NdotH2 = NdotH * NdotH;
+
+    const float num   = a2;
+
+	float denom = (NdotH2 * (a2 - 1.0) + 1.0);
+    denom = PI * denom * denom;
+
+    return num / denom;
+}
+
+float geometry_schlick_ggx(in float NdotV, in float roughness)
+{
+    const float r = (roughness + 1.0);
+    const float k = (r*r) / 8.0;
+
+    const float num   = NdotV;
+    const float denom = NdotV * (1.0 - k) + k;
+
+    return num / denom;
+}
+float geometry_smith(in vec3 N, in vec3 V, in vec3 L, in float roughness)
+{
+    const float NdotV = max(dot(N, V), 0.0);
+    const float NdotL = max(dot(N, L), 0.0);
+    const float ggx2  = geometry_schlick_ggx(NdotV, roughness);
+    const float ggx1  = geometry_schlick_ggx(NdotL, roughness);
+
+    return ggx1 * ggx2;
+}
+
+/**
+ * @brief Light reflected towards the camera from an emissive sphere, assuming nothing blocks it
+ *
+ * @param L  Direction from `P` towards a sampled point on the sphere
+ * @param t  Distance from `P` to the sphere's surface
+ */
+vec3 sphere_light(in Material mat, in vec3 P, in vec3 N, in vec3 L, in Sphere s, in float t)
+{
+	vec3 attenuation = s.mat.emissive * 1.0 / pow(t / s.r + 1.0, 2);
+
+	// Clamp light distance
+	attenuation = (attenuation - 0.001) / (1 - 0.001);
+	attenuation = max(attenuation, 0);
+
+	vec3 F0 = vec3(0.04);
+	F0 = mix(F0, mat.albedo, mat.metalness);
+
+	const vec3 V = normalize(camera.pos - P);
+	const vec3 H = normalize(V + L);
+
+	// Cook-Torrance BRDF
+	const float NDF = distribution_ggx(N, H, mat.roughness);
+	const float G   = geometry_smith(N, V, L, mat.roughness);
+	const vec3  F   = fresnel_schlick(max(dot(H, V), 0.0), F0);
+
+	const vec3 kS = F;
+	vec3 kD = vec3(1.0) - kS;
+	kD *= 1.0 - mat.metalness;
+
+	const vec3  numerator   = NDF * G * F;
+	const float denominator = 4.0 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0);
+	const vec3  specular    = numerator / max(denominator, 0.001);
+
+	const float NdotL = max(dot(N, L), 0.0);
+
+	return (kD * mat.albedo / PI + specular) * attenuation * NdotL;
+}
+
+float calc_sphere_intersect(in Ray ray, in Sphere sphere)
+{
+	const vec3  oc = ray.origin - sphere.P;
+	const float b  = 2.0 * dot(oc, ray.dir);
+	const float c  = dot(oc, oc) - sphere.r * sphere.r;
+	const float h  = b * b - 4.0 * c;
+
+	if (h < 0.0)
+	{
+		return -1.0;
+	}
+
+	const float t = (-b - sqrt(h)) / 2.0;
+
+	return t;
+}
+
+float calc_plane_intersect(in Ray ray, in Plane plane)
+{
+	float d = dot(ray.dir, plane.N);
+
+	float dist = -(plane.len + dot(ray.origin, plane.N)) / d;
+
+	return when_neq(d, 0.0) * max(dist, 0.0);
+}
+
+float calc_tri_intersect(in Ray ray, in Triangle tri)
+{
+	const vec3 pvec = cross(ray.dir, tri.e2);
+
+	const float determinant = dot(tri.e1, pvec);
+
+	if (determinant < EPSILON)
+	{
+		return -1.0;
+	}
+
+	const float inverse_determinant = 1 / determinant;
+
+	const vec3  tvec = ray.origin - tri.v0;
+	const float u    = dot(tvec, pvec) * inverse_determinant;
+
+	if (u < 0 || u > 1)
+	{
+		return -1.0;
+	}
+
+	const vec3  qvec = cross(tvec, tri.e1);
+	const float v    = dot(ray.dir, qvec) * inverse_determinant;
+
+	if (v < 0 || u + v > 1)
+	{
+		return -1.0;
+	}
+
+	return dot(tri.e2, qvec) * inverse_determinant;
+}
+
+/**
+ * @brief Slab test against an axis-aligned box
+ *
+ * @return Entry distance along the ray, or a huge value when the box is missed or further than `t_max`
+ */
+float calc_aabb_intersect(in Ray ray, in vec3 inv_dir, in vec3 aabb_min, in vec3 aabb_max, in float t_max)
+{
+	const vec3 t0 = (aabb_min - ray.origin) * inv_dir;
+	const vec3 t1 = (aabb_max - ray.origin) * inv_dir;
+
+	const float t_near = max3(min(t0, t1));
+	const float t_far  = min(min(max(t0.x, t1.x), max(t0.y, t1.y)), max(t0.z, t1.z));
+
+	// An inverted box, the root of an empty mesh, would otherwise pass every slab with t_near = -huge, t_far = +huge
+
+	const bool inverted = any(greaterThan(aabb_min, aabb_max));
+
+	return (t_near <= t_far && t_far > 0.0 && t_near < t_max && !inverted) ? t_near : 1e30;
+}
+
+#ifdef DYNAMIC_BVH
+
+/**
+ * @brief Walks the device-built linear BVH with a fixed-size stack, visiting the nearer child first
+ *
+ * @return Index of the closest triangle hit, or -1
+ */
+int trace_bvh(in Ray ray, inout float t_closest)
+{
+	const vec3 inv_dir = 1.0 / ray.dir;
+
+	int hit_idx = -1;
+
+	if (calc_aabb_intersect(ray, inv_dir, lbvh_nodes[0].aabb_min, lbvh_nodes[0].aabb_max, t_closest + EPSILON) == 1e30)
+	{
+		return hit_idx;
+	}
+
+	uint stack[BVH_STACK_SIZE];
+	uint stack_ptr = 0;
+
+	uint node_idx = 0;
+
+	while (true)
+	{
+		const LBVHNode node = lbvh_nodes[node_idx];
+
+		if (node.right == LBVH_LEAF)
+		{
+			const float t = calc_tri_intersect(ray, tris[node.left]);
+
+			if ((t > EPSILON) && (t < t_closest + EPSILON))
+			{
+				t_closest = t;
+				hit_idx   = int(node.left);
+			}
+
+			if (stack_ptr == 0) break;
+
+			node_idx = stack[--stack_ptr];
+			continue;
+		}
+
+		uint near_idx = node.left;
+		uint far_idx  = node.right;
+
+		float t_near = calc_aabb_intersect(ray, inv_dir, lbvh_nodes[near_idx].aabb_min, lbvh_nodes[near_idx].aabb_max, t_closest + EPSILON);
+		float t_far  = calc_aabb_intersect(ray, inv_dir, lbvh_nodes[far_idx].aabb_min, lbvh_nodes[far_idx].aabb_max, t_closest + EPSILON);
+
+		if (t_far < t_near)
+		{
+			const uint  idx = near_idx; near_idx = far_idx; far_idx = idx;
+			const float t   = t_near;   t_near   = t_far;   t_far   = t;
+		}
+
+		if (t_near == 1e30)
+		{
+			if (stack_ptr == 0) break;
+
+			node_idx = stack[--stack_ptr];
+			continue;
+		}
+
+		node_idx = near_idx;
+
+		if (t_far != 1e30 && stack_ptr < BVH_STACK_SIZE)
+		{
+			stack[stack_ptr++] = far_idx;
+		}
+	}
+
+	return hit_idx;
+}
+
+/**
+ * @brief Closest triangle hit in the flattened, world-space scene
+ *
+ * @return True on a hit, with `N` set to the unit face normal
+ */
+bool trace_triangles(in Ray ray, inout float t_closest, out vec3 N)
+{
+	const int tri_idx = trace_bvh(ray, t_closest);
+
+	if (tri_idx < 0) return false;
+
+	N = normals[tri_idx].xyz;
+
+	return true;
+}
+
+#else
+
+#ifdef WIDE_BVH
+
+/**
+ * @brief Unpacks byte `i` of a node's packed byte array
+ */
+#define BVH8_BYTE(arr, i) ((arr[(i) >> 2] >> (((i) & 3) * 8)) & 0xFF)
+
+/**
+ * @brief Walks one mesh's eight-wide BVH, testing leaf triangles inline and visiting hit children nearest first
+ *
+ * @param ray   Ray in the mesh's object space
+ * @param root  Index of the mesh's root in `nodes`
+ *
+ * @return Index of the closest triangle hit, or -1
+ */
+int trace_blas(in Ray ray, in uint root, inout float t_closest)
+{
+	const vec3 inv_dir = 1.0 / ray.dir;
+
+	int hit_idx = -1;
+
+	uint stack[BVH_STACK_SIZE];
+	uint stack_ptr = 0;
+
+	uint node_idx = root;
+
+	while (true)
+	{
+		const BVH8Node node = nodes[node_idx];
+
+		const vec3 scale = vec3(
+			uintBitsToFloat((node.exponents_imask & 0xFF) << 23),
+			uintBitsToFloat(((node.exponents_imask >> 8) & 0xFF) << 23),
+			uintBitsToFloat(((node.exponents_imask >> 16) & 0xFF) << 23));
+
+		// Interior children hit by the ray, kept sorted nearest first
+
+		uint  child_idx[8];
+		float child_t[8];
+		int   child_count = 0;
+
+		uint tri_offset = 0;
+
+		for (uint i = 0; i < 8; ++i)
+		{
+			const uint meta = BVH8_BYTE(node.meta, i);
+
+			if (meta == 0) continue;
+
+			const vec3 lo = node.origin + vec3(BVH8_BYTE(node.lo_x, i), BVH8_BYTE(node.lo_y, i), BVH8_BYTE(node.lo_z, i)) * scale;
+			const vec3 hi = node.origin + vec3(BVH8_BYTE(node.hi_x, i), BVH8_BYTE(node.hi_y, i), BVH8_BYTE(node.hi_z, i)) * scale;
+
+			const float t_box = calc_aabb_intersect(ray, inv_dir, lo, hi, t_closest + EPSILON);
+
+			if ((meta & 0x80) != 0)
+			{
+				if (t_box == 1e30) continue;
+
+				int j = child_count++;
+
+				for (; j > 0 && child_t[j - 1] > t_box; --j)
+				{
+					child_idx[j] = child_idx[j - 1];
+					child_t[j]   = child_t[j - 1];
+				}
+
+				child_idx[j] = node.child_base + (meta & 0x7F);
+				child_t[j]   = t_box;
+
+				continue;
+			}
+
+			if (t_box != 1e30)
+			{
+				const uint first = node.tri_base + tri_offset;
+
+				for (uint k = first; k < first + meta; ++k)
+				{
+					const float t = calc_tri_intersect(ray, tris[k]);
+
+					if ((t > EPSILON) && (t < t_closest + EPSILON))
+					{
+						t_closest = t;
+						hit_idx   = int(k);
+					}
+				}
+			}
+
+			tri_offset += meta;
+		}
+
+		// Push far to near, so the nearest child is visited next
+
+		for (int j = child_count - 1; j >= 0; --j)
+		{
+			if (stack_ptr < BVH_STACK_SIZE)
+			{
+				stack[stack_ptr++] = child_idx[j];
+			}
+		}
+
+		if (stack_ptr == 0) break;
+
+		node_idx = stack[--stack_ptr];
+	}
+
+	return hit_idx;
+}
+
+#else
+
+/**
+ * @brief Walks one mesh's BVH with a fixed-size stack, visiting the nearer child first
+ *
+ * @param ray   Ray in the mesh's object space
+ * @param root  Index of the mesh's root in `nodes`
+ *
+ * @return Index of the closest triangle hit, or -1
+ */
+int trace_blas(in Ray ray, in uint root, inout float t_closest)
+{
+	const vec3 inv_dir = 1.0 / ray.dir;
+
+	int hit_idx = -1;
+
+	if (calc_aabb_intersect(ray, inv_dir, nodes[root].aabb_min, nodes[root].aabb_max, t_closest + EPSILON) == 1e30)
+	{
+		return hit_idx;
+	}
+
+	uint stack[BVH_STACK_SIZE];
+	uint stack_ptr = 0;
+
+	uint node_idx = root;
+
+	while (true)
+	{
+		const BVHNode node = nodes[node_idx];
+
+		if (node.tri_count > 0)
+		{
+			for (uint i = node.left_first; i < node.left_first + node.tri_count; ++i)
+			{
+				const float t = calc_tri_intersect(ray, tris[i]);
+
+				if ((t > EPSILON) && (t < t_closest + EPSILON))
+				{
+					t_closest = t;
+					hit_idx   = int(i);
+				}
+			}
+
+			if (stack_ptr == 0) break;
+
+			node_idx = stack[--stack_ptr];
+			continue;
+		}
+
+		uint near_idx = node.left_first;
+		uint far_idx  = node.left_first + 1;
+
+		float t_near = calc_aabb_intersect(ray, inv_dir, nodes[near_idx].aabb_min, nodes[near_idx].aabb_max, t_closest + EPSILON);
+		float t_far  = calc_aabb_intersect(ray, inv_dir, nodes[far_idx].aabb_min, nodes[far_idx].aabb_max, t_closest + EPSILON);
+
+		if (t_far < t_near)
+		{
+			const uint  idx = near_idx; near_idx = far_idx; far_idx = idx;
+			const float t   = t_near;   t_near   = t_far;   t_far   = t;
+		}
+
+		if (t_near == 1e30)
+		{
+			if (stack_ptr == 0) break;
+
+			node_idx = stack[--stack_ptr];
+			continue;
+		}
+
+		node_idx = near_idx;
+
+		if (t_far != 1e30 && stack_ptr < BVH_STACK_SIZE)
+		{
+			stack[stack_ptr++] = far_idx;
+		}
+	}
+
+	return hit_idx;
+}
+
+#endif // WIDE_BVH
+
+/**
+ * @brief Walks the instance BVH, tracing each instance's mesh with the ray moved into its object space
+ *
+ * @note Transforms are affine and directions are not renormalized, so distances stay in world units
+ *
+ * @return Index of the closest instance hit, or -1.  `tri_idx` receives the triangle within it
+ */
+int trace_tlas(in Ray ray, inout float t_closest, out int tri_idx)
+{
+	const vec3 inv_dir = 1.0 / ray.dir;
+
+	int hit_idx = -1;
+
+	tri_idx = -1;
+
+	if (calc_aabb_intersect(ray, inv_dir, tlas_nodes[0].aabb_min, tlas_nodes[0].aabb_max, t_closest + EPSILON) == 1e30)
+	{
+		return hit_idx;
+	}
+
+	uint stack[BVH_STACK_SIZE];
+	uint stack_ptr = 0;
+
+	uint node_idx = 0;
+
+	while (true)
+	{
+		const BVHNode node = tlas_nodes[node_idx];
+
+		if (node.tri_count > 0)
+		{
+			for (uint i = node.left_first; i < node.left_first + node.tri_count; ++i)
+			{
+				const InstanceData instance = instances[i];
+
+				const Ray local_ray =
+				{
+					vec3(dot(instance.world_to_object[0], vec4(ray.origin, 1.0)), dot(instance.world_to_object[1], vec4(ray.origin, 1.0)), dot(instance.world_to_object[2], vec4(ray.origin, 1.0))),
+					vec3(dot(instance.world_to_object[0].xyz, ray.dir), dot(instance.world_to_object[1].xyz, ray.dir), dot(instance.world_to_object[2].xyz, ray.dir))
+				};
+
+				const int local_hit = trace_blas(local_ray, instance.blas_root, t_closest);
+
+				if (local_hit >= 0)
+				{
+					hit_idx = int(i);
+					tri_idx = local_hit;
+				}
+			}
+
+			if (stack_ptr == 0) break;
+
+			node_idx = stack[--stack_ptr];
+			continue;
+		}
+
+		uint near_idx = node.left_first;
+		uint far_idx  = node.left_first + 1;
+
+		float t_near = calc_aabb_intersect(ray, inv_dir, tlas_nodes[near_idx].aabb_min, tlas_nodes[near_idx].aabb_max, t_closest + EPSILON);
+		float t_far  = calc_aabb_intersect(ray, inv_dir, tlas_nodes[far_idx].aabb_min, tlas_nodes[far_idx].aabb_max, t_closest + EPSILON);
+
+		if (t_far < t_near)
+		{
+			const uint  idx = near_idx; near_idx = far_idx; far_idx = idx;
+			const float t   = t_near;   t_near   = t_far;   t_far   = t;
+		}
+
+		if (t_near == 1e30)
+		{
+			if (stack_ptr == 0) break;
+
+			node_idx = stack[--stack_ptr];
+			continue;
+		}
+
+		node_idx = near_idx;
+
+		if (t_far != 1e30 && stack_ptr < BVH_STACK_SIZE)
+		{
+			stack[stack_ptr++] = far_idx;
+		}
+	}
+
+	return hit_idx;
+}
+
+/**
+ * @brief Closest triangle hit across every instance
+ *
+ * @return True on a hit, with `N` set to the unit world-space face normal
+ */
+bool trace_triangles(in Ray ray, inout float t_closest, out vec3 N)
+{
+	int tri_idx;
+
+	const int instance_idx = trace_tlas(ray, t_closest, tri_idx);
+
+	if (instance_idx < 0) return false;
+
+	// Normals transform by the inverse transpose, whose columns are the world-to-object rows
+
+	const InstanceData instance = instances[instance_idx];
+
+	N = normalize(mat3(instance.world_to_object[0].xyz, instance.world_to_object[1].xyz, instance.world_to_object[2].xyz) * normals[tri_idx].xyz);
+
+	return true;
+}
+
+#endif
+
+bool trace_ray(in Ray ray, inout Intersection intersect)
+{
+	bool found = false;
+
+	vec3 tri_normal;
+
+	if (trace_triangles(ray, intersect.t, tri_normal))
+	{
+		intersect.mat    = mirror;
+		intersect.P      = ray.origin + intersect.t * ray.dir;
+		intersect.N      = tri_normal;
+		intersect.object = OBJECT_TRIANGLES;
+
+		found = true;
+	}
+
+	for (uint i = 0; i < SPHERE_COUNT; ++i)
+	{
+		const float t = calc_sphere_intersect(ray, spheres[i]);
+
+		if ((t > EPSILON) && (t < intersect.t + EPSILON))
+		{
+			intersect.mat = spheres[i].mat;
+
+			intersect.t = t;
+			intersect.P = ray.origin + t * ray.dir;
+			intersect.N = (intersect.P - spheres[i].P) / spheres[i].r;
+
+			intersect.object = i;
+
+			found = true;
+		}
+	}
+
+	for (uint i = 0; i < PLANE_COUNT; ++i)
+	{
+		const float t = calc_plane_intersect(ray, planes[i]);
+
+		if ((t > EPSILON) && (t < intersect.t - EPSILON))
+		{
+			intersect.mat = planes[i].mat;
+
+			intersect.t = t;
+			intersect.P = ray.origin + t * ray.dir;
+			intersect.N = planes[i].N;
+
+			intersect.object = SPHERE_COUNT + i;
+
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+/**
+ * @brief Unnormalized direction of the camera ray through `uv`, which spans [0, 1) over the render target
+ */
+vec3 camera_dir(in vec2 uv)
+{
+	const vec2 trans = 2.0 * uv - vec2(1.0, 1.0);
+
+	return (camera.dir + camera.right * trans.x + camera.up * trans.y) * vec2(aspect_ratio, 1.0).xyx;
+}
+
+/**
+ * @brief Stores this frame's mean radiance, and the distance along the camera ray to the primary hit, for
+ *        Temporal.comp to resolve
+ */
+void store_pixel(in ivec2 pixel, in vec3 color, in float primary_t)
+{
+	const vec3 position = camera.pos + normalize(camera_dir(vec2(pixel) / imageSize(render_target))) * primary_t;
+
+	imageStore(radiance_target, pixel, vec4(color, 1.0));
+	imageStore(position_target, pixel, vec4(position, 1.0));
+}
+
+/**
+ * @brief Stores the normal, depth and albedo of a pixel's primary hit, which guide the denoiser
+ */
+void store_features(in ivec2 pixel, in Intersection intersect, in bool hit)
+{
+	// Misses face back along the camera ray from as far as it looked, and have nothing to divide out
+
+	const vec3 N      = hit ? intersect.N : -camera.dir;
+	const vec3 albedo = hit ? intersect.mat.albedo : vec3(1.0);
+
+	imageStore(normal_target, pixel, vec4(N, intersect.t));
+	imageStore(albedo_target, pixel, vec4(albedo, 1.0));
+}
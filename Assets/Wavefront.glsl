@@ -0,0 +1,271 @@
+/**
+ * @file   Wavefront.glsl
+ * @brief  Path state and work queues shared by the wavefront kernels
+ *
+ * Each bounce runs as three dispatches:
+ *   - WavefrontExtend  finds the closest hit of every queued ray
+ *   - WavefrontShade   evaluates materials, picks the next ray, and queues one shadow ray towards a light
+ *   - WavefrontConnect traces the shadow rays and adds the light they carry
+ * WavefrontGenerate starts one path per pixel for every sample, and WavefrontResolve writes the averaged result
+ *
+ * Queues are sized from atomic counters, which double as the arguments of the indirect dispatch that drains them.
+ * With ray sorting on, WavefrontSortKeys and a radix sort reorder the extension queue by `ray_sort_key` and the
+ * shading queue by material before they are drained
+ *
+ * Include after Tracer.glsl, with WAVEFRONT defined
+ */
+
+
+
+/////
+// Structures
+/////
+
+
+
+/**
+ * @struct PathState
+ *
+ * @brief One path per pixel, indexed by `y * width + x`
+ */
+struct PathState
+{
+	/// @brief Origin of the next ray, which is also the origin of the pending shadow ray
+	vec3 origin;
+
+	/// @brief RNG salt, carried between dispatches so the sequence matches a single invocation's
+	float salt;
+
+	vec3 dir;
+
+	/// @brief Distance to the closest hit found by the last extension
+	float t;
+
+	/// @brief Throughput of the path so far
+	vec3 mask;
+
+	/// @brief Primitive hit by the last extension
+	/// @see Intersection::object
+	uint object;
+
+	/// @brief Radiance gathered by the current sample
+	vec3 acc;
+
+	/// @brief Distance to the first hit, or how far the camera ray looked if it missed
+	float primary_t;
+
+	/// @brief Surface normal at the last hit
+	vec3 N;
+
+	/// @brief Distance to the light along `shadow_dir`
+	float shadow_t;
+
+	vec3 shadow_dir;
+
+	uint padding1;
+
+	/// @brief Radiance added to `acc` if the shadow ray reaches the light
+	vec3 shadow_radiance;
+
+	uint padding2;
+
+	/// @brief Radiance of the finished samples
+	vec3 sum;
+
+	uint padding3;
+};
+
+/**
+ * @struct Queue
+ *
+ * @brief Counter of a work queue.  The first three members are a VkDispatchIndirectCommand
+ */
+struct Queue
+{
+	/// @brief Workgroups needed to drain the queue, bumped by whichever push lands on a group boundary
+	uint group_count_x;
+	uint group_count_y;
+	uint group_count_z;
+
+	/// @brief Paths in the queue
+	uint count;
+};
+
+const uint QUEUE_EXTEND  = 0; // Rays waiting for their closest hit
+const uint QUEUE_SHADE   = 1; // Hits waiting for their material
+const uint QUEUE_CONNECT = 2; // Shadow rays waiting for a visibility test
+
+const uint WAVEFRONT_GROUP_SIZE = 64;
+
+/// @brief Keys the radix sort handles per workgroup, `BLOCK_SIZE` in RadixSort.glsl
+const uint SORT_BLOCK_SIZE = 256;
+
+/// @brief Half the size of the camera-centred cube ray origins are quantized in for sorting
+const float RAY_SORT_EXTENT = 256.0;
+
+
+
+/////
+// Shader Communication
+/////
+
+
+
+layout (std430, set = 1, binding = 0) buffer Paths
+{
+	PathState paths[];
+};
+
+layout (std430, set = 1, binding = 1) buffer Queues
+{
+	Queue queues[3];
+};
+
+/// @brief Path indices of every queue, one `path_count()` sized region per queue
+layout (std430, set = 1, binding = 2) buffer QueueItems
+{
+	uint queue_items[];
+};
+
+/// @brief Keys and values handed to the radix sort, `path_count()` long of which the first `sort_count` are sorted
+layout (std430, set = 1, binding = 3) buffer SortKeys
+{
+	uint sort_keys[];
+};
+
+layout (std430, set = 1, binding = 4) buffer SortValues
+{
+	uint sort_values[];
+};
+
+/// @brief Rays traced by the current frame, copied out for the host at its end
+layout (std430, set = 1, binding = 5) buffer Statistics
+{
+	uint traced_rays_lo;
+	uint traced_rays_hi;
+};
+
+/// @brief Length of the queue being sorted, and the radix sort's indirect dispatch over it
+layout (std430, set = 1, binding = 6) buffer SortCount
+{
+	uint sort_group_count_x;
+	uint sort_group_count_y;
+	uint sort_group_count_z;
+
+	uint sort_count;
+};
+
+
+
+/////
+// Functions
+/////
+
+
+
+uint path_count()
+{
+	const ivec2 size = imageSize(render_target);
+
+	return uint(size.x * size.y);
+}
+
+/**
+ * @brief Pixel a path was generated for
+ */
+ivec2 path_pixel(in uint path)
+{
+	const ivec2 size = imageSize(render_target);
+
+	return ivec2(path % uint(size.x), path / uint(size.x));
+}
+
+/**
+ * @brief Pixel coordinates of a path, normalized as in the megakernel so the RNG sees the same `coords`
+ */
+vec2 path_uv(in uint path)
+{
+	return vec2(path_pixel(path)) / imageSize(render_target);
+}
+
+void enqueue(in uint queue, in uint path)
+{
+	const uint slot = atomicAdd(queues[queue].count, 1);
+
+	if (slot % WAVEFRONT_GROUP_SIZE == 0)
+	{
+		atomicAdd(queues[queue].group_count_x, 1);
+	}
+
+	queue_items[queue * path_count() + slot] = path;
+}
+
+/**
+ * @brief Path processed by this invocation of a queue-draining kernel
+ *
+ * @return False when the invocation lies past the end of the queue
+ */
+bool dequeue(in uint queue, out uint path)
+{
+	const uint slot = gl_GlobalInvocationID.x;
+
+	if (slot >= queues[queue].count) return false;
+
+	path = queue_items[queue * path_count() + slot];
+
+	return true;
+}
+
+/**
+ * @brief Adds the size of the queue being drained to the ray total, once per dispatch
+ */
+void count_traced_rays(in uint queue)
+{
+	if (gl_GlobalInvocationID.x != 0) return;
+
+	const uint n   = queues[queue].count;
+	const uint old = atomicAdd(traced_rays_lo, n);
+
+	if (old + n < old)
+	{
+		atomicAdd(traced_rays_hi, 1);
+	}
+}
+
+/// @brief Spreads the low 10 bits of `v` out so there are two zero bits between each
+uint expand_bits(uint v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+
+	return v;
+}
+
+/**
+ * @brief Groups rays by direction octant, then along a Morton curve through their origins
+ *
+ * @see ray_sort_key in BVH.h, which benchmarks the same ordering on the host
+ */
+uint ray_sort_key(in vec3 origin, in vec3 dir)
+{
+	const uint octant = (dir.x < 0.0 ? 4 : 0) | (dir.y < 0.0 ? 2 : 0) | (dir.z < 0.0 ? 1 : 0);
+
+	const vec3 p = clamp((origin - camera.pos) / (2.0 * RAY_SORT_EXTENT) + 0.5, 0.0, 1.0);
+	const uvec3 q = uvec3(min(p * 1024.0, 1023.0));
+
+	const uint code = expand_bits(q.x) * 4 + expand_bits(q.y) * 2 + expand_bits(q.z);
+
+	// Nine bits per axis leave room for the octant above them
+
+	return (octant << 27) | (code >> 3);
+}
+
+Material object_material(in uint object)
+{
+	if (object < SPHERE_COUNT)     return spheres[object].mat;
+	if (object < OBJECT_TRIANGLES) return planes[object - SPHERE_COUNT].mat;
+
+	return mirror;
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <Geometry.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/**
+ * @brief Flattened BVH node, laid out to match the std430 `BVHNode` struct in Tracer.comp
+ *
+ * @note Interior nodes have `tri_count == 0`, and their children live at `left_first` and `left_first + 1`
+ * @note Leaf nodes reference `tri_count` triangles starting at `left_first`, in BVH order
+ */
+struct BVHNode
+{
+	glm::vec3 aabb_min;
+	uint32_t  left_first;
+
+	glm::vec3 aabb_max;
+	uint32_t  tri_count;
+};
+
+static_assert(sizeof(BVHNode) == 32, "BVHNode must match the GPU layout");
+
+/**
+ * @brief Bounding volume hierarchy over a triangle array
+ *
+ * @note Node 0 is the root.  Children are always stored after their parent
+ */
+struct BVH
+{
+	std::vector<BVHNode> nodes;
+
+	/// @brief Maps BVH order to indices in the source triangle array
+	std::vector<uint32_t> tri_indices;
+
+	/// @brief SAH cost right after the last full build.  Refitted trees are measured against this
+	float build_cost = 0.0f;
+};
+
+/**
+ * @brief Eight-wide node with child boxes quantized to 8 bits against the node's own frame, laid out to match the
+ *        std430 `BVH8Node` struct in Tracer.comp
+ *
+ * Child `i` spans `origin + lo[i] * 2^(exponent - 127)` to `origin + hi[i] * 2^(exponent - 127)` per axis.
+ * `meta[i]` is zero for an empty slot, `0x80 | k` for the interior node at `child_base + k`, and otherwise
+ * the triangle count of a leaf.  Leaf triangles are stored back to back from `tri_base`, in slot order
+ */
+struct BVH8Node
+{
+	glm::vec3 origin;
+	uint8_t   exponent[3];
+	uint8_t   interior_mask;
+
+	uint32_t child_base;
+	uint32_t tri_base;
+
+	uint8_t meta[8];
+
+	uint8_t lo_x[8];
+	uint8_t lo_y[8];
+	uint8_t lo_z[8];
+	uint8_t hi_x[8];
+	uint8_t hi_y[8];
+	uint8_t hi_z[8];
+};
+
+static_assert(sizeof(BVH8Node) == 80, "BVH8Node must match the GPU layout");
+
+/**
+ * @brief Compressed wide hierarchy collapsed from a binary BVH.  Node 0 is the root
+ */
+struct BVH8
+{
+	std::vector<BVH8Node> nodes;
+
+	/// @brief Maps BVH8 order to indices in the source triangle array
+	std::vector<uint32_t> tri_indices;
+};
+
+/**
+ * @brief Wide node with full-precision child boxes stored as structure of arrays, so the CPU can test one ray against
+ *        every child in a single SIMD operation
+ *
+ * `count[i]` is zero for the interior node at `child[i]`, and otherwise a leaf of that many triangles starting at
+ * `child[i]`, in the binary BVH's order.  Empty slots have every bound at +infinity, which no ray ever enters
+ */
+template <size_t N>
+struct alignas(4 * N) WideBVHNode
+{
+	float lo_x[N];
+	float lo_y[N];
+	float lo_z[N];
+	float hi_x[N];
+	float hi_y[N];
+	float hi_z[N];
+
+	uint32_t child[N];
+	uint32_t count[N];
+};
+
+/**
+ * @brief Four- or eight-wide hierarchy collapsed from a binary BVH for CPU traversal.  Node 0 is the root
+ *
+ * @note Triangles keep the binary BVH's order, so `reorder_triangles` on the source BVH gives the array to trace
+ */
+template <size_t N>
+struct WideBVH
+{
+	std::vector<WideBVHNode<N>> nodes;
+};
+
+/**
+ * @brief Counters accumulated by the host traversals, for comparing hierarchy layouts
+ */
+struct TraversalStats
+{
+	uint64_t rays      = 0;
+	uint64_t nodes     = 0; //< Nodes popped and processed
+	uint64_t triangles = 0; //< Triangle tests
+	uint64_t bytes     = 0; //< Node and triangle bytes loaded, counted the way Tracer.comp loads them
+};
+
+/**
+ * @brief Closest hit found by a host traversal
+ */
+struct Hit
+{
+	float t = std::numeric_limits<float>::max();
+
+	/// @brief Index into the BVH-ordered triangle array, or `UINT32_MAX` on a miss
+	uint32_t tri = UINT32_MAX;
+};
+
+/**
+ * @brief Tunables for the BVH builders
+ */
+struct BVHBuildInfo
+{
+	enum class Method
+	{
+		SAH,  //< Binned surface area heuristic.  Best trees, slowest to build
+		LBVH, //< Linear BVH over sorted Morton codes.  Fast to build, noticeably worse trees
+		AUTO  //< SAH below `lbvh_threshold` triangles, LBVH above it
+	};
+
+	Method method = Method::AUTO;
+
+	/// @brief Triangle count at which `Method::AUTO` switches over to the LBVH builder
+	size_t lbvh_threshold = 4'000'000;
+
+	/// @brief Worker threads used during construction.  Zero uses every hardware thread
+	unsigned int thread_count = 0;
+
+	/// @brief Number of centroid bins evaluated per axis
+	unsigned int bin_count = 16;
+
+	/// @brief Leaves never hold more triangles than this, even when the SAH would prefer it
+	unsigned int max_leaf_size = 8;
+
+	/// @brief Relative cost of traversing a node versus intersecting a triangle
+	float traversal_cost = 1.0f;
+
+	/// @brief `update_bvh` rebuilds once refitting has grown the SAH cost past this multiple of `BVH::build_cost`
+	float rebuild_threshold = 1.5f;
+};
+
+/**
+ * @brief Builds a BVH over `tri_count` triangles in parallel
+ *
+ * The top of the tree is split on the calling thread with parallel binning, then the remaining subtrees are
+ * built as independent tasks across `info.thread_count` threads and spliced back into one node array
+ *
+ * @param tris       Triangles to partition
+ * @param tri_count  Number of triangles
+ * @param info       Builder tunables
+ *
+ * @return BVH  Flattened hierarchy.  An empty input produces a single root with an inverted box, which
+ *             every box test rejects, so it is never descended into
+ */
+BVH build_bvh(const Triangle * tris, size_t tri_count, const BVHBuildInfo & info = {});
+
+/**
+ * @brief Builds a BVH over boxes rather than triangles, e.g. instance bounds for a top-level hierarchy
+ *
+ * @return BVH  Flattened hierarchy whose leaves index `boxes` through `tri_indices`
+ */
+BVH build_bvh(const AABB * boxes, size_t box_count, const BVHBuildInfo & info = {});
+
+/**
+ * @brief Recomputes node bounds bottom-up for moved vertices, keeping the topology
+ *
+ * @param bvh   Hierarchy previously built over the same triangle count
+ * @param tris  Triangles in their original order, at their new positions
+ * @param info  Builder tunables.  Only `thread_count` is used
+ */
+void refit_bvh(BVH & bvh, const Triangle * tris, const BVHBuildInfo & info = {});
+
+/**
+ * @brief Brings a hierarchy up to date with moved or replaced triangles
+ *
+ * Refits when the triangle count is unchanged, and rebuilds from scratch when it is not, or when the refitted
+ * tree's SAH cost exceeds `info.rebuild_threshold` times its cost at build time
+ *
+ * @return bool  True when the hierarchy was rebuilt, so node count and triangle order may have changed
+ */
+bool update_bvh(BVH & bvh, const Triangle * tris, size_t tri_count, const BVHBuildInfo & info = {});
+
+/**
+ * @brief Collapses a binary BVH into eight-wide nodes, repeatedly opening the largest interior child
+ *
+ * @note Leaves must hold fewer than 128 triangles, which `BVHBuildInfo::max_leaf_size` normally guarantees
+ */
+BVH8 collapse_bvh8(const BVH & bvh);
+
+/**
+ * @brief Collapses a binary BVH into `N`-wide nodes the same way as `collapse_bvh8`, keeping full-precision boxes.
+ *        Instantiated for 4 and 8
+ */
+template <size_t N>
+WideBVH<N> collapse_wide_bvh(const BVH & bvh);
+
+/**
+ * @brief Reorders triangles into BVH order, so leaf ranges index the returned array directly
+ *
+ * @note Pass the result through `precompute_triangle` before tracing it
+ */
+std::vector<Triangle> reorder_triangles(const BVH & bvh, const Triangle * tris);
+
+std::vector<Triangle> reorder_triangles(const BVH8 & bvh, const Triangle * tris);
+
+/**
+ * @brief Closest hit along `ray`, walking the hierarchy exactly as `trace_blas` in Tracer.comp does
+ *
+ * @param tris   Triangles in BVH order, in their intersection layout
+ * @param stats  Optional counters to accumulate into
+ */
+Hit trace_bvh(const BVH & bvh, const PrecomputedTriangle * tris, const Ray & ray, float t_max, TraversalStats * stats = nullptr);
+
+Hit trace_bvh(const BVH8 & bvh, const PrecomputedTriangle * tris, const Ray & ray, float t_max, TraversalStats * stats = nullptr);
+
+/**
+ * @brief Closest hit along `ray`, testing children one at a time.  The SIMD kernels in SIMDTraversal.h test them all
+ *        at once, and fall back to this
+ */
+template <size_t N>
+Hit trace_bvh(const WideBVH<N> & bvh, const PrecomputedTriangle * tris, const Ray & ray, float t_max, TraversalStats * stats = nullptr);
+
+/**
+ * @brief Groups rays by direction octant, then along a Morton curve through their origins, so sorting by it gives
+ *        neighbouring rays similar paths through the hierarchy.  Mirrors `ray_sort_key` in Wavefront.glsl
+ *
+ * @param bounds_min     Low corner of the box origins are quantized in.  Origins outside it are clamped
+ * @param bounds_extent  Size of that box
+ */
+uint32_t ray_sort_key(const Ray & ray, const glm::vec3 & bounds_min, const glm::vec3 & bounds_extent);
+
+/**
+ * @brief Expected cost of tracing a ray through the hierarchy, normalized by the root surface area
+ */
+float sah_cost(const BVH & bvh, const BVHBuildInfo & info = {});
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <BVH.h>
+#include <GraphicsDevice.h>
+#include <Scene.h>
+#include <SIMDTraversal.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Instance as the CPU tracer sees it.  Mirrors `InstanceData` in Tracer.comp, with the mesh index in place of
+ *        a node offset since every mesh keeps its own hierarchy
+ */
+struct CPUInstance
+{
+	/// @brief Rows of the world-to-object 3x4 matrix
+	glm::vec4 world_to_object[3];
+
+	uint32_t mesh;
+};
+
+/**
+ * @brief Triangle scene laid out for the CPU tracer: one BVH per mesh under a BVH over instance bounds, exactly as
+ *        GraphicsDevice uploads it when neither the dynamic nor the wide hierarchy is in use
+ */
+struct CPUScene
+{
+	std::vector<BVH> blas;
+
+	/// @brief `blas` collapsed for bounce rays, whose paths through a hierarchy share too little to trace as packets.
+	///        Eight-wide nodes need AVX2, so both widths are kept
+	std::vector<WideBVH<4>> wide4;
+	std::vector<WideBVH<8>> wide8;
+
+	/// @brief Each mesh's triangles in BVH order, in their intersection layout
+	std::vector<std::vector<PrecomputedTriangle>> tris;
+
+	/// @brief Unit face normal of each triangle in `tris`, at the same index
+	std::vector<std::vector<glm::vec3>> normals;
+
+	BVH tlas;
+
+	/// @brief Instances in top-level leaf order
+	std::vector<CPUInstance> instances;
+};
+
+/**
+ * @brief Tunables for `trace_cpu`
+ */
+struct CPUTraceInfo
+{
+	unsigned int width  = 1024;
+	unsigned int height = 1024;
+
+	/// @brief Worker threads.  Zero uses every hardware thread
+	unsigned int thread_count = 0;
+
+	/// @brief Side of the square tiles the image is split into and scheduled by
+	unsigned int tile_size = 16;
+
+	/// @brief Kernels for packets of primary and shadow rays and for wide nodes.  `SIMDLevel::SCALAR` traces every ray
+	///        on its own, testing one box at a time
+	SIMDLevel simd_level = detect_simd_level();
+};
+
+/**
+ * @brief Counters accumulated by `trace_cpu`
+ */
+struct CPUTraceStats
+{
+	/// @brief Rays traced, counting both bounces and shadow rays
+	uint64_t rays = 0;
+
+	/// @brief Tiles a worker took from another worker's queue after running out of its own
+	uint64_t stolen_tiles = 0;
+
+	double seconds = 0.0;
+
+	/// @brief Time spent walking the hierarchies, summed over workers
+	double trace_seconds = 0.0;
+};
+
+/**
+ * @brief Builds per-mesh hierarchies and the instance hierarchy over them
+ *
+ * @note Mesh triangles are copied, so the arrays passed in need not outlive the scene
+ */
+CPUScene build_cpu_scene(const Mesh * meshes, size_t mesh_count, const Instance * instances, size_t instance_count);
+
+/**
+ * @brief Renders one frame on the CPU, reproducing Tracer.comp: camera rays from `frame_data`, the analytic spheres
+ *        and planes, the GGX `radiance` loop, and the Reinhard tonemapping with gamma the fullscreen pass applies
+ *
+ * The image is cut into tiles, dealt out evenly to per-thread queues.  A worker whose queue runs dry steals from the
+ * back of the others, so threads that drew cheap tiles help finish expensive ones.  Each pixel seeds its own RNG as
+ * the compute shader does, so the output does not depend on how tiles were scheduled
+ *
+ * A tile's pixels bounce in lockstep, so each bounce's rays are traced as one batch: primary and shadow rays in
+ * packets at `info.simd_level`, bounces one at a time through the wide hierarchies.  Up to ties between equally close hits, every level renders
+ * the same image
+ *
+ * @param stats  Optional counters to fill in
+ *
+ * @return RGBA8 pixels, row `y` of the compute shader's image first, tonemapped as they would be displayed
+ */
+std::vector<uint8_t> trace_cpu(const CPUScene & scene, const FrameData & frame_data, const CPUTraceInfo & info = {}, CPUTraceStats * stats = nullptr);
+
+/**
+ * @brief Writes RGBA8 pixels as a binary PPM, flipped vertically to match what the fullscreen pass displays
+ *
+ * @return False if the file could not be written
+ */
+bool write_ppm(const char * path, const uint8_t * rgba, unsigned int width, unsigned int height);
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <GraphicsDevice.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Encodes captured frames to disk on a background thread, so whoever hands them over never waits on encoding
+ *        or I/O
+ *
+ * The format follows each file's extension.  `.exr` keeps the linear half floats as captured, `.png` is tonemapped as
+ * the fullscreen pass does, and anything else gets the half floats raw.  Images are flipped on the way out to match
+ * what the fullscreen pass displays
+ */
+struct FrameWriter final
+{
+	/**
+	 * @param pattern     File name with one printf-style integer conversion for the frame index, e.g. "frame_%04llu.png".
+	 *                    Only a zero flag, a width and integer length modifiers are accepted, and `%%` is a literal '%'
+	 * @param max_queued  Frames allowed to wait for the encoder.  Beyond it frames are dropped rather than waited on
+	 *
+	 * @return False, without starting, if the pattern does not hold exactly one such conversion
+	 */
+	bool Start(const std::string & pattern, size_t max_queued = 64);
+
+	/**
+	 * @brief Encodes everything still queued, then joins the encoder thread
+	 */
+	void Stop();
+
+	/**
+	 * @brief Queues a frame for encoding.  Takes a lock for as long as a push_back, never longer
+	 *
+	 * @return False if the queue was full and the frame was dropped
+	 */
+	bool Push(CapturedFrame && frame);
+
+	/**
+	 * @brief Frames written so far, and frames dropped because the encoder fell behind
+	 */
+	uint64_t Written() const;
+	uint64_t Dropped() const;
+
+private:
+
+	void Run();
+
+	std::string pattern;
+
+	/// @brief The pattern split around its conversion, which the writer fills in itself rather than handing the
+	///        pattern to printf
+	std::string prefix;
+	std::string suffix;
+
+	size_t index_width;
+
+	bool zero_pad;
+
+	size_t max_queued;
+
+	std::thread thread;
+
+	mutable std::mutex mutex;
+
+	std::condition_variable wake;
+
+	std::deque<CapturedFrame> queue;
+
+	uint64_t written = 0;
+	uint64_t dropped = 0;
+
+	bool stopping = false;
+};
+
+/**
+ * @brief Encodes RGBA8 pixels, top row first, as a PNG.  Stored deflate blocks keep it free of a zlib dependency
+ *
+ * @return False if the file could not be written
+ */
+bool write_png(const char * path, const uint8_t * rgba, unsigned int width, unsigned int height);
+
+/**
+ * @brief Encodes RGBA half-float pixels, top row first, as an uncompressed scanline OpenEXR
+ *
+ * @return False if the file could not be written
+ */
+bool write_exr(const char * path, const uint16_t * rgba, unsigned int width, unsigned int height);
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <limits>
+
+struct Triangle
+{
+	alignas(16) glm::vec3 v0;
+	alignas(16) glm::vec3 v1;
+	alignas(16) glm::vec3 v2;
+};
+
+/**
+ * @brief Triangle as the tracers store it: one vertex and the two edges leaving it, so the intersection test skips
+ *        both subtractions.  Matches `Triangle` in Tracer.comp
+ *
+ * @note Shading normals live in a buffer of their own, only read for the closest hit
+ */
+struct PrecomputedTriangle
+{
+	alignas(16) glm::vec3 v0;
+	alignas(16) glm::vec3 e1;
+	alignas(16) glm::vec3 e2;
+};
+
+inline PrecomputedTriangle precompute_triangle(const Triangle & tri)
+{
+	return { tri.v0, tri.v1 - tri.v0, tri.v2 - tri.v0 };
+}
+
+/**
+ * @brief Unit normal on the side `intersect_triangle` treats as the front.  Degenerate triangles get a zero normal,
+ *        since they can never be hit
+ */
+inline glm::vec3 face_normal(const Triangle & tri)
+{
+	const glm::vec3 n = glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0);
+
+	const float length = glm::length(n);
+
+	return length > 0.0f ? n / length : glm::vec3(0.0f);
+}
+
+/**
+ * @brief Axis-aligned bounding box.  Default constructed boxes are empty, and grow to fit whatever is added to them
+ */
+struct AABB
+{
+	glm::vec3 min{ std::numeric_limits<float>::max() };
+	glm::vec3 max{ -std::numeric_limits<float>::max() };
+
+	void grow(const glm::vec3 & p)
+	{
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	void grow(const AABB & other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	void grow(const Triangle & tri)
+	{
+		grow(tri.v0);
+		grow(tri.v1);
+		grow(tri.v2);
+	}
+
+	bool empty() const
+	{
+		return min.x > max.x;
+	}
+
+	/// @brief Surface area of the box, used by the surface area heuristic.  Empty boxes have zero area
+	float area() const
+	{
+		if (empty()) return 0.0f;
+
+		const glm::vec3 e = max - min;
+
+		return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+};
+
+inline glm::vec3 centroid(const Triangle & tri)
+{
+	return (tri.v0 + tri.v1 + tri.v2) * (1.0f / 3.0f);
+}
+
+/// @brief Matches `EPSILON` in Tracer.comp, so host traversal accepts and rejects the same hits
+constexpr float RAY_EPSILON = 1e-3f;
+
+struct Ray
+{
+	glm::vec3 origin;
+	glm::vec3 dir;
+};
+
+/**
+ * @brief Moller-Trumbore intersection with back faces culled, mirroring `calc_tri_intersect` in Tracer.comp
+ *
+ * @return Distance along the ray, or -1 on a miss
+ */
+inline float intersect_triangle(const Ray & ray, const PrecomputedTriangle & tri)
+{
+	const glm::vec3 pvec = glm::cross(ray.dir, tri.e2);
+
+	const float determinant = glm::dot(tri.e1, pvec);
+
+	if (determinant < RAY_EPSILON) return -1.0f;
+
+	const float inverse_determinant = 1.0f / determinant;
+
+	const glm::vec3 tvec = ray.origin - tri.v0;
+	const float     u    = glm::dot(tvec, pvec) * inverse_determinant;
+
+	if (u < 0.0f || u > 1.0f) return -1.0f;
+
+	const glm::vec3 qvec = glm::cross(tvec, tri.e1);
+	const float     v    = glm::dot(ray.dir, qvec) * inverse_determinant;
+
+	if (v < 0.0f || u + v > 1.0f) return -1.0f;
+
+	return glm::dot(tri.e2, qvec) * inverse_determinant;
+}
+
+/**
+ * @brief Slab test, mirroring `calc_aabb_intersect` in Tracer.comp
+ *
+ * @return Entry distance along the ray, or infinity when the box is missed or further than `t_max`
+ */
+inline float intersect_aabb(const Ray & ray, const glm::vec3 & inv_dir, const glm::vec3 & aabb_min, const glm::vec3 & aabb_max, float t_max)
+{
+	const glm::vec3 t0 = (aabb_min - ray.origin) * inv_dir;
+	const glm::vec3 t1 = (aabb_max - ray.origin) * inv_dir;
+
+	const glm::vec3 near = glm::min(t0, t1);
+	const glm::vec3 far  = glm::max(t0, t1);
+
+	const float t_near = glm::max(glm::max(near.x, near.y), near.z);
+	const float t_far  = glm::min(glm::min(far.x, far.y), far.z);
+
+	// An inverted box, the root of an empty hierarchy, would otherwise pass every slab
+
+	const bool inverted = glm::any(glm::greaterThan(aabb_min, aabb_max));
+
+	return (t_near <= t_far && t_far > 0.0f && t_near < t_max && !inverted) ? t_near : std::numeric_limits<float>::infinity();
+}
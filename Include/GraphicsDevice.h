@@ -5,17 +5,14 @@
 #pragma once
 
 #include <Camera.h>
+#include <Scene.h>
 
 #include <glm/glm.hpp>
 
-struct GLFWwindow;
+#include <cstdint>
+#include <vector>
 
-struct Triangle
-{
-	alignas(16) glm::vec3 v0;
-	alignas(16) glm::vec3 v1;
-	alignas(16) glm::vec3 v2;
-};
+struct GLFWwindow;
 
 struct FrameData
 {
@@ -28,6 +25,38 @@ struct FrameData
 	alignas(16) CameraData camera;
 };
 
+/**
+ * @brief Traced image of one frame, copied back from the device
+ */
+struct CapturedFrame
+{
+	/// @brief Frame number, counting every frame drawn
+	uint64_t index;
+
+	unsigned int width;
+	unsigned int height;
+
+	/// @brief Linear radiance as RGBA half floats, before tonemapping, in the order the tracer writes them, so the
+	/// bottom row of the screen comes first
+	std::vector<uint16_t> rgba;
+};
+
+/**
+ * @brief Quality settings of the tracers, applied as specialization constants of their pipelines
+ */
+struct TraceSettings
+{
+	/// @brief Bounces per path
+	uint32_t depth = 4;
+
+	/// @brief Paths traced per pixel each frame
+	uint32_t samples = 1;
+
+	/// @brief Leading analytic spheres and planes of the scene to trace, at most 4 and 5
+	uint32_t sphere_count = 4;
+	uint32_t plane_count  = 5;
+};
+
 /**
  * @brief Platform-agnostic, explicit API for interfacing with and controlling system GPUs
  *
@@ -56,10 +85,11 @@ struct GraphicsDevice final
 	 */
 	struct CreateInfo final
 	{
-		/// @brief Handle to OS window object (GLFW)
+		/// @brief Handle to OS window object (GLFW).  Null runs headless: no surface or swapchain is created, and frames
+		/// are rendered into offscreen images to be read back with `ReadFrame`
 		GLFWwindow * window;
 
-		/// @brief Desired number of backbuffer images in swapchain
+		/// @brief Desired number of backbuffer images in swapchain.  Ignored when headless
 		unsigned char swapchainSize;
 
 		/// @brief Number of frames which may be 'in-flight' (processed) at once
@@ -69,6 +99,55 @@ struct GraphicsDevice final
 
 		/// @brief Toggles debugging features during graphics device construction
 		bool debug;
+
+		/// @brief Scene geometry.  Each mesh gets a bottom-level BVH, uploaded once however many times it is placed
+		const Mesh * meshes;
+
+		/// @brief Number of entries in `meshes`
+		unsigned int mesh_count;
+
+		/// @brief Placed meshes.  A top-level BVH is built over their world-space bounds
+		const Instance * instances;
+
+		/// @brief Number of entries in `instances`
+		unsigned int instance_count;
+
+		/// @brief Flatten instances into world space and build one linear BVH over them on the device instead, so
+		/// updates only cost an upload
+		bool dynamic_bvh;
+
+		/// @brief Collapse each mesh's BVH into eight-wide nodes with 8-bit child boxes, cutting the bandwidth each
+		/// incoherent ray needs.  Ignored with `dynamic_bvh`
+		bool wide_bvh;
+
+		/// @brief Trace with separate generate, extend, shade and connect dispatches which pass paths through queues,
+		/// instead of one kernel tracing whole paths.  Less divergent, at the cost of storing every path's state
+		bool wavefront;
+
+		/// @brief Radix sort queued rays by direction octant and origin Morton code before each extension, and hits
+		/// by the object they hit before shading, so neighbouring invocations take similar paths.  Needs `wavefront`
+		bool sort_rays;
+
+		/// @brief Launch only enough megakernel workgroups to fill the device, each invocation fetching pixels from
+		/// an atomic counter until none are left, so lanes whose paths end early keep working.  Ignored with
+		/// `wavefront`
+		bool persistent_threads;
+
+		/// @brief Size of the offscreen image frames are rendered into when there is no window.  Ignored otherwise
+		unsigned short headless_width;
+		unsigned short headless_height;
+
+		/// @brief Copy every traced image into a ring of host-visible buffers, one per frame in flight, to be taken
+		/// with `PopCapturedFrame` once the frame completes
+		bool capture_frames;
+
+		/// @brief Keep averaging frames into the history, unclipped and without limit, for as long as the camera,
+		/// light and scene hold still, so a still view converges.  Otherwise only the last few frames are blended
+		bool progressive;
+
+		/// @brief Filter each frame with a spatiotemporal variance-guided filter: an estimate of each pixel's
+		/// variance, then edge-avoiding à-trous passes guided by the normal, depth and albedo of primary hits
+		bool denoise;
 	};
 
 	/**
@@ -91,7 +170,88 @@ struct GraphicsDevice final
 	 */
 	Error Destruct();
 
-	void Draw(const FrameData & frame_data);
+	/**
+	 * @brief Traces and presents a frame
+	 *
+	 * @param frame_data  View to trace.  Its aspect ratio and seed are filled in here
+	 *
+	 * @return Number of the frame, counting from one, to pass to `WaitForFrame`
+	 */
+	uint64_t Draw(const FrameData & frame_data);
+
+	/**
+	 * @brief Moves a mesh's vertices without changing its topology
+	 *
+	 * The mesh's BVH is refitted rather than rebuilt, until refitting has degraded it enough to warrant a full
+	 * rebuild.  Every instance of the mesh picks up the change.  The new data is staged without waiting on the device,
+	 * and copied on the transfer queue into each frame in flight's copy of the scene once the last frame tracing
+	 * against that copy is done with it
+	 *
+	 * @param mesh       Index of the mesh passed at construction
+	 * @param triangles  New positions for its `triangle_count` triangles, in the same order
+	 */
+	void UpdateMesh(unsigned int mesh, const Triangle * triangles);
+
+	/**
+	 * @brief Moves every instance.  Only the top-level BVH is rebuilt, and no geometry is re-uploaded
+	 *
+	 * @param transforms  New object-to-world transforms for the `instance_count` instances passed at construction
+	 */
+	void UpdateInstances(const glm::mat4x3 * transforms);
+
+	/**
+	 * @brief Changes the tracers' quality from the next frame on, without recompiling any SPIR-V
+	 *
+	 * Each combination of settings is a pipeline built the first time it is used, and kept until destruction, so
+	 * switching back and forth only costs the first time.  Counts are clamped to what the scene holds
+	 */
+	void SetTraceSettings(const TraceSettings & settings);
+
+	/**
+	 * @brief Rays traced so far by the wavefront kernels, shadow rays included.  Always zero for the megakernel
+	 *
+	 * @note Counted on the device as frames complete, so sampling it once a second gives rays per second
+	 */
+	uint64_t TracedRays();
+
+	/**
+	 * @brief Copies the most recently drawn frame back to the host, as displayed: RGBA8 rows, top row first
+	 *
+	 * Waits for every frame in flight, so this is meant for batch rendering and regression tests rather than once per
+	 * frame
+	 *
+	 * @param rgba  Room for `headless_width * headless_height` pixels
+	 *
+	 * @return Error  UNKNOWN when not headless, or when no frame has been drawn yet
+	 */
+	Error ReadFrame(uint8_t * rgba);
+
+	/**
+	 * @brief Prints every device memory pool: its strategy, blocks, bytes used and free ranges, then how many of the
+	 *        device's allowed memory objects are in use
+	 */
+	void DumpMemoryStats();
+
+	/**
+	 * @brief Takes the oldest captured frame which the device has finished, without waiting for any
+	 *
+	 * Frames are collected once the device finishes them, and by `Draw` before it reuses their buffer, so none are lost
+	 * however rarely this is called.  Call until it returns false to drain them
+	 *
+	 * @return False if no finished frame is waiting, or `capture_frames` was not set
+	 */
+	bool PopCapturedFrame(CapturedFrame & frame);
+
+	/**
+	 * @brief Blocks until the device has finished a frame returned by `Draw`, and every frame before it.  Frames
+	 *        not yet drawn are not waited for
+	 */
+	void WaitForFrame(uint64_t frame);
+
+	/**
+	 * @return Number of the last frame the device has finished, without waiting.  Zero before the first
+	 */
+	uint64_t CompletedFrame();
 
 	void WaitIdle();
 };
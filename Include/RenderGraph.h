@@ -26,12 +26,15 @@ namespace Renderer
 		ShaderInfo shaders[2];
 	};
 
+	/**
+	 * @brief A framebuffer-sized color image passes render into, in the backbuffer's format
+	 */
 	struct AttachmentInfo
 	{
 		enum class Source
 		{
-			TRANSIENT,
-			BACKBUFFER
+			TRANSIENT, //< Lives only within the frame's render pass, so it need never be stored to memory
+			BACKBUFFER //< The image presented.  A graph has at most one
 		};
 
 		const char * debug_name;
@@ -39,6 +42,9 @@ namespace Renderer
 		Source source;
 	};
 
+	/**
+	 * @brief Pipelines drawing into the same color outputs.  Each draws one fullscreen triangle
+	 */
 	struct PassInfo
 	{
 		const char * debug_name;
@@ -47,6 +53,8 @@ namespace Renderer
 		unsigned short color_input_count;
 		unsigned short pipeline_count;
 
+		/// @brief Indices into `GraphInfo::color_attachments`.  Outputs are written in the order of their fragment
+		/// shader locations, and inputs read as input attachments at the pixel being shaded
 		unsigned short color_outputs[8];
 		unsigned short color_inputs[8];
 
@@ -62,4 +70,69 @@ namespace Renderer
 
 		AttachmentInfo * color_attachments;
 	};
+
+	/**
+	 * @brief Why a later subpass must wait for an earlier one
+	 */
+	struct SubpassDependency
+	{
+		unsigned short src_subpass;
+		unsigned short dst_subpass;
+
+		/// @brief `dst_subpass` reads an attachment `src_subpass` wrote
+		bool read_after_write;
+
+		/// @brief Both write an attachment
+		bool write_after_write;
+	};
+
+	/**
+	 * @brief How the compiled graph uses one attachment
+	 */
+	struct AttachmentUsage
+	{
+		/// @brief Some pass kept uses it.  The rest need no image
+		bool used;
+
+		/// @brief Some pass kept reads it
+		bool read;
+
+		/// @brief Subpasses using it first and last
+		unsigned short first_subpass;
+		unsigned short last_subpass;
+	};
+
+	/**
+	 * @brief A graph's passes, sorted, culled and merged into the subpasses of one render pass
+	 */
+	struct CompiledGraph
+	{
+		/// @brief Indices into `GraphInfo::passes` of the passes kept, in the order they run
+		std::vector<unsigned short> passes;
+
+		/// @brief Subpass each of `passes` is recorded into.  Never decreases
+		std::vector<unsigned short> pass_subpasses;
+
+		/// @brief Outputs and inputs of each subpass, which every pass merged into it shares
+		std::vector<std::vector<unsigned short>> subpass_outputs;
+		std::vector<std::vector<unsigned short>> subpass_inputs;
+
+		/// @brief By index into `GraphInfo::color_attachments`
+		std::vector<AttachmentUsage> attachments;
+
+		/// @brief Each subpass waits only on the nearest earlier subpass writing what it uses, as dependencies chain
+		std::vector<SubpassDependency> dependencies;
+	};
+
+	/**
+	 * @brief Compiles a graph into the subpasses of one render pass
+	 *
+	 * Each pass runs after every pass writing an attachment it reads, and passes writing one attachment run in the
+	 * order they are given.  Passes nothing displayed depends on are culled.  Neighbours with the same outputs and
+	 * inputs share a subpass, as rasterization order already keeps their writes in order
+	 *
+	 * @return False if the graph is malformed: an index out of range, an attachment read but never written or read
+	 *         and written by one pass, a backbuffer read or declared twice, or passes depending on each other
+	 */
+	bool CompileGraph(const GraphInfo & info, CompiledGraph & graph);
 }
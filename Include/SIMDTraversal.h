@@ -0,0 +1,54 @@
+#pragma once
+
+#include <BVH.h>
+
+#include <cstddef>
+
+/**
+ * @brief Instruction sets the SIMD traversals have kernels for.  Each level implies the ones below it
+ */
+enum class SIMDLevel
+{
+	SCALAR, //< One ray and one box at a time through `trace_bvh`
+	SSE,    //< Four-ray packets and four-wide nodes.  Every x86-64 CPU has SSE2
+	AVX2,   //< Eight-ray packets and eight-wide nodes.  Needs AVX2 and FMA
+	AVX512  //< Sixteen-ray packets.  Needs AVX-512F
+};
+
+/**
+ * @brief Widest packet kernel this CPU and OS can run, read from CPUID and XGETBV
+ *
+ * @note Always `SIMDLevel::SCALAR` when the kernels were not compiled in, e.g. on non-x86 targets
+ */
+SIMDLevel detect_simd_level();
+
+const char * simd_level_name(SIMDLevel level);
+
+/**
+ * @brief Closest hits for a batch of rays, traced in packets of 4, 8 or 16 sharing one walk through the hierarchy
+ *
+ * Consecutive rays are grouped into packets, so pass them in a coherent order: primary rays in small screen tiles,
+ * or shadow rays towards the same light.  A packet visits every node any of its rays enters, so incoherent batches
+ * are better served by `trace_wide_bvh`
+ *
+ * @param tris   Triangles in BVH order, in their intersection layout
+ * @param hits   On entry, `t` is each ray's maximum distance.  On exit, the same result `trace_bvh` gives, up to ties
+ *               between hits within `RAY_EPSILON` of each other
+ * @param level  Kernel to use.  Levels above `detect_simd_level()` must not be requested
+ */
+void trace_bvh_packets(const BVH & bvh, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count, SIMDLevel level = detect_simd_level());
+
+/**
+ * @brief Closest hits for a batch of rays, traced one at a time through a wide hierarchy, each node's child boxes
+ *        tested in a single SIMD operation
+ *
+ * Unlike packets this does not depend on rays agreeing on a path, so it keeps its speed on incoherent bounces
+ *
+ * @param tris   Triangles in the order of the binary BVH the hierarchy was collapsed from
+ * @param hits   As for `trace_bvh_packets`
+ * @param level  Four-wide nodes need `SIMDLevel::SSE`, eight-wide nodes `SIMDLevel::AVX2`.  Lower levels test
+ *               children one at a time
+ */
+void trace_wide_bvh(const WideBVH<4> & bvh, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count, SIMDLevel level = detect_simd_level());
+
+void trace_wide_bvh(const WideBVH<8> & bvh, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count, SIMDLevel level = detect_simd_level());
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Geometry.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+/**
+ * @brief Triangle geometry, shared by every instance which places it.  Each mesh gets its own bottom-level BVH
+ */
+struct Mesh
+{
+	const Triangle * triangles;
+
+	uint32_t triangle_count;
+};
+
+/**
+ * @brief Places a mesh in the world.  Moving an instance only rebuilds the top-level BVH
+ */
+struct Instance
+{
+	/// @brief Object-to-world affine transform, as a 3x4 matrix (three rows, four columns)
+	glm::mat4x3 transform;
+
+	/// @brief Index of the placed mesh
+	uint32_t mesh;
+};
+
+/**
+ * @brief Instance as seen by the tracer, laid out to match the std430 `InstanceData` struct in Tracer.comp
+ *
+ * @note Rays are moved into object space rather than geometry into world space, so only the inverse is stored
+ */
+struct InstanceData
+{
+	/// @brief Rows of the world-to-object 3x4 matrix
+	glm::vec4 world_to_object[3];
+
+	/// @brief Root of this instance's mesh in the concatenated bottom-level node buffer
+	uint32_t blas_root;
+
+	uint32_t padding[3];
+};
+
+static_assert(sizeof(InstanceData) == 64, "InstanceData must match the GPU layout");
@@ -0,0 +1,1331 @@
+#include <BVH.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <numeric>
+#include <thread>
+
+namespace
+{
+	/// @brief Nodes with at least this many triangles are binned across all threads
+	constexpr uint32_t PARALLEL_BINNING_THRESHOLD = 1 << 16;
+
+	/// @brief Nodes with at most this many triangles are never split further on the calling thread
+	constexpr uint32_t SUBTREE_GRAIN = 1 << 12;
+
+	/// @brief Subtree tasks generated per worker thread, so uneven subtrees still balance out
+	constexpr unsigned int TASKS_PER_THREAD = 4;
+
+	constexpr uint32_t LBVH_LEAF_SIZE = 4;
+
+	struct Bin
+	{
+		AABB bounds;
+
+		unsigned int count = 0;
+	};
+
+	/**
+	 * @brief Best partition found for a node.  `axis == -1` when no useful split exists
+	 */
+	struct Split
+	{
+		int axis = -1;
+
+		unsigned int bin = 0;
+
+		float cost = std::numeric_limits<float>::max();
+
+		AABB left_bounds;
+		AABB right_bounds;
+	};
+
+	/**
+	 * @brief State shared by every thread taking part in a build
+	 */
+	struct BuildContext
+	{
+		const Triangle * tris;
+
+		const BVHBuildInfo & info;
+
+		/// @brief Indexed by source triangle
+		std::vector<glm::vec3> centroids;
+
+		/// @brief Indexed in BVH order.  Only filled in for LBVH builds
+		std::vector<uint32_t> morton_codes;
+
+		/// @brief Each node owns a disjoint range of this, so threads never touch the same entries
+		std::vector<uint32_t> & tri_indices;
+
+		bool lbvh;
+	};
+
+	/**
+	 * @brief Splits `[0, count)` into one contiguous chunk per thread and calls `f(begin, end, chunk)` on each
+	 *
+	 * @note Chunking only depends on `count` and `thread_count`, so repeated calls see identical chunks
+	 */
+	template <typename F>
+	void parallel_for(size_t count, unsigned int thread_count, F && f)
+	{
+		if (thread_count <= 1 || count < thread_count)
+		{
+			f(size_t{ 0 }, count, 0u);
+			return;
+		}
+
+		const size_t chunk = (count + thread_count - 1) / thread_count;
+
+		std::vector<std::thread> threads;
+
+		for (unsigned int t = 1; t < thread_count; ++t)
+		{
+			const size_t begin = std::min(count, t * chunk);
+			const size_t end   = std::min(count, begin + chunk);
+
+			threads.emplace_back([&f, begin, end, t] { f(begin, end, t); });
+		}
+
+		f(size_t{ 0 }, std::min(count, chunk), 0u);
+
+		for (auto & thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+	AABB triangle_bounds(const Triangle * tris, const uint32_t * indices, uint32_t count)
+	{
+		AABB bounds;
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			bounds.grow(tris[indices[i]]);
+		}
+
+		return bounds;
+	}
+
+	AABB centroid_bounds(const glm::vec3 * centroids, const uint32_t * indices, uint32_t count, unsigned int thread_count)
+	{
+		std::vector<AABB> partial(std::max(thread_count, 1u));
+
+		parallel_for(count, thread_count, [&](size_t begin, size_t end, unsigned int t)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				partial[t].grow(centroids[indices[i]]);
+			}
+		});
+
+		AABB bounds;
+
+		for (const auto & p : partial)
+		{
+			bounds.grow(p);
+		}
+
+		return bounds;
+	}
+
+	unsigned int bin_index(float c, float min, float scale, unsigned int bin_count)
+	{
+		const auto bin = static_cast<int>((c - min) * scale);
+
+		return static_cast<unsigned int>(std::clamp(bin, 0, static_cast<int>(bin_count) - 1));
+	}
+
+	/**
+	 * @brief Bins triangle centroids along every axis and sweeps the bins for the cheapest SAH partition
+	 *
+	 * @note Large nodes are binned by every thread into private bins, which are merged before sweeping
+	 */
+	Split find_split(const BuildContext & ctx, const uint32_t * indices, uint32_t count, const AABB & cbounds, unsigned int thread_count)
+	{
+		const unsigned int bin_count = ctx.info.bin_count;
+
+		if (count < PARALLEL_BINNING_THRESHOLD)
+		{
+			thread_count = 1;
+		}
+
+		float scale[3];
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float extent = cbounds.max[axis] - cbounds.min[axis];
+
+			// Axes where every centroid lies on the same plane are skipped
+			scale[axis] = extent > 0.0f ? bin_count / extent : 0.0f;
+		}
+
+		std::vector<std::vector<Bin>> thread_bins(thread_count, std::vector<Bin>(3 * bin_count));
+
+		parallel_for(count, thread_count, [&](size_t begin, size_t end, unsigned int t)
+		{
+			auto & bins = thread_bins[t];
+
+			for (size_t i = begin; i < end; ++i)
+			{
+				const Triangle &  tri = ctx.tris[indices[i]];
+				const glm::vec3 & c   = ctx.centroids[indices[i]];
+
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					if (scale[axis] == 0.0f) continue;
+
+					Bin & bin = bins[axis * bin_count + bin_index(c[axis], cbounds.min[axis], scale[axis], bin_count)];
+
+					bin.bounds.grow(tri);
+					++bin.count;
+				}
+			}
+		});
+
+		auto & bins = thread_bins[0];
+
+		for (unsigned int t = 1; t < thread_count; ++t)
+		{
+			for (unsigned int i = 0; i < 3 * bin_count; ++i)
+			{
+				bins[i].bounds.grow(thread_bins[t][i].bounds);
+				bins[i].count += thread_bins[t][i].count;
+			}
+		}
+
+		Split best;
+
+		std::vector<float> left_area(bin_count);
+		std::vector<unsigned int> left_count(bin_count);
+
+		std::vector<AABB> left_bounds(bin_count);
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (scale[axis] == 0.0f) continue;
+
+			const Bin * axis_bins = bins.data() + axis * bin_count;
+
+			// Sweep left-to-right, then right-to-left, evaluating the plane after each bin
+
+			AABB         sweep_bounds;
+			unsigned int sweep_count = 0;
+
+			for (unsigned int i = 0; i < bin_count - 1; ++i)
+			{
+				sweep_bounds.grow(axis_bins[i].bounds);
+				sweep_count += axis_bins[i].count;
+
+				left_bounds[i] = sweep_bounds;
+				left_area[i]   = sweep_bounds.area();
+				left_count[i]  = sweep_count;
+			}
+
+			sweep_bounds = AABB{};
+			sweep_count  = 0;
+
+			for (unsigned int i = bin_count - 1; i > 0; --i)
+			{
+				sweep_bounds.grow(axis_bins[i].bounds);
+				sweep_count += axis_bins[i].count;
+
+				if (left_count[i - 1] == 0 || sweep_count == 0) continue;
+
+				const float cost = left_count[i - 1] * left_area[i - 1] + sweep_count * sweep_bounds.area();
+
+				if (cost < best.cost)
+				{
+					best.axis = axis;
+					best.bin  = i;
+					best.cost = cost;
+
+					best.left_bounds  = left_bounds[i - 1];
+					best.right_bounds = sweep_bounds;
+				}
+			}
+		}
+
+		return best;
+	}
+
+	/**
+	 * @brief Partitions a node's triangles along the cheapest SAH plane
+	 *
+	 * @return bool  False when the node is cheaper to keep as a leaf
+	 */
+	bool split_sah(BuildContext & ctx, const BVHNode & node, unsigned int thread_count, BVHNode & left, BVHNode & right)
+	{
+		const uint32_t first = node.left_first;
+		const uint32_t count = node.tri_count;
+
+		uint32_t * const indices = ctx.tri_indices.data() + first;
+
+		const AABB node_bounds{ node.aabb_min, node.aabb_max };
+		const AABB cbounds = centroid_bounds(ctx.centroids.data(), indices, count, count < PARALLEL_BINNING_THRESHOLD ? 1 : thread_count);
+
+		const Split split = find_split(ctx, indices, count, cbounds, thread_count);
+
+		const float leaf_cost  = count * node_bounds.area();
+		const float split_cost = ctx.info.traversal_cost * node_bounds.area() + split.cost;
+
+		if ((split.axis == -1 || split_cost >= leaf_cost) && count <= ctx.info.max_leaf_size)
+		{
+			// Cheaper to intersect every triangle than to descend any further
+			return false;
+		}
+
+		uint32_t left_count;
+
+		AABB left_bounds;
+		AABB right_bounds;
+
+		if (split.axis != -1)
+		{
+			const unsigned int bin_count = ctx.info.bin_count;
+
+			const float scale = bin_count / (cbounds.max[split.axis] - cbounds.min[split.axis]);
+
+			const auto mid = std::partition(indices, indices + count, [&](uint32_t idx)
+			{
+				return bin_index(ctx.centroids[idx][split.axis], cbounds.min[split.axis], scale, bin_count) < split.bin;
+			});
+
+			left_count = static_cast<uint32_t>(mid - indices);
+
+			left_bounds  = split.left_bounds;
+			right_bounds = split.right_bounds;
+		}
+		else
+		{
+			// Centroids are coincident; split the oversized leaf down the middle
+			left_count = count / 2;
+
+			left_bounds  = triangle_bounds(ctx.tris, indices, left_count);
+			right_bounds = triangle_bounds(ctx.tris, indices + left_count, count - left_count);
+		}
+
+		left  = { left_bounds.min, first, left_bounds.max, left_count };
+		right = { right_bounds.min, first + left_count, right_bounds.max, count - left_count };
+
+		return true;
+	}
+
+	int highest_bit(uint32_t x)
+	{
+		int bit = -1;
+
+		while (x != 0)
+		{
+			x >>= 1;
+			++bit;
+		}
+
+		return bit;
+	}
+
+	/**
+	 * @brief Splits a range of sorted Morton codes at the highest bit in which they differ
+	 *
+	 * @note Child bounds are left empty; they are filled in bottom-up once the topology is complete
+	 */
+	bool split_lbvh(BuildContext & ctx, const BVHNode & node, BVHNode & left, BVHNode & right)
+	{
+		const uint32_t first = node.left_first;
+		const uint32_t count = node.tri_count;
+
+		if (count <= LBVH_LEAF_SIZE)
+		{
+			return false;
+		}
+
+		const uint32_t * const codes = ctx.morton_codes.data() + first;
+
+		uint32_t left_count = count / 2;
+
+		if (codes[0] != codes[count - 1])
+		{
+			const int bit = highest_bit(codes[0] ^ codes[count - 1]);
+
+			const auto mid = std::partition_point(codes, codes + count, [bit](uint32_t code)
+			{
+				return ((code >> bit) & 1) == 0;
+			});
+
+			left_count = static_cast<uint32_t>(mid - codes);
+		}
+
+		const AABB empty;
+
+		left  = { empty.min, first, empty.max, left_count };
+		right = { empty.min, first + left_count, empty.max, count - left_count };
+
+		return true;
+	}
+
+	bool split_node(BuildContext & ctx, const BVHNode & node, unsigned int thread_count, BVHNode & left, BVHNode & right)
+	{
+		if (node.tri_count <= 1)
+		{
+			return false;
+		}
+
+		return ctx.lbvh ? split_lbvh(ctx, node, left, right) : split_sah(ctx, node, thread_count, left, right);
+	}
+
+	/**
+	 * @brief Builds the subtree below `nodes[0]` on the calling thread
+	 */
+	void build_subtree(BuildContext & ctx, std::vector<BVHNode> & nodes)
+	{
+		std::vector<uint32_t> stack{ 0 };
+
+		while (stack.empty() == false)
+		{
+			const uint32_t node_idx = stack.back();
+			stack.pop_back();
+
+			BVHNode left;
+			BVHNode right;
+
+			if (split_node(ctx, nodes[node_idx], 1, left, right) == false)
+			{
+				continue;
+			}
+
+			const auto child_idx = static_cast<uint32_t>(nodes.size());
+
+			nodes.push_back(left);
+			nodes.push_back(right);
+
+			nodes[node_idx].left_first = child_idx;
+			nodes[node_idx].tri_count  = 0;
+
+			stack.push_back(child_idx + 1);
+			stack.push_back(child_idx);
+		}
+	}
+
+	/**
+	 * @brief Spreads the low 10 bits of `v` out so there are two zero bits between each
+	 */
+	uint32_t expand_bits(uint32_t v)
+	{
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+
+		return v;
+	}
+
+	/**
+	 * @brief 30-bit Morton code for a point inside the unit cube
+	 */
+	uint32_t morton_code(const glm::vec3 & p)
+	{
+		const glm::vec3 q = glm::clamp(p * 1024.0f, glm::vec3(0.0f), glm::vec3(1023.0f));
+
+		return expand_bits(static_cast<uint32_t>(q.x)) * 4
+		     + expand_bits(static_cast<uint32_t>(q.y)) * 2
+		     + expand_bits(static_cast<uint32_t>(q.z));
+	}
+
+	/**
+	 * @brief Sorts triangles along a Morton curve through their centroids, filling in `tri_indices` and `morton_codes`
+	 *
+	 * Keys are `code << 32 | index`, sorted with a stable parallel LSD radix sort over the code bits
+	 */
+	void sort_morton(BuildContext & ctx, unsigned int thread_count)
+	{
+		const size_t count = ctx.tri_indices.size();
+
+		const AABB cbounds = centroid_bounds(ctx.centroids.data(), ctx.tri_indices.data(), static_cast<uint32_t>(count), thread_count);
+
+		const glm::vec3 extent    = cbounds.max - cbounds.min;
+		const glm::vec3 inv_scale = glm::vec3(
+			extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+			extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+			extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+		std::vector<uint64_t> keys(count);
+		std::vector<uint64_t> scratch(count);
+
+		parallel_for(count, thread_count, [&](size_t begin, size_t end, unsigned int)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				const uint64_t code = morton_code((ctx.centroids[i] - cbounds.min) * inv_scale);
+
+				keys[i] = (code << 32) | i;
+			}
+		});
+
+		constexpr unsigned int RADIX = 256;
+
+		std::vector<size_t> histograms(static_cast<size_t>(thread_count) * RADIX);
+
+		for (unsigned int shift = 32; shift < 64; shift += 8)
+		{
+			std::fill(histograms.begin(), histograms.end(), 0);
+
+			parallel_for(count, thread_count, [&](size_t begin, size_t end, unsigned int t)
+			{
+				size_t * const histogram = histograms.data() + t * RADIX;
+
+				for (size_t i = begin; i < end; ++i)
+				{
+					++histogram[(keys[i] >> shift) & (RADIX - 1)];
+				}
+			});
+
+			// Exclusive scan, digit-major so each thread scatters after lower-numbered threads
+
+			size_t offset = 0;
+
+			for (unsigned int digit = 0; digit < RADIX; ++digit)
+			{
+				for (unsigned int t = 0; t < thread_count; ++t)
+				{
+					const size_t digit_count = histograms[t * RADIX + digit];
+
+					histograms[t * RADIX + digit] = offset;
+
+					offset += digit_count;
+				}
+			}
+
+			parallel_for(count, thread_count, [&](size_t begin, size_t end, unsigned int t)
+			{
+				size_t * const offsets = histograms.data() + t * RADIX;
+
+				for (size_t i = begin; i < end; ++i)
+				{
+					scratch[offsets[(keys[i] >> shift) & (RADIX - 1)]++] = keys[i];
+				}
+			});
+
+			keys.swap(scratch);
+		}
+
+		ctx.morton_codes.resize(count);
+
+		parallel_for(count, thread_count, [&](size_t begin, size_t end, unsigned int)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				ctx.tri_indices[i]  = static_cast<uint32_t>(keys[i]);
+				ctx.morton_codes[i] = static_cast<uint32_t>(keys[i] >> 32);
+			}
+		});
+	}
+
+	/**
+	 * @brief Recomputes every node's bounds from its triangles or children
+	 *
+	 * Leaves are bounded in parallel, then interior nodes are merged in one reverse sweep, which relies on
+	 * children always being stored after their parent
+	 */
+	void compute_bounds_bottom_up(BVH & bvh, const Triangle * tris, unsigned int thread_count)
+	{
+		parallel_for(bvh.nodes.size(), thread_count, [&](size_t begin, size_t end, unsigned int)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				BVHNode & node = bvh.nodes[i];
+
+				if (node.tri_count == 0) continue;
+
+				const AABB bounds = triangle_bounds(tris, bvh.tri_indices.data() + node.left_first, node.tri_count);
+
+				node.aabb_min = bounds.min;
+				node.aabb_max = bounds.max;
+			}
+		});
+
+		for (size_t i = bvh.nodes.size(); i-- > 0;)
+		{
+			BVHNode & node = bvh.nodes[i];
+
+			if (node.tri_count > 0) continue;
+
+			const BVHNode & left  = bvh.nodes[node.left_first];
+			const BVHNode & right = bvh.nodes[node.left_first + 1];
+
+			node.aabb_min = glm::min(left.aabb_min, right.aabb_min);
+			node.aabb_max = glm::max(left.aabb_max, right.aabb_max);
+		}
+	}
+
+	/**
+	 * @brief Picks a power-of-two step per axis so 255 steps cover `extent`, as a biased float exponent
+	 */
+	uint8_t quantization_exponent(float extent)
+	{
+		int exponent = 0;
+
+		std::frexp(extent / 255.0f, &exponent);
+
+		return static_cast<uint8_t>(std::clamp(exponent + 127, 1, 254));
+	}
+
+	float exponent_scale(uint8_t exponent)
+	{
+		return std::ldexp(1.0f, static_cast<int>(exponent) - 127);
+	}
+
+	/**
+	 * @brief Quantizes one axis of a child box conservatively, so the decoded box always contains the original
+	 */
+	void quantize_axis(float origin, float scale, float lo, float hi, uint8_t & q_lo, uint8_t & q_hi)
+	{
+		int l = std::clamp(static_cast<int>(std::floor((lo - origin) / scale)), 0, 255);
+		int h = std::clamp(static_cast<int>(std::ceil((hi - origin) / scale)), 0, 255);
+
+		while (l > 0 && origin + static_cast<float>(l) * scale > lo) --l;
+		while (h < 255 && origin + static_cast<float>(h) * scale < hi) ++h;
+
+		q_lo = static_cast<uint8_t>(l);
+		q_hi = static_cast<uint8_t>(h);
+	}
+
+	/**
+	 * @brief Binary nodes a wide node over `binary_idx` holds, opening the largest interior child until every one
+	 *        of `width` slots is used or only leaves remain
+	 *
+	 * @note A leaf root still needs an interior node above it, so it becomes the only child
+	 */
+	std::vector<uint32_t> collapse_children(const BVH & bvh, uint32_t binary_idx, size_t width)
+	{
+		const BVHNode & binary = bvh.nodes[binary_idx];
+
+		if (binary.tri_count > 0)
+		{
+			return { binary_idx };
+		}
+
+		std::vector<uint32_t> children{ binary.left_first, binary.left_first + 1 };
+
+		while (children.size() < width)
+		{
+			int   largest      = -1;
+			float largest_area = -1.0f;
+
+			for (size_t i = 0; i < children.size(); ++i)
+			{
+				const BVHNode & child = bvh.nodes[children[i]];
+
+				const float area = AABB{ child.aabb_min, child.aabb_max }.area();
+
+				if (child.tri_count == 0 && area > largest_area)
+				{
+					largest      = static_cast<int>(i);
+					largest_area = area;
+				}
+			}
+
+			if (largest < 0) break;
+
+			const uint32_t opened = children[largest];
+
+			children[largest] = bvh.nodes[opened].left_first;
+			children.push_back(bvh.nodes[opened].left_first + 1);
+		}
+
+		return children;
+	}
+
+	unsigned int resolve_thread_count(const BVHBuildInfo & info)
+	{
+		return info.thread_count != 0 ? info.thread_count : std::max(std::thread::hardware_concurrency(), 1u);
+	}
+}
+
+BVH build_bvh(const Triangle * tris, size_t tri_count, const BVHBuildInfo & info)
+{
+	BVH bvh;
+
+	// An empty leaf would still need a triangle, so the root is an inverted box instead, which every box test
+	// rejects, so traversal never reaches its children
+
+	if (tri_count == 0)
+	{
+		const AABB empty;
+
+		bvh.nodes.push_back({ empty.min, 0, empty.max, 0 });
+
+		return bvh;
+	}
+
+	const unsigned int thread_count = resolve_thread_count(info);
+
+	bvh.tri_indices.resize(tri_count);
+	std::iota(bvh.tri_indices.begin(), bvh.tri_indices.end(), 0);
+
+	BuildContext ctx{ tris, info, {}, {}, bvh.tri_indices, false };
+
+	ctx.lbvh = info.method == BVHBuildInfo::Method::LBVH || (info.method == BVHBuildInfo::Method::AUTO && tri_count >= info.lbvh_threshold);
+
+	ctx.centroids.resize(tri_count);
+
+	parallel_for(tri_count, thread_count, [&](size_t begin, size_t end, unsigned int)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			ctx.centroids[i] = centroid(tris[i]);
+		}
+	});
+
+	AABB root_bounds;
+
+	if (ctx.lbvh)
+	{
+		sort_morton(ctx, thread_count);
+	}
+	else
+	{
+		std::vector<AABB> partial(thread_count);
+
+		parallel_for(tri_count, thread_count, [&](size_t begin, size_t end, unsigned int t)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				partial[t].grow(tris[i]);
+			}
+		});
+
+		for (const auto & p : partial)
+		{
+			root_bounds.grow(p);
+		}
+	}
+
+	bvh.nodes.reserve(2 * tri_count);
+	bvh.nodes.push_back({ root_bounds.min, 0, root_bounds.max, static_cast<uint32_t>(tri_count) });
+
+	// Split the top of the tree on this thread, binning large nodes in parallel, until there are
+	// enough independent subtrees to keep every worker busy
+
+	std::vector<uint32_t> tasks;
+	std::deque<uint32_t>  frontier{ 0 };
+
+	const size_t task_target = thread_count == 1 ? 1 : static_cast<size_t>(thread_count) * TASKS_PER_THREAD;
+
+	while (frontier.empty() == false)
+	{
+		const uint32_t node_idx = frontier.front();
+		frontier.pop_front();
+
+		if (bvh.nodes[node_idx].tri_count <= SUBTREE_GRAIN || tasks.size() + frontier.size() + 1 >= task_target)
+		{
+			tasks.push_back(node_idx);
+			continue;
+		}
+
+		BVHNode left;
+		BVHNode right;
+
+		if (split_node(ctx, bvh.nodes[node_idx], thread_count, left, right) == false)
+		{
+			continue;
+		}
+
+		const auto child_idx = static_cast<uint32_t>(bvh.nodes.size());
+
+		bvh.nodes.push_back(left);
+		bvh.nodes.push_back(right);
+
+		bvh.nodes[node_idx].left_first = child_idx;
+		bvh.nodes[node_idx].tri_count  = 0;
+
+		frontier.push_back(child_idx);
+		frontier.push_back(child_idx + 1);
+	}
+
+	// Build the subtrees as parallel tasks, each into its own node array
+
+	std::vector<std::vector<BVHNode>> subtrees(tasks.size());
+
+	std::atomic<size_t> next_task{ 0 };
+
+	parallel_for(std::min<size_t>(thread_count, tasks.size()), std::min<size_t>(thread_count, tasks.size()), [&](size_t, size_t, unsigned int)
+	{
+		for (size_t task; (task = next_task++) < tasks.size();)
+		{
+			subtrees[task].push_back(bvh.nodes[tasks[task]]);
+
+			build_subtree(ctx, subtrees[task]);
+		}
+	});
+
+	// Splice subtrees back in.  Each subtree root replaces its placeholder, and the rest are appended
+
+	for (size_t task = 0; task < tasks.size(); ++task)
+	{
+		const auto & subtree = subtrees[task];
+
+		const auto base = static_cast<uint32_t>(bvh.nodes.size());
+
+		const auto relocate = [base](BVHNode node)
+		{
+			if (node.tri_count == 0)
+			{
+				node.left_first = base + node.left_first - 1;
+			}
+
+			return node;
+		};
+
+		bvh.nodes[tasks[task]] = relocate(subtree[0]);
+
+		for (size_t i = 1; i < subtree.size(); ++i)
+		{
+			bvh.nodes.push_back(relocate(subtree[i]));
+		}
+	}
+
+	if (ctx.lbvh)
+	{
+		compute_bounds_bottom_up(bvh, tris, thread_count);
+	}
+
+	bvh.build_cost = sah_cost(bvh, info);
+
+	return bvh;
+}
+
+BVH build_bvh(const AABB * boxes, size_t box_count, const BVHBuildInfo & info)
+{
+	// A triangle spanning min, max and the centre is bounded by exactly the box, and shares its centroid
+
+	std::vector<Triangle> proxies(box_count);
+
+	for (size_t i = 0; i < box_count; ++i)
+	{
+		proxies[i] = { boxes[i].min, boxes[i].max, (boxes[i].min + boxes[i].max) * 0.5f };
+	}
+
+	return build_bvh(proxies.data(), proxies.size(), info);
+}
+
+void refit_bvh(BVH & bvh, const Triangle * tris, const BVHBuildInfo & info)
+{
+	if (bvh.tri_indices.empty()) return;
+
+	compute_bounds_bottom_up(bvh, tris, resolve_thread_count(info));
+}
+
+bool update_bvh(BVH & bvh, const Triangle * tris, size_t tri_count, const BVHBuildInfo & info)
+{
+	if (tri_count == bvh.tri_indices.size())
+	{
+		refit_bvh(bvh, tris, info);
+
+		if (sah_cost(bvh, info) <= bvh.build_cost * info.rebuild_threshold)
+		{
+			return false;
+		}
+	}
+
+	bvh = build_bvh(tris, tri_count, info);
+
+	return true;
+}
+
+BVH8 collapse_bvh8(const BVH & bvh)
+{
+	BVH8 wide;
+
+	wide.nodes.emplace_back();
+
+	wide.tri_indices.reserve(bvh.tri_indices.size());
+
+	if (bvh.tri_indices.empty())
+	{
+		return wide;
+	}
+
+	// Pairs of (wide node, binary node it stands for)
+
+	std::vector<std::pair<uint32_t, uint32_t>> stack{ { 0, 0 } };
+
+	while (stack.empty() == false)
+	{
+		const auto [wide_idx, binary_idx] = stack.back();
+		stack.pop_back();
+
+		const std::vector<uint32_t> children = collapse_children(bvh, binary_idx, 8);
+
+		AABB bounds;
+
+		for (const uint32_t child : children)
+		{
+			bounds.grow(AABB{ bvh.nodes[child].aabb_min, bvh.nodes[child].aabb_max });
+		}
+
+		BVH8Node node{};
+
+		node.origin     = bounds.min;
+		node.child_base = static_cast<uint32_t>(wide.nodes.size());
+		node.tri_base   = static_cast<uint32_t>(wide.tri_indices.size());
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			node.exponent[axis] = quantization_exponent(bounds.max[axis] - bounds.min[axis]);
+		}
+
+		const glm::vec3 scale{ exponent_scale(node.exponent[0]), exponent_scale(node.exponent[1]), exponent_scale(node.exponent[2]) };
+
+		uint8_t interior_count = 0;
+
+		for (size_t i = 0; i < children.size(); ++i)
+		{
+			const BVHNode & child = bvh.nodes[children[i]];
+
+			quantize_axis(node.origin.x, scale.x, child.aabb_min.x, child.aabb_max.x, node.lo_x[i], node.hi_x[i]);
+			quantize_axis(node.origin.y, scale.y, child.aabb_min.y, child.aabb_max.y, node.lo_y[i], node.hi_y[i]);
+			quantize_axis(node.origin.z, scale.z, child.aabb_min.z, child.aabb_max.z, node.lo_z[i], node.hi_z[i]);
+
+			if (child.tri_count > 0)
+			{
+				node.meta[i] = static_cast<uint8_t>(child.tri_count);
+
+				wide.tri_indices.insert(wide.tri_indices.end(), bvh.tri_indices.begin() + child.left_first, bvh.tri_indices.begin() + child.left_first + child.tri_count);
+			}
+			else
+			{
+				node.meta[i] = static_cast<uint8_t>(0x80 | interior_count);
+
+				node.interior_mask |= static_cast<uint8_t>(1 << i);
+
+				stack.push_back({ node.child_base + interior_count, children[i] });
+
+				++interior_count;
+			}
+		}
+
+		wide.nodes.resize(wide.nodes.size() + interior_count);
+
+		wide.nodes[wide_idx] = node;
+	}
+
+	return wide;
+}
+
+template <size_t N>
+WideBVH<N> collapse_wide_bvh(const BVH & bvh)
+{
+	WideBVH<N> wide;
+
+	// Pairs of (wide node, binary node it stands for)
+
+	std::vector<std::pair<uint32_t, uint32_t>> stack{ { 0, 0 } };
+
+	wide.nodes.emplace_back();
+
+	while (stack.empty() == false)
+	{
+		const auto [wide_idx, binary_idx] = stack.back();
+		stack.pop_back();
+
+		// An empty hierarchy collapses to a root with every slot empty
+
+		const std::vector<uint32_t> children = bvh.tri_indices.empty() ? std::vector<uint32_t>{} : collapse_children(bvh, binary_idx, N);
+
+		WideBVHNode<N> node;
+
+		for (size_t i = 0; i < N; ++i)
+		{
+			if (i >= children.size())
+			{
+				constexpr float empty = std::numeric_limits<float>::infinity();
+
+				node.lo_x[i] = node.lo_y[i] = node.lo_z[i] = empty;
+				node.hi_x[i] = node.hi_y[i] = node.hi_z[i] = empty;
+
+				node.child[i] = 0;
+				node.count[i] = 0;
+
+				continue;
+			}
+
+			const BVHNode & child = bvh.nodes[children[i]];
+
+			node.lo_x[i] = child.aabb_min.x;
+			node.lo_y[i] = child.aabb_min.y;
+			node.lo_z[i] = child.aabb_min.z;
+			node.hi_x[i] = child.aabb_max.x;
+			node.hi_y[i] = child.aabb_max.y;
+			node.hi_z[i] = child.aabb_max.z;
+
+			if (child.tri_count > 0)
+			{
+				node.child[i] = child.left_first;
+				node.count[i] = child.tri_count;
+			}
+			else
+			{
+				node.child[i] = static_cast<uint32_t>(wide.nodes.size());
+				node.count[i] = 0;
+
+				stack.push_back({ node.child[i], children[i] });
+
+				wide.nodes.emplace_back();
+			}
+		}
+
+		wide.nodes[wide_idx] = node;
+	}
+
+	return wide;
+}
+
+template WideBVH<4> collapse_wide_bvh(const BVH & bvh);
+template WideBVH<8> collapse_wide_bvh(const BVH & bvh);
+
+std::vector<Triangle> reorder_triangles(const BVH & bvh, const Triangle * tris)
+{
+	std::vector<Triangle> ordered(bvh.tri_indices.size());
+
+	for (size_t i = 0; i < bvh.tri_indices.size(); ++i)
+	{
+		ordered[i] = tris[bvh.tri_indices[i]];
+	}
+
+	return ordered;
+}
+
+std::vector<Triangle> reorder_triangles(const BVH8 & bvh, const Triangle * tris)
+{
+	std::vector<Triangle> ordered(bvh.tri_indices.size());
+
+	for (size_t i = 0; i < bvh.tri_indices.size(); ++i)
+	{
+		ordered[i] = tris[bvh.tri_indices[i]];
+	}
+
+	return ordered;
+}
+
+Hit trace_bvh(const BVH & bvh, const PrecomputedTriangle * tris, const Ray & ray, float t_max, TraversalStats * stats)
+{
+	TraversalStats local;
+
+	TraversalStats & s = stats ? *stats : local;
+
+	Hit hit;
+
+	hit.t = t_max;
+
+	++s.rays;
+
+	const glm::vec3 inv_dir = 1.0f / ray.dir;
+
+	constexpr float miss = std::numeric_limits<float>::infinity();
+
+	s.bytes += sizeof(BVHNode);
+
+	if (intersect_aabb(ray, inv_dir, bvh.nodes[0].aabb_min, bvh.nodes[0].aabb_max, hit.t + RAY_EPSILON) == miss)
+	{
+		return hit;
+	}
+
+	std::array<uint32_t, 64> stack;
+	size_t stack_ptr = 0;
+
+	uint32_t node_idx = 0;
+
+	while (true)
+	{
+		const BVHNode & node = bvh.nodes[node_idx];
+
+		++s.nodes;
+		s.bytes += sizeof(BVHNode);
+
+		if (node.tri_count > 0)
+		{
+			for (uint32_t i = node.left_first; i < node.left_first + node.tri_count; ++i)
+			{
+				++s.triangles;
+				s.bytes += sizeof(PrecomputedTriangle);
+
+				const float t = intersect_triangle(ray, tris[i]);
+
+				if (t > RAY_EPSILON && t < hit.t + RAY_EPSILON)
+				{
+					hit.t   = t;
+					hit.tri = i;
+				}
+			}
+
+			if (stack_ptr == 0) break;
+
+			node_idx = stack[--stack_ptr];
+			continue;
+		}
+
+		uint32_t near_idx = node.left_first;
+		uint32_t far_idx  = node.left_first + 1;
+
+		s.bytes += 2 * sizeof(BVHNode);
+
+		float t_near = intersect_aabb(ray, inv_dir, bvh.nodes[near_idx].aabb_min, bvh.nodes[near_idx].aabb_max, hit.t + RAY_EPSILON);
+		float t_far  = intersect_aabb(ray, inv_dir, bvh.nodes[far_idx].aabb_min, bvh.nodes[far_idx].aabb_max, hit.t + RAY_EPSILON);
+
+		if (t_far < t_near)
+		{
+			std::swap(near_idx, far_idx);
+			std::swap(t_near, t_far);
+		}
+
+		if (t_near == miss)
+		{
+			if (stack_ptr == 0) break;
+
+			node_idx = stack[--stack_ptr];
+			continue;
+		}
+
+		node_idx = near_idx;
+
+		if (t_far != miss && stack_ptr < stack.size())
+		{
+			stack[stack_ptr++] = far_idx;
+		}
+	}
+
+	return hit;
+}
+
+Hit trace_bvh(const BVH8 & bvh, const PrecomputedTriangle * tris, const Ray & ray, float t_max, TraversalStats * stats)
+{
+	TraversalStats local;
+
+	TraversalStats & s = stats ? *stats : local;
+
+	Hit hit;
+
+	hit.t = t_max;
+
+	++s.rays;
+
+	const glm::vec3 inv_dir = 1.0f / ray.dir;
+
+	constexpr float miss = std::numeric_limits<float>::infinity();
+
+	std::array<uint32_t, 64> stack;
+	size_t stack_ptr = 0;
+
+	uint32_t node_idx = 0;
+
+	while (true)
+	{
+		const BVH8Node & node = bvh.nodes[node_idx];
+
+		++s.nodes;
+		s.bytes += sizeof(BVH8Node);
+
+		const glm::vec3 scale{ exponent_scale(node.exponent[0]), exponent_scale(node.exponent[1]), exponent_scale(node.exponent[2]) };
+
+		// Interior children hit by the ray, kept sorted nearest first
+
+		uint32_t child_idx[8];
+		float    child_t[8];
+		int      child_count = 0;
+
+		uint32_t tri_offset = 0;
+
+		for (int i = 0; i < 8; ++i)
+		{
+			const uint8_t meta = node.meta[i];
+
+			if (meta == 0) continue;
+
+			const glm::vec3 lo = node.origin + glm::vec3(node.lo_x[i], node.lo_y[i], node.lo_z[i]) * scale;
+			const glm::vec3 hi = node.origin + glm::vec3(node.hi_x[i], node.hi_y[i], node.hi_z[i]) * scale;
+
+			const float t_box = intersect_aabb(ray, inv_dir, lo, hi, hit.t + RAY_EPSILON);
+
+			if (meta & 0x80)
+			{
+				if (t_box == miss) continue;
+
+				int j = child_count++;
+
+				for (; j > 0 && child_t[j - 1] > t_box; --j)
+				{
+					child_idx[j] = child_idx[j - 1];
+					child_t[j]   = child_t[j - 1];
+				}
+
+				child_idx[j] = node.child_base + (meta & 0x7F);
+				child_t[j]   = t_box;
+
+				continue;
+			}
+
+			if (t_box != miss)
+			{
+				for (uint32_t k = node.tri_base + tri_offset; k < node.tri_base + tri_offset + meta; ++k)
+				{
+					++s.triangles;
+					s.bytes += sizeof(PrecomputedTriangle);
+
+					const float t = intersect_triangle(ray, tris[k]);
+
+					if (t > RAY_EPSILON && t < hit.t + RAY_EPSILON)
+					{
+						hit.t   = t;
+						hit.tri = k;
+					}
+				}
+			}
+
+			tri_offset += meta;
+		}
+
+		// Push far to near, so the nearest child is visited next
+
+		for (int j = child_count; j-- > 0;)
+		{
+			if (stack_ptr < stack.size())
+			{
+				stack[stack_ptr++] = child_idx[j];
+			}
+		}
+
+		if (stack_ptr == 0) break;
+
+		node_idx = stack[--stack_ptr];
+	}
+
+	return hit;
+}
+
+template <size_t N>
+Hit trace_bvh(const WideBVH<N> & bvh, const PrecomputedTriangle * tris, const Ray & ray, float t_max, TraversalStats * stats)
+{
+	TraversalStats local;
+
+	TraversalStats & s = stats ? *stats : local;
+
+	Hit hit;
+
+	hit.t = t_max;
+
+	++s.rays;
+
+	const glm::vec3 inv_dir = 1.0f / ray.dir;
+
+	constexpr float miss = std::numeric_limits<float>::infinity();
+
+	std::array<uint32_t, 64> stack;
+	size_t stack_ptr = 0;
+
+	uint32_t node_idx = 0;
+
+	while (true)
+	{
+		const WideBVHNode<N> & node = bvh.nodes[node_idx];
+
+		++s.nodes;
+		s.bytes += sizeof(WideBVHNode<N>);
+
+		// Interior children hit by the ray, kept sorted nearest first
+
+		uint32_t child_idx[N];
+		float    child_t[N];
+		int      child_count = 0;
+
+		for (size_t i = 0; i < N; ++i)
+		{
+			const float t_box = intersect_aabb(ray, inv_dir, { node.lo_x[i], node.lo_y[i], node.lo_z[i] }, { node.hi_x[i], node.hi_y[i], node.hi_z[i] }, hit.t + RAY_EPSILON);
+
+			if (t_box == miss) continue;
+
+			if (node.count[i] == 0)
+			{
+				int j = child_count++;
+
+				for (; j > 0 && child_t[j - 1] > t_box; --j)
+				{
+					child_idx[j] = child_idx[j - 1];
+					child_t[j]   = child_t[j - 1];
+				}
+
+				child_idx[j] = node.child[i];
+				child_t[j]   = t_box;
+
+				continue;
+			}
+
+			for (uint32_t k = node.child[i]; k < node.child[i] + node.count[i]; ++k)
+			{
+				++s.triangles;
+				s.bytes += sizeof(PrecomputedTriangle);
+
+				const float t = intersect_triangle(ray, tris[k]);
+
+				if (t > RAY_EPSILON && t < hit.t + RAY_EPSILON)
+				{
+					hit.t   = t;
+					hit.tri = k;
+				}
+			}
+		}
+
+		// Push far to near, so the nearest child is visited next
+
+		for (int j = child_count; j-- > 0;)
+		{
+			if (stack_ptr < stack.size())
+			{
+				stack[stack_ptr++] = child_idx[j];
+			}
+		}
+
+		if (stack_ptr == 0) break;
+
+		node_idx = stack[--stack_ptr];
+	}
+
+	return hit;
+}
+
+template Hit trace_bvh(const WideBVH<4> & bvh, const PrecomputedTriangle * tris, const Ray & ray, float t_max, TraversalStats * stats);
+template Hit trace_bvh(const WideBVH<8> & bvh, const PrecomputedTriangle * tris, const Ray & ray, float t_max, TraversalStats * stats);
+
+uint32_t ray_sort_key(const Ray & ray, const glm::vec3 & bounds_min, const glm::vec3 & bounds_extent)
+{
+	const uint32_t octant = (ray.dir.x < 0.0f ? 4 : 0) | (ray.dir.y < 0.0f ? 2 : 0) | (ray.dir.z < 0.0f ? 1 : 0);
+
+	// Nine bits per axis leave room for the octant above them
+
+	const glm::vec3 p = (ray.origin - bounds_min) / glm::max(bounds_extent, glm::vec3(1e-20f));
+
+	return (octant << 27) | (morton_code(p) >> 3);
+}
+
+float sah_cost(const BVH & bvh, const BVHBuildInfo & info)
+{
+	const float root_area = AABB{ bvh.nodes[0].aabb_min, bvh.nodes[0].aabb_max }.area();
+
+	if (root_area <= 0.0f)
+	{
+		return 0.0f;
+	}
+
+	float cost = 0.0f;
+
+	for (const auto & node : bvh.nodes)
+	{
+		const float area = AABB{ node.aabb_min, node.aabb_max }.area();
+
+		cost += (node.tri_count == 0 ? info.traversal_cost : static_cast<float>(node.tri_count)) * area;
+	}
+
+	return cost / root_area;
+}
@@ -0,0 +1,405 @@
+/**
+ * @file  BVHBench.cpp
+ * @brief Measures BVH build and refit time, node count and SAH cost over synthetic triangle soups, then compares
+ *        binary and compressed eight-wide layouts on incoherent rays, in random order and sorted for coherence.
+ *        Finally compares SIMD packets and wide nodes against one ray at a time, on primary rays along a fixed camera
+ *        path, on incoherent bounces and on axis-parallel rays.  Needs no GPU
+ *
+ * Usage: BVHBench [max_triangles] [threads]
+ */
+
+#include <BVH.h>
+#include <SIMDTraversal.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @brief Rays traced per hierarchy when comparing layouts
+static constexpr size_t RAY_COUNT = 100'000;
+
+/// @brief Frames along the camera path, and their resolution, when comparing packet kernels
+static constexpr unsigned int CAMERA_FRAMES     = 8;
+static constexpr unsigned int CAMERA_RESOLUTION = 256;
+
+/// @brief Keep density roughly constant, so larger soups cover a larger volume
+static float soup_extent(size_t count)
+{
+	return 16.0f * std::cbrt(static_cast<float>(count));
+}
+
+static std::vector<Triangle> make_triangle_soup(size_t count, unsigned int seed)
+{
+	std::mt19937 rng(seed);
+
+	const float extent = soup_extent(count);
+
+	std::uniform_real_distribution<float> position(0.0f, extent);
+	std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+
+	std::vector<Triangle> tris(count);
+
+	for (auto & tri : tris)
+	{
+		const glm::vec3 p{ position(rng), position(rng), position(rng) };
+
+		tri.v0 = p;
+		tri.v1 = p + glm::vec3(offset(rng), offset(rng), offset(rng)) * 4.0f;
+		tri.v2 = p + glm::vec3(offset(rng), offset(rng), offset(rng)) * 4.0f;
+	}
+
+	return tris;
+}
+
+/**
+ * @brief Moves every triangle rigidly by a small random offset, like one frame of animation
+ */
+static std::vector<Triangle> animate_triangle_soup(const std::vector<Triangle> & tris, unsigned int seed)
+{
+	std::mt19937 rng(seed);
+
+	std::uniform_real_distribution<float> offset(-0.5f, 0.5f);
+
+	std::vector<Triangle> moved(tris);
+
+	for (auto & tri : moved)
+	{
+		const glm::vec3 d{ offset(rng), offset(rng), offset(rng) };
+
+		tri.v0 += d;
+		tri.v1 += d;
+		tri.v2 += d;
+	}
+
+	return moved;
+}
+
+/**
+ * @brief Rays from random points inside the soup in uniformly random directions, like diffuse bounces
+ */
+static std::vector<Ray> make_incoherent_rays(size_t count, float extent, unsigned int seed)
+{
+	std::mt19937 rng(seed);
+
+	std::uniform_real_distribution<float> position(0.0f, extent);
+	std::normal_distribution<float>       direction;
+
+	std::vector<Ray> rays(count);
+
+	for (auto & ray : rays)
+	{
+		ray.origin = { position(rng), position(rng), position(rng) };
+		ray.dir    = glm::normalize(glm::vec3(direction(rng), direction(rng), direction(rng)));
+	}
+
+	return rays;
+}
+
+/**
+ * @brief Rays from random points inside the soup along each of the six axis directions in turn.  Zero direction
+ *        components give infinite slab distances, which a box test must not turn into NaN
+ */
+static std::vector<Ray> make_axis_rays(size_t count, float extent, unsigned int seed)
+{
+	std::mt19937 rng(seed);
+
+	std::uniform_real_distribution<float> position(0.0f, extent);
+
+	std::vector<Ray> rays(count);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		glm::vec3 dir(0.0f);
+
+		dir[i % 3] = (i / 3) % 2 == 0 ? 1.0f : -1.0f;
+
+		rays[i].origin = { position(rng), position(rng), position(rng) };
+		rays[i].dir    = dir;
+	}
+
+	return rays;
+}
+
+/**
+ * @brief Primary rays of a camera circling the soup while looking at its centre.  Each frame is ordered in 4x4 pixel
+ *        tiles, so packets of 8 or 16 rays always hold neighbouring pixels
+ */
+static std::vector<Ray> make_camera_path_rays(float extent)
+{
+	const glm::vec3 center(extent * 0.5f);
+
+	std::vector<Ray> rays;
+
+	rays.reserve(static_cast<size_t>(CAMERA_FRAMES) * CAMERA_RESOLUTION * CAMERA_RESOLUTION);
+
+	for (unsigned int frame = 0; frame < CAMERA_FRAMES; ++frame)
+	{
+		const float angle = 6.28318530718f * frame / CAMERA_FRAMES;
+
+		const glm::vec3 eye = center + glm::vec3(std::cos(angle), 0.25f, std::sin(angle)) * extent;
+
+		const glm::vec3 forward = glm::normalize(center - eye);
+		const glm::vec3 right   = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+		const glm::vec3 up      = glm::cross(right, forward);
+
+		for (unsigned int ty = 0; ty < CAMERA_RESOLUTION; ty += 4)
+		{
+			for (unsigned int tx = 0; tx < CAMERA_RESOLUTION; tx += 4)
+			{
+				for (unsigned int y = ty; y < ty + 4; ++y)
+				{
+					for (unsigned int x = tx; x < tx + 4; ++x)
+					{
+						const glm::vec2 uv = (glm::vec2(x, y) + 0.5f) / static_cast<float>(CAMERA_RESOLUTION) * 2.0f - 1.0f;
+
+						rays.push_back({ eye, glm::normalize(forward + (right * uv.x + up * uv.y) * 0.5f) });
+					}
+				}
+			}
+		}
+	}
+
+	return rays;
+}
+
+/**
+ * @brief The same rays, reordered by `ray_sort_key` as the wavefront tracer's sorting pass does between bounces
+ */
+static std::vector<Ray> sort_rays(std::vector<Ray> rays, float extent)
+{
+	std::vector<std::pair<uint32_t, size_t>> keys(rays.size());
+
+	for (size_t i = 0; i < rays.size(); ++i)
+	{
+		keys[i] = { ray_sort_key(rays[i], glm::vec3(0.0f), glm::vec3(extent)), i };
+	}
+
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<Ray> sorted(rays.size());
+
+	for (size_t i = 0; i < rays.size(); ++i)
+	{
+		sorted[i] = rays[keys[i].second];
+	}
+
+	return sorted;
+}
+
+template <typename Hierarchy>
+static std::vector<PrecomputedTriangle> precompute_in_order(const Hierarchy & bvh, const std::vector<Triangle> & tris)
+{
+	std::vector<PrecomputedTriangle> ordered;
+
+	for (const auto & tri : reorder_triangles(bvh, tris.data()))
+	{
+		ordered.push_back(precompute_triangle(tri));
+	}
+
+	return ordered;
+}
+
+/**
+ * @brief Traces every ray single-threaded and formats one row of the layout table
+ */
+template <typename Hierarchy>
+static std::string measure_traversal(const char * builder, const char * layout, const char * order, size_t count, const Hierarchy & bvh, const std::vector<Triangle> & tris, const std::vector<Ray> & rays)
+{
+	const std::vector<PrecomputedTriangle> ordered = precompute_in_order(bvh, tris);
+
+	TraversalStats stats;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (const auto & ray : rays)
+	{
+		trace_bvh(bvh, ordered.data(), ray, 1e30f, &stats);
+	}
+
+	const auto end = std::chrono::steady_clock::now();
+
+	const double seconds = std::chrono::duration<double>(end - start).count();
+	const double rays_n  = static_cast<double>(stats.rays);
+
+	char row[160];
+
+	std::snprintf(row, sizeof(row), "%-10zu %-14s %-7s %-7s %10.1f %10.1f %10.0f %10.2f\n", count, builder, layout, order,
+		stats.nodes / rays_n, stats.triangles / rays_n, stats.bytes / rays_n, rays_n / seconds / 1e6);
+
+	return row;
+}
+
+/**
+ * @brief Traces every ray single-threaded with one SIMD kernel and formats one row of the SIMD table
+ *
+ * @param trace      Called once with the rays and hits to fill in
+ * @param reference  Hits from the scalar kernel, filled in by the first call.  Rows count the rays hitting a
+ *                   different triangle, which only near-ties between hits should cause
+ */
+template <typename F>
+static std::string measure_simd(size_t count, const char * kernel, const char * order, const std::vector<Ray> & rays, std::vector<Hit> & reference, F && trace)
+{
+	std::vector<Hit> hits(rays.size());
+
+	const auto start = std::chrono::steady_clock::now();
+
+	trace(rays.data(), hits.data(), hits.size());
+
+	const auto end = std::chrono::steady_clock::now();
+
+	if (reference.empty()) reference = hits;
+
+	size_t mismatches = 0;
+
+	for (size_t i = 0; i < hits.size(); ++i)
+	{
+		if (hits[i].tri != reference[i].tri) ++mismatches;
+	}
+
+	const double seconds = std::chrono::duration<double>(end - start).count();
+
+	char row[160];
+
+	std::snprintf(row, sizeof(row), "%-10zu %-14s %-7s %10.2f %10zu\n", count, kernel, order, rays.size() / seconds / 1e6, mismatches);
+
+	return row;
+}
+
+int main(int argc, char ** argv)
+{
+	const size_t max_tris = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+
+	const unsigned int threads = argc > 2 ? static_cast<unsigned int>(std::atoi(argv[2])) : std::thread::hardware_concurrency();
+
+	struct Config
+	{
+		const char * name;
+
+		BVHBuildInfo::Method method;
+
+		unsigned int thread_count;
+
+		/// @brief Builds the same tree as another config, so is timed but not traced
+		bool duplicate;
+	};
+
+	const Config configs[]
+	{
+		{ "sah  serial",   BVHBuildInfo::Method::SAH,  1,       true  },
+		{ "sah  parallel", BVHBuildInfo::Method::SAH,  threads, false },
+		{ "lbvh parallel", BVHBuildInfo::Method::LBVH, threads, false }
+	};
+
+	std::printf("%-10s %-14s %8s %12s %12s %10s %8s %11s\n", "tris", "builder", "threads", "build (ms)", "refit (ms)", "nodes", "sah", "refit sah");
+
+	std::vector<std::string> traversal_rows;
+	std::vector<std::string> simd_rows;
+
+	for (size_t count = 10'000; count <= max_tris; count *= 10)
+	{
+		const auto tris    = make_triangle_soup(count, 1337);
+		const auto moved   = animate_triangle_soup(tris, 7331);
+		const auto rays    = make_incoherent_rays(RAY_COUNT, soup_extent(count), 4242);
+		const auto sorted  = sort_rays(rays, soup_extent(count));
+		const auto primary = make_camera_path_rays(soup_extent(count));
+		const auto axis    = make_axis_rays(RAY_COUNT, soup_extent(count), 2424);
+
+		for (const auto & config : configs)
+		{
+			BVHBuildInfo info;
+
+			info.method       = config.method;
+			info.thread_count = config.thread_count;
+
+			const auto start = std::chrono::steady_clock::now();
+
+			BVH bvh = build_bvh(tris.data(), tris.size(), info);
+
+			const auto built = std::chrono::steady_clock::now();
+
+			refit_bvh(bvh, moved.data(), info);
+
+			const auto refitted = std::chrono::steady_clock::now();
+
+			const double build_ms = std::chrono::duration<double, std::milli>(built - start).count();
+			const double refit_ms = std::chrono::duration<double, std::milli>(refitted - built).count();
+
+			std::printf("%-10zu %-14s %8u %12.2f %12.2f %10zu %8.2f %11.2f\n", count, config.name, config.thread_count, build_ms, refit_ms, bvh.nodes.size(), bvh.build_cost, sah_cost(bvh, info));
+
+			// Serial builds produce the same tree as parallel ones, so only trace one of them
+
+			if (config.duplicate) continue;
+
+			refit_bvh(bvh, tris.data(), info);
+
+			const BVH8 wide = collapse_bvh8(bvh);
+
+			traversal_rows.push_back(measure_traversal(config.name, "binary", "random", count, bvh, tris, rays));
+			traversal_rows.push_back(measure_traversal(config.name, "binary", "sorted", count, bvh, tris, sorted));
+			traversal_rows.push_back(measure_traversal(config.name, "bvh8", "random", count, wide, tris, rays));
+			traversal_rows.push_back(measure_traversal(config.name, "bvh8", "sorted", count, wide, tris, sorted));
+
+			if (config.method != BVHBuildInfo::Method::SAH) continue;
+
+			// Packets across rays against wide nodes across children, on coherent primary rays, incoherent bounces and
+			// axis-parallel rays
+
+			const std::vector<PrecomputedTriangle> ordered = precompute_in_order(bvh, tris);
+
+			const WideBVH<4> wide4 = collapse_wide_bvh<4>(bvh);
+			const WideBVH<8> wide8 = collapse_wide_bvh<8>(bvh);
+
+			const SIMDLevel widest = detect_simd_level();
+
+			for (const auto & [order, batch] : { std::make_pair("primary", &primary), std::make_pair("bounce", &rays), std::make_pair("axis", &axis) })
+			{
+				std::vector<Hit> reference;
+
+				simd_rows.push_back(measure_simd(count, "scalar", order, *batch, reference, [&](const Ray * r, Hit * h, size_t n)
+				{
+					trace_bvh_packets(bvh, ordered.data(), r, h, n, SIMDLevel::SCALAR);
+				}));
+
+				for (int level = static_cast<int>(SIMDLevel::SSE); level <= static_cast<int>(widest); ++level)
+				{
+					const std::string kernel = std::string("packet ") + simd_level_name(static_cast<SIMDLevel>(level));
+
+					simd_rows.push_back(measure_simd(count, kernel.c_str(), order, *batch, reference, [&](const Ray * r, Hit * h, size_t n)
+					{
+						trace_bvh_packets(bvh, ordered.data(), r, h, n, static_cast<SIMDLevel>(level));
+					}));
+				}
+
+				simd_rows.push_back(measure_simd(count, widest >= SIMDLevel::SSE ? "wide4 sse" : "wide4 scalar", order, *batch, reference, [&](const Ray * r, Hit * h, size_t n)
+				{
+					trace_wide_bvh(wide4, ordered.data(), r, h, n, widest);
+				}));
+
+				simd_rows.push_back(measure_simd(count, widest >= SIMDLevel::AVX2 ? "wide8 avx2" : "wide8 scalar", order, *batch, reference, [&](const Ray * r, Hit * h, size_t n)
+				{
+					trace_wide_bvh(wide8, ordered.data(), r, h, n, widest);
+				}));
+			}
+		}
+	}
+
+	std::printf("\n%-10s %-14s %-7s %-7s %10s %10s %10s %10s\n", "tris", "builder", "layout", "rays", "nodes/ray", "tris/ray", "bytes/ray", "Mrays/s");
+
+	for (const auto & row : traversal_rows)
+	{
+		std::fputs(row.c_str(), stdout);
+	}
+
+	std::printf("\n%-10s %-14s %-7s %10s %10s\n", "tris", "kernel", "rays", "Mrays/s", "mismatches");
+
+	for (const auto & row : simd_rows)
+	{
+		std::fputs(row.c_str(), stdout);
+	}
+}
@@ -0,0 +1,980 @@
+#include <CPUTracer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+	/////
+	// Scene, mirroring the constants in Tracer.glsl
+	/////
+
+	constexpr float PI = 3.14159265359f;
+
+	constexpr uint32_t DEPTH   = 4;
+
+	/// @brief Tracer.glsl traces one sample per frame and leaves the rest to Temporal.comp.  A single reference
+	/// frame has no history to lean on, so it keeps the samples the device used to take in one
+	constexpr uint32_t SAMPLES = 4;
+
+	constexpr uint32_t SPHERE_COUNT = 4;
+	constexpr uint32_t PLANE_COUNT  = 5;
+
+	enum class MaterialType
+	{
+		DIFFUSE,   //< Diffuse and specular
+		DIELECTRIC //< Glass, water
+	};
+
+	struct Material
+	{
+		glm::vec3 albedo;
+		glm::vec3 emissive;
+
+		float roughness;
+		float metalness;
+
+		MaterialType type;
+	};
+
+	struct Sphere
+	{
+		Material mat;
+
+		glm::vec3 P;
+
+		float r;
+	};
+
+	struct Plane
+	{
+		Material mat;
+
+		glm::vec3 N;
+
+		float len;
+	};
+
+	struct Intersection
+	{
+		Material mat;
+
+		float t;
+
+		glm::vec3 P;
+		glm::vec3 N;
+	};
+
+	const Material matte_white = { glm::vec3(1.0f, 1.0f, 1.0f),    glm::vec3(0.0f), 0.3f, 0.7f, MaterialType::DIFFUSE };
+	const Material matte_red   = { glm::vec3(0.75f, 0.25f, 0.25f), glm::vec3(0.0f), 0.4f, 0.0f, MaterialType::DIFFUSE };
+	const Material matte_green = { glm::vec3(0.25f, 0.75f, 0.25f), glm::vec3(0.0f), 0.4f, 0.0f, MaterialType::DIFFUSE };
+	const Material matte_blue  = { glm::vec3(0.25f, 0.25f, 0.75f), glm::vec3(0.0f), 0.4f, 0.0f, MaterialType::DIFFUSE };
+
+	const Material plastic = { glm::vec3(0.25f, 0.25f, 0.75f), glm::vec3(0.0f),   0.3f,  0.6f, MaterialType::DIFFUSE };
+	const Material mirror  = { glm::vec3(1.0f, 0.5f, 0.5f),    glm::vec3(0.0f),   0.0f,  1.0f, MaterialType::DIFFUSE };
+	const Material glass   = { glm::vec3(1.0f, 1.0f, 1.0f),    glm::vec3(0.0f),   0.42f, 0.0f, MaterialType::DIELECTRIC };
+	const Material light   = { glm::vec3(1.0f, 1.0f, 1.0f),    glm::vec3(128.0f), 0.6f,  0.0f, MaterialType::DIFFUSE };
+
+	const Sphere spheres[SPHERE_COUNT] =
+	{
+		{ glass,   glm::vec3(42.0f, 16.0f, 12.0f),   16.0f },
+		{ light,   glm::vec3(0.0f, 96.0f, 0.0f),     12.0f },
+		{ mirror,  glm::vec3(-32.0f, 24.0f, 24.0f),  24.0f },
+		{ plastic, glm::vec3(-24.0f, 11.0f, -48.0f), 11.0f }
+	};
+
+	const Plane planes[PLANE_COUNT] =
+	{
+		{ matte_white, glm::vec3(0.0f, 1.0f, 0.0f),  0.0f },
+		{ matte_white, glm::vec3(0.0f, -1.0f, 0.0f), 128.0f },
+		{ matte_red,   glm::vec3(1.0f, 0.0f, 0.0f),  64.0f },
+		{ matte_green, glm::vec3(0.0f, 0.0f, -1.0f), 64.0f },
+		{ matte_blue,  glm::vec3(-1.0f, 0.0f, 0.0f), 64.0f }
+	};
+
+	/////
+	// Shading, mirroring the functions in Tracer.glsl and Tracer.comp
+	/////
+
+	/**
+	 * @brief One pixel's path through `radiance`, with the state the shader keeps in globals: the RNG, seeded per pixel
+	 *
+	 * Paths of a tile advance a bounce at a time, so their rays can be traced together.  Each path still draws from its
+	 * RNG in the order the shader does, so batching does not change the image
+	 */
+	struct Path
+	{
+		unsigned int x = 0;
+		unsigned int y = 0;
+
+		glm::vec2 coords = glm::vec2(0.0f);
+
+		float rand_salt = 0.0f;
+
+		Ray primary;
+		Ray ray;
+
+		glm::vec3 acc   = glm::vec3(0.0f);
+		glm::vec3 mask  = glm::vec3(1.0f);
+		glm::vec3 accum = glm::vec3(0.0f); //< Sum of `acc` over finished samples
+
+		/// @brief Hit being shaded, and the bounce jitter drawn for it before its shadow rays went out
+		Intersection intersect;
+		glm::vec3    d;
+
+		float rand()
+		{
+			const glm::vec2 K1{ 23.14069263277926f, 2.665144142690225f };
+
+			return glm::fract(std::cos(glm::dot((coords + ++rand_salt) * 5.0f, K1)) * 12345.6789f);
+		}
+	};
+
+	float max3(const glm::vec3 & e)
+	{
+		return std::max(std::max(e.x, e.y), e.z);
+	}
+
+	bool all_positive(const glm::vec3 & e)
+	{
+		return e.x > 0.0f && e.y > 0.0f && e.z > 0.0f;
+	}
+
+	glm::vec3 jitter(const glm::vec3 & d, float phi, float sina, float cosa)
+	{
+		const glm::vec3 w = glm::normalize(d);
+		const glm::vec3 u = glm::normalize(glm::cross(glm::vec3(w.y, w.z, w.x), w));
+		const glm::vec3 v = glm::cross(w, u);
+
+		return (u * std::cos(phi) + v * std::sin(phi)) * sina + w * cosa;
+	}
+
+	float schlick(float cosine, float ior)
+	{
+		float r0 = (1.0f - ior) / (1.0f + ior);
+
+		r0 = r0 * r0;
+
+		return r0 + (1.0f - r0) * std::pow(1.0f - cosine, 5.0f);
+	}
+
+	glm::vec3 fresnel_schlick(float cos_theta, const glm::vec3 & F0)
+	{
+		return F0 + (1.0f - F0) * std::pow(1.0f - cos_theta, 5.0f);
+	}
+
+	float distribution_ggx(const glm::vec3 & N, const glm::vec3 & H, float roughness)
+	{
+		const float a      = roughness * roughness;
+		const float a2     = a * a;
+		const float NdotH  = std::max(glm::dot(N, H), 0.0f);
+		const float NdotH2 = NdotH * NdotH;
+
+		float denom = (NdotH2 * (a2 - 1.0f) + 1.0f);
+		denom = PI * denom * denom;
+
+		return a2 / denom;
+	}
+
+	float geometry_schlick_ggx(float NdotV, float roughness)
+	{
+		const float r = (roughness + 1.0f);
+		const float k = (r * r) / 8.0f;
+
+		return NdotV / (NdotV * (1.0f - k) + k);
+	}
+
+	float geometry_smith(const glm::vec3 & N, const glm::vec3 & V, const glm::vec3 & L, float roughness)
+	{
+		const float NdotV = std::max(glm::dot(N, V), 0.0f);
+		const float NdotL = std::max(glm::dot(N, L), 0.0f);
+
+		return geometry_schlick_ggx(NdotL, roughness) * geometry_schlick_ggx(NdotV, roughness);
+	}
+
+	glm::vec3 sphere_light(const FrameData & frame, const Material & mat, const glm::vec3 & P, const glm::vec3 & N, const glm::vec3 & L, const Sphere & s, float t)
+	{
+		glm::vec3 attenuation = s.mat.emissive * 1.0f / std::pow(t / s.r + 1.0f, 2.0f);
+
+		// Clamp light distance
+		attenuation = (attenuation - 0.001f) / (1.0f - 0.001f);
+		attenuation = glm::max(attenuation, 0.0f);
+
+		const glm::vec3 F0 = glm::mix(glm::vec3(0.04f), mat.albedo, mat.metalness);
+
+		const glm::vec3 V = glm::normalize(frame.camera.pos - P);
+		const glm::vec3 H = glm::normalize(V + L);
+
+		// Cook-Torrance BRDF
+		const float     NDF = distribution_ggx(N, H, mat.roughness);
+		const float     G   = geometry_smith(N, V, L, mat.roughness);
+		const glm::vec3 F   = fresnel_schlick(std::max(glm::dot(H, V), 0.0f), F0);
+
+		const glm::vec3 kD = (glm::vec3(1.0f) - F) * (1.0f - mat.metalness);
+
+		const glm::vec3 numerator   = NDF * G * F;
+		const float     denominator = 4.0f * std::max(glm::dot(N, V), 0.0f) * std::max(glm::dot(N, L), 0.0f);
+		const glm::vec3 specular    = numerator / std::max(denominator, 0.001f);
+
+		const float NdotL = std::max(glm::dot(N, L), 0.0f);
+
+		return (kD * mat.albedo / PI + specular) * attenuation * NdotL;
+	}
+
+	float intersect_sphere(const Ray & ray, const Sphere & sphere)
+	{
+		const glm::vec3 oc = ray.origin - sphere.P;
+		const float     b  = 2.0f * glm::dot(oc, ray.dir);
+		const float     c  = glm::dot(oc, oc) - sphere.r * sphere.r;
+		const float     h  = b * b - 4.0f * c;
+
+		if (h < 0.0f) return -1.0f;
+
+		return (-b - std::sqrt(h)) / 2.0f;
+	}
+
+	float intersect_plane(const Ray & ray, const Plane & plane)
+	{
+		const float d = glm::dot(ray.dir, plane.N);
+
+		if (d == 0.0f) return 0.0f;
+
+		return std::max(-(plane.len + glm::dot(ray.origin, plane.N)) / d, 0.0f);
+	}
+
+	/**
+	 * @brief Which traversal a batch of rays suits
+	 */
+	enum class RayBatch
+	{
+		COHERENT,  //< Primary rays in screen order or shadow rays towards one light, traced as packets
+		INCOHERENT //< Bounces, traced one at a time through wide nodes
+	};
+
+	/**
+	 * @brief Buffers `trace_triangles` reuses between batches, one set per worker
+	 */
+	struct TraceScratch
+	{
+		/// @brief For each instance, the rays of the batch whose walk of the instance hierarchy reaches it
+		std::vector<std::vector<uint32_t>> candidates;
+
+		std::vector<Ray> local_rays;
+		std::vector<Hit> local_hits;
+	};
+
+	/**
+	 * @brief Walks the instance hierarchy as `trace_tlas` does for every ray, then traces each instance's mesh in its
+	 *        object space for all the rays that reached it at once
+	 *
+	 * @param hits       On entry, `t` is each ray's maximum distance.  On exit, its closest triangle hit
+	 * @param instances  Index into `scene.instances` of each hit.  Left alone on a miss
+	 */
+	void trace_triangles(const CPUScene & scene, SIMDLevel level, RayBatch batch, const Ray * rays, Hit * hits, uint32_t * instances, size_t count, TraceScratch & scratch)
+	{
+		const std::vector<BVHNode> & nodes = scene.tlas.nodes;
+
+		constexpr float miss = std::numeric_limits<float>::infinity();
+
+		scratch.candidates.resize(scene.instances.size());
+
+		// Rays are pushed in batch order, so each instance sees them as coherent as the caller laid them out
+
+		for (uint32_t r = 0; r < count; ++r)
+		{
+			const Ray & ray = rays[r];
+
+			const glm::vec3 inv_dir = 1.0f / ray.dir;
+
+			const float t_max = hits[r].t + RAY_EPSILON;
+
+			if (intersect_aabb(ray, inv_dir, nodes[0].aabb_min, nodes[0].aabb_max, t_max) == miss) continue;
+
+			uint32_t stack[64];
+			uint32_t stack_ptr = 0;
+
+			uint32_t node_idx = 0;
+
+			while (true)
+			{
+				const BVHNode & node = nodes[node_idx];
+
+				if (node.tri_count > 0)
+				{
+					for (uint32_t i = node.left_first; i < node.left_first + node.tri_count; ++i)
+					{
+						scratch.candidates[i].push_back(r);
+					}
+
+					if (stack_ptr == 0) break;
+
+					node_idx = stack[--stack_ptr];
+					continue;
+				}
+
+				uint32_t near_idx = node.left_first;
+				uint32_t far_idx  = node.left_first + 1;
+
+				float t_near = intersect_aabb(ray, inv_dir, nodes[near_idx].aabb_min, nodes[near_idx].aabb_max, t_max);
+				float t_far  = intersect_aabb(ray, inv_dir, nodes[far_idx].aabb_min, nodes[far_idx].aabb_max, t_max);
+
+				if (t_far < t_near)
+				{
+					std::swap(near_idx, far_idx);
+					std::swap(t_near, t_far);
+				}
+
+				if (t_near == miss)
+				{
+					if (stack_ptr == 0) break;
+
+					node_idx = stack[--stack_ptr];
+					continue;
+				}
+
+				node_idx = near_idx;
+
+				if (t_far != miss && stack_ptr < 64)
+				{
+					stack[stack_ptr++] = far_idx;
+				}
+			}
+		}
+
+		// Each instance traces with the closest distance found so far, so later instances only report nearer hits
+
+		for (uint32_t i = 0; i < scene.instances.size(); ++i)
+		{
+			std::vector<uint32_t> & candidates = scratch.candidates[i];
+
+			if (candidates.empty()) continue;
+
+			const CPUInstance & instance = scene.instances[i];
+
+			scratch.local_rays.clear();
+			scratch.local_hits.clear();
+
+			for (const uint32_t r : candidates)
+			{
+				const glm::vec4 origin(rays[r].origin, 1.0f);
+
+				scratch.local_rays.push_back(
+				{
+					{ glm::dot(instance.world_to_object[0], origin), glm::dot(instance.world_to_object[1], origin), glm::dot(instance.world_to_object[2], origin) },
+					{ glm::dot(glm::vec3(instance.world_to_object[0]), rays[r].dir), glm::dot(glm::vec3(instance.world_to_object[1]), rays[r].dir), glm::dot(glm::vec3(instance.world_to_object[2]), rays[r].dir) }
+				});
+
+				scratch.local_hits.push_back(Hit{ hits[r].t });
+			}
+
+			const PrecomputedTriangle * tris = scene.tris[instance.mesh].data();
+
+			if (batch == RayBatch::COHERENT)
+			{
+				trace_bvh_packets(scene.blas[instance.mesh], tris, scratch.local_rays.data(), scratch.local_hits.data(), candidates.size(), level);
+			}
+			else if (level >= SIMDLevel::AVX2)
+			{
+				trace_wide_bvh(scene.wide8[instance.mesh], tris, scratch.local_rays.data(), scratch.local_hits.data(), candidates.size(), level);
+			}
+			else
+			{
+				trace_wide_bvh(scene.wide4[instance.mesh], tris, scratch.local_rays.data(), scratch.local_hits.data(), candidates.size(), level);
+			}
+
+			for (size_t k = 0; k < candidates.size(); ++k)
+			{
+				if (scratch.local_hits[k].tri == UINT32_MAX) continue;
+
+				hits[candidates[k]]      = scratch.local_hits[k];
+				instances[candidates[k]] = i;
+			}
+
+			candidates.clear();
+		}
+	}
+
+	/**
+	 * @brief Finishes `trace_ray` for a ray whose triangles were traced by `trace_triangles`, testing the analytic
+	 *        spheres and planes against its closest triangle
+	 *
+	 * @param intersect  `t` is the ray's maximum distance on entry
+	 */
+	bool closest_hit(const CPUScene & scene, const Ray & ray, const Hit & hit, uint32_t instance, Intersection & intersect)
+	{
+		bool found = false;
+
+		if (hit.tri != UINT32_MAX)
+		{
+			const CPUInstance & hit_instance = scene.instances[instance];
+
+			// Normals transform by the inverse transpose, whose columns are the world-to-object rows
+
+			const glm::mat3 normal_matrix(glm::vec3(hit_instance.world_to_object[0]), glm::vec3(hit_instance.world_to_object[1]), glm::vec3(hit_instance.world_to_object[2]));
+
+			intersect.mat = mirror;
+			intersect.t   = hit.t;
+			intersect.P   = ray.origin + intersect.t * ray.dir;
+			intersect.N   = glm::normalize(normal_matrix * scene.normals[hit_instance.mesh][hit.tri]);
+
+			found = true;
+		}
+
+		for (const auto & sphere : spheres)
+		{
+			const float t = intersect_sphere(ray, sphere);
+
+			if ((t > RAY_EPSILON) && (t < intersect.t + RAY_EPSILON))
+			{
+				intersect.mat = sphere.mat;
+
+				intersect.t = t;
+				intersect.P = ray.origin + t * ray.dir;
+				intersect.N = (intersect.P - sphere.P) / sphere.r;
+
+				found = true;
+			}
+		}
+
+		for (const auto & plane : planes)
+		{
+			const float t = intersect_plane(ray, plane);
+
+			if ((t > RAY_EPSILON) && (t < intersect.t - RAY_EPSILON))
+			{
+				intersect.mat = plane.mat;
+
+				intersect.t = t;
+				intersect.P = ray.origin + t * ray.dir;
+				intersect.N = plane.N;
+
+				found = true;
+			}
+		}
+
+		return found;
+	}
+
+	/**
+	 * @brief Shadow ray from a diffuse hit towards an emissive sphere
+	 */
+	struct ShadowRay
+	{
+		uint32_t path;
+		uint32_t sphere;
+
+		float t;
+
+		glm::vec3 L;
+	};
+
+	/**
+	 * @brief Per-worker buffers for `trace_tile`
+	 */
+	struct TileScratch
+	{
+		std::vector<Path> paths;
+
+		/// @brief Paths still bouncing, and the ones that hit something this bounce
+		std::vector<uint32_t> active;
+		std::vector<uint32_t> shaded;
+
+		std::vector<Ray>      rays;
+		std::vector<Hit>      hits;
+		std::vector<uint32_t> instances;
+
+		std::vector<ShadowRay> shadows;
+		std::vector<Ray>       shadow_rays;
+		std::vector<Hit>       shadow_hits;
+		std::vector<uint32_t>  shadow_instances;
+
+		TraceScratch trace;
+
+		uint64_t ray_count = 0;
+
+		std::chrono::steady_clock::duration trace_time{};
+	};
+
+	/**
+	 * @brief Even bits of a Morton code, i.e. its x coordinate
+	 */
+	uint32_t compact_bits(uint32_t v)
+	{
+		v &= 0x55555555u;
+		v = (v | (v >> 1)) & 0x33333333u;
+		v = (v | (v >> 2)) & 0x0f0f0f0fu;
+		v = (v | (v >> 4)) & 0x00ff00ffu;
+		v = (v | (v >> 8)) & 0x0000ffffu;
+
+		return v;
+	}
+
+	/**
+	 * @brief Mirrors `trace_pixel` in Tracer.comp for every pixel of a tile, storing what it would store
+	 *
+	 * The tile's paths run `radiance` in lockstep, one bounce at a time.  Each bounce traces every live path's ray in
+	 * one batch, then every shadow ray its diffuse hits cast.  Primary and shadow rays go through packets; bounces have
+	 * scattered, so they are traced one at a time through wide nodes
+	 */
+	void trace_tile(const CPUScene & scene, const FrameData & frame, const CPUTraceInfo & info, unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, TileScratch & s, uint8_t * pixels)
+	{
+		// Pixels along a Z curve, so every aligned run of 4, 8 or 16 primary rays is a compact block of the image
+
+		uint32_t side = 1;
+
+		while (side < x1 - x0 || side < y1 - y0) side *= 2;
+
+		s.paths.clear();
+
+		for (uint32_t code = 0; code < side * side; ++code)
+		{
+			const unsigned int x = x0 + compact_bits(code);
+			const unsigned int y = y0 + compact_bits(code >> 1);
+
+			if (x >= x1 || y >= y1) continue;
+
+			Path path;
+
+			path.x = x;
+			path.y = y;
+
+			// Compute camera coordinates and ray direction
+
+			const glm::vec2 uv = glm::vec2(x, y) / glm::vec2(info.width, info.height);
+
+			path.rand_salt = uv.y / uv.x + frame.seed;
+			path.coords    = uv;
+
+			const glm::vec2 trans = 2.0f * uv - glm::vec2(1.0f, 1.0f);
+
+			const CameraData & camera = frame.camera;
+
+			const glm::vec3 dir = (camera.dir + camera.right * trans.x + camera.up * trans.y) * glm::vec3(frame.aspect_ratio, 1.0f, frame.aspect_ratio);
+
+			path.primary = Ray{ camera.pos, glm::normalize(dir) };
+
+			s.paths.push_back(path);
+		}
+
+		// Shoot rays and compute final pixel color
+
+		for (uint32_t sample = 0; sample < SAMPLES; ++sample)
+		{
+			s.active.clear();
+
+			for (uint32_t p = 0; p < s.paths.size(); ++p)
+			{
+				s.paths[p].ray  = s.paths[p].primary;
+				s.paths[p].acc  = glm::vec3(0.0f);
+				s.paths[p].mask = glm::vec3(1.0f);
+
+				s.active.push_back(p);
+			}
+
+			for (uint32_t depth = 0; depth < DEPTH && s.active.empty() == false; ++depth)
+			{
+				const float t_max = 3000.0f / std::pow(static_cast<float>(depth + 1), 2.0f);
+
+				s.rays.clear();
+				s.hits.clear();
+
+				for (const uint32_t p : s.active)
+				{
+					// Clamp fireflies
+					s.paths[p].acc = glm::clamp(s.paths[p].acc, glm::vec3(0.0f), glm::vec3(1.0f));
+
+					s.rays.push_back(s.paths[p].ray);
+					s.hits.push_back(Hit{ t_max });
+				}
+
+				s.instances.resize(s.rays.size());
+
+				auto start = std::chrono::steady_clock::now();
+
+				trace_triangles(scene, info.simd_level, depth == 0 ? RayBatch::COHERENT : RayBatch::INCOHERENT, s.rays.data(), s.hits.data(), s.instances.data(), s.rays.size(), s.trace);
+
+				s.trace_time += std::chrono::steady_clock::now() - start;
+				s.ray_count  += s.rays.size();
+
+				// Draw everything the shader draws before its shadow rays, and queue those rays
+
+				s.shaded.clear();
+				s.shadows.clear();
+				s.shadow_rays.clear();
+				s.shadow_hits.clear();
+
+				for (size_t k = 0; k < s.active.size(); ++k)
+				{
+					Path & path = s.paths[s.active[k]];
+
+					path.intersect.t = t_max;
+					if (closest_hit(scene, s.rays[k], s.hits[k], s.instances[k], path.intersect) == false) continue;
+
+					s.shaded.push_back(s.active[k]);
+
+					const Intersection & intersect = path.intersect;
+					const Material &     mat       = intersect.mat;
+
+					switch (mat.type)
+					{
+						case MaterialType::DIFFUSE:
+						{
+							const float r2 = path.rand();
+
+							path.d = jitter(intersect.N, 2.0f * PI * path.rand(), std::sqrt(r2), std::sqrt(1.0f - r2)) * (1.0f - mat.metalness);
+
+							for (uint32_t i = 0; i < SPHERE_COUNT; ++i)
+							{
+								const Sphere & sphere = spheres[i];
+
+								if (sphere.mat.emissive == glm::vec3(0.0f)) continue;
+
+								const float t = glm::length(sphere.P - intersect.P) - sphere.r;
+
+								const glm::vec3 l0        = sphere.P - intersect.P;
+								const float     cos_a_max = std::sqrt(1.0f - glm::clamp(sphere.r * sphere.r / glm::dot(l0, l0), 0.0f, 1.0f));
+								const float     cosa      = glm::mix(cos_a_max, 1.0f, path.rand());
+								const glm::vec3 L         = jitter(l0, 2.0f * PI * path.rand(), std::sqrt(1.0f - cosa * cosa), cosa);
+
+								s.shadows.push_back({ s.active[k], i, t, L });
+								s.shadow_rays.push_back(Ray{ intersect.P, L });
+								s.shadow_hits.push_back(Hit{ t });
+							}
+							break;
+						}
+						case MaterialType::DIELECTRIC:
+						{
+							path.acc  += mat.emissive * path.mask;
+							path.mask *= mat.albedo;
+
+							const Ray & ray = path.ray;
+
+							const float nint   = mat.roughness;
+							const float cosine = -glm::dot(ray.dir, intersect.N) / glm::length(ray.dir);
+
+							const glm::vec3 reflected = glm::reflect(ray.dir, intersect.N);
+							const glm::vec3 refracted = glm::refract(ray.dir, intersect.N, nint);
+
+							const float probability_of_reflection = (refracted == glm::vec3(0.0f)) ? 1.0f : schlick(cosine, mat.roughness);
+
+							path.ray = Ray{ intersect.P, glm::normalize(path.rand() < probability_of_reflection ? reflected : refracted) };
+						}
+					}
+				}
+
+				s.shadow_instances.resize(s.shadow_rays.size());
+
+				start = std::chrono::steady_clock::now();
+
+				trace_triangles(scene, info.simd_level, RayBatch::COHERENT, s.shadow_rays.data(), s.shadow_hits.data(), s.shadow_instances.data(), s.shadow_rays.size(), s.trace);
+
+				s.trace_time += std::chrono::steady_clock::now() - start;
+				s.ray_count  += s.shadow_rays.size();
+
+				// Light the diffuse hits and pick up where the shader left off
+
+				size_t shadow = 0;
+
+				s.active.clear();
+
+				for (const uint32_t p : s.shaded)
+				{
+					Path & path = s.paths[p];
+
+					const Intersection & intersect = path.intersect;
+					const Material &     mat       = intersect.mat;
+
+					if (mat.type == MaterialType::DIFFUSE)
+					{
+						glm::vec3 e(0.0f);
+
+						for (; shadow < s.shadows.size() && s.shadows[shadow].path == p; ++shadow)
+						{
+							const ShadowRay & shadow_ray = s.shadows[shadow];
+
+							Intersection shadow_intersection;
+							shadow_intersection.t = shadow_ray.t;
+							if (closest_hit(scene, s.shadow_rays[shadow], s.shadow_hits[shadow], s.shadow_instances[shadow], shadow_intersection) == false)
+							{
+								e += sphere_light(frame, mat, intersect.P, intersect.N, shadow_ray.L, spheres[shadow_ray.sphere], shadow_ray.t);
+							}
+						}
+
+						// Normalize emissive value if present, otherwise set to zero
+						const glm::vec3 emissive = all_positive(mat.emissive) ? glm::normalize(mat.emissive) : glm::vec3(0.0f);
+
+						path.acc  += path.mask * (emissive + e);
+						path.mask *= mat.albedo;
+						path.ray   = Ray{ intersect.P, glm::normalize(glm::reflect(path.ray.dir, intersect.N) + path.d) };
+					}
+
+					const float probality_of_termination = max3(path.mask);
+
+					if (path.rand() > probality_of_termination) continue;
+
+					path.mask *= 1.0f / probality_of_termination;
+
+					s.active.push_back(p);
+				}
+			}
+
+			for (auto & path : s.paths)
+			{
+				path.accum += path.acc;
+			}
+		}
+
+		for (auto & path : s.paths)
+		{
+			glm::vec3 accum = path.accum / static_cast<float>(SAMPLES);
+
+			// The device leaves this to the fullscreen pass, which sees only the traced image
+
+			accum = accum / (accum + glm::vec3(1.0f));
+			accum = glm::pow(accum, glm::vec3(1.0f / 2.2f));
+
+			const glm::vec3 color = glm::clamp(accum + path.rand() / 64.0f, 0.0f, 1.0f);
+
+			// Unorm conversion, as the rgba8 storage image does on store
+
+			uint8_t * pixel = &pixels[(static_cast<size_t>(path.y) * info.width + path.x) * 4];
+
+			pixel[0] = static_cast<uint8_t>(std::lround(color.r * 255.0f));
+			pixel[1] = static_cast<uint8_t>(std::lround(color.g * 255.0f));
+			pixel[2] = static_cast<uint8_t>(std::lround(color.b * 255.0f));
+			pixel[3] = 255;
+		}
+	}
+
+	/**
+	 * @brief One worker's share of the tiles.  The owner pops from the front, thieves take from the back
+	 */
+	struct TileQueue
+	{
+		std::mutex mutex;
+
+		std::deque<uint32_t> tiles;
+	};
+
+	unsigned int resolve_thread_count(const CPUTraceInfo & info)
+	{
+		return info.thread_count != 0 ? info.thread_count : std::max(std::thread::hardware_concurrency(), 1u);
+	}
+}
+
+CPUScene build_cpu_scene(const Mesh * meshes, size_t mesh_count, const Instance * instances, size_t instance_count)
+{
+	CPUScene scene;
+
+	scene.blas.resize(mesh_count);
+	scene.wide4.resize(mesh_count);
+	scene.wide8.resize(mesh_count);
+	scene.tris.resize(mesh_count);
+	scene.normals.resize(mesh_count);
+
+	for (size_t i = 0; i < mesh_count; ++i)
+	{
+		scene.blas[i]  = build_bvh(meshes[i].triangles, meshes[i].triangle_count);
+		scene.wide4[i] = collapse_wide_bvh<4>(scene.blas[i]);
+		scene.wide8[i] = collapse_wide_bvh<8>(scene.blas[i]);
+
+		for (const auto & tri : reorder_triangles(scene.blas[i], meshes[i].triangles))
+		{
+			scene.tris[i].push_back(precompute_triangle(tri));
+			scene.normals[i].push_back(face_normal(tri));
+		}
+	}
+
+	// Instance bounds as GraphicsDevice computes them, from the eight transformed corners of the mesh's root box
+
+	std::vector<AABB> bounds(instance_count);
+
+	for (size_t i = 0; i < instance_count; ++i)
+	{
+		const BVHNode & root = scene.blas[instances[i].mesh].nodes[0];
+
+		if (AABB{ root.aabb_min, root.aabb_max }.empty())
+		{
+			bounds[i].grow(instances[i].transform[3]);
+			continue;
+		}
+
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			const glm::vec3 p
+			{
+				(corner & 1) ? root.aabb_max.x : root.aabb_min.x,
+				(corner & 2) ? root.aabb_max.y : root.aabb_min.y,
+				(corner & 4) ? root.aabb_max.z : root.aabb_min.z
+			};
+
+			bounds[i].grow(instances[i].transform * glm::vec4(p, 1.0f));
+		}
+	}
+
+	BVHBuildInfo build_info;
+
+	build_info.thread_count = 1;
+
+	scene.tlas = build_bvh(bounds.data(), bounds.size(), build_info);
+
+	for (const uint32_t idx : scene.tlas.tri_indices)
+	{
+		const Instance & instance = instances[idx];
+
+		// Rows of the inverse are the columns of its transpose
+
+		const glm::mat4 world_to_object = glm::transpose(glm::inverse(glm::mat4(instance.transform)));
+
+		scene.instances.push_back({ { world_to_object[0], world_to_object[1], world_to_object[2] }, instance.mesh });
+	}
+
+	return scene;
+}
+
+std::vector<uint8_t> trace_cpu(const CPUScene & scene, const FrameData & frame_data, const CPUTraceInfo & info, CPUTraceStats * stats)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	std::vector<uint8_t> pixels(static_cast<size_t>(info.width) * info.height * 4);
+
+	const uint32_t tiles_x = (info.width + info.tile_size - 1) / info.tile_size;
+	const uint32_t tiles_y = (info.height + info.tile_size - 1) / info.tile_size;
+
+	const uint32_t tile_count = tiles_x * tiles_y;
+
+	const unsigned int thread_count = std::min(resolve_thread_count(info), std::max(tile_count, 1u));
+
+	// Deal contiguous runs of tiles, so each worker starts on a coherent patch of the image
+
+	std::vector<TileQueue> queues(thread_count);
+
+	for (uint32_t tile = 0; tile < tile_count; ++tile)
+	{
+		queues[static_cast<uint64_t>(tile) * thread_count / tile_count].tiles.push_back(tile);
+	}
+
+	std::atomic<uint64_t> rays{ 0 };
+	std::atomic<uint64_t> stolen{ 0 };
+
+	std::mutex trace_time_mutex;
+
+	std::chrono::steady_clock::duration trace_time{};
+
+	const auto next_tile = [&](unsigned int self, uint32_t & tile)
+	{
+		{
+			std::lock_guard<std::mutex> lock(queues[self].mutex);
+
+			if (queues[self].tiles.empty() == false)
+			{
+				tile = queues[self].tiles.front();
+				queues[self].tiles.pop_front();
+
+				return true;
+			}
+		}
+
+		// Tiles are never added once work starts, so finding every queue empty means the frame is done
+
+		for (unsigned int k = 1; k < thread_count; ++k)
+		{
+			TileQueue & victim = queues[(self + k) % thread_count];
+
+			std::lock_guard<std::mutex> lock(victim.mutex);
+
+			if (victim.tiles.empty() == false)
+			{
+				tile = victim.tiles.back();
+				victim.tiles.pop_back();
+
+				++stolen;
+
+				return true;
+			}
+		}
+
+		return false;
+	};
+
+	const auto worker = [&](unsigned int self)
+	{
+		TileScratch scratch;
+
+		for (uint32_t tile; next_tile(self, tile);)
+		{
+			const unsigned int x0 = (tile % tiles_x) * info.tile_size;
+			const unsigned int y0 = (tile / tiles_x) * info.tile_size;
+
+			const unsigned int x1 = std::min(x0 + info.tile_size, info.width);
+			const unsigned int y1 = std::min(y0 + info.tile_size, info.height);
+
+			trace_tile(scene, frame_data, info, x0, y0, x1, y1, scratch, pixels.data());
+		}
+
+		rays += scratch.ray_count;
+
+		std::lock_guard<std::mutex> lock(trace_time_mutex);
+
+		trace_time += scratch.trace_time;
+	};
+
+	std::vector<std::thread> threads;
+
+	for (unsigned int t = 1; t < thread_count; ++t)
+	{
+		threads.emplace_back(worker, t);
+	}
+
+	worker(0);
+
+	for (auto & thread : threads)
+	{
+		thread.join();
+	}
+
+	if (stats)
+	{
+		stats->rays          += rays;
+		stats->stolen_tiles  += stolen;
+		stats->seconds       += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		stats->trace_seconds += std::chrono::duration<double>(trace_time).count();
+	}
+
+	return pixels;
+}
+
+bool write_ppm(const char * path, const uint8_t * rgba, unsigned int width, unsigned int height)
+{
+	std::FILE * file = std::fopen(path, "wb");
+
+	if (file == nullptr) return false;
+
+	std::fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+	std::vector<uint8_t> row(static_cast<size_t>(width) * 3);
+
+	// The fullscreen pass samples the traced image upside down, so its last row is the top of the screen
+
+	for (unsigned int y = height; y-- > 0;)
+	{
+		for (unsigned int x = 0; x < width; ++x)
+		{
+			const uint8_t * pixel = &rgba[(static_cast<size_t>(y) * width + x) * 4];
+
+			row[x * 3 + 0] = pixel[0];
+			row[x * 3 + 1] = pixel[1];
+			row[x * 3 + 2] = pixel[2];
+		}
+
+		std::fwrite(row.data(), 1, row.size(), file);
+	}
+
+	return std::fclose(file) == 0;
+}
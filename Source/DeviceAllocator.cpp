@@ -0,0 +1,688 @@
+#include "DeviceAllocator.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+namespace
+{
+	constexpr uint32_t NONE = UINT32_MAX;
+
+	/// @brief Largest block a default pool allocates at once.  Smaller heaps get an eighth of their size
+	constexpr VkDeviceSize MAX_BLOCK_SIZE = VkDeviceSize(256) << 20;
+
+	/// @brief Free space left over after an allocation is only split off as its own region from this size on
+	constexpr VkDeviceSize MIN_SPLIT_SIZE = 256;
+
+	uint32_t highest_bit(uint64_t value)
+	{
+		uint32_t bit = 0;
+
+		while (value >>= 1) ++bit;
+
+		return bit;
+	}
+
+	/**
+	 * @note `value` must not be zero
+	 */
+	uint32_t lowest_bit(uint64_t value)
+	{
+		uint32_t bit = 0;
+
+		while ((value & 1) == 0)
+		{
+			value >>= 1;
+			++bit;
+		}
+
+		return bit;
+	}
+
+	VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	uint32_t bit_count(uint32_t value)
+	{
+		uint32_t count = 0;
+
+		for (; value; value &= value - 1) ++count;
+
+		return count;
+	}
+
+	double mebibytes(VkDeviceSize size)
+	{
+		return static_cast<double>(size) / (1 << 20);
+	}
+
+	const char * strategy_name(AllocationStrategy strategy)
+	{
+		switch (strategy)
+		{
+		case AllocationStrategy::TLSF:   return "tlsf";
+		case AllocationStrategy::LINEAR: return "linear";
+		case AllocationStrategy::POOL:   return "pool";
+		}
+
+		return "";
+	}
+}
+
+void DeviceAllocator::Init(VkPhysicalDevice physical_device, VkDevice device)
+{
+	this->physical_device = physical_device;
+	this->device          = device;
+
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+	max_allocation_count = properties.limits.maxMemoryAllocationCount;
+}
+
+void DeviceAllocator::Destroy()
+{
+	for (Pool & pool : pools)
+	{
+		uint32_t leaked = 0;
+
+		for (Block & block : pool.blocks)
+		{
+			if (block.memory == VK_NULL_HANDLE) continue;
+
+			leaked += block.allocation_count;
+
+			vkFreeMemory(device, block.memory, nullptr);
+		}
+
+		if (leaked > 0)
+		{
+			std::cout << "[app] - err :: " << leaked << " allocations still live in " << pool.info.name << " pool" << std::endl;
+		}
+	}
+
+	pools.clear();
+	default_pools.clear();
+
+	block_count = 0;
+}
+
+uint32_t DeviceAllocator::CreatePool(const PoolInfo & info)
+{
+	Pool pool;
+
+	pool.info        = info;
+	pool.memory_type = NONE;
+
+	pools.push_back(std::move(pool));
+
+	return static_cast<uint32_t>(pools.size() - 1);
+}
+
+bool DeviceAllocator::Allocate(const VkMemoryRequirements & reqs, VkMemoryPropertyFlags properties, ResourceKind kind, DeviceAllocation & allocation)
+{
+	const uint32_t memory_type = FindMemoryType(reqs.memoryTypeBits, properties);
+
+	if (memory_type == NONE)
+	{
+		std::cout << "[app] - err :: Failed to find suitable memory type" << std::endl;
+		return false;
+	}
+
+	const uint32_t key = 2 * memory_type + static_cast<uint32_t>(kind);
+
+	auto it = default_pools.find(key);
+
+	if (it == default_pools.end())
+	{
+		PoolInfo info;
+
+		info.name       = kind == ResourceKind::IMAGE ? "image" : "buffer";
+		info.kind       = kind;
+		info.properties = properties;
+
+		const uint32_t pool = CreatePool(info);
+
+		pools[pool].memory_type = memory_type;
+
+		it = default_pools.emplace(key, pool).first;
+	}
+
+	return Allocate(it->second, reqs, allocation);
+}
+
+bool DeviceAllocator::Allocate(uint32_t pool_index, const VkMemoryRequirements & reqs, DeviceAllocation & allocation)
+{
+	Pool & pool = pools[pool_index];
+
+	if (pool.memory_type == NONE)
+	{
+		pool.memory_type = FindMemoryType(reqs.memoryTypeBits, pool.info.properties);
+
+		if (pool.memory_type == NONE)
+		{
+			std::cout << "[app] - err :: Failed to find suitable memory type for " << pool.info.name << " pool" << std::endl;
+			return false;
+		}
+	}
+	else if ((reqs.memoryTypeBits & (1u << pool.memory_type)) == 0)
+	{
+		std::cout << "[app] - err :: Resource cannot live in the memory type of " << pool.info.name << " pool" << std::endl;
+		return false;
+	}
+
+	if (pool.info.strategy == AllocationStrategy::POOL)
+	{
+		if (pool.slot_stride == 0)
+		{
+			pool.slot_stride = align_up(std::max<VkDeviceSize>(pool.info.slot_size, 1), reqs.alignment);
+		}
+
+		if (reqs.size > pool.slot_stride || pool.slot_stride % reqs.alignment != 0)
+		{
+			std::cout << "[app] - err :: Resource does not fit the slots of " << pool.info.name << " pool" << std::endl;
+			return false;
+		}
+	}
+
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	uint32_t     region;
+
+	uint32_t block_index = NONE;
+
+	for (uint32_t i = 0; i < pool.blocks.size(); ++i)
+	{
+		Block & block = pool.blocks[i];
+
+		if (block.memory != VK_NULL_HANDLE && place(pool, block, reqs, offset, size, region))
+		{
+			block_index = i;
+			break;
+		}
+	}
+
+	if (block_index == NONE)
+	{
+		// Worst case alignment padding is included, so the new block always fits
+
+		VkDeviceSize min_size = reqs.size + reqs.alignment;
+
+		if (pool.info.strategy == AllocationStrategy::TLSF) min_size = search_size(reqs.size, reqs.alignment);
+		if (pool.info.strategy == AllocationStrategy::POOL) min_size = pool.slot_stride;
+
+		block_index = create_block(pool, min_size);
+
+		if (block_index == NONE || place(pool, pool.blocks[block_index], reqs, offset, size, region) == false)
+		{
+			return false;
+		}
+	}
+
+	Block & block = pool.blocks[block_index];
+
+	block.allocation_count += 1;
+	block.used             += size;
+
+	allocation.memory = block.memory;
+	allocation.offset = offset;
+	allocation.size   = size;
+	allocation.mapped = block.mapped ? static_cast<char *>(block.mapped) + offset : nullptr;
+	allocation.pool   = pool_index;
+	allocation.block  = block_index;
+	allocation.region = region;
+
+	return true;
+}
+
+void DeviceAllocator::Free(DeviceAllocation & allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE) return;
+
+	Pool  & pool  = pools[allocation.pool];
+	Block & block = pool.blocks[allocation.block];
+
+	block.allocation_count -= 1;
+	block.used             -= allocation.size;
+
+	switch (pool.info.strategy)
+	{
+	case AllocationStrategy::TLSF:
+		tlsf_free(block, allocation.region);
+		break;
+
+	case AllocationStrategy::LINEAR:
+		if (block.allocation_count == 0) block.head = 0;
+		break;
+
+	case AllocationStrategy::POOL:
+		block.free_slots.push_back(static_cast<uint32_t>(allocation.offset / pool.slot_stride));
+		break;
+	}
+
+	// Empty blocks go back to the driver, unless it is the last one the pool has
+
+	if (block.allocation_count == 0)
+	{
+		const auto live = std::count_if(pool.blocks.begin(), pool.blocks.end(), [](const Block & b) { return b.memory != VK_NULL_HANDLE; });
+
+		if (live > 1) release_block(pool, allocation.block);
+	}
+
+	allocation = DeviceAllocation{};
+}
+
+uint32_t DeviceAllocator::FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const
+{
+	uint32_t best      = NONE;
+	uint32_t best_cost = NONE;
+
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i)
+	{
+		const VkMemoryPropertyFlags flags = memory_properties.memoryTypes[i].propertyFlags;
+
+		if ((type_filter & (1u << i)) == 0 || (flags & properties) != properties) continue;
+
+		const uint32_t cost = bit_count(flags & ~properties);
+
+		if (cost < best_cost)
+		{
+			best      = i;
+			best_cost = cost;
+		}
+	}
+
+	return best;
+}
+
+void DeviceAllocator::DumpStats(std::ostream & out) const
+{
+	VkDeviceSize total_reserved = 0;
+	VkDeviceSize total_used     = 0;
+
+	for (const Pool & pool : pools)
+	{
+		uint32_t     blocks      = 0;
+		uint32_t     allocations = 0;
+		uint32_t     free_ranges = 0;
+		VkDeviceSize reserved    = 0;
+		VkDeviceSize used        = 0;
+		VkDeviceSize largest     = 0;
+
+		for (const Block & block : pool.blocks)
+		{
+			if (block.memory == VK_NULL_HANDLE) continue;
+
+			blocks      += 1;
+			allocations += block.allocation_count;
+			reserved    += block.size;
+			used        += block.used;
+
+			switch (pool.info.strategy)
+			{
+			case AllocationStrategy::TLSF:
+				for (const Region & region : block.regions)
+				{
+					if (region.size == 0 || region.free == false) continue;
+
+					free_ranges += 1;
+					largest = std::max(largest, region.size);
+				}
+				break;
+
+			case AllocationStrategy::LINEAR:
+				free_ranges += 1;
+				largest = std::max(largest, block.size - block.head);
+				break;
+
+			case AllocationStrategy::POOL:
+				free_ranges += static_cast<uint32_t>(block.free_slots.size());
+				if (block.free_slots.empty() == false) largest = std::max(largest, pool.slot_stride);
+				break;
+			}
+		}
+
+		total_reserved += reserved;
+		total_used     += used;
+
+		out << "[app] - mem :: " << pool.info.name << " pool (" << strategy_name(pool.info.strategy) << ", memory type ";
+
+		if (pool.memory_type == NONE) out << "unset";
+		else                          out << pool.memory_type;
+
+		out << "): " << mebibytes(used) << " of " << mebibytes(reserved) << " MiB used by " << allocations
+			<< " allocations in " << blocks << " blocks, " << free_ranges << " free ranges, largest "
+			<< mebibytes(largest) << " MiB" << std::endl;
+	}
+
+	out << "[app] - mem :: " << mebibytes(total_used) << " of " << mebibytes(total_reserved) << " MiB used, in "
+		<< block_count << " of " << max_allocation_count << " device memory objects" << std::endl;
+}
+
+void DeviceAllocator::size_class(VkDeviceSize size, uint32_t & fl, uint32_t & sl)
+{
+	if (size < SL_COUNT)
+	{
+		fl = 0;
+		sl = static_cast<uint32_t>(size);
+		return;
+	}
+
+	const uint32_t msb = highest_bit(size);
+
+	fl = msb - SL_LOG2 + 1;
+	sl = static_cast<uint32_t>(size >> (msb - SL_LOG2)) - SL_COUNT;
+}
+
+VkDeviceSize DeviceAllocator::search_size(VkDeviceSize size, VkDeviceSize alignment)
+{
+	VkDeviceSize search = size + alignment - 1;
+
+	if (search >= SL_COUNT)
+	{
+		search += (VkDeviceSize(1) << (highest_bit(search) - SL_LOG2)) - 1;
+	}
+
+	return search;
+}
+
+uint32_t DeviceAllocator::create_block(Pool & pool, VkDeviceSize min_size)
+{
+	VkDeviceSize block_size = pool.info.block_size;
+
+	if (block_size == 0)
+	{
+		const uint32_t heap = memory_properties.memoryTypes[pool.memory_type].heapIndex;
+
+		block_size = std::min(MAX_BLOCK_SIZE, memory_properties.memoryHeaps[heap].size / 8);
+	}
+
+	if (pool.info.strategy == AllocationStrategy::POOL)
+	{
+		block_size = std::max(block_size / pool.slot_stride, VkDeviceSize(1)) * pool.slot_stride;
+	}
+
+	block_size = std::max(block_size, min_size);
+
+	VkMemoryAllocateInfo alloc_info{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+	alloc_info.allocationSize  = block_size;
+	alloc_info.memoryTypeIndex = pool.memory_type;
+
+	Block block;
+
+	if (vkAllocateMemory(device, &alloc_info, nullptr, &block.memory) != VK_SUCCESS)
+	{
+		std::cout << "[app] - err :: Failed to allocate " << mebibytes(block_size) << " MiB for " << pool.info.name << " pool" << std::endl;
+		return NONE;
+	}
+
+	block.size = block_size;
+
+	if (memory_properties.memoryTypes[pool.memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped);
+	}
+
+	switch (pool.info.strategy)
+	{
+	case AllocationStrategy::TLSF:
+		std::fill(std::begin(block.sl_bitmap), std::end(block.sl_bitmap), 0u);
+		std::fill(&block.heads[0][0], &block.heads[0][0] + FL_COUNT * SL_COUNT, NONE);
+
+		block.regions.push_back({0, block_size, NONE, NONE, NONE, NONE, true});
+
+		insert_free(block, 0);
+		break;
+
+	case AllocationStrategy::LINEAR:
+		break;
+
+	case AllocationStrategy::POOL:
+		for (uint32_t slot = static_cast<uint32_t>(block_size / pool.slot_stride); slot-- > 0;)
+		{
+			block.free_slots.push_back(slot);
+		}
+		break;
+	}
+
+	block_count += 1;
+
+	// Reuse the slot of a released block, so live allocations keep their block indices
+
+	for (uint32_t i = 0; i < pool.blocks.size(); ++i)
+	{
+		if (pool.blocks[i].memory == VK_NULL_HANDLE)
+		{
+			pool.blocks[i] = std::move(block);
+			return i;
+		}
+	}
+
+	pool.blocks.push_back(std::move(block));
+
+	return static_cast<uint32_t>(pool.blocks.size() - 1);
+}
+
+void DeviceAllocator::release_block(Pool & pool, uint32_t block)
+{
+	vkFreeMemory(device, pool.blocks[block].memory, nullptr);
+
+	pool.blocks[block] = Block{};
+
+	block_count -= 1;
+}
+
+bool DeviceAllocator::place(Pool & pool, Block & block, const VkMemoryRequirements & reqs, VkDeviceSize & offset, VkDeviceSize & size, uint32_t & region)
+{
+	switch (pool.info.strategy)
+	{
+	case AllocationStrategy::TLSF:
+		if (tlsf_allocate(block, reqs.size, reqs.alignment, region) == false) return false;
+
+		offset = block.regions[region].offset;
+		size   = block.regions[region].size;
+		return true;
+
+	case AllocationStrategy::LINEAR:
+		offset = align_up(block.head, reqs.alignment);
+
+		if (offset + reqs.size > block.size) return false;
+
+		block.head = offset + reqs.size;
+
+		size   = reqs.size;
+		region = NONE;
+		return true;
+
+	case AllocationStrategy::POOL:
+		if (block.free_slots.empty()) return false;
+
+		offset = block.free_slots.back() * pool.slot_stride;
+
+		block.free_slots.pop_back();
+
+		size   = pool.slot_stride;
+		region = NONE;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Finds a free region in the smallest size class guaranteed to hold `size` plus worst case alignment padding, so
+ * the search is two bitmap scans rather than a walk.  The padding and whatever the allocation leaves over are split
+ * back onto the free lists
+ */
+bool DeviceAllocator::tlsf_allocate(Block & block, VkDeviceSize size, VkDeviceSize alignment, uint32_t & region)
+{
+	uint32_t fl;
+	uint32_t sl;
+	size_class(search_size(size, alignment), fl, sl);
+
+	uint32_t sl_map = block.sl_bitmap[fl] & (~0u << sl);
+
+	if (sl_map == 0)
+	{
+		const uint64_t fl_map = fl + 1 < FL_COUNT ? block.fl_bitmap & (~uint64_t(0) << (fl + 1)) : 0;
+
+		if (fl_map == 0) return false;
+
+		fl     = lowest_bit(fl_map);
+		sl_map = block.sl_bitmap[fl];
+	}
+
+	sl = lowest_bit(sl_map);
+
+	region = block.heads[fl][sl];
+
+	remove_free(block, region);
+
+	// Split off the alignment padding in front.  The region before is never free, since free neighbours are merged
+
+	const VkDeviceSize padding = align_up(block.regions[region].offset, alignment) - block.regions[region].offset;
+
+	if (padding > 0)
+	{
+		const uint32_t front = new_region(block);
+
+		Region & r = block.regions[region];
+
+		block.regions[front] = {r.offset, padding, r.prev, region, NONE, NONE, true};
+
+		if (r.prev != NONE) block.regions[r.prev].next = front;
+
+		r.prev    = front;
+		r.offset += padding;
+		r.size   -= padding;
+
+		insert_free(block, front);
+	}
+
+	// Split off what is left over behind
+
+	if (block.regions[region].size - size >= MIN_SPLIT_SIZE)
+	{
+		const uint32_t back = new_region(block);
+
+		Region & r = block.regions[region];
+
+		block.regions[back] = {r.offset + size, r.size - size, region, r.next, NONE, NONE, true};
+
+		if (r.next != NONE) block.regions[r.next].prev = back;
+
+		r.next = back;
+		r.size = size;
+
+		insert_free(block, back);
+	}
+
+	block.regions[region].free = false;
+
+	return true;
+}
+
+void DeviceAllocator::tlsf_free(Block & block, uint32_t region)
+{
+	block.regions[region].free = true;
+
+	const uint32_t next = block.regions[region].next;
+
+	if (next != NONE && block.regions[next].free)
+	{
+		remove_free(block, next);
+
+		block.regions[region].size += block.regions[next].size;
+		block.regions[region].next  = block.regions[next].next;
+
+		if (block.regions[next].next != NONE) block.regions[block.regions[next].next].prev = region;
+
+		block.regions[next].size = 0;
+		block.spare_regions.push_back(next);
+	}
+
+	const uint32_t prev = block.regions[region].prev;
+
+	if (prev != NONE && block.regions[prev].free)
+	{
+		remove_free(block, prev);
+
+		block.regions[prev].size += block.regions[region].size;
+		block.regions[prev].next  = block.regions[region].next;
+
+		if (block.regions[region].next != NONE) block.regions[block.regions[region].next].prev = prev;
+
+		block.regions[region].size = 0;
+		block.spare_regions.push_back(region);
+
+		region = prev;
+	}
+
+	insert_free(block, region);
+}
+
+void DeviceAllocator::insert_free(Block & block, uint32_t region)
+{
+	Region & r = block.regions[region];
+
+	uint32_t fl;
+	uint32_t sl;
+	size_class(r.size, fl, sl);
+
+	r.prev_free = NONE;
+	r.next_free = block.heads[fl][sl];
+
+	if (r.next_free != NONE) block.regions[r.next_free].prev_free = region;
+
+	block.heads[fl][sl] = region;
+
+	block.fl_bitmap    |= uint64_t(1) << fl;
+	block.sl_bitmap[fl] |= 1u << sl;
+}
+
+void DeviceAllocator::remove_free(Block & block, uint32_t region)
+{
+	Region & r = block.regions[region];
+
+	uint32_t fl;
+	uint32_t sl;
+	size_class(r.size, fl, sl);
+
+	if (r.prev_free != NONE) block.regions[r.prev_free].next_free = r.next_free;
+	if (r.next_free != NONE) block.regions[r.next_free].prev_free = r.prev_free;
+
+	if (block.heads[fl][sl] == region)
+	{
+		block.heads[fl][sl] = r.next_free;
+
+		if (r.next_free == NONE)
+		{
+			block.sl_bitmap[fl] &= ~(1u << sl);
+
+			if (block.sl_bitmap[fl] == 0) block.fl_bitmap &= ~(uint64_t(1) << fl);
+		}
+	}
+
+	r.prev_free = NONE;
+	r.next_free = NONE;
+}
+
+uint32_t DeviceAllocator::new_region(Block & block)
+{
+	if (block.spare_regions.empty() == false)
+	{
+		const uint32_t region = block.spare_regions.back();
+
+		block.spare_regions.pop_back();
+
+		return region;
+	}
+
+	block.regions.push_back({});
+
+	return static_cast<uint32_t>(block.regions.size() - 1);
+}
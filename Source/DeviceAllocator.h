@@ -0,0 +1,228 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief How a pool places allocations within its blocks
+ */
+enum class AllocationStrategy
+{
+	TLSF,   //< Two-level segregated fit.  Any size, freed in any order, with neighbouring free space merged
+	LINEAR, //< Bump pointer.  Cheapest to allocate, but a block's space only returns once all of it is freed
+	POOL    //< Equal slots of `PoolInfo::slot_size`.  For many resources of one size, freed in any order
+};
+
+/**
+ * @brief What will be bound to an allocation.  Buffers and optimally tiled images are kept in separate blocks, so
+ *        `bufferImageGranularity` never has to be honoured between neighbours
+ */
+enum class ResourceKind
+{
+	BUFFER, //< Buffers, and linearly tiled images
+	IMAGE   //< Optimally tiled images
+};
+
+/**
+ * @brief Describes a pool created with `DeviceAllocator::CreatePool`
+ */
+struct PoolInfo
+{
+	/// @brief Shown by `DeviceAllocator::DumpStats`
+	const char * name = "pool";
+
+	AllocationStrategy strategy = AllocationStrategy::TLSF;
+
+	ResourceKind kind = ResourceKind::BUFFER;
+
+	/// @brief Required properties of the pool's memory type
+	VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+	/// @brief Bytes per `vkAllocateMemory`.  Zero picks a size from the heap's.  Larger allocations get a block of
+	/// their own
+	VkDeviceSize block_size = 0;
+
+	/// @brief Bytes per slot, for `AllocationStrategy::POOL` only
+	VkDeviceSize slot_size = 0;
+};
+
+/**
+ * @brief Part of a device memory block, bound to one buffer or image
+ */
+struct DeviceAllocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+
+	VkDeviceSize offset = 0;
+	VkDeviceSize size   = 0;
+
+	/// @brief Host address of `offset`, if the memory is host visible.  Blocks stay mapped for as long as they live,
+	/// so allocations sharing one never map it twice
+	void * mapped = nullptr;
+
+	/// @brief Where the allocator keeps track of it
+	uint32_t pool   = 0;
+	uint32_t block  = 0;
+	uint32_t region = 0;
+};
+
+/**
+ * @brief Sub-allocates buffers and images from a few large blocks of device memory, rather than giving each its own
+ *        `vkAllocateMemory`, which drivers cap at `maxMemoryAllocationCount` and which fragments memory
+ *
+ * Blocks belong to pools, each bound to one memory type and one strategy.  Allocations which name no pool go to a
+ * TLSF pool kept per memory type and resource kind
+ *
+ * @note Single threaded
+ */
+struct DeviceAllocator final
+{
+	void Init(VkPhysicalDevice physical_device, VkDevice device);
+
+	/**
+	 * @brief Frees every block, reporting pools which still have allocations in them
+	 */
+	void Destroy();
+
+	/**
+	 * @return Index of the new pool, to pass to `Allocate`
+	 */
+	uint32_t CreatePool(const PoolInfo & info);
+
+	/**
+	 * @brief Allocates from the default pool of the best memory type with `properties`
+	 *
+	 * @return False if no memory type fits or the device is out of memory, in which case `allocation` is untouched
+	 */
+	bool Allocate(const VkMemoryRequirements & reqs, VkMemoryPropertyFlags properties, ResourceKind kind, DeviceAllocation & allocation);
+
+	/**
+	 * @brief Allocates from a pool made by `CreatePool`.  Its memory type is fixed by the first allocation
+	 */
+	bool Allocate(uint32_t pool, const VkMemoryRequirements & reqs, DeviceAllocation & allocation);
+
+	/**
+	 * @brief Returns an allocation to its pool and clears it.  Freeing a cleared allocation does nothing
+	 */
+	void Free(DeviceAllocation & allocation);
+
+	/**
+	 * @brief Memory type with every one of `properties` and as few others as possible, so host-visible allocations
+	 *        avoid scarce device-local host-visible memory when there is a plain alternative
+	 *
+	 * @return UINT32_MAX if none fits
+	 */
+	uint32_t FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+
+	/**
+	 * @brief Writes each pool's blocks, usage and fragmentation, then the device memory objects in use overall
+	 */
+	void DumpStats(std::ostream & out) const;
+
+private:
+
+	/// @brief Second-level subdivisions of each power of two, and the first levels needed to cover 64-bit sizes
+	static constexpr uint32_t SL_LOG2  = 4;
+	static constexpr uint32_t SL_COUNT = 1u << SL_LOG2;
+	static constexpr uint32_t FL_COUNT = 64 - SL_LOG2 + 1;
+
+	/**
+	 * @brief Span of a TLSF block, either allocated or on one of the free lists
+	 */
+	struct Region
+	{
+		VkDeviceSize offset;
+		VkDeviceSize size;
+
+		/// @brief Physical neighbours, by address
+		uint32_t prev;
+		uint32_t next;
+
+		/// @brief Neighbours on the free list of this region's size class
+		uint32_t prev_free;
+		uint32_t next_free;
+
+		bool free;
+	};
+
+	/**
+	 * @brief One `vkAllocateMemory`.  Null `memory` marks a slot whose block was released
+	 */
+	struct Block
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize   size   = 0;
+
+		void * mapped = nullptr;
+
+		uint32_t     allocation_count = 0;
+		VkDeviceSize used             = 0;
+
+		/// @brief TLSF: regions by index, indices of released regions to reuse, and the segregated free lists
+		std::vector<Region>   regions;
+		std::vector<uint32_t> spare_regions;
+		uint64_t              fl_bitmap = 0;
+		uint32_t              sl_bitmap[FL_COUNT];
+		uint32_t              heads[FL_COUNT][SL_COUNT];
+
+		/// @brief LINEAR: first byte not yet handed out
+		VkDeviceSize head = 0;
+
+		/// @brief POOL: slots not in use
+		std::vector<uint32_t> free_slots;
+	};
+
+	struct Pool
+	{
+		PoolInfo info;
+
+		/// @brief UINT32_MAX until the first allocation picks it
+		uint32_t memory_type;
+
+		/// @brief POOL: distance between slots, `slot_size` rounded up to the first allocation's alignment
+		VkDeviceSize slot_stride = 0;
+
+		std::vector<Block> blocks;
+	};
+
+	/**
+	 * @brief First and second level of the free lists holding regions of `size`
+	 */
+	static void size_class(VkDeviceSize size, uint32_t & fl, uint32_t & sl);
+
+	/**
+	 * @brief Size whose class only holds regions which fit `size` bytes at `alignment`, however they are aligned
+	 */
+	static VkDeviceSize search_size(VkDeviceSize size, VkDeviceSize alignment);
+
+	uint32_t create_block(Pool & pool, VkDeviceSize min_size);
+	void     release_block(Pool & pool, uint32_t block);
+
+	bool place(Pool & pool, Block & block, const VkMemoryRequirements & reqs, VkDeviceSize & offset, VkDeviceSize & size, uint32_t & region);
+
+	bool tlsf_allocate(Block & block, VkDeviceSize size, VkDeviceSize alignment, uint32_t & region);
+	void tlsf_free(Block & block, uint32_t region);
+
+	void     insert_free(Block & block, uint32_t region);
+	void     remove_free(Block & block, uint32_t region);
+	uint32_t new_region(Block & block);
+
+	VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+	VkDevice         device          = VK_NULL_HANDLE;
+
+	VkPhysicalDeviceMemoryProperties memory_properties;
+
+	uint32_t max_allocation_count;
+
+	std::vector<Pool> pools;
+
+	/// @brief Default pool of each memory type and resource kind, keyed by `2 * memory_type + kind`
+	std::unordered_map<uint32_t, uint32_t> default_pools;
+
+	/// @brief Live `vkAllocateMemory`s, across every pool
+	uint32_t block_count = 0;
+};
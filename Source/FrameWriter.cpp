@@ -0,0 +1,470 @@
+#include <FrameWriter.h>
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	/**
+	 * @brief CRC-32 as PNG chunks use it, continuing from `crc`
+	 */
+	uint32_t crc32(uint32_t crc, const uint8_t * data, size_t size)
+	{
+		static const auto table = []
+		{
+			std::vector<uint32_t> table(256);
+
+			for (uint32_t n = 0; n < 256; ++n)
+			{
+				uint32_t c = n;
+
+				for (int k = 0; k < 8; ++k)
+				{
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				}
+
+				table[n] = c;
+			}
+
+			return table;
+		}();
+
+		crc = ~crc;
+
+		for (size_t i = 0; i < size; ++i)
+		{
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		}
+
+		return ~crc;
+	}
+
+	void put_u32_be(std::vector<uint8_t> & out, uint32_t value)
+	{
+		out.push_back(static_cast<uint8_t>(value >> 24));
+		out.push_back(static_cast<uint8_t>(value >> 16));
+		out.push_back(static_cast<uint8_t>(value >> 8));
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	template<typename T>
+	void put_le(std::vector<uint8_t> & out, T value)
+	{
+		uint8_t bytes[sizeof(T)];
+		std::memcpy(bytes, &value, sizeof(T));
+
+		// OpenEXR is little-endian, as is every target this builds for
+		out.insert(out.end(), bytes, bytes + sizeof(T));
+	}
+
+	void put_chunk(std::vector<uint8_t> & out, const char type[4], const std::vector<uint8_t> & data)
+	{
+		put_u32_be(out, static_cast<uint32_t>(data.size()));
+
+		const size_t start = out.size();
+
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data.begin(), data.end());
+
+		put_u32_be(out, crc32(0, out.data() + start, out.size() - start));
+	}
+
+	void put_exr_attribute(std::vector<uint8_t> & out, const char * name, const char * type, const std::vector<uint8_t> & value)
+	{
+		out.insert(out.end(), name, name + std::strlen(name) + 1);
+		out.insert(out.end(), type, type + std::strlen(type) + 1);
+
+		put_le<int32_t>(out, static_cast<int32_t>(value.size()));
+
+		out.insert(out.end(), value.begin(), value.end());
+	}
+
+	bool write_file(const char * path, const void * bytes, size_t size)
+	{
+		FILE * file = std::fopen(path, "wb");
+
+		if (file == nullptr) return false;
+
+		const bool written = std::fwrite(bytes, 1, size, file) == size;
+
+		return std::fclose(file) == 0 && written;
+	}
+
+	/**
+	 * @brief Reinhard, gamma and quantization, matching Fullscreen.frag without its filter
+	 */
+	uint8_t tonemap(uint16_t half)
+	{
+		const float linear = std::max(glm::unpackHalf1x16(half), 0.0f);
+
+		const float mapped = std::pow(linear / (linear + 1.0f), 1.0f / 2.2f);
+
+		return static_cast<uint8_t>(std::min(mapped * 255.0f + 0.5f, 255.0f));
+	}
+
+	bool ends_with(const std::string & str, const char * suffix)
+	{
+		const size_t length = std::strlen(suffix);
+
+		return str.size() >= length && str.compare(str.size() - length, length, suffix) == 0;
+	}
+
+	/**
+	 * @brief Splits a file name pattern around its one integer conversion, unescaping `%%` on either side
+	 *
+	 * @return False if the pattern holds no conversion, more than one, or one which is not a plain integer
+	 */
+	bool parse_pattern(const std::string & pattern, std::string & prefix, std::string & suffix, size_t & width, bool & zero_pad)
+	{
+		prefix.clear();
+		suffix.clear();
+
+		width    = 0;
+		zero_pad = false;
+
+		bool converted = false;
+
+		for (size_t i = 0; i < pattern.size(); ++i)
+		{
+			std::string & out = converted ? suffix : prefix;
+
+			if (pattern[i] != '%')
+			{
+				out += pattern[i];
+				continue;
+			}
+
+			if (++i == pattern.size()) return false;
+
+			if (pattern[i] == '%')
+			{
+				out += '%';
+				continue;
+			}
+
+			if (converted) return false;
+
+			if (pattern[i] == '0')
+			{
+				zero_pad = true;
+				++i;
+			}
+
+			for (; i < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[i])); ++i)
+			{
+				width = 10 * width + (pattern[i] - '0');
+
+				if (width > 64) return false;
+			}
+
+			while (i < pattern.size() && std::strchr("hlzjt", pattern[i]) != nullptr)
+			{
+				++i;
+			}
+
+			if (i == pattern.size() || std::strchr("diu", pattern[i]) == nullptr) return false;
+
+			converted = true;
+		}
+
+		return converted;
+	}
+}
+
+bool write_png(const char * path, const uint8_t * rgba, unsigned int width, unsigned int height)
+{
+	// Every row is prefixed with filter type 0, then the lot is wrapped in a zlib stream of stored blocks
+
+	const size_t row_size = 4 * static_cast<size_t>(width) + 1;
+
+	std::vector<uint8_t> raw(row_size * height);
+
+	for (size_t y = 0; y < height; ++y)
+	{
+		raw[y * row_size] = 0;
+
+		std::memcpy(&raw[y * row_size + 1], rgba + 4 * width * y, row_size - 1);
+	}
+
+	std::vector<uint8_t> zlib{ 0x78, 0x01 };
+
+	for (size_t offset = 0; offset < raw.size() || offset == 0; )
+	{
+		const size_t block = std::min<size_t>(raw.size() - offset, 65535);
+
+		zlib.push_back(offset + block == raw.size() ? 1 : 0);
+
+		zlib.push_back(static_cast<uint8_t>(block));
+		zlib.push_back(static_cast<uint8_t>(block >> 8));
+		zlib.push_back(static_cast<uint8_t>(~block));
+		zlib.push_back(static_cast<uint8_t>(~block >> 8));
+
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + block);
+
+		offset += block;
+
+		if (block == 0) break;
+	}
+
+	uint32_t a = 1;
+	uint32_t b = 0;
+
+	for (const uint8_t byte : raw)
+	{
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	put_u32_be(zlib, (b << 16) | a);
+
+	std::vector<uint8_t> header;
+
+	put_u32_be(header, width);
+	put_u32_be(header, height);
+
+	header.push_back(8); // Bit depth
+	header.push_back(6); // RGBA
+	header.push_back(0); // Deflate
+	header.push_back(0); // Adaptive filtering
+	header.push_back(0); // Not interlaced
+
+	std::vector<uint8_t> png{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+	put_chunk(png, "IHDR", header);
+	put_chunk(png, "IDAT", zlib);
+	put_chunk(png, "IEND", {});
+
+	return write_file(path, png.data(), png.size());
+}
+
+bool write_exr(const char * path, const uint16_t * rgba, unsigned int width, unsigned int height)
+{
+	std::vector<uint8_t> exr;
+
+	put_le<uint32_t>(exr, 20000630); // Magic
+	put_le<uint32_t>(exr, 2);        // Single-part scanline image
+
+	// Channels are stored in alphabetical order, each as half floats sampled at every pixel
+
+	const char channel_names[] = { 'A', 'B', 'G', 'R' };
+	const int  channel_offsets[] = { 3, 2, 1, 0 };
+
+	std::vector<uint8_t> channels;
+
+	for (const char name : channel_names)
+	{
+		channels.push_back(static_cast<uint8_t>(name));
+		channels.push_back(0);
+
+		put_le<int32_t>(channels, 1); // HALF
+		put_le<int32_t>(channels, 0); // pLinear and reserved
+		put_le<int32_t>(channels, 1); // xSampling
+		put_le<int32_t>(channels, 1); // ySampling
+	}
+
+	channels.push_back(0);
+
+	std::vector<uint8_t> window;
+
+	put_le<int32_t>(window, 0);
+	put_le<int32_t>(window, 0);
+	put_le<int32_t>(window, static_cast<int32_t>(width) - 1);
+	put_le<int32_t>(window, static_cast<int32_t>(height) - 1);
+
+	std::vector<uint8_t> aspect;
+	put_le<float>(aspect, 1.0f);
+
+	std::vector<uint8_t> center;
+	put_le<float>(center, 0.0f);
+	put_le<float>(center, 0.0f);
+
+	put_exr_attribute(exr, "channels", "chlist", channels);
+	put_exr_attribute(exr, "compression", "compression", { 0 });
+	put_exr_attribute(exr, "dataWindow", "box2i", window);
+	put_exr_attribute(exr, "displayWindow", "box2i", window);
+	put_exr_attribute(exr, "lineOrder", "lineOrder", { 0 });
+	put_exr_attribute(exr, "pixelAspectRatio", "float", aspect);
+	put_exr_attribute(exr, "screenWindowCenter", "v2f", center);
+	put_exr_attribute(exr, "screenWindowWidth", "float", aspect);
+
+	exr.push_back(0);
+
+	// Offset table, then one uncompressed scanline per chunk: its y, its size, and each channel's run of pixels
+
+	const uint32_t line_size = 4 * sizeof(uint16_t) * width;
+
+	uint64_t offset = exr.size() + sizeof(uint64_t) * height;
+
+	for (unsigned int y = 0; y < height; ++y)
+	{
+		put_le<uint64_t>(exr, offset);
+
+		offset += 2 * sizeof(int32_t) + line_size;
+	}
+
+	for (unsigned int y = 0; y < height; ++y)
+	{
+		put_le<int32_t>(exr, static_cast<int32_t>(y));
+		put_le<uint32_t>(exr, line_size);
+
+		for (const int channel : channel_offsets)
+		{
+			for (size_t x = 0; x < width; ++x)
+			{
+				put_le<uint16_t>(exr, rgba[4 * (width * y + x) + channel]);
+			}
+		}
+	}
+
+	return write_file(path, exr.data(), exr.size());
+}
+
+bool FrameWriter::Start(const std::string & pattern, size_t max_queued)
+{
+	if (parse_pattern(pattern, prefix, suffix, index_width, zero_pad) == false) return false;
+
+	this->pattern    = pattern;
+	this->max_queued = max_queued;
+
+	stopping = false;
+
+	thread = std::thread(&FrameWriter::Run, this);
+
+	return true;
+}
+
+void FrameWriter::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		stopping = true;
+	}
+
+	wake.notify_one();
+
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+}
+
+bool FrameWriter::Push(CapturedFrame && frame)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (queue.size() >= max_queued)
+		{
+			++dropped;
+			return false;
+		}
+
+		queue.push_back(std::move(frame));
+	}
+
+	wake.notify_one();
+
+	return true;
+}
+
+uint64_t FrameWriter::Written() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	return written;
+}
+
+uint64_t FrameWriter::Dropped() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	return dropped;
+}
+
+void FrameWriter::Run()
+{
+	std::vector<uint16_t> flipped;
+
+	std::vector<uint8_t> mapped;
+
+	for (;;)
+	{
+		CapturedFrame frame;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			wake.wait(lock, [this] { return stopping || queue.empty() == false; });
+
+			if (queue.empty()) return;
+
+			frame = std::move(queue.front());
+
+			queue.pop_front();
+		}
+
+		// Captured rows are in the order the tracer wrote them, the bottom of the screen first
+
+		const size_t row_size = 4 * static_cast<size_t>(frame.width);
+
+		flipped.resize(row_size * frame.height);
+
+		for (size_t y = 0; y < frame.height; ++y)
+		{
+			std::memcpy(&flipped[row_size * y], &frame.rgba[row_size * (frame.height - 1 - y)], row_size);
+		}
+
+		std::string index = std::to_string(frame.index);
+
+		if (index.size() < index_width)
+		{
+			index.insert(0, index_width - index.size(), zero_pad ? '0' : ' ');
+		}
+
+		const std::string path_string = prefix + index + suffix;
+
+		const char * path = path_string.c_str();
+
+		bool success;
+
+		if (ends_with(pattern, ".png"))
+		{
+			mapped.resize(flipped.size());
+
+			std::transform(flipped.begin(), flipped.end(), mapped.begin(), tonemap);
+
+			// Alpha is not tonemapped
+			for (size_t i = 3; i < mapped.size(); i += 4)
+			{
+				mapped[i] = 255;
+			}
+
+			success = write_png(path, mapped.data(), frame.width, frame.height);
+		}
+		else if (ends_with(pattern, ".exr"))
+		{
+			success = write_exr(path, flipped.data(), frame.width, frame.height);
+		}
+		else
+		{
+			success = write_file(path, flipped.data(), sizeof(uint16_t) * flipped.size());
+		}
+
+		if (success == false)
+		{
+			std::cout << "[app] - err :: Failed to write " << path << std::endl;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (success) ++written;
+	}
+}
@@ -1,14 +1,18 @@
 #include <GraphicsDevice.h>
+#include <BVH.h>
+#include <Util.hpp>
 #include "VulkanState.h"
 
 #include <GLFW/glfw3.h>
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <fstream>
 #include <iostream>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -69,1279 +73,4378 @@ namespace
 		VK_SHADER_STAGE_VERTEX_BIT,
 		VK_SHADER_STAGE_FRAGMENT_BIT
 	};
+
+	/// @brief Device BVH refits allowed between full rebuilds.  The device tree's SAH cost never reaches the host,
+	/// so its quality is bounded by refit count instead
+	constexpr unsigned int LBVH_REFITS_PER_REBUILD = 8;
+
+	/// @brief Workgroups of 256 invocations launched by the persistent-threads tracer.  Vulkan cannot report how
+	/// many compute units a device has, so this is sized to keep even large devices busy
+	constexpr uint32_t PERSISTENT_WORKGROUPS = 512;
+
+	/// @brief Passed as a pool to `create_buffer` to allocate from the allocator's default pool instead
+	constexpr uint32_t DEFAULT_POOL = UINT32_MAX;
+
+	/// @brief Bytes of host-visible memory scene uploads pass through.  Larger uploads are split, waiting for earlier
+	/// parts to be copied out before later ones are written in
+	constexpr VkDeviceSize STAGING_RING_SIZE = VkDeviceSize(16) << 20;
+
+	/// @brief Alignment of every upload in the staging ring, the largest any scene structure asks for
+	constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+	/// @brief Pipeline cache kept between runs, relative to the working directory like the shader binaries
+	constexpr const char * PIPELINE_CACHE_PATH = "PipelineCache.bin";
+
+	/// @brief Bytes in a VK_PIPELINE_CACHE_HEADER_VERSION_ONE header: its size, its version, the vendor and device IDs,
+	/// then the pipeline cache UUID
+	constexpr size_t PIPELINE_CACHE_HEADER_SIZE = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+
+	/// @brief Sizes of `spheres` and `planes` in Tracer.glsl, which trace settings cannot exceed
+	constexpr uint32_t MAX_SPHERES = 4;
+	constexpr uint32_t MAX_PLANES  = 5;
+
+	/// @brief Sizes of `PathState` and `Queue` in Wavefront.glsl
+	constexpr VkDeviceSize WAVEFRONT_PATH_SIZE  = 128;
+	constexpr VkDeviceSize WAVEFRONT_QUEUE_SIZE = 4 * sizeof(uint32_t);
+
+	/// @brief Number of queues in Wavefront.glsl, and the index of each
+	constexpr uint32_t WAVEFRONT_QUEUE_COUNT   = 3;
+	constexpr uint32_t WAVEFRONT_QUEUE_EXTEND  = 0;
+	constexpr uint32_t WAVEFRONT_QUEUE_SHADE   = 1;
+	constexpr uint32_t WAVEFRONT_QUEUE_CONNECT = 2;
+
+	/// @brief Most frames of history Temporal.comp keeps while the view moves.  More smooths noise further, but
+	/// lets shading that changed linger
+	constexpr uint32_t TEMPORAL_HISTORY_FRAMES = 9;
+
+	/// @brief Push constants of Temporal.comp
+	struct TemporalData
+	{
+		alignas(16) CameraData previous_camera;
+
+		alignas(4) float aspect_ratio;
+
+		alignas(4) uint32_t history_frames;
+
+		alignas(4) uint32_t clip_history;
+	};
+
+	/// @brief À-trous iterations run by the denoiser.  Their reach doubles each time, so five cover 61 pixels
+	constexpr uint32_t ATROUS_ITERATIONS = 5;
+
+	/// @brief Push constants of Atrous.comp
+	struct AtrousData
+	{
+		uint32_t iteration;
+		uint32_t iteration_count;
+	};
 }
 
-uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties)
+/**
+ * @brief Create a buffer object and bind it to memory sub-allocated from `state.allocator`
+ *
+ * @param size        Size of the buffer in bytes
+ * @param usage       How the buffer will be used
+ * @param properties  Required properties of the backing memory.  Ignored when `pool` is given
+ * @param buffer      Receives the buffer handle
+ * @param memory      Receives the allocation
+ * @param pool        Allocator pool to take the memory from, rather than the default pool for `properties`
+ */
+void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, DeviceAllocation & memory, uint32_t pool = DEFAULT_POOL)
 {
-	VkPhysicalDeviceMemoryProperties mem_properties;
-	vkGetPhysicalDeviceMemoryProperties(state.physicalDevice, &mem_properties);
+	VkBufferCreateInfo buffer_info{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
 
-	for (unsigned int i = 0; i < mem_properties.memoryTypeCount; ++i)
+	buffer_info.size  = size;
+	buffer_info.usage = usage;
+
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	vkCreateBuffer(state.device, &buffer_info, nullptr, &buffer);
+
+	VkMemoryRequirements mem_reqs;
+	vkGetBufferMemoryRequirements(state.device, buffer, &mem_reqs);
+
+	if (pool == DEFAULT_POOL)
 	{
-		if ((type_filter & (1 << i)) && (mem_properties.memoryTypes[i].propertyFlags & properties) == properties)
-		{
-			return i;
-		}
+		state.allocator.Allocate(mem_reqs, properties, ResourceKind::BUFFER, memory);
+	}
+	else
+	{
+		state.allocator.Allocate(pool, mem_reqs, memory);
 	}
 
-	std::cout << "Failed to find suitable memory type" << std::endl;
-	return 0;
+	vkBindBufferMemory(state.device, buffer, memory.memory, memory.offset);
 }
 
 /**
- * @brief Create a raster pipeline object
- *
- * @param vert_path  Path to a compiled vertex shader binary
- * @param frag_path  Path to a compiled fragment shader binary
+ * @brief Copy host data into host-visible memory, `offset` bytes in.  Host-visible blocks stay mapped, so this is
+ *        only a copy
+ */
+void upload_to_memory(const DeviceAllocation & memory, const void * data, size_t size, VkDeviceSize offset = 0)
+{
+	if (size == 0) return;
+
+	memcpy(static_cast<char *>(memory.mapped) + offset, data, size);
+}
+
+void destroy_buffer(Buffer & buffer)
+{
+	vkDestroyBuffer(state.device, buffer.buffer, nullptr);
+	state.allocator.Free(buffer.memory);
+}
+
+/**
+ * @brief Create a device-local image with a view of all of it, in `state.render_target_pool`
  *
- * @return RasterPipeline  Pipeline state object (PSO) containing pipeline and layout
+ * @param extent  Zero for the size of the traced images
  *
- * @todo Descriptors
+ * @note The image is left in the undefined layout
  */
-RasterPipeline create_raster_pipeline(const char * vert_path, const char * frag_path)
+Image create_image(VkFormat format, VkImageUsageFlags usage, VkExtent2D extent = {})
 {
-	RasterPipeline pso;
+	Image image;
 
-	const auto vert_shader_code = ReadFile(vert_path);
-	const auto frag_shader_code = ReadFile(frag_path);
+	VkImageCreateInfo image_info{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
 
-	VkShaderModuleCreateInfo vert_module_info{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
-	vert_module_info.codeSize = vert_shader_code.size();
-	vert_module_info.pCode    = reinterpret_cast<const uint32_t *>(vert_shader_code.data());
+	image_info.imageType = VK_IMAGE_TYPE_2D;
+	image_info.format    = format;
+	image_info.tiling    = VK_IMAGE_TILING_OPTIMAL;
+	image_info.usage     = usage;
+	image_info.samples   = VK_SAMPLE_COUNT_1_BIT;
 
-	VkShaderModule vert_shader_module;
-	vkCreateShaderModule(state.device, &vert_module_info, nullptr, &vert_shader_module);
+	image_info.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+	image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-	VkShaderModuleCreateInfo frag_module_info{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
-	frag_module_info.codeSize = frag_shader_code.size();
-	frag_module_info.pCode    = reinterpret_cast<const uint32_t *>(frag_shader_code.data());
+	if (extent.width == 0)
+	{
+		extent = { state.RAYTRACE_RESOLUTION, state.RAYTRACE_RESOLUTION };
+	}
 
-	VkShaderModule frag_shader_module;
-	vkCreateShaderModule(state.device, &frag_module_info, nullptr, &frag_shader_module);
+	image_info.extent = { extent.width, extent.height, 1 };
 
-	VkPipelineShaderStageCreateInfo vert_shader_info{VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
-	vert_shader_info.stage  = VK_SHADER_STAGE_VERTEX_BIT;
-	vert_shader_info.module = vert_shader_module;
-	vert_shader_info.pName  = "main";
+	image_info.mipLevels   = 1;
+	image_info.arrayLayers = 1;
 
-	VkPipelineShaderStageCreateInfo frag_shader_info{VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
-	frag_shader_info.stage  = VK_SHADER_STAGE_FRAGMENT_BIT;
-	frag_shader_info.module = frag_shader_module;
-	frag_shader_info.pName  = "main";
+	vkCreateImage(state.device, &image_info, nullptr, &image.image);
 
-	VkPipelineShaderStageCreateInfo shader_stages[] { vert_shader_info, frag_shader_info };
+	VkMemoryRequirements mem_reqs;
+	vkGetImageMemoryRequirements(state.device, image.image, &mem_reqs);
 
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 0;
-	vertexInputInfo.vertexAttributeDescriptionCount = 0;
+	state.allocator.Allocate(state.render_target_pool, mem_reqs, image.memory);
 
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
+	vkBindImageMemory(state.device, image.image, image.memory.memory, image.memory.offset);
 
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float) state.swapchain.extent.width;
-	viewport.height = (float) state.swapchain.extent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
+	VkImageViewCreateInfo view_info{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
 
-	VkRect2D scissor{};
-	scissor.offset = {0, 0};
-	scissor.extent = state.swapchain.extent;
+	view_info.image    = image.image;
+	view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_info.format   = format;
 
-	VkPipelineViewportStateCreateInfo viewportState = {};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
-	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
+	view_info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 
-	VkPipelineRasterizationStateCreateInfo rasterizer = {};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = VK_CULL_MODE_FRONT_BIT;
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	rasterizer.depthBiasEnable = VK_FALSE;
+	vkCreateImageView(state.device, &view_info, nullptr, &image.view);
 
-	VkPipelineMultisampleStateCreateInfo multisampling = {};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	return image;
+}
 
-	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_FALSE;
+void destroy_image(Image & image)
+{
+	vkDestroyImageView(state.device, image.view, nullptr);
+	vkDestroyImage(state.device, image.image, nullptr);
+	state.allocator.Free(image.memory);
+}
 
-	VkPipelineColorBlendStateCreateInfo colorBlending = {};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable = VK_FALSE;
-	colorBlending.logicOp = VK_LOGIC_OP_COPY;
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-	colorBlending.blendConstants[0] = 0.0f;
-	colorBlending.blendConstants[1] = 0.0f;
-	colorBlending.blendConstants[2] = 0.0f;
-	colorBlending.blendConstants[3] = 0.0f;
+/**
+ * @brief Block until the device has finished frame `frame`, and every frame before it.  Frame zero never waits
+ */
+void wait_for_frame(uint64_t frame)
+{
+	if (frame <= state.timeline.completed) return;
 
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-	pipelineLayoutInfo.setLayoutCount = 1;
-	pipelineLayoutInfo.pSetLayouts    = &state.graphics_descset_layout;
+	VkSemaphoreWaitInfoKHR wait_info{VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR};
 
-	vkCreatePipelineLayout(state.device, &pipelineLayoutInfo, nullptr, &pso.layout);
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores    = &state.timeline.semaphore;
+	wait_info.pValues        = &frame;
 
-	VkGraphicsPipelineCreateInfo pipelineInfo = {};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount = 2;
-	pipelineInfo.pStages = shader_stages;
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pRasterizationState = &rasterizer;
-	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.layout = pso.layout;
-	pipelineInfo.renderPass = state.render_pass;
-	pipelineInfo.subpass = 0;
-	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	state.wait_semaphores(state.device, &wait_info, std::numeric_limits<uint64_t>::max());
 
-	vkCreateGraphicsPipelines(state.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pso.pipeline);
+	state.timeline.completed = frame;
+}
 
-	vkDestroyShaderModule(state.device, frag_shader_module, nullptr);
-	vkDestroyShaderModule(state.device, vert_shader_module, nullptr);
+/**
+ * @brief Last frame the device has finished, without waiting
+ */
+uint64_t completed_frame()
+{
+	state.get_semaphore_counter_value(state.device, state.timeline.semaphore, &state.timeline.completed);
 
-	return pso;
+	return state.timeline.completed;
 }
 
-GraphicsDevice::Error GraphicsDevice::Construct(const GraphicsDevice::CreateInfo & info)
+/**
+ * @brief Destroy a resource once every frame submitted so far is done with it, rather than waiting for them now
+ */
+void defer_destruction(std::function<void()> destroy)
 {
-	std::cerr << __LINE__ << std::endl;
+	state.timeline.destructions.push_back({ state.timeline.submitted, std::move(destroy) });
+}
 
-	// Create instance
+/**
+ * @brief Run the deferred destructions whose frames the device has finished
+ */
+void run_deferred_destructions()
+{
+	auto & destructions = state.timeline.destructions;
+
+	while (destructions.empty() == false && destructions.front().frame <= state.timeline.completed)
 	{
-		state.FRAMES_IN_FLIGHT    = info.framesInFlight;
-		state.RAYTRACE_RESOLUTION = info.raytrace_resolution;
+		destructions.front().destroy();
 
-		VkApplicationInfo appInfo{VK_STRUCTURE_TYPE_APPLICATION_INFO};
-		appInfo.pApplicationName   = "Square Demo";
-		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-		appInfo.pEngineName        = "VK Render Backend";
-		appInfo.engineVersion      = VK_MAKE_VERSION(1, 0, 0);
-		appInfo.apiVersion         = VK_API_VERSION_1_0;
+		destructions.pop_front();
+	}
+}
 
-		const char * extensionNames[]
-		{
-			VK_KHR_SURFACE_EXTENSION_NAME,
-			#ifdef WIN32
-			VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
-			#else
-			VK_KHR_XCB_SURFACE_EXTENSION_NAME,
-			#endif
-			VK_EXT_DEBUG_UTILS_EXTENSION_NAME
-		};
+/**
+ * @brief Create one of the scene buffers in every frame in flight's copy of the scene, as a device-local storage
+ *        buffer written only through the staging ring.  When transfers or tracing have their own queue family the
+ *        buffer is shared with it, so copies need no ownership transfers
+ */
+void create_scene_buffer(VkDeviceSize size, Buffer SceneBuffers::* member)
+{
+	std::vector<uint32_t> families
+	{
+		static_cast<uint32_t>(state.graphicsQueueIndex),
+		static_cast<uint32_t>(state.transferQueueIndex),
+		static_cast<uint32_t>(state.computeQueueIndex)
+	};
 
-		VkInstanceCreateInfo instanceInfo{VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO};
-		instanceInfo.pApplicationInfo        = &appInfo;
-		instanceInfo.enabledExtensionCount   = sizeof(extensionNames) / sizeof(extensionNames[0]);
-		instanceInfo.ppEnabledExtensionNames = extensionNames;
+	std::sort(families.begin(), families.end());
 
-		if (info.debug)
-		{
-			const char * layerNames[]
-			{
-				"VK_LAYER_LUNARG_standard_validation"
-			};
+	families.erase(std::unique(families.begin(), families.end()), families.end());
 
-			instanceInfo.enabledLayerCount   = sizeof(layerNames) / sizeof(layerNames[0]);
-			instanceInfo.ppEnabledLayerNames = layerNames;
-		}
+	VkBufferCreateInfo buffer_info{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
 
-		if (const auto res = vkCreateInstance(&instanceInfo, nullptr, &state.instance); res != VK_SUCCESS)
-		{
-			std::cout << "[app] - err :: Failed to create Vulkan instance (" << res << ")" << std::endl;
-			return Error::UNKNOWN;
-		}
-	}
+	buffer_info.size  = size;
+	buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
-	// Create surface
+	if (families.size() > 1)
 	{
-		if (glfwCreateWindowSurface(state.instance, info.window, nullptr, &state.surface) != VK_SUCCESS)
-		{
-			std::cout << "[app] - err :: Failed to create window surface" << std::endl;
-			return Error::UNKNOWN;
-		}
+		buffer_info.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+		buffer_info.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+		buffer_info.pQueueFamilyIndices   = families.data();
+	}
+	else
+	{
+		buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	}
 
-	// Choose physical device
+	for (auto & scene : state.scenes)
 	{
-		unsigned int availableDeviceCount = 0;
-		vkEnumeratePhysicalDevices(state.instance, &availableDeviceCount, nullptr);
+		Buffer & buffer = scene.*member;
 
-		if (availableDeviceCount == 0)
-		{
-			// We weren't able to find any GPUs on the system
-			return Error::NO_SUITABLE_GPU;
-		}
+		vkCreateBuffer(state.device, &buffer_info, nullptr, &buffer.buffer);
 
-		std::vector<VkPhysicalDevice> availableDevices{availableDeviceCount};
-		vkEnumeratePhysicalDevices(state.instance, &availableDeviceCount, availableDevices.data());
+		VkMemoryRequirements mem_reqs;
+		vkGetBufferMemoryRequirements(state.device, buffer.buffer, &mem_reqs);
 
-		const char * requiredExtensions[]
-		{
-			VK_KHR_SWAPCHAIN_EXTENSION_NAME
-		};
+		state.allocator.Allocate(mem_reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ResourceKind::BUFFER, buffer.memory);
 
-		// Attempt to find suitable GPU
+		vkBindBufferMemory(state.device, buffer.buffer, buffer.memory.memory, buffer.memory.offset);
+	}
+}
 
-		for (const auto & device : availableDevices)
-		{
-			unsigned int supportedExtensionCount = 0;
+/**
+ * @brief Wait for the oldest staging batch, then release its part of the ring and keep it for reuse
+ */
+void retire_staging_batch()
+{
+	StagingRing & ring = state.staging;
 
-			// Enumerate available GPU extensions
+	StagingBatch batch = ring.batches.front();
 
-			uint32_t availableExtensionCount;
-			vkEnumerateDeviceExtensionProperties(device, nullptr, &availableExtensionCount, nullptr);
-			std::vector<VkExtensionProperties> availableExtensions{availableExtensionCount};
-			vkEnumerateDeviceExtensionProperties(device, nullptr, &availableExtensionCount, availableExtensions.data());
+	ring.batches.pop_front();
 
-			// Check if GPU supports all of our required extensions
+	vkWaitForFences(state.device, 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	vkResetFences(state.device, 1, &batch.fence);
 
-			for (const auto & requiredExtension : requiredExtensions)
-			{
-				for (const auto & availableExtension : availableExtensions)
-				{
-					if (strcmp(requiredExtension, availableExtension.extensionName) == 0)
-					{
-						++supportedExtensionCount;
-						break;
-					}
-				}
-			}
+	ring.tail = batch.head;
 
-			if (supportedExtensionCount != (sizeof(requiredExtensions) / sizeof(requiredExtensions[0])))
-			{
-				// GPU doesn't support all of our required extensions
-				continue;
-			}
+	ring.spare_batches.push_back(batch);
+}
 
-			// At this point all checks have passed for the current device
+/**
+ * @brief Submit copies into one frame in flight's scene copy as one command buffer, with one copy command per
+ *        destination
+ *
+ * @param wait_value  Timeline value of the last frame to trace against the copy
+ * @param semaphore   Signalled once these copies and every batch submitted before them have landed.  May be null
+ * @param head        Ring position to release up to once the batch finishes
+ */
+void submit_staging_batch(const StagingCopy * copies, size_t count, uint64_t wait_value, VkSemaphore semaphore, uint64_t head)
+{
+	StagingRing & ring = state.staging;
 
-			state.physicalDevice = device;
-		}
+	if (ring.spare_batches.empty())
+	{
+		StagingBatch batch;
 
-		if (state.physicalDevice == VK_NULL_HANDLE)
-		{
-			// No suitable GPU was found on the system
-			return Error::NO_SUITABLE_GPU;
-		}
-	}
+		VkCommandBufferAllocateInfo alloc_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
 
-	// Create logical device
-	{
-		// Enumerate available GPU queue families
+		alloc_info.commandPool        = ring.command_pool;
+		alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		alloc_info.commandBufferCount = 1;
 
-		unsigned int queueFamilyCount = 0;
-		vkGetPhysicalDeviceQueueFamilyProperties(state.physicalDevice, &queueFamilyCount, nullptr);
-		std::vector<VkQueueFamilyProperties> queueFamilies{queueFamilyCount};
-		vkGetPhysicalDeviceQueueFamilyProperties(state.physicalDevice, &queueFamilyCount, queueFamilies.data());
+		vkAllocateCommandBuffers(state.device, &alloc_info, &batch.command_buffer);
 
-		// Retrieve queues from queue families
+		VkFenceCreateInfo fence_info{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
 
-		int queueIndex = 0;
-		for (const auto & queueFamily : queueFamilies)
-		{
-			if (queueFamily.queueCount == 0)
-			{
-				// Queue family does not contain any queues
-				continue;
-			}
+		vkCreateFence(state.device, &fence_info, nullptr, &batch.fence);
 
-			if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
-			{
-				state.graphicsQueueIndex = queueIndex;
-			}
+		ring.spare_batches.push_back(batch);
+	}
 
-			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(state.physicalDevice, queueIndex, state.surface, &presentSupport);
+	StagingBatch batch = ring.spare_batches.back();
 
-			if (presentSupport)
-			{
-				state.presentQueueIndex = queueIndex;
-			}
+	ring.spare_batches.pop_back();
 
-			if (state.graphicsQueueIndex && state.presentQueueIndex)
-			{
-				// All queues have been found; stop searching
-				break;
-			}
+	// Beginning resets the command buffer, since its pool allows individual resets
 
-			++queueIndex;
-		}
+	VkCommandBufferBeginInfo begin_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
 
-		std::vector<int> uniqueQueues;
-		uniqueQueues.push_back(state.graphicsQueueIndex);
-		uniqueQueues.push_back(state.presentQueueIndex);
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-		uniqueQueues.erase(std::unique(uniqueQueues.begin(), uniqueQueues.end()), uniqueQueues.end());
+	vkBeginCommandBuffer(batch.command_buffer, &begin_info);
 
-		std::vector<VkDeviceQueueCreateInfo> queueInfos;
+	// Batches may overlap on the queue, and a later one often rewrites what an earlier one wrote
 
-		const float queuePriority = 1.0f;
+	VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
 
-		for (const auto & queue : uniqueQueues)
-		{
-			VkDeviceQueueCreateInfo queueCreateInfo{VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 
-			queueCreateInfo.queueFamilyIndex = queue;
-			queueCreateInfo.queueCount       = 1;
-			queueCreateInfo.pQueuePriorities = &queuePriority;
+	vkCmdPipelineBarrier(batch.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 
-			queueInfos.push_back(queueCreateInfo);
-		}
+	std::vector<VkBufferCopy> regions;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		regions.push_back(copies[i].region);
 
-		const char * requiredExtensions[]
+		if (i + 1 == count || copies[i + 1].dst != copies[i].dst)
 		{
-			VK_KHR_SWAPCHAIN_EXTENSION_NAME
-		};
+			vkCmdCopyBuffer(batch.command_buffer, ring.buffer.buffer, copies[i].dst, static_cast<uint32_t>(regions.size()), regions.data());
 
-		VkPhysicalDeviceFeatures deviceFeatures{};
+			regions.clear();
+		}
+	}
 
-		VkDeviceCreateInfo createInfo{VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
+	vkEndCommandBuffer(batch.command_buffer);
 
-		createInfo.queueCreateInfoCount = queueInfos.size();
+	VkSubmitInfo submit_info{VK_STRUCTURE_TYPE_SUBMIT_INFO};
 
-		createInfo.pQueueCreateInfos = queueInfos.data();
-		createInfo.pEnabledFeatures  = &deviceFeatures;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers    = &batch.command_buffer;
 
-		createInfo.enabledExtensionCount   = sizeof(requiredExtensions) / sizeof(requiredExtensions[0]);
-		createInfo.ppEnabledExtensionNames = requiredExtensions;
+	// The transfer queue, rather than the host, waits for the frame to finish.  Frame zero is signalled at creation,
+	// so copies into a copy no frame has read yet never wait
 
-		if (info.debug)
-		{
-			const char * layerNames[]
-			{
-				"VK_LAYER_LUNARG_standard_validation"
-			};
+	const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
 
-			createInfo.enabledLayerCount   = sizeof(layerNames) / sizeof(layerNames[0]);
-			createInfo.ppEnabledLayerNames = layerNames;
-		}
+	const uint64_t signal_value = 0;
 
-		if (vkCreateDevice(state.physicalDevice, &createInfo, nullptr, &state.device) != VK_SUCCESS)
-		{
-			std::cout << "[app] - err :: Failed to create logical device" << std::endl;
-			return Error::UNKNOWN;
-		}
+	VkTimelineSemaphoreSubmitInfoKHR timeline_info{VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR};
 
-		vkGetDeviceQueue(state.device, state.graphicsQueueIndex, 0, &state.graphicsQueue);
+	timeline_info.waitSemaphoreValueCount = 1;
+	timeline_info.pWaitSemaphoreValues    = &wait_value;
 
-		vkGetDeviceQueue(state.device, state.presentQueueIndex, 0, &state.presentQueue);
-	}
+	submit_info.pNext = &timeline_info;
 
-	// Create command pool / buffers
-	{
-		VkCommandPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+	submit_info.waitSemaphoreCount = 1;
+	submit_info.pWaitSemaphores    = &state.timeline.semaphore;
+	submit_info.pWaitDstStageMask  = &wait_stage;
 
-		poolInfo.queueFamilyIndex = state.graphicsQueueIndex;
-		poolInfo.flags = 0;
+	if (semaphore != VK_NULL_HANDLE)
+	{
+		timeline_info.signalSemaphoreValueCount = 1;
+		timeline_info.pSignalSemaphoreValues    = &signal_value;
 
-		VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+		submit_info.signalSemaphoreCount = 1;
+		submit_info.pSignalSemaphores    = &semaphore;
+	}
 
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandBufferCount = 1;
+	vkQueueSubmit(state.transferQueue, 1, &submit_info, batch.fence);
 
-		state.commandPools.resize(state.FRAMES_IN_FLIGHT);
-		state.commandBuffers.resize(state.FRAMES_IN_FLIGHT);
+	batch.head = head;
 
-		for (unsigned char i = 0; i < state.FRAMES_IN_FLIGHT; ++i)
-		{
-			if (vkCreateCommandPool(state.device, &poolInfo, nullptr, &state.commandPools[i]) != VK_SUCCESS)
-			{
-				std::cout << "[app] - err :: Failed to create command pool" << std::endl;
-				return Error::UNKNOWN;
-			}
+	ring.batches.push_back(batch);
+}
 
-			allocInfo.commandPool = state.commandPools[i];
+/**
+ * @brief Submit every copy written into the staging ring since the last submission to the transfer queue, as one
+ *        batch per scene copy
+ *
+ * Each batch waits only for the last frame traced against its copy.  The next frame's copy goes first: the frame it
+ * was last read by is the oldest in flight, so those copies start soonest, and the next frame waits on nothing
+ * submitted after them.  Copies into the other frames' copies wait on the device for those frames, holding up no one
+ *
+ * @param semaphore  Signalled once the next frame's copy, and every batch submitted before it, has landed.  May be
+ *                   null
+ */
+void submit_staging(VkSemaphore semaphore)
+{
+	StagingRing & ring = state.staging;
 
-			if (vkAllocateCommandBuffers(state.device, &allocInfo, &state.commandBuffers[i]) != VK_SUCCESS)
-			{
-				std::cout << "[app] - err :: Failed to create command buffers" << std::endl;
-				return Error::UNKNOWN;
-			}
-		}
-	}
+	if (ring.copies.empty() && semaphore == VK_NULL_HANDLE) return;
 
-	// Create swapchain
+	while (ring.batches.empty() == false && vkGetFenceStatus(state.device, ring.batches.front().fence) == VK_SUCCESS)
 	{
-		// Enumerate available surface formats
+		retire_staging_batch();
+	}
 
-		unsigned int availableFormatCount;
-		vkGetPhysicalDeviceSurfaceFormatsKHR(state.physicalDevice, state.surface, &availableFormatCount, nullptr);
+	const uint32_t frame_count = static_cast<uint32_t>(state.scenes.size());
 
-		if (availableFormatCount == 0)
-		{
-			// Surface does not avail any supported pixel formats
-			return Error::NO_SUITABLE_SURFACE;
-		}
+	// Every scene copy reads the same part of the ring, so only the last batch submitted releases it
 
-		std::vector<VkSurfaceFormatKHR> availableFormats{availableFormatCount};
-		vkGetPhysicalDeviceSurfaceFormatsKHR(state.physicalDevice, state.surface, &availableFormatCount, availableFormats.data());
+	const uint64_t previous_head = ring.batches.empty() ? ring.tail : ring.batches.back().head;
 
-		// Choose optimal surface format
+	// Copies in the order they will be submitted, starting with the frame about to be drawn
 
-		if (availableFormats.size() == 1 && availableFormats[0].format == VK_FORMAT_UNDEFINED)
-		{
-			state.swapchain.surfaceFormat = {VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
-		}
+	const auto submit_order = [&](const StagingCopy & copy)
+	{
+		return (copy.scene + frame_count - state.currentFrame) % frame_count;
+	};
 
-		for (const auto & availableFormat : availableFormats)
-		{
-			if (availableFormat.format == VK_FORMAT_B8G8R8A8_UNORM && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
-			{
-				state.swapchain.surfaceFormat = availableFormat;
-			}
-		}
+	std::stable_sort(ring.copies.begin(), ring.copies.end(), [&](const StagingCopy & a, const StagingCopy & b)
+	{
+		return submit_order(a) != submit_order(b) ? submit_order(a) < submit_order(b) : a.dst < b.dst;
+	});
 
-		// Enumerate available present modes
+	size_t first = 0;
 
-		unsigned int availablePresentModeCount;
-		vkGetPhysicalDeviceSurfacePresentModesKHR(state.physicalDevice, state.surface, &availablePresentModeCount, nullptr);
+	for (uint32_t k = 0; k < frame_count; ++k)
+	{
+		const uint32_t scene = (state.currentFrame + k) % frame_count;
 
-		if (availablePresentModeCount == 0)
-		{
-			// Surface does not avail any supported present modes
-			return Error::NO_SUITABLE_SURFACE;
-		}
+		size_t last = first;
 
-		std::vector<VkPresentModeKHR> availablePresentModes{availablePresentModeCount};
-		vkGetPhysicalDeviceSurfacePresentModesKHR(state.physicalDevice, state.surface, &availablePresentModeCount, availablePresentModes.data());
+		while (last < ring.copies.size() && ring.copies[last].scene == scene) ++last;
 
-		// Choose optimal present mode
+		const VkSemaphore signal = k == 0 ? semaphore : VK_NULL_HANDLE;
 
-		VkPresentModeKHR bestMode = VK_PRESENT_MODE_FIFO_KHR;
+		if (last == first && signal == VK_NULL_HANDLE) continue;
 
-		for (const auto & presentMode : availablePresentModes)
-		{
-			if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
-			{
-				state.swapchain.presentMode = presentMode;
-			}
-			else if (presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR)
-			{
-				state.swapchain.presentMode = presentMode;
-			}
-		}
+		const uint64_t head = last == ring.copies.size() ? ring.head : previous_head;
 
-		// Enumerate available swap extents
+		submit_staging_batch(ring.copies.data() + first, last - first, state.scenes[scene].frame, signal, head);
 
-		VkSurfaceCapabilitiesKHR surfaceCapabilities;
-		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(state.physicalDevice, state.surface, &surfaceCapabilities);
+		first = last;
+	}
 
-		if (surfaceCapabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
-		{
-			state.swapchain.extent = surfaceCapabilities.currentExtent;
-		}
-		else
-		{
-			int width;
-			int height;
-			glfwGetFramebufferSize(info.window, &width, &height);
+	ring.copies.clear();
 
-			VkExtent2D actualExtent{static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+	ring.submitted = semaphore == VK_NULL_HANDLE;
+}
 
-			actualExtent.width  = std::clamp(actualExtent.width, surfaceCapabilities.minImageExtent.width, surfaceCapabilities.maxImageExtent.width);
-			actualExtent.height = std::clamp(actualExtent.height, surfaceCapabilities.minImageExtent.height, surfaceCapabilities.maxImageExtent.height);
+/**
+ * @brief Reserve `size` bytes of the staging ring, waiting for earlier batches to be copied out if it is full
+ *
+ * @note `size` must be at most half the ring, so a run of it always fits behind the wrap once the ring drains
+ *
+ * @return Offset of the reservation in the ring
+ */
+VkDeviceSize reserve_staging(VkDeviceSize size)
+{
+	StagingRing & ring = state.staging;
 
-			state.swapchain.extent = actualExtent;
-		}
+	size = (size + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
 
-		// Create swapchain
+	for (;;)
+	{
+		// Uploads are never split across the end of the ring, so one which would be skips to the start instead
 
-		unsigned int imageCount = info.swapchainSize == 0 ? surfaceCapabilities.minImageCount + 1 : info.swapchainSize;
+		const VkDeviceSize position = ring.head % ring.capacity;
+		const VkDeviceSize skip     = position + size > ring.capacity ? ring.capacity - position : 0;
 
-		if (info.swapchainSize != 0 && surfaceCapabilities.minImageCount > info.swapchainSize)
+		if (ring.head + skip + size - ring.tail <= ring.capacity)
 		{
-			imageCount = surfaceCapabilities.minImageCount;
+			ring.head += skip;
+
+			const VkDeviceSize offset = ring.head % ring.capacity;
+
+			ring.head += size;
+
+			return offset;
 		}
 
-		if (surfaceCapabilities.maxImageCount > 0 && imageCount > surfaceCapabilities.maxImageCount)
+		if (ring.batches.empty())
 		{
-			imageCount = surfaceCapabilities.maxImageCount;
+			submit_staging(VK_NULL_HANDLE);
 		}
 
-		VkSwapchainCreateInfoKHR createInfo{VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR};
-		createInfo.surface          = state.surface;
-		createInfo.minImageCount    = imageCount;
-		createInfo.imageFormat      = state.swapchain.surfaceFormat.format;
-		createInfo.imageColorSpace  = state.swapchain.surfaceFormat.colorSpace;
-		createInfo.imageExtent      = state.swapchain.extent;
-		createInfo.imageArrayLayers = 1;
-		createInfo.imageUsage       = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-		createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		createInfo.preTransform     = surfaceCapabilities.currentTransform;
-		createInfo.compositeAlpha   = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-		createInfo.presentMode      = state.swapchain.presentMode;
-		createInfo.clipped          = VK_TRUE;
+		retire_staging_batch();
+	}
+}
 
-		if (vkCreateSwapchainKHR(state.device, &createInfo, nullptr, &state.swapchain.swapchain) != VK_SUCCESS)
+/**
+ * @brief Write data into the staging ring, to be copied `dst_offset` bytes into `member` of every scene copy by the
+ *        next batches
+ *
+ * The copy lands before the next frame traces, without waiting for frames in flight now.  Uploads too large for the
+ * ring go in parts, each submitted once the ring fills.  The next frame then waits for those parts, and so for the
+ * frames in flight tracing against the other copies
+ */
+void stage_upload(Buffer SceneBuffers::* member, const void * data, VkDeviceSize size, VkDeviceSize dst_offset = 0)
+{
+	StagingRing & ring = state.staging;
+
+	const char * bytes = static_cast<const char *>(data);
+
+	while (size > 0)
+	{
+		const VkDeviceSize part   = std::min(size, ring.capacity / 2);
+		const VkDeviceSize offset = reserve_staging(part);
+
+		memcpy(static_cast<char *>(ring.buffer.memory.mapped) + offset, bytes, part);
+
+		for (uint32_t i = 0; i < state.scenes.size(); ++i)
 		{
-			return Error::NO_SUITABLE_SURFACE;
+			ring.copies.push_back({ (state.scenes[i].*member).buffer, i, { offset, dst_offset, part } });
 		}
 
-		// Retrieve swapchain images
+		bytes      += part;
+		dst_offset += part;
+		size       -= part;
+	}
+}
 
-		vkGetSwapchainImagesKHR(state.device, state.swapchain.swapchain, &imageCount, nullptr);
-		state.swapchain.images.resize(imageCount);
-		vkGetSwapchainImagesKHR(state.device, state.swapchain.swapchain, &imageCount, state.swapchain.images.data());
+/**
+ * @brief Create a descriptor set layout with `count` compute storage buffers, at bindings [0, count)
+ */
+VkDescriptorSetLayout create_storage_buffer_set_layout(uint32_t count)
+{
+	std::vector<VkDescriptorSetLayoutBinding> bindings(count);
 
-		// Create image views
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		bindings[i].binding    = i;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 
-		state.swapchain.imageViews.resize(state.swapchain.images.size());
+		bindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+	}
 
-		for (unsigned int i = 0; i < state.swapchain.imageViews.size(); ++i)
-		{
-			VkImageViewCreateInfo createInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+	VkDescriptorSetLayoutCreateInfo layout_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+	layout_info.bindingCount = count;
+	layout_info.pBindings    = bindings.data();
 
-			createInfo.image    = state.swapchain.images[i];
-			createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-			createInfo.format   = state.swapchain.surfaceFormat.format;
+	VkDescriptorSetLayout layout;
+	vkCreateDescriptorSetLayout(state.device, &layout_info, nullptr, &layout);
 
-			createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-			createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-			createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-			createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	return layout;
+}
 
-			createInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-			createInfo.subresourceRange.baseMipLevel   = 0;
-			createInfo.subresourceRange.levelCount     = 1;
-			createInfo.subresourceRange.baseArrayLayer = 0;
-			createInfo.subresourceRange.layerCount     = 1;
+/**
+ * @brief Allocate a single descriptor set holding `count` storage buffers from a pool of its own
+ */
+VkDescriptorSet allocate_storage_buffer_set(VkDescriptorSetLayout layout, uint32_t count, VkDescriptorPool & pool)
+{
+	VkDescriptorPoolSize pool_size{};
 
-			if (vkCreateImageView(state.device, &createInfo, nullptr, &state.swapchain.imageViews[i]) != VK_SUCCESS)
-			{
-				return Error::NO_SUITABLE_SURFACE;
-			}
-		}
+	pool_size.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_size.descriptorCount = count;
 
-		// Create semaphores
+	VkDescriptorPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
 
-		state.swapchain.imageAvailableSemaphores.resize(info.framesInFlight);
-		state.swapchain.renderFinishedSemaphores.resize(info.framesInFlight);
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes    = &pool_size;
+	pool_info.maxSets       = 1;
 
-		state.swapchain.frameFences.resize(info.framesInFlight);
+	vkCreateDescriptorPool(state.device, &pool_info, nullptr, &pool);
 
-		for (unsigned char i = 0; i < info.framesInFlight; ++i)
-		{
-			VkSemaphoreCreateInfo semaphoreInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+	VkDescriptorSetAllocateInfo alloc_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+	alloc_info.descriptorPool     = pool;
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts        = &layout;
 
-			VkFenceCreateInfo fenceInfo{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+	VkDescriptorSet set;
+	vkAllocateDescriptorSets(state.device, &alloc_info, &set);
 
-			fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	return set;
+}
 
-			if (vkCreateSemaphore(state.device, &semaphoreInfo, nullptr, &state.swapchain.imageAvailableSemaphores[i]) != VK_SUCCESS
-				|| vkCreateSemaphore(state.device, &semaphoreInfo, nullptr, &state.swapchain.renderFinishedSemaphores[i]) != VK_SUCCESS)
-			{
-				std::cout << "[app] - err :: Failed to create swapchain semaphores" << std::endl;
-				return Error::UNKNOWN;
-			}
+/**
+ * @brief Point a storage buffer binding at the whole of `buffer`
+ */
+void write_storage_buffer(VkDescriptorSet set, uint32_t binding, VkBuffer buffer)
+{
+	VkDescriptorBufferInfo buffer_info{};
 
-			if (vkCreateFence(state.device, &fenceInfo, nullptr, &state.swapchain.frameFences[i]) != VK_SUCCESS)
-			{
-				std::cout << "[app] - err :: Failed to create swapchain fence" << std::endl;
-				return Error::UNKNOWN;
-			}
-		}
-	}
+	buffer_info.buffer = buffer;
+	buffer_info.offset = 0;
+	buffer_info.range  = VK_WHOLE_SIZE;
 
-	// Create shader resources
-	{
-		state.traced_images.resize(state.FRAMES_IN_FLIGHT);
-		state.traced_image_memory.resize(state.FRAMES_IN_FLIGHT);
+	VkWriteDescriptorSet descriptor_write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+
+	descriptor_write.dstSet          = set;
+	descriptor_write.dstBinding      = binding;
+	descriptor_write.dstArrayElement = 0;
+	descriptor_write.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptor_write.descriptorCount = 1;
+	descriptor_write.pBufferInfo     = &buffer_info;
+
+	vkUpdateDescriptorSets(state.device, 1, &descriptor_write, 0, nullptr);
+}
+
+/**
+ * @brief Point a storage image binding at `view`, which must be in the general layout
+ */
+void write_storage_image(VkDescriptorSet set, uint32_t binding, VkImageView view)
+{
+	VkDescriptorImageInfo image_info{};
+
+	image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	image_info.imageView   = view;
+
+	VkWriteDescriptorSet descriptor_write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+
+	descriptor_write.dstSet          = set;
+	descriptor_write.dstBinding      = binding;
+	descriptor_write.dstArrayElement = 0;
+	descriptor_write.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	descriptor_write.descriptorCount = 1;
+	descriptor_write.pImageInfo      = &image_info;
+
+	vkUpdateDescriptorSets(state.device, 1, &descriptor_write, 0, nullptr);
+}
+
+/**
+ * @brief Create a compute pipeline layout with one descriptor set and an optional push constant block
+ */
+VkPipelineLayout create_compute_pipeline_layout(VkDescriptorSetLayout set_layout, uint32_t push_constant_size)
+{
+	VkPushConstantRange push_constant_range{};
+
+	push_constant_range.offset     = 0;
+	push_constant_range.size       = push_constant_size;
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo layout_info{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+
+	layout_info.setLayoutCount = 1;
+	layout_info.pSetLayouts    = &set_layout;
+
+	layout_info.pushConstantRangeCount = push_constant_size > 0 ? 1 : 0;
+	layout_info.pPushConstantRanges    = &push_constant_range;
+
+	VkPipelineLayout layout;
+	vkCreatePipelineLayout(state.device, &layout_info, nullptr, &layout);
+
+	return layout;
+}
+
+/**
+ * @brief Whether pipeline cache data was written by this device and driver.  Drivers change the pipeline cache UUID
+ *        whenever their old data would not be compatible, which covers driver updates
+ */
+bool valid_pipeline_cache(const std::vector<char> & data)
+{
+	if (data.size() < PIPELINE_CACHE_HEADER_SIZE) return false;
+
+	uint32_t header[4];
+	std::memcpy(header, data.data(), sizeof(header));
+
+	const uint32_t header_size    = header[0];
+	const uint32_t header_version = header[1];
+	const uint32_t vendor_id      = header[2];
+	const uint32_t device_id      = header[3];
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(state.physicalDevice, &properties);
+
+	return header_size >= PIPELINE_CACHE_HEADER_SIZE && header_size <= data.size()
+		&& header_version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& vendor_id == properties.vendorID
+		&& device_id == properties.deviceID
+		&& std::memcmp(data.data() + sizeof(header), properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+/**
+ * @brief Create the pipeline cache every pipeline is built through, seeded from `PIPELINE_CACHE_PATH` when it was
+ *        written by this device and driver.  Otherwise the cache starts empty
+ */
+VkPipelineCache create_pipeline_cache()
+{
+	std::vector<char> data;
+
+	std::ifstream file(PIPELINE_CACHE_PATH, std::ios::ate | std::ios::binary);
+
+	if (file.is_open())
+	{
+		data.resize(static_cast<size_t>(file.tellg()));
+
+		file.seekg(0);
+		file.read(data.data(), data.size());
+	}
+
+	if (data.empty() == false && valid_pipeline_cache(data) == false)
+	{
+		std::cout << "[app] - err :: Ignoring " << PIPELINE_CACHE_PATH << ", which another device or driver wrote" << std::endl;
+
+		data.clear();
+	}
+
+	VkPipelineCacheCreateInfo cache_info{VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+
+	cache_info.initialDataSize = data.size();
+	cache_info.pInitialData    = data.empty() ? nullptr : data.data();
+
+	VkPipelineCache cache;
+	vkCreatePipelineCache(state.device, &cache_info, nullptr, &cache);
+
+	return cache;
+}
+
+/**
+ * @brief Write the pipeline cache back to `PIPELINE_CACHE_PATH`, so the next run skips compiling what this one did
+ */
+void save_pipeline_cache(VkPipelineCache cache)
+{
+	size_t size = 0;
+	vkGetPipelineCacheData(state.device, cache, &size, nullptr);
+
+	std::vector<char> data(size);
+
+	if (size == 0 || vkGetPipelineCacheData(state.device, cache, &size, data.data()) != VK_SUCCESS) return;
+
+	std::ofstream file(PIPELINE_CACHE_PATH, std::ios::binary | std::ios::trunc);
+
+	file.write(data.data(), size);
+
+	if (file.good() == false)
+	{
+		std::cout << "[app] - err :: Failed to write " << PIPELINE_CACHE_PATH << std::endl;
+	}
+}
+
+/**
+ * @brief Create a compute pipeline object
+ *
+ * @param comp_path       Path to a compiled compute shader binary
+ * @param layout          Pipeline layout the shader was written against
+ * @param specialization  Values for the shader's specialization constants, or null to keep their defaults
+ *
+ * @return VkPipeline  Compute pipeline, with entry point `main`
+ */
+VkPipeline create_compute_pipeline(const char * comp_path, VkPipelineLayout layout, const VkSpecializationInfo * specialization = nullptr)
+{
+	const auto comp_shader_code = ReadFile(comp_path);
+
+	VkShaderModuleCreateInfo comp_module_info{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+	comp_module_info.codeSize = comp_shader_code.size();
+	comp_module_info.pCode    = reinterpret_cast<const uint32_t *>(comp_shader_code.data());
+
+	VkShaderModule comp_shader_module;
+	vkCreateShaderModule(state.device, &comp_module_info, nullptr, &comp_shader_module);
+
+	VkPipelineShaderStageCreateInfo compute_shader_info{VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
+
+	compute_shader_info.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+	compute_shader_info.module = comp_shader_module;
+	compute_shader_info.pName  = "main";
+
+	compute_shader_info.pSpecializationInfo = specialization;
+
+	VkComputePipelineCreateInfo compute_pipeline_info{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+
+	compute_pipeline_info.layout = layout;
+	compute_pipeline_info.stage  = compute_shader_info;
+
+	VkPipeline pipeline;
+	vkCreateComputePipelines(state.device, state.pipeline_cache, 1, &compute_pipeline_info, nullptr, &pipeline);
+
+	vkDestroyShaderModule(state.device, comp_shader_module, nullptr);
+
+	return pipeline;
+}
+
+/**
+ * @brief Fetch the variant of a tracer kernel specialized for the current trace settings, building it on first use
+ *
+ * @note Owned by `state.pipeline_variants`, so never destroy the result
+ */
+VkPipeline get_pipeline_variant(const std::string & comp_path, VkPipelineLayout layout)
+{
+	const TraceSettings & settings = state.trace_settings;
+
+	const std::string key = comp_path
+		+ ":" + std::to_string(settings.depth) + ":" + std::to_string(settings.samples)
+		+ ":" + std::to_string(settings.sphere_count) + ":" + std::to_string(settings.plane_count);
+
+	if (const auto it = state.pipeline_variants.find(key); it != state.pipeline_variants.end())
+	{
+		return it->second;
+	}
+
+	// Constant IDs as declared in Tracer.glsl
+
+	const VkSpecializationMapEntry entries[]
+	{
+		{ 0, offsetof(TraceSettings, depth),        sizeof(uint32_t) },
+		{ 1, offsetof(TraceSettings, samples),      sizeof(uint32_t) },
+		{ 2, offsetof(TraceSettings, sphere_count), sizeof(uint32_t) },
+		{ 3, offsetof(TraceSettings, plane_count),  sizeof(uint32_t) }
+	};
+
+	VkSpecializationInfo specialization{};
+
+	specialization.mapEntryCount = 4;
+	specialization.pMapEntries   = entries;
+	specialization.dataSize      = sizeof(TraceSettings);
+	specialization.pData         = &settings;
+
+	const VkPipeline pipeline = create_compute_pipeline(comp_path.c_str(), layout, &specialization);
+
+	state.pipeline_variants.emplace(key, pipeline);
+
+	return pipeline;
+}
+
+/**
+ * @brief Record a global memory barrier
+ */
+void memory_barrier(VkCommandBuffer command_buffer, VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access)
+{
+	VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+
+	barrier.srcAccessMask = src_access;
+	barrier.dstAccessMask = dst_access;
+
+	vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+/**
+ * @brief Make compute shader writes visible to the next compute dispatch
+ */
+void compute_barrier(VkCommandBuffer command_buffer)
+{
+	memory_barrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+/**
+ * @brief Record one side of handing a traced image between the compute and graphics queues, changing its layout
+ *
+ * Between two families, the releasing queue records the barrier against its own stages and the acquiring queue
+ * against its own, after waiting for the release.  Within one family a single barrier does both, so the release
+ * records nothing and the acquire the whole transition
+ */
+void transfer_traced_image(
+	VkCommandBuffer command_buffer, VkImage image, bool release,
+	int src_family, int dst_family,
+	VkImageLayout old_layout, VkImageLayout new_layout,
+	VkPipelineStageFlags src_stage, VkAccessFlags src_access,
+	VkPipelineStageFlags dst_stage, VkAccessFlags dst_access)
+{
+	VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+
+	barrier.oldLayout = old_layout;
+	barrier.newLayout = new_layout;
+
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+	barrier.image = image;
+
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	if (src_family != dst_family)
+	{
+		barrier.srcQueueFamilyIndex = static_cast<uint32_t>(src_family);
+		barrier.dstQueueFamilyIndex = static_cast<uint32_t>(dst_family);
+
+		// Each queue only sees its own side of the transfer.  The acquire starts from the stage its queue waited at
+
+		if (release)
+		{
+			dst_stage  = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			dst_access = 0;
+		}
+		else
+		{
+			src_stage  = dst_stage;
+			src_access = 0;
+		}
+	}
+	else if (release)
+	{
+		return;
+	}
+
+	barrier.srcAccessMask = src_access;
+	barrier.dstAccessMask = dst_access;
+
+	vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+/**
+ * @brief Create the radix sort pipelines, sized to sort up to `max_count` keys
+ *
+ * @note Bind the key and value buffers with `write_storage_buffer` at bindings 0 and 1, each holding two halves of
+ *       `max_count` entries
+ */
+RadixSorter create_radix_sorter(uint32_t max_count)
+{
+	RadixSorter sorter;
+
+	sorter.descset_layout  = create_storage_buffer_set_layout(4);
+	sorter.descset         = allocate_storage_buffer_set(sorter.descset_layout, 4, sorter.desc_pool);
+	sorter.pipeline_layout = create_compute_pipeline_layout(sorter.descset_layout, 3 * sizeof(uint32_t));
+
+	sorter.histogram_pipeline = create_compute_pipeline("../Assets/Compiled/RadixHistogram.comp.spv", sorter.pipeline_layout);
+	sorter.scan_pipeline      = create_compute_pipeline("../Assets/Compiled/RadixScan.comp.spv", sorter.pipeline_layout);
+	sorter.scatter_pipeline   = create_compute_pipeline("../Assets/Compiled/RadixScatter.comp.spv", sorter.pipeline_layout);
+
+	sorter.capacity = max_count;
+
+	const VkDeviceSize block_count = (std::max(max_count, 1u) + 255) / 256;
+
+	// Block histograms, then the total of each digit
+
+	create_buffer(256 * (block_count + 1) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sorter.histogram_buffer.buffer, sorter.histogram_buffer.memory);
+
+	const VkBufferUsageFlags count_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	create_buffer(4 * sizeof(uint32_t), count_usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sorter.count_buffer.buffer, sorter.count_buffer.memory);
+
+	write_storage_buffer(sorter.descset, 2, sorter.histogram_buffer.buffer);
+	write_storage_buffer(sorter.descset, 3, sorter.count_buffer.buffer);
+
+	return sorter;
+}
+
+void destroy_radix_sorter(RadixSorter & sorter)
+{
+	destroy_buffer(sorter.histogram_buffer);
+	destroy_buffer(sorter.count_buffer);
+
+	vkDestroyPipeline(state.device, sorter.histogram_pipeline, nullptr);
+	vkDestroyPipeline(state.device, sorter.scan_pipeline, nullptr);
+	vkDestroyPipeline(state.device, sorter.scatter_pipeline, nullptr);
+
+	vkDestroyPipelineLayout(state.device, sorter.pipeline_layout, nullptr);
+	vkDestroyDescriptorPool(state.device, sorter.desc_pool, nullptr);
+	vkDestroyDescriptorSetLayout(state.device, sorter.descset_layout, nullptr);
+}
+
+/**
+ * @brief Set the number of keys the next sort covers from the host, along with its indirect dispatch
+ */
+void record_radix_sort_count(VkCommandBuffer command_buffer, const RadixSorter & sorter, uint32_t count)
+{
+	// The previous sort may still be reading the count
+
+	memory_barrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+	const uint32_t sort_count[] { (count + 255) / 256, 1, 1, count };
+
+	vkCmdUpdateBuffer(command_buffer, sorter.count_buffer.buffer, 0, sizeof(sort_count), sort_count);
+
+	memory_barrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+/**
+ * @brief Record a sort of the keys counted in `count_buffer`, and their values, on their lowest `key_bits` bits
+ *
+ * Takes one pass per 8 bits of key.  Only the histogram and scatter passes scale with the keys, and both are
+ * dispatched indirectly from the count, so a sort sized on the device costs nothing past the keys it holds
+ *
+ * @return Offset of the half of the key and value buffers the sorted entries end up in, either 0 or the capacity
+ */
+uint32_t record_radix_sort(VkCommandBuffer command_buffer, const RadixSorter & sorter, uint32_t key_bits)
+{
+	const uint32_t passes = (key_bits + 7) / 8;
+
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sorter.pipeline_layout, 0, 1, &sorter.descset, 0, nullptr);
+
+	for (uint32_t pass = 0; pass < passes; ++pass)
+	{
+		const uint32_t in_offset  = pass % 2 == 0 ? 0 : sorter.capacity;
+		const uint32_t out_offset = pass % 2 == 0 ? sorter.capacity : 0;
+
+		const uint32_t sort_pass[] { 8 * pass, in_offset, out_offset };
+
+		vkCmdPushConstants(command_buffer, sorter.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(sort_pass), sort_pass);
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sorter.histogram_pipeline);
+		vkCmdDispatchIndirect(command_buffer, sorter.count_buffer.buffer, 0);
+
+		compute_barrier(command_buffer);
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sorter.scan_pipeline);
+		vkCmdDispatch(command_buffer, 256, 1, 1);
+
+		compute_barrier(command_buffer);
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sorter.scatter_pipeline);
+		vkCmdDispatchIndirect(command_buffer, sorter.count_buffer.buffer, 0);
+
+		compute_barrier(command_buffer);
+	}
+
+	return passes % 2 == 0 ? 0 : sorter.capacity;
+}
+
+/**
+ * @brief Create the device LBVH builder over the triangles in `scene_data_buffer`, with a descriptor set for each
+ *        frame in flight's copy of it
+ */
+LBVHBuilder create_lbvh_builder(uint32_t tri_count)
+{
+	LBVHBuilder builder;
+
+	const VkDeviceSize n = std::max(tri_count, 1u);
+
+	const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	create_buffer(6 * sizeof(uint32_t),            usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, builder.state_buffer.buffer,  builder.state_buffer.memory);
+	create_buffer(2 * n * sizeof(uint32_t),        usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, builder.key_buffer.buffer,    builder.key_buffer.memory);
+	create_buffer(2 * n * sizeof(uint32_t),        usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, builder.value_buffer.buffer,  builder.value_buffer.memory);
+	// LBVH nodes share the 32 byte footprint of BVHNode
+	create_buffer((2 * n - 1) * sizeof(BVHNode),   usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, builder.node_buffer.buffer,   builder.node_buffer.memory);
+	create_buffer((2 * n - 1) * sizeof(uint32_t),  usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, builder.parent_buffer.buffer, builder.parent_buffer.memory);
+	create_buffer(n * sizeof(uint32_t),            usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, builder.flag_buffer.buffer,   builder.flag_buffer.memory);
+
+	builder.descset_layout  = create_storage_buffer_set_layout(7);
+	builder.pipeline_layout = create_compute_pipeline_layout(builder.descset_layout, sizeof(uint32_t));
+
+	builder.desc_pools.resize(state.scenes.size());
+	builder.descsets.resize(state.scenes.size());
+
+	for (size_t i = 0; i < state.scenes.size(); ++i)
+	{
+		const VkDescriptorSet descset = allocate_storage_buffer_set(builder.descset_layout, 7, builder.desc_pools[i]);
+
+		write_storage_buffer(descset, 0, state.scenes[i].scene_data_buffer.buffer);
+		write_storage_buffer(descset, 1, builder.state_buffer.buffer);
+		write_storage_buffer(descset, 2, builder.key_buffer.buffer);
+		write_storage_buffer(descset, 3, builder.value_buffer.buffer);
+		write_storage_buffer(descset, 4, builder.node_buffer.buffer);
+		write_storage_buffer(descset, 5, builder.parent_buffer.buffer);
+		write_storage_buffer(descset, 6, builder.flag_buffer.buffer);
+
+		builder.descsets[i] = descset;
+	}
+
+	builder.bounds_pipeline    = create_compute_pipeline("../Assets/Compiled/LBVHBounds.comp.spv", builder.pipeline_layout);
+	builder.morton_pipeline    = create_compute_pipeline("../Assets/Compiled/LBVHMorton.comp.spv", builder.pipeline_layout);
+	builder.hierarchy_pipeline = create_compute_pipeline("../Assets/Compiled/LBVHHierarchy.comp.spv", builder.pipeline_layout);
+	builder.fit_pipeline       = create_compute_pipeline("../Assets/Compiled/LBVHFit.comp.spv", builder.pipeline_layout);
+
+	builder.sorter = create_radix_sorter(tri_count);
+
+	write_storage_buffer(builder.sorter.descset, 0, builder.key_buffer.buffer);
+	write_storage_buffer(builder.sorter.descset, 1, builder.value_buffer.buffer);
+
+	return builder;
+}
+
+void destroy_lbvh_builder(LBVHBuilder & builder)
+{
+	destroy_radix_sorter(builder.sorter);
+
+	vkDestroyPipeline(state.device, builder.bounds_pipeline, nullptr);
+	vkDestroyPipeline(state.device, builder.morton_pipeline, nullptr);
+	vkDestroyPipeline(state.device, builder.hierarchy_pipeline, nullptr);
+	vkDestroyPipeline(state.device, builder.fit_pipeline, nullptr);
+
+	vkDestroyPipelineLayout(state.device, builder.pipeline_layout, nullptr);
+
+	for (const auto & pool : builder.desc_pools)
+	{
+		vkDestroyDescriptorPool(state.device, pool, nullptr);
+	}
+
+	vkDestroyDescriptorSetLayout(state.device, builder.descset_layout, nullptr);
+
+	destroy_buffer(builder.state_buffer);
+	destroy_buffer(builder.key_buffer);
+	destroy_buffer(builder.value_buffer);
+	destroy_buffer(builder.node_buffer);
+	destroy_buffer(builder.parent_buffer);
+	destroy_buffer(builder.flag_buffer);
+}
+
+/**
+ * @brief Record a full LBVH rebuild: centroid bounds, Morton codes, radix sort, hierarchy emission, then bottom-up bounds
+ *
+ * @param frame  Frame in flight whose copy of the scene is built over
+ */
+void record_lbvh_build(VkCommandBuffer command_buffer, const LBVHBuilder & builder, uint32_t tri_count, uint32_t frame)
+{
+	if (tri_count == 0) return;
+
+	const uint32_t group_count = (tri_count + 255) / 256;
+
+	// The previous frame's trace may still be reading the hierarchy
+
+	memory_barrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+	vkCmdFillBuffer(command_buffer, builder.state_buffer.buffer, 0, 3 * sizeof(uint32_t), 0xFFFFFFFF);
+	vkCmdFillBuffer(command_buffer, builder.state_buffer.buffer, 3 * sizeof(uint32_t), 3 * sizeof(uint32_t), 0);
+	vkCmdFillBuffer(command_buffer, builder.flag_buffer.buffer, 0, VK_WHOLE_SIZE, 0);
+
+	memory_barrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, builder.pipeline_layout, 0, 1, &builder.descsets[frame], 0, nullptr);
+	vkCmdPushConstants(command_buffer, builder.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &tri_count);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, builder.bounds_pipeline);
+	vkCmdDispatch(command_buffer, group_count, 1, 1);
+
+	compute_barrier(command_buffer);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, builder.morton_pipeline);
+	vkCmdDispatch(command_buffer, group_count, 1, 1);
+
+	compute_barrier(command_buffer);
+
+	record_radix_sort_count(command_buffer, builder.sorter, tri_count);
+	record_radix_sort(command_buffer, builder.sorter, 32);
+
+	// Sorting rebinds descriptors and push constants with a different layout
+
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, builder.pipeline_layout, 0, 1, &builder.descsets[frame], 0, nullptr);
+	vkCmdPushConstants(command_buffer, builder.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &tri_count);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, builder.hierarchy_pipeline);
+	vkCmdDispatch(command_buffer, group_count, 1, 1);
+
+	compute_barrier(command_buffer);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, builder.fit_pipeline);
+	vkCmdDispatch(command_buffer, group_count, 1, 1);
+
+	compute_barrier(command_buffer);
+}
+
+/**
+ * @brief Record an LBVH refit: bottom-up bounds over the existing hierarchy and triangle order
+ *
+ * @param frame  Frame in flight whose copy of the scene is refitted to
+ */
+void record_lbvh_refit(VkCommandBuffer command_buffer, const LBVHBuilder & builder, uint32_t tri_count, uint32_t frame)
+{
+	if (tri_count == 0) return;
+
+	memory_barrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+	vkCmdFillBuffer(command_buffer, builder.flag_buffer.buffer, 0, VK_WHOLE_SIZE, 0);
+
+	memory_barrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, builder.pipeline_layout, 0, 1, &builder.descsets[frame], 0, nullptr);
+	vkCmdPushConstants(command_buffer, builder.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &tri_count);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, builder.fit_pipeline);
+	vkCmdDispatch(command_buffer, (tri_count + 255) / 256, 1, 1);
+
+	compute_barrier(command_buffer);
+}
+
+/**
+ * @brief Create the wavefront queues and the kernels which do not depend on trace settings, with room for one path
+ *        per pixel
+ *
+ * @param sort_rays  Sort the extension and shading queues before draining them
+ *
+ * @note The remaining kernels are picked by `select_tracer_pipelines`
+ */
+WavefrontTracer create_wavefront_tracer(uint32_t path_count, bool sort_rays)
+{
+	WavefrontTracer tracer;
+
+	tracer.sort_rays = sort_rays;
+
+	const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	create_buffer(WAVEFRONT_PATH_SIZE * path_count, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tracer.path_buffer.buffer, tracer.path_buffer.memory);
+	create_buffer(WAVEFRONT_QUEUE_COUNT * WAVEFRONT_QUEUE_SIZE, usage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tracer.queue_buffer.buffer, tracer.queue_buffer.memory);
+	create_buffer(WAVEFRONT_QUEUE_COUNT * sizeof(uint32_t) * path_count, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tracer.item_buffer.buffer, tracer.item_buffer.memory);
+	create_buffer(2 * sizeof(uint32_t) * path_count, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tracer.key_buffer.buffer, tracer.key_buffer.memory);
+	create_buffer(2 * sizeof(uint32_t) * path_count, usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tracer.value_buffer.buffer, tracer.value_buffer.memory);
+	create_buffer(sizeof(uint64_t), usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tracer.stats_buffer.buffer, tracer.stats_buffer.memory);
+
+	// The count is only read back from frames the timeline has passed, through a copy per frame in flight
+
+	tracer.stats_readbacks.resize(state.FRAMES_IN_FLIGHT);
+	tracer.stats_frames.assign(state.FRAMES_IN_FLIGHT, 0);
+
+	tracer.traced_rays = 0;
+
+	for (auto & readback : tracer.stats_readbacks)
+	{
+		create_buffer(sizeof(uint64_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readback.buffer, readback.memory);
+	}
+
+	tracer.descset_layout = create_storage_buffer_set_layout(7);
+	tracer.descset        = allocate_storage_buffer_set(tracer.descset_layout, 7, tracer.desc_pool);
+
+	write_storage_buffer(tracer.descset, 0, tracer.path_buffer.buffer);
+	write_storage_buffer(tracer.descset, 1, tracer.queue_buffer.buffer);
+	write_storage_buffer(tracer.descset, 2, tracer.item_buffer.buffer);
+	write_storage_buffer(tracer.descset, 3, tracer.key_buffer.buffer);
+	write_storage_buffer(tracer.descset, 4, tracer.value_buffer.buffer);
+	write_storage_buffer(tracer.descset, 5, tracer.stats_buffer.buffer);
+
+	tracer.sorter = create_radix_sorter(path_count);
+
+	write_storage_buffer(tracer.sorter.descset, 0, tracer.key_buffer.buffer);
+	write_storage_buffer(tracer.sorter.descset, 1, tracer.value_buffer.buffer);
+
+	// WavefrontSortKeys sizes the sort to the queue it keys
+
+	write_storage_buffer(tracer.descset, 6, tracer.sorter.count_buffer.buffer);
+
+	// Kernels see the scene exactly as the megakernel does, with the queues in a second set
+
+	const VkDescriptorSetLayout set_layouts[] { state.compute_descset_layout, tracer.descset_layout };
+
+	VkPushConstantRange push_constant_range{};
+
+	push_constant_range.offset     = 0;
+	push_constant_range.size       = sizeof(FrameData) + 3 * sizeof(uint32_t);
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo layout_info{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+
+	layout_info.setLayoutCount = 2;
+	layout_info.pSetLayouts    = set_layouts;
+
+	layout_info.pushConstantRangeCount = 1;
+	layout_info.pPushConstantRanges    = &push_constant_range;
+
+	vkCreatePipelineLayout(state.device, &layout_info, nullptr, &tracer.pipeline_layout);
+
+	tracer.sort_keys_pipeline = create_compute_pipeline("../Assets/Compiled/WavefrontSortKeys.comp.spv", tracer.pipeline_layout);
+
+	return tracer;
+}
+
+void destroy_wavefront_tracer(WavefrontTracer & tracer)
+{
+	destroy_radix_sorter(tracer.sorter);
+
+	vkDestroyPipeline(state.device, tracer.sort_keys_pipeline, nullptr);
+
+	vkDestroyPipelineLayout(state.device, tracer.pipeline_layout, nullptr);
+	vkDestroyDescriptorPool(state.device, tracer.desc_pool, nullptr);
+	vkDestroyDescriptorSetLayout(state.device, tracer.descset_layout, nullptr);
+
+	destroy_buffer(tracer.path_buffer);
+	destroy_buffer(tracer.queue_buffer);
+	destroy_buffer(tracer.item_buffer);
+	destroy_buffer(tracer.key_buffer);
+	destroy_buffer(tracer.value_buffer);
+	destroy_buffer(tracer.stats_buffer);
+
+	for (auto & readback : tracer.stats_readbacks)
+	{
+		destroy_buffer(readback);
+	}
+}
+
+/**
+ * @brief Add the rays of every frame copied into `stats_readbacks` which the timeline has passed to `traced_rays`
+ */
+void collect_traced_rays(WavefrontTracer & tracer, uint64_t completed)
+{
+	for (size_t slot = 0; slot < tracer.stats_readbacks.size(); ++slot)
+	{
+		if (tracer.stats_frames[slot] == 0 || tracer.stats_frames[slot] > completed) continue;
+
+		uint64_t traced_rays;
+
+		memcpy(&traced_rays, tracer.stats_readbacks[slot].memory.mapped, sizeof(traced_rays));
+
+		tracer.traced_rays += traced_rays;
+
+		tracer.stats_frames[slot] = 0;
+	}
+}
+
+/**
+ * @brief Point the tracer in use at the variants of its kernels specialized for the current trace settings
+ */
+void select_tracer_pipelines()
+{
+	// Kernels which traverse triangle hierarchies are compiled once per layout
+
+	std::string variant;
+
+	if (state.DYNAMIC_BVH) variant = "Dynamic";
+	if (state.WIDE_BVH)    variant = "Wide";
+
+	if (state.WAVEFRONT)
+	{
+		auto & tracer = state.wavefront;
+
+		tracer.generate_pipeline = get_pipeline_variant("../Assets/Compiled/WavefrontGenerate.comp.spv", tracer.pipeline_layout);
+		tracer.extend_pipeline   = get_pipeline_variant("../Assets/Compiled/WavefrontExtend" + variant + ".comp.spv", tracer.pipeline_layout);
+		tracer.shade_pipeline    = get_pipeline_variant("../Assets/Compiled/WavefrontShade.comp.spv", tracer.pipeline_layout);
+		tracer.connect_pipeline  = get_pipeline_variant("../Assets/Compiled/WavefrontConnect" + variant + ".comp.spv", tracer.pipeline_layout);
+		tracer.resolve_pipeline  = get_pipeline_variant("../Assets/Compiled/WavefrontResolve.comp.spv", tracer.pipeline_layout);
+	}
+	else
+	{
+		const std::string tracer_path = std::string("../Assets/Compiled/Tracer") + (state.PERSISTENT_THREADS ? "Persistent" : "") + variant + ".comp.spv";
+
+		state.compute_pipeline = get_pipeline_variant(tracer_path, state.compute_pipeline_layout);
+	}
+}
+
+/**
+ * @brief Make every prior compute and transfer write visible to the next dispatch, indirect or not, and to transfers
+ */
+void wavefront_barrier(VkCommandBuffer command_buffer)
+{
+	memory_barrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+}
+
+/**
+ * @brief Empty a queue, leaving its indirect dispatch at zero workgroups
+ */
+void reset_wavefront_queue(VkCommandBuffer command_buffer, const WavefrontTracer & tracer, uint32_t queue)
+{
+	const uint32_t empty[] { 0, 1, 1, 0 };
+
+	vkCmdUpdateBuffer(command_buffer, tracer.queue_buffer.buffer, queue * WAVEFRONT_QUEUE_SIZE, WAVEFRONT_QUEUE_SIZE, empty);
+}
+
+/**
+ * @brief Record every sample and bounce of a frame as separate dispatches, ending with the resolve into `descset`'s
+ *        render target
+ *
+ * @note Dispatches draining a queue are sized on the device, so the host never waits on queue counts
+ */
+void record_wavefront_trace(VkCommandBuffer command_buffer, const WavefrontTracer & tracer, VkDescriptorSet descset, const FrameData & frame_data)
+{
+	const VkDescriptorSet descsets[] { descset, tracer.descset };
+
+	const uint32_t path_count = static_cast<uint32_t>(state.RAYTRACE_RESOLUTION) * state.RAYTRACE_RESOLUTION;
+
+	const auto bind = [&]()
+	{
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, tracer.pipeline_layout, 0, 2, descsets, 0, nullptr);
+		vkCmdPushConstants(command_buffer, tracer.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FrameData), &frame_data);
+	};
+
+	const auto push_pass = [&](uint32_t sample, uint32_t depth, uint32_t sort_queue)
+	{
+		const uint32_t pass[] { sample, depth, sort_queue };
+
+		vkCmdPushConstants(command_buffer, tracer.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, sizeof(FrameData), sizeof(pass), pass);
+	};
+
+	const auto dispatch_queue = [&](VkPipeline pipeline, uint32_t queue)
+	{
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdDispatchIndirect(command_buffer, tracer.queue_buffer.buffer, queue * WAVEFRONT_QUEUE_SIZE);
+	};
+
+	// Hits are keyed by object id, which needs far fewer bits than the rays' Morton order
+
+	uint32_t object_bits = 1;
+
+	while ((1u << object_bits) <= state.trace_settings.sphere_count + state.trace_settings.plane_count) ++object_bits;
+
+	// Key the queue, sort as much of it as is queued, and copy the sorted path indices over the queue's own
+
+	const auto sort_queue = [&](uint32_t sample, uint32_t depth, uint32_t queue)
+	{
+		if (tracer.sort_rays == false) return;
+
+		// An empty queue dispatches no keys, and so never overwrites the previous sort's count
+
+		record_radix_sort_count(command_buffer, tracer.sorter, 0);
+
+		push_pass(sample, depth, queue);
+
+		dispatch_queue(tracer.sort_keys_pipeline, queue);
+
+		wavefront_barrier(command_buffer);
+
+		// ray_sort_key spans 30 bits
+
+		const uint32_t sorted = record_radix_sort(command_buffer, tracer.sorter, queue == WAVEFRONT_QUEUE_SHADE ? object_bits : 30);
+
+		wavefront_barrier(command_buffer);
+
+		// Anything past the end of the queue is never read, so the whole region is copied rather than sizing the copy
+
+		VkBufferCopy region{};
+
+		region.srcOffset = sizeof(uint32_t) * sorted;
+		region.dstOffset = queue * sizeof(uint32_t) * path_count;
+		region.size      = sizeof(uint32_t) * path_count;
+
+		vkCmdCopyBuffer(command_buffer, tracer.value_buffer.buffer, tracer.item_buffer.buffer, 1, &region);
+
+		wavefront_barrier(command_buffer);
+
+		// Sorting rebinds descriptors and push constants with a different layout
+
+		bind();
+		push_pass(sample, depth, queue);
+	};
+
+	// The ray count starts over every frame, once the previous frame has copied its own out
+
+	const VkBufferCopy stats_region { 0, 0, sizeof(uint64_t) };
+
+	wavefront_barrier(command_buffer);
+
+	vkCmdFillBuffer(command_buffer, tracer.stats_buffer.buffer, 0, sizeof(uint64_t), 0);
+
+	bind();
+
+	const uint32_t group_count = state.RAYTRACE_RESOLUTION / 16;
+
+	for (uint32_t sample = 0; sample < state.trace_settings.samples; ++sample)
+	{
+		// The previous frame, or sample, may still be draining the queues
+
+		wavefront_barrier(command_buffer);
+
+		reset_wavefront_queue(command_buffer, tracer, WAVEFRONT_QUEUE_EXTEND);
+
+		wavefront_barrier(command_buffer);
+
+		push_pass(sample, 0, 0);
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, tracer.generate_pipeline);
+		vkCmdDispatch(command_buffer, group_count, group_count, 1);
+
+		for (uint32_t depth = 0; depth < state.trace_settings.depth; ++depth)
+		{
+			push_pass(sample, depth, 0);
+
+			reset_wavefront_queue(command_buffer, tracer, WAVEFRONT_QUEUE_SHADE);
+
+			wavefront_barrier(command_buffer);
+
+			// Camera rays already leave in pixel order, which is as coherent as they get
+
+			if (depth > 0) sort_queue(sample, depth, WAVEFRONT_QUEUE_EXTEND);
+
+			dispatch_queue(tracer.extend_pipeline, WAVEFRONT_QUEUE_EXTEND);
+
+			// Shading refills the extension queue with the paths that survive
+
+			wavefront_barrier(command_buffer);
+
+			sort_queue(sample, depth, WAVEFRONT_QUEUE_SHADE);
+
+			reset_wavefront_queue(command_buffer, tracer, WAVEFRONT_QUEUE_EXTEND);
+			reset_wavefront_queue(command_buffer, tracer, WAVEFRONT_QUEUE_CONNECT);
+
+			wavefront_barrier(command_buffer);
+
+			dispatch_queue(tracer.shade_pipeline, WAVEFRONT_QUEUE_SHADE);
+
+			wavefront_barrier(command_buffer);
+
+			dispatch_queue(tracer.connect_pipeline, WAVEFRONT_QUEUE_CONNECT);
+		}
+	}
+
+	wavefront_barrier(command_buffer);
+
+	vkCmdCopyBuffer(command_buffer, tracer.stats_buffer.buffer, tracer.stats_readbacks[state.currentFrame].buffer, 1, &stats_region);
+
+	memory_barrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, tracer.resolve_pipeline);
+	vkCmdDispatch(command_buffer, group_count, group_count, 1);
+}
+
+/**
+ * @brief Flatten every instance into world-space triangles, for hierarchies built over the whole scene
+ */
+std::vector<Triangle> flatten_instances()
+{
+	std::vector<Triangle> tris;
+
+	for (const auto & instance : state.instances)
+	{
+		for (const auto & tri : state.meshes[instance.mesh])
+		{
+			tris.push_back({ instance.transform * glm::vec4(tri.v0, 1.0f), instance.transform * glm::vec4(tri.v1, 1.0f), instance.transform * glm::vec4(tri.v2, 1.0f) });
+		}
+	}
+
+	return tris;
+}
+
+/**
+ * @brief Upload triangles to `scene_data_buffer` in their intersection layout, with their face normals alongside
+ *
+ * @param offset  Index of the first triangle written
+ */
+void upload_triangles(const std::vector<Triangle> & tris, uint32_t offset = 0)
+{
+	std::vector<PrecomputedTriangle> packed(tris.size());
+	std::vector<glm::vec4>           normals(tris.size());
+
+	for (size_t i = 0; i < tris.size(); ++i)
+	{
+		packed[i]  = precompute_triangle(tris[i]);
+		normals[i] = glm::vec4(face_normal(tris[i]), 0.0f);
+	}
+
+	stage_upload(&SceneBuffers::scene_data_buffer, packed.data(), sizeof(PrecomputedTriangle) * packed.size(), sizeof(PrecomputedTriangle) * offset);
+	stage_upload(&SceneBuffers::normal_buffer, normals.data(), sizeof(glm::vec4) * normals.size(), sizeof(glm::vec4) * offset);
+}
+
+/**
+ * @brief Upload one mesh's bottom-level nodes and triangles into its slice of the scene buffers, collapsing the
+ *        hierarchy into eight-wide nodes first when the wide layout is in use
+ */
+void upload_blas(uint32_t mesh)
+{
+	const BVH & blas = state.blas[mesh];
+
+	const uint32_t node_offset = state.blas_node_offsets[mesh];
+	const uint32_t tri_offset  = state.blas_tri_offsets[mesh];
+
+	// Every mesh shares one node and one triangle buffer, so indices are relocated into its slice
+
+	if (state.WIDE_BVH)
+	{
+		BVH8 wide = collapse_bvh8(blas);
+
+		for (auto & node : wide.nodes)
+		{
+			node.child_base += node_offset;
+			node.tri_base   += tri_offset;
+		}
+
+		stage_upload(&SceneBuffers::bvh_node_buffer, wide.nodes.data(), sizeof(BVH8Node) * wide.nodes.size(), sizeof(BVH8Node) * node_offset);
+		upload_triangles(reorder_triangles(wide, state.meshes[mesh].data()), tri_offset);
+
+		return;
+	}
+
+	std::vector<BVHNode> nodes(blas.nodes);
+
+	for (auto & node : nodes)
+	{
+		node.left_first += node.tri_count > 0 ? tri_offset : node_offset;
+	}
+
+	stage_upload(&SceneBuffers::bvh_node_buffer, nodes.data(), sizeof(BVHNode) * nodes.size(), sizeof(BVHNode) * node_offset);
+	upload_triangles(reorder_triangles(blas, state.meshes[mesh].data()), tri_offset);
+}
+
+/**
+ * @brief World-space bounds of an instance, from the eight transformed corners of its mesh's root box
+ */
+AABB instance_bounds(const Instance & instance)
+{
+	const BVHNode & root = state.blas[instance.mesh].nodes[0];
+
+	AABB bounds;
+
+	// Empty meshes still get a point, so the top-level build only ever sees finite boxes
+
+	if (AABB{ root.aabb_min, root.aabb_max }.empty())
+	{
+		bounds.grow(instance.transform[3]);
+
+		return bounds;
+	}
+
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		const glm::vec3 p
+		{
+			(corner & 1) ? root.aabb_max.x : root.aabb_min.x,
+			(corner & 2) ? root.aabb_max.y : root.aabb_min.y,
+			(corner & 4) ? root.aabb_max.z : root.aabb_min.z
+		};
+
+		bounds.grow(instance.transform * glm::vec4(p, 1.0f));
+	}
+
+	return bounds;
+}
+
+/**
+ * @brief Rebuild the top-level hierarchy over instance bounds, and upload it alongside the instances in its order
+ */
+void upload_tlas()
+{
+	std::vector<AABB> bounds(state.instances.size());
+
+	for (size_t i = 0; i < bounds.size(); ++i)
+	{
+		bounds[i] = instance_bounds(state.instances[i]);
+	}
+
+	// Top-level trees are small enough that worker threads cost more than they save
+
+	BVHBuildInfo build_info;
+
+	build_info.thread_count = 1;
+
+	state.tlas = build_bvh(bounds.data(), bounds.size(), build_info);
+
+	std::vector<InstanceData> instance_data(state.tlas.tri_indices.size());
+
+	for (size_t i = 0; i < instance_data.size(); ++i)
+	{
+		const Instance & instance = state.instances[state.tlas.tri_indices[i]];
+
+		// Rows of the inverse are the columns of its transpose
+
+		const glm::mat4 world_to_object = glm::transpose(glm::inverse(glm::mat4(instance.transform)));
+
+		instance_data[i].world_to_object[0] = world_to_object[0];
+		instance_data[i].world_to_object[1] = world_to_object[1];
+		instance_data[i].world_to_object[2] = world_to_object[2];
+
+		instance_data[i].blas_root = state.blas_node_offsets[instance.mesh];
+	}
+
+	stage_upload(&SceneBuffers::tlas_node_buffer, state.tlas.nodes.data(), sizeof(BVHNode) * state.tlas.nodes.size());
+	stage_upload(&SceneBuffers::instance_buffer, instance_data.data(), sizeof(InstanceData) * instance_data.size());
+}
+
+/**
+ * @brief Move a readback slot's completed copy into `captured_frames`, freeing the slot for another frame
+ */
+void collect_readback(ReadbackSlot & slot)
+{
+	CapturedFrame frame;
+
+	frame.index  = slot.frame;
+	frame.width  = state.RAYTRACE_RESOLUTION;
+	frame.height = state.RAYTRACE_RESOLUTION;
+
+	const auto pixels = static_cast<const uint16_t *>(slot.mapped);
+
+	frame.rgba.assign(pixels, pixels + 4 * frame.width * frame.height);
+
+	state.captured_frames.push_back(std::move(frame));
+
+	slot.pending = false;
+}
+
+/**
+ * @brief Whether two frames look at the scene from the same place, under the same light.  The seed differs every
+ *        frame, and is ignored
+ */
+bool same_view(const FrameData & a, const FrameData & b)
+{
+	return a.aspect_ratio == b.aspect_ratio
+		&& a.light_pos  == b.light_pos
+		&& a.camera.pos == b.camera.pos && a.camera.dir == b.camera.dir
+		&& a.camera.right == b.camera.right && a.camera.up == b.camera.up;
+}
+
+/**
+ * @brief Create a raster pipeline object
+ *
+ * @param info          Shaders to build it from
+ * @param render_pass   Render pass it draws within
+ * @param subpass       Subpass of `render_pass` it draws in
+ * @param color_count   Color attachments of that subpass
+ * @param input_layout  Layout of set 1, holding the subpass's input attachments.  Null if it reads none
+ *
+ * @return RasterPipeline  Pipeline state object (PSO) containing pipeline and layout
+ */
+RasterPipeline create_raster_pipeline(const Renderer::PipelineInfo & info, VkRenderPass render_pass, uint32_t subpass, uint32_t color_count, VkDescriptorSetLayout input_layout)
+{
+	RasterPipeline pso;
+
+	std::vector<VkShaderModule>                  shader_modules;
+	std::vector<VkPipelineShaderStageCreateInfo> shader_stages;
+
+	for (unsigned short i = 0; i < info.shader_count; ++i)
+	{
+		const auto & shader = info.shaders[i];
+
+		const auto shader_code = ReadFile(shader.file_path);
+
+		VkShaderModuleCreateInfo module_info{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+		module_info.codeSize = shader_code.size();
+		module_info.pCode    = reinterpret_cast<const uint32_t *>(shader_code.data());
+
+		VkShaderModule shader_module;
+		vkCreateShaderModule(state.device, &module_info, nullptr, &shader_module);
+
+		VkPipelineShaderStageCreateInfo shader_info{VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
+		shader_info.stage  = shader.stage == Renderer::PipelineInfo::ShaderInfo::Stage::VERTEX ? VK_SHADER_STAGE_VERTEX_BIT : VK_SHADER_STAGE_FRAGMENT_BIT;
+		shader_info.module = shader_module;
+		shader_info.pName  = shader.entry_point;
+
+		shader_modules.push_back(shader_module);
+		shader_stages.push_back(shader_info);
+	}
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = 0;
+	vertexInputInfo.vertexAttributeDescriptionCount = 0;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float) state.swapchain.extent.width;
+	viewport.height = (float) state.swapchain.extent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor{};
+	scissor.offset = {0, 0};
+	scissor.extent = state.swapchain.extent;
+
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.pViewports = &viewport;
+	viewportState.scissorCount = 1;
+	viewportState.pScissors = &scissor;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer = {};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = VK_CULL_MODE_FRONT_BIT;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling = {};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
+
+	const std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments(color_count, colorBlendAttachment);
+
+	VkPipelineColorBlendStateCreateInfo colorBlending = {};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY;
+	colorBlending.attachmentCount = color_count;
+	colorBlending.pAttachments = colorBlendAttachments.data();
+	colorBlending.blendConstants[0] = 0.0f;
+	colorBlending.blendConstants[1] = 0.0f;
+	colorBlending.blendConstants[2] = 0.0f;
+	colorBlending.blendConstants[3] = 0.0f;
+
+	const VkDescriptorSetLayout set_layouts[] { state.graphics_descset_layout, input_layout };
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+	pipelineLayoutInfo.setLayoutCount = input_layout == VK_NULL_HANDLE ? 1 : 2;
+	pipelineLayoutInfo.pSetLayouts    = set_layouts;
+
+	vkCreatePipelineLayout(state.device, &pipelineLayoutInfo, nullptr, &pso.layout);
+
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = static_cast<uint32_t>(shader_stages.size());
+	pipelineInfo.pStages = shader_stages.data();
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.layout = pso.layout;
+	pipelineInfo.renderPass = render_pass;
+	pipelineInfo.subpass = subpass;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+	vkCreateGraphicsPipelines(state.device, state.pipeline_cache, 1, &pipelineInfo, nullptr, &pso.pipeline);
+
+	for (const auto shader_module : shader_modules)
+	{
+		vkDestroyShaderModule(state.device, shader_module, nullptr);
+	}
+
+	return pso;
+}
+
+/**
+ * @brief Compile a render graph into a render pass over the swapchain images, creating its transient attachments,
+ *        framebuffers, input attachment descriptors and pipelines
+ *
+ * Layout transitions and barriers all come from the render pass: attachment layouts from each subpass's references,
+ * subpass dependencies from `Renderer::CompiledGraph::dependencies`, and external ones ordering each attachment's
+ * first use after the previous frame's last
+ *
+ * @return False if the graph does not compile
+ */
+bool create_render_graph(const Renderer::GraphInfo & info, RenderGraph & graph)
+{
+	if (Renderer::CompileGraph(info, graph.compiled) == false)
+	{
+		return false;
+	}
+
+	const auto & compiled = graph.compiled;
+
+	const auto subpass_count = static_cast<uint32_t>(compiled.subpass_outputs.size());
+
+	const VkFormat format = state.swapchain.surfaceFormat.format;
+
+	// Attachments, numbered in the render pass in the order they are declared, skipping those no pass kept uses
+
+	std::vector<uint32_t> slots(info.color_attachment_count, VK_ATTACHMENT_UNUSED);
+
+	std::vector<VkAttachmentDescription> attachment_descs;
+
+	int backbuffer = -1;
+
+	graph.attachments.assign(info.color_attachment_count, Image{});
+
+	for (unsigned short a = 0; a < info.color_attachment_count; ++a)
+	{
+		const auto & usage = compiled.attachments[a];
+
+		if (usage.used == false) continue;
+
+		const bool is_backbuffer = info.color_attachments[a].source == Renderer::AttachmentInfo::Source::BACKBUFFER;
+
+		VkAttachmentDescription desc{};
+
+		desc.format  = format;
+		desc.samples = VK_SAMPLE_COUNT_1_BIT;
+
+		desc.loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		desc.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		desc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+		desc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		VkClearValue clear_value{};
+
+		if (is_backbuffer)
+		{
+			desc.storeOp     = VK_ATTACHMENT_STORE_OP_STORE;
+			desc.finalLayout = state.HEADLESS ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+			clear_value.color = { {1.0f, 0.0f, 0.0f, 1.0f} };
+
+			backbuffer = a;
+		}
+		else
+		{
+			// Nothing outlives the render pass, so a transient attachment ends in whichever layout it was last used in
+
+			const auto & last_inputs = compiled.subpass_inputs[usage.last_subpass];
+
+			const bool last_read = std::find(last_inputs.begin(), last_inputs.end(), a) != last_inputs.end();
+
+			desc.storeOp     = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			desc.finalLayout = last_read ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+			graph.attachments[a] = create_image(
+				format,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+				state.swapchain.extent);
+		}
+
+		slots[a] = static_cast<uint32_t>(attachment_descs.size());
+
+		attachment_descs.push_back(desc);
+		graph.clear_values.push_back(clear_value);
+	}
+
+	// Subpasses.  Attachments used both before and after a subpass which does not use them are preserved across it
+
+	std::vector<std::vector<VkAttachmentReference>> color_refs(subpass_count);
+	std::vector<std::vector<VkAttachmentReference>> input_refs(subpass_count);
+	std::vector<std::vector<uint32_t>>              preserved(subpass_count);
+
+	std::vector<VkSubpassDescription> subpass_descs(subpass_count);
+
+	for (uint32_t s = 0; s < subpass_count; ++s)
+	{
+		const auto & outputs = compiled.subpass_outputs[s];
+		const auto & inputs  = compiled.subpass_inputs[s];
+
+		for (const unsigned short a : outputs) color_refs[s].push_back({ slots[a], VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+		for (const unsigned short a : inputs)  input_refs[s].push_back({ slots[a], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL });
+
+		for (unsigned short a = 0; a < info.color_attachment_count; ++a)
+		{
+			const auto & usage = compiled.attachments[a];
+
+			const bool uses = std::find(outputs.begin(), outputs.end(), a) != outputs.end() || std::find(inputs.begin(), inputs.end(), a) != inputs.end();
+
+			if (usage.used && usage.first_subpass < s && s < usage.last_subpass && uses == false)
+			{
+				preserved[s].push_back(slots[a]);
+			}
+		}
+
+		auto & desc = subpass_descs[s];
+
+		desc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+
+		desc.colorAttachmentCount = static_cast<uint32_t>(color_refs[s].size());
+		desc.pColorAttachments    = color_refs[s].data();
+
+		desc.inputAttachmentCount = static_cast<uint32_t>(input_refs[s].size());
+		desc.pInputAttachments    = input_refs[s].data();
+
+		desc.preserveAttachmentCount = static_cast<uint32_t>(preserved[s].size());
+		desc.pPreserveAttachments    = preserved[s].data();
+	}
+
+	// Dependencies between subpasses.  Reads are of input attachments, so only the fragment shader waits on them
+
+	std::vector<VkSubpassDependency> dependencies;
+
+	for (const auto & dependency : compiled.dependencies)
+	{
+		VkSubpassDependency desc{};
+
+		desc.srcSubpass    = dependency.src_subpass;
+		desc.srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		desc.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+		desc.dstSubpass = dependency.dst_subpass;
+
+		if (dependency.read_after_write)
+		{
+			desc.dstStageMask  |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			desc.dstAccessMask |= VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+		}
+
+		if (dependency.write_after_write)
+		{
+			desc.dstStageMask  |= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			desc.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		}
+
+		desc.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		dependencies.push_back(desc);
+	}
+
+	// Dependencies on the previous frame.  Each attachment is cleared where it is first used, and that clear must not
+	// overtake the last frame's use of the same image, nor the layout transition out of it
+
+	for (unsigned short a = 0; a < info.color_attachment_count; ++a)
+	{
+		const auto & usage = compiled.attachments[a];
+
+		if (usage.used == false) continue;
+
+		VkSubpassDependency desc{};
+
+		desc.srcSubpass = VK_SUBPASS_EXTERNAL;
+
+		if (a == backbuffer)
+		{
+			// Waits on the same stage as the semaphore the image was acquired with, or on the last read back
+
+			desc.srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | (state.HEADLESS ? VK_PIPELINE_STAGE_TRANSFER_BIT : 0);
+			desc.srcAccessMask = 0;
+		}
+		else
+		{
+			desc.srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | (usage.read ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : 0);
+			desc.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		}
+
+		desc.dstSubpass    = usage.first_subpass;
+		desc.dstStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		desc.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+		dependencies.push_back(desc);
+
+		// The backbuffer is presented or read back afterwards, which must wait for the pass's writes
+
+		if (a == backbuffer)
+		{
+			VkSubpassDependency out{};
+
+			out.srcSubpass    = usage.last_subpass;
+			out.srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			out.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+			out.dstSubpass    = VK_SUBPASS_EXTERNAL;
+			out.dstStageMask  = state.HEADLESS ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			out.dstAccessMask = state.HEADLESS ? VK_ACCESS_TRANSFER_READ_BIT : 0;
+
+			dependencies.push_back(out);
+		}
+	}
+
+	// Render pass
+
+	VkRenderPassCreateInfo render_pass_info{VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
+
+	render_pass_info.attachmentCount = static_cast<uint32_t>(attachment_descs.size());
+	render_pass_info.pAttachments    = attachment_descs.data();
+
+	render_pass_info.subpassCount = subpass_count;
+	render_pass_info.pSubpasses   = subpass_descs.data();
+
+	render_pass_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	render_pass_info.pDependencies   = dependencies.data();
+
+	vkCreateRenderPass(state.device, &render_pass_info, nullptr, &graph.render_pass);
+
+	// Framebuffers, which only differ in the backbuffer
+
+	graph.framebuffers.resize(state.swapchain.imageViews.size());
+
+	for (size_t i = 0; i < state.swapchain.imageViews.size(); ++i)
+	{
+		std::vector<VkImageView> views(attachment_descs.size());
+
+		for (unsigned short a = 0; a < info.color_attachment_count; ++a)
+		{
+			if (slots[a] == VK_ATTACHMENT_UNUSED) continue;
+
+			views[slots[a]] = a == backbuffer ? state.swapchain.imageViews[i] : graph.attachments[a].view;
+		}
+
+		VkFramebufferCreateInfo framebufferInfo{VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
+
+		framebufferInfo.renderPass = graph.render_pass;
+
+		framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+		framebufferInfo.pAttachments    = views.data();
+
+		framebufferInfo.width  = state.swapchain.extent.width;
+		framebufferInfo.height = state.swapchain.extent.height;
+		framebufferInfo.layers = 1;
+
+		vkCreateFramebuffer(state.device, &framebufferInfo, nullptr, &graph.framebuffers[i]);
+	}
+
+	// Input attachment descriptors, one set per pass reading any, since transient images are shared by every frame
+
+	const auto pass_count = compiled.passes.size();
+
+	uint32_t input_count = 0;
+	uint32_t input_set_count = 0;
+
+	for (size_t p = 0; p < pass_count; ++p)
+	{
+		const auto & inputs = compiled.subpass_inputs[compiled.pass_subpasses[p]];
+
+		input_count += static_cast<uint32_t>(inputs.size());
+		input_set_count += inputs.empty() ? 0 : 1;
+	}
+
+	graph.input_pool = VK_NULL_HANDLE;
+
+	if (input_set_count > 0)
+	{
+		VkDescriptorPoolSize pool_size{};
+		pool_size.type            = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		pool_size.descriptorCount = input_count;
+
+		VkDescriptorPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+		pool_info.poolSizeCount = 1;
+		pool_info.pPoolSizes    = &pool_size;
+		pool_info.maxSets       = input_set_count;
+
+		vkCreateDescriptorPool(state.device, &pool_info, nullptr, &graph.input_pool);
+	}
+
+	graph.input_layouts.assign(pass_count, VK_NULL_HANDLE);
+	graph.input_sets.assign(pass_count, VK_NULL_HANDLE);
+	graph.pipelines.resize(pass_count);
+
+	for (size_t p = 0; p < pass_count; ++p)
+	{
+		const auto subpass = compiled.pass_subpasses[p];
+
+		const auto & inputs = compiled.subpass_inputs[subpass];
+
+		if (inputs.empty() == false)
+		{
+			std::vector<VkDescriptorSetLayoutBinding> bindings(inputs.size());
+
+			for (uint32_t i = 0; i < inputs.size(); ++i)
+			{
+				bindings[i].binding         = i;
+				bindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+				bindings[i].descriptorCount = 1;
+				bindings[i].stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT;
+			}
+
+			VkDescriptorSetLayoutCreateInfo layout_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+			layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+			layout_info.pBindings    = bindings.data();
+
+			vkCreateDescriptorSetLayout(state.device, &layout_info, nullptr, &graph.input_layouts[p]);
+
+			VkDescriptorSetAllocateInfo alloc_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+			alloc_info.descriptorPool     = graph.input_pool;
+			alloc_info.descriptorSetCount = 1;
+			alloc_info.pSetLayouts        = &graph.input_layouts[p];
+
+			vkAllocateDescriptorSets(state.device, &alloc_info, &graph.input_sets[p]);
+
+			for (uint32_t i = 0; i < inputs.size(); ++i)
+			{
+				VkDescriptorImageInfo image_info{};
+				image_info.imageView   = graph.attachments[inputs[i]].view;
+				image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+				VkWriteDescriptorSet write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+				write.dstSet          = graph.input_sets[p];
+				write.dstBinding      = i;
+				write.descriptorCount = 1;
+				write.descriptorType  = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+				write.pImageInfo      = &image_info;
+
+				vkUpdateDescriptorSets(state.device, 1, &write, 0, nullptr);
+			}
+		}
+
+		// Pipelines
+
+		const auto & pass = info.passes[compiled.passes[p]];
+
+		for (unsigned short i = 0; i < pass.pipeline_count; ++i)
+		{
+			graph.pipelines[p].push_back(create_raster_pipeline(
+				pass.pipelines[i],
+				graph.render_pass, subpass,
+				static_cast<uint32_t>(compiled.subpass_outputs[subpass].size()),
+				graph.input_layouts[p]));
+		}
+	}
+
+	return true;
+}
+
+void destroy_render_graph(RenderGraph & graph)
+{
+	for (auto & pipelines : graph.pipelines)
+	{
+		for (const auto & pso : pipelines)
+		{
+			vkDestroyPipeline(state.device, pso.pipeline, nullptr);
+			vkDestroyPipelineLayout(state.device, pso.layout, nullptr);
+		}
+	}
+
+	for (const auto & layout : graph.input_layouts)
+	{
+		vkDestroyDescriptorSetLayout(state.device, layout, nullptr);
+	}
+
+	vkDestroyDescriptorPool(state.device, graph.input_pool, nullptr);
+
+	for (const auto & framebuffer : graph.framebuffers)
+	{
+		vkDestroyFramebuffer(state.device, framebuffer, nullptr);
+	}
+
+	vkDestroyRenderPass(state.device, graph.render_pass, nullptr);
+
+	for (auto & image : graph.attachments)
+	{
+		if (image.image != VK_NULL_HANDLE)
+		{
+			destroy_image(image);
+		}
+	}
+
+	graph = RenderGraph{};
+}
+
+/**
+ * @brief Record a render graph's render pass, each of its passes drawing a fullscreen triangle per pipeline
+ *
+ * @param framebuffer  Index of the swapchain image to draw into
+ * @param descset      Graphics set, bound as set 0
+ */
+void record_render_graph(VkCommandBuffer command_buffer, const RenderGraph & graph, uint32_t framebuffer, VkDescriptorSet descset)
+{
+	VkRenderPassBeginInfo pass_begin_info{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+
+	pass_begin_info.renderPass  = graph.render_pass;
+	pass_begin_info.framebuffer = graph.framebuffers[framebuffer];
+
+	pass_begin_info.renderArea.offset = {0, 0};
+	pass_begin_info.renderArea.extent = state.swapchain.extent;
+
+	pass_begin_info.clearValueCount = static_cast<uint32_t>(graph.clear_values.size());
+	pass_begin_info.pClearValues    = graph.clear_values.data();
+
+	vkCmdBeginRenderPass(command_buffer, &pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+
+	unsigned short subpass = 0;
+
+	for (size_t p = 0; p < graph.compiled.passes.size(); ++p)
+	{
+		for (; subpass < graph.compiled.pass_subpasses[p]; ++subpass)
+		{
+			vkCmdNextSubpass(command_buffer, VK_SUBPASS_CONTENTS_INLINE);
+		}
+
+		for (const auto & pso : graph.pipelines[p])
+		{
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pso.pipeline);
+
+			const VkDescriptorSet descsets[] { descset, graph.input_sets[p] };
+
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pso.layout, 0, graph.input_sets[p] == VK_NULL_HANDLE ? 1 : 2, descsets, 0, nullptr);
+
+			vkCmdDraw(command_buffer, 3, 1, 0, 0);
+		}
+	}
+
+	vkCmdEndRenderPass(command_buffer);
+}
+
+GraphicsDevice::Error GraphicsDevice::Construct(const GraphicsDevice::CreateInfo & info)
+{
+	std::cerr << __LINE__ << std::endl;
+
+	// Create instance
+	{
+		state.FRAMES_IN_FLIGHT    = info.framesInFlight;
+		state.RAYTRACE_RESOLUTION = info.raytrace_resolution;
+		state.DYNAMIC_BVH         = info.dynamic_bvh;
+		state.WIDE_BVH            = info.wide_bvh && info.dynamic_bvh == false;
+		state.WAVEFRONT           = info.wavefront;
+		state.PERSISTENT_THREADS  = info.persistent_threads && info.wavefront == false;
+		state.HEADLESS            = info.window == nullptr;
+		state.PROGRESSIVE         = info.progressive;
+		state.DENOISE             = info.denoise;
+
+		VkApplicationInfo appInfo{VK_STRUCTURE_TYPE_APPLICATION_INFO};
+		appInfo.pApplicationName   = "Square Demo";
+		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+		appInfo.pEngineName        = "VK Render Backend";
+		appInfo.engineVersion      = VK_MAKE_VERSION(1, 0, 0);
+		appInfo.apiVersion         = VK_API_VERSION_1_1;
+
+		// Render nodes and software implementations may expose no window system at all, so headless instances ask
+		// only for what debugging needs
+
+		std::vector<const char *> extensionNames;
+
+		if (state.HEADLESS == false)
+		{
+			extensionNames.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+			#ifdef WIN32
+			extensionNames.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+			#else
+			extensionNames.push_back(VK_KHR_XCB_SURFACE_EXTENSION_NAME);
+			#endif
+		}
+
+		if (state.HEADLESS == false || info.debug)
+		{
+			extensionNames.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+		}
+
+		// Timeline semaphores build on it when the instance is Vulkan 1.0
+
+		extensionNames.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+
+		VkInstanceCreateInfo instanceInfo{VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO};
+		instanceInfo.pApplicationInfo        = &appInfo;
+		instanceInfo.enabledExtensionCount   = static_cast<uint32_t>(extensionNames.size());
+		instanceInfo.ppEnabledExtensionNames = extensionNames.data();
+
+		if (info.debug)
+		{
+			const char * layerNames[]
+			{
+				"VK_LAYER_LUNARG_standard_validation"
+			};
+
+			instanceInfo.enabledLayerCount   = sizeof(layerNames) / sizeof(layerNames[0]);
+			instanceInfo.ppEnabledLayerNames = layerNames;
+		}
+
+		if (const auto res = vkCreateInstance(&instanceInfo, nullptr, &state.instance); res != VK_SUCCESS)
+		{
+			std::cout << "[app] - err :: Failed to create Vulkan instance (" << res << ")" << std::endl;
+			return Error::UNKNOWN;
+		}
+	}
+
+	// Create surface
+	if (state.HEADLESS == false)
+	{
+		if (glfwCreateWindowSurface(state.instance, info.window, nullptr, &state.surface) != VK_SUCCESS)
+		{
+			std::cout << "[app] - err :: Failed to create window surface" << std::endl;
+			return Error::UNKNOWN;
+		}
+	}
+
+	// Choose physical device
+	{
+		unsigned int availableDeviceCount = 0;
+		vkEnumeratePhysicalDevices(state.instance, &availableDeviceCount, nullptr);
+
+		if (availableDeviceCount == 0)
+		{
+			// We weren't able to find any GPUs on the system
+			return Error::NO_SUITABLE_GPU;
+		}
+
+		std::vector<VkPhysicalDevice> availableDevices{availableDeviceCount};
+		vkEnumeratePhysicalDevices(state.instance, &availableDeviceCount, availableDevices.data());
+
+		// Headless devices present nothing, so any device with timeline semaphores will do, CPU implementations
+		// included
+
+		std::vector<const char *> requiredExtensions{ VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME };
+
+		if (state.HEADLESS == false)
+		{
+			requiredExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+		}
+
+		// Attempt to find suitable GPU
+
+		for (const auto & device : availableDevices)
+		{
+			unsigned int supportedExtensionCount = 0;
+
+			// Enumerate available GPU extensions
+
+			uint32_t availableExtensionCount;
+			vkEnumerateDeviceExtensionProperties(device, nullptr, &availableExtensionCount, nullptr);
+			std::vector<VkExtensionProperties> availableExtensions{availableExtensionCount};
+			vkEnumerateDeviceExtensionProperties(device, nullptr, &availableExtensionCount, availableExtensions.data());
+
+			// Check if GPU supports all of our required extensions
+
+			for (const auto & requiredExtension : requiredExtensions)
+			{
+				for (const auto & availableExtension : availableExtensions)
+				{
+					if (strcmp(requiredExtension, availableExtension.extensionName) == 0)
+					{
+						++supportedExtensionCount;
+						break;
+					}
+				}
+			}
+
+			if (supportedExtensionCount != requiredExtensions.size())
+			{
+				// GPU doesn't support all of our required extensions
+				continue;
+			}
+
+			// At this point all checks have passed for the current device
+
+			state.physicalDevice = device;
+		}
+
+		if (state.physicalDevice == VK_NULL_HANDLE)
+		{
+			// No suitable GPU was found on the system
+			return Error::NO_SUITABLE_GPU;
+		}
+
+		// Persistent threads fetch pixels a subgroup at a time, broadcasting one lane's fetch to the rest
+
+		if (state.PERSISTENT_THREADS)
+		{
+			VkPhysicalDeviceProperties properties;
+
+			vkGetPhysicalDeviceProperties(state.physicalDevice, &properties);
+
+			VkPhysicalDeviceSubgroupProperties subgroupProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES};
+
+			if (properties.apiVersion >= VK_API_VERSION_1_1)
+			{
+				VkPhysicalDeviceProperties2 properties2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+
+				properties2.pNext = &subgroupProperties;
+
+				vkGetPhysicalDeviceProperties2(state.physicalDevice, &properties2);
+			}
+
+			const VkSubgroupFeatureFlags requiredOperations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+
+			if ((subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) == 0 || (subgroupProperties.supportedOperations & requiredOperations) != requiredOperations)
+			{
+				std::cout << "[app] - err :: Persistent threads need subgroup ballots in compute shaders, tracing a pixel per thread instead" << std::endl;
+
+				state.PERSISTENT_THREADS = false;
+			}
+		}
+	}
+
+	// Create logical device
+	{
+		// Enumerate available GPU queue families
+
+		unsigned int queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(state.physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies{queueFamilyCount};
+		vkGetPhysicalDeviceQueueFamilyProperties(state.physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+		// Retrieve queues from queue families
+
+		// Frames are traced on the graphics queue when no family computes without graphics, so a headless device
+		// wants a family doing both.  Vulkan guarantees one exists wherever graphics is supported
+
+		const VkQueueFlags headlessFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+
+		int queueIndex = 0;
+		for (const auto & queueFamily : queueFamilies)
+		{
+			if (state.HEADLESS)
+			{
+				if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & headlessFlags) == headlessFlags)
+				{
+					state.graphicsQueueIndex = queueIndex;
+					state.presentQueueIndex  = queueIndex;
+					break;
+				}
+
+				++queueIndex;
+				continue;
+			}
+
+			if (queueFamily.queueCount == 0)
+			{
+				// Queue family does not contain any queues
+				continue;
+			}
+
+			if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			{
+				state.graphicsQueueIndex = queueIndex;
+			}
+
+			VkBool32 presentSupport = false;
+			vkGetPhysicalDeviceSurfaceSupportKHR(state.physicalDevice, queueIndex, state.surface, &presentSupport);
+
+			if (presentSupport)
+			{
+				state.presentQueueIndex = queueIndex;
+			}
+
+			if (state.graphicsQueueIndex && state.presentQueueIndex)
+			{
+				// All queues have been found; stop searching
+				break;
+			}
+
+			++queueIndex;
+		}
+
+		// Scene uploads go to a family which only transfers if there is one, as those queues usually front copy
+		// engines that run alongside graphics and compute work.  Otherwise they share the graphics queue
+
+		state.transferQueueIndex = state.graphicsQueueIndex;
+
+		for (unsigned int i = 0; i < queueFamilies.size(); ++i)
+		{
+			const VkQueueFlags flags = queueFamilies[i].queueFlags;
+
+			if (queueFamilies[i].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) && (flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0)
+			{
+				state.transferQueueIndex = static_cast<int>(i);
+				break;
+			}
+		}
+
+		// Frames are traced on a family with compute but no graphics if there is one, as it can then run while the
+		// graphics queue composites and presents the frame before.  Otherwise they are traced on the graphics queue
+
+		state.computeQueueIndex = state.graphicsQueueIndex;
+
+		for (unsigned int i = 0; i < queueFamilies.size(); ++i)
+		{
+			const VkQueueFlags flags = queueFamilies[i].queueFlags;
+
+			if (queueFamilies[i].queueCount > 0 && (flags & VK_QUEUE_COMPUTE_BIT) && (flags & VK_QUEUE_GRAPHICS_BIT) == 0)
+			{
+				state.computeQueueIndex = static_cast<int>(i);
+				break;
+			}
+		}
+
+		std::vector<int> uniqueQueues;
+		uniqueQueues.push_back(state.graphicsQueueIndex);
+		uniqueQueues.push_back(state.presentQueueIndex);
+		uniqueQueues.push_back(state.transferQueueIndex);
+		uniqueQueues.push_back(state.computeQueueIndex);
+
+		std::sort(uniqueQueues.begin(), uniqueQueues.end());
+
+		uniqueQueues.erase(std::unique(uniqueQueues.begin(), uniqueQueues.end()), uniqueQueues.end());
+
+		std::vector<VkDeviceQueueCreateInfo> queueInfos;
+
+		const float queuePriority = 1.0f;
+
+		for (const auto & queue : uniqueQueues)
+		{
+			VkDeviceQueueCreateInfo queueCreateInfo{VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
+
+			queueCreateInfo.queueFamilyIndex = queue;
+			queueCreateInfo.queueCount       = 1;
+			queueCreateInfo.pQueuePriorities = &queuePriority;
+
+			queueInfos.push_back(queueCreateInfo);
+		}
+
+		std::vector<const char *> requiredExtensions{ VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME };
+
+		if (state.HEADLESS == false)
+		{
+			requiredExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+		}
+
+		VkPhysicalDeviceFeatures deviceFeatures{};
+
+		// Every device exposing the extension supports the feature, so it is enabled without being queried
+
+		VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR};
+
+		timelineFeatures.timelineSemaphore = VK_TRUE;
+
+		VkDeviceCreateInfo createInfo{VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
+
+		createInfo.pNext = &timelineFeatures;
+
+		createInfo.queueCreateInfoCount = queueInfos.size();
+
+		createInfo.pQueueCreateInfos = queueInfos.data();
+		createInfo.pEnabledFeatures  = &deviceFeatures;
+
+		createInfo.enabledExtensionCount   = static_cast<uint32_t>(requiredExtensions.size());
+		createInfo.ppEnabledExtensionNames = requiredExtensions.data();
+
+		if (info.debug)
+		{
+			const char * layerNames[]
+			{
+				"VK_LAYER_LUNARG_standard_validation"
+			};
+
+			createInfo.enabledLayerCount   = sizeof(layerNames) / sizeof(layerNames[0]);
+			createInfo.ppEnabledLayerNames = layerNames;
+		}
+
+		if (vkCreateDevice(state.physicalDevice, &createInfo, nullptr, &state.device) != VK_SUCCESS)
+		{
+			std::cout << "[app] - err :: Failed to create logical device" << std::endl;
+			return Error::UNKNOWN;
+		}
+
+		vkGetDeviceQueue(state.device, state.graphicsQueueIndex, 0, &state.graphicsQueue);
+
+		vkGetDeviceQueue(state.device, state.presentQueueIndex, 0, &state.presentQueue);
+
+		vkGetDeviceQueue(state.device, state.transferQueueIndex, 0, &state.transferQueue);
+
+		vkGetDeviceQueue(state.device, state.computeQueueIndex, 0, &state.computeQueue);
+
+		state.wait_semaphores             = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(state.device, "vkWaitSemaphoresKHR"));
+		state.get_semaphore_counter_value = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(vkGetDeviceProcAddr(state.device, "vkGetSemaphoreCounterValueKHR"));
+
+		if (state.wait_semaphores == nullptr || state.get_semaphore_counter_value == nullptr)
+		{
+			std::cout << "[app] - err :: Failed to load timeline semaphore functions" << std::endl;
+			return Error::UNKNOWN;
+		}
+	}
+
+	// Create memory allocator
+	{
+		state.allocator.Init(state.physicalDevice, state.device);
+
+		// Screen-sized images are all created here and destroyed together, so they are packed back to back
+
+		PoolInfo render_target_info;
+
+		render_target_info.name     = "render target";
+		render_target_info.strategy = AllocationStrategy::LINEAR;
+		render_target_info.kind     = ResourceKind::IMAGE;
+
+		state.render_target_pool = state.allocator.CreatePool(render_target_info);
+	}
+
+	// Create pipeline cache
+	{
+		state.pipeline_cache = create_pipeline_cache();
+	}
+
+	// Create command pool / buffers
+	{
+		VkCommandPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+
+		poolInfo.queueFamilyIndex = state.graphicsQueueIndex;
+		poolInfo.flags = 0;
+
+		VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		state.commandPools.resize(state.FRAMES_IN_FLIGHT);
+		state.commandBuffers.resize(state.FRAMES_IN_FLIGHT);
+
+		for (unsigned char i = 0; i < state.FRAMES_IN_FLIGHT; ++i)
+		{
+			if (vkCreateCommandPool(state.device, &poolInfo, nullptr, &state.commandPools[i]) != VK_SUCCESS)
+			{
+				std::cout << "[app] - err :: Failed to create command pool" << std::endl;
+				return Error::UNKNOWN;
+			}
+
+			allocInfo.commandPool = state.commandPools[i];
+
+			if (vkAllocateCommandBuffers(state.device, &allocInfo, &state.commandBuffers[i]) != VK_SUCCESS)
+			{
+				std::cout << "[app] - err :: Failed to create command buffers" << std::endl;
+				return Error::UNKNOWN;
+			}
+		}
+
+		// Tracing gets pools of its own, as it may be submitted to another family
+
+		poolInfo.queueFamilyIndex = state.computeQueueIndex;
+
+		state.computeCommandPools.resize(state.FRAMES_IN_FLIGHT);
+		state.computeCommandBuffers.resize(state.FRAMES_IN_FLIGHT);
+		state.trace_finished_semaphores.resize(state.FRAMES_IN_FLIGHT);
+
+		for (unsigned char i = 0; i < state.FRAMES_IN_FLIGHT; ++i)
+		{
+			if (vkCreateCommandPool(state.device, &poolInfo, nullptr, &state.computeCommandPools[i]) != VK_SUCCESS)
+			{
+				std::cout << "[app] - err :: Failed to create compute command pool" << std::endl;
+				return Error::UNKNOWN;
+			}
+
+			allocInfo.commandPool = state.computeCommandPools[i];
+
+			if (vkAllocateCommandBuffers(state.device, &allocInfo, &state.computeCommandBuffers[i]) != VK_SUCCESS)
+			{
+				std::cout << "[app] - err :: Failed to create compute command buffers" << std::endl;
+				return Error::UNKNOWN;
+			}
+
+			VkSemaphoreCreateInfo semaphore_info{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+
+			if (vkCreateSemaphore(state.device, &semaphore_info, nullptr, &state.trace_finished_semaphores[i]) != VK_SUCCESS)
+			{
+				std::cout << "[app] - err :: Failed to create trace semaphores" << std::endl;
+				return Error::UNKNOWN;
+			}
+		}
+	}
+
+	// Create staging ring
+	{
+		StagingRing & ring = state.staging;
+
+		ring.capacity = STAGING_RING_SIZE;
+
+		create_buffer(ring.capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, ring.buffer.buffer, ring.buffer.memory);
+
+		VkCommandPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+
+		pool_info.queueFamilyIndex = state.transferQueueIndex;
+		pool_info.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+		if (vkCreateCommandPool(state.device, &pool_info, nullptr, &ring.command_pool) != VK_SUCCESS)
+		{
+			std::cout << "[app] - err :: Failed to create staging command pool" << std::endl;
+			return Error::UNKNOWN;
+		}
+
+		ring.semaphores.resize(state.FRAMES_IN_FLIGHT);
+
+		for (auto & semaphore : ring.semaphores)
+		{
+			VkSemaphoreCreateInfo semaphore_info{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+
+			vkCreateSemaphore(state.device, &semaphore_info, nullptr, &semaphore);
+		}
+	}
+
+	// Create offscreen images
+	if (state.HEADLESS)
+	{
+		// Stand in for swapchain images, one per frame in flight, so the filter pass and framebuffers are shared.
+		// RGBA rather than BGRA, so read back pixels need no swizzle
+
+		state.swapchain.surfaceFormat = {VK_FORMAT_R8G8B8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+		state.swapchain.extent        = {info.headless_width, info.headless_height};
+
+		state.swapchain.images.resize(state.FRAMES_IN_FLIGHT);
+		state.swapchain.imageMemory.resize(state.FRAMES_IN_FLIGHT);
+		state.swapchain.imageViews.resize(state.FRAMES_IN_FLIGHT);
+
+		for (unsigned int i = 0; i < state.FRAMES_IN_FLIGHT; ++i)
+		{
+			VkImageCreateInfo image_info{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+
+			image_info.imageType = VK_IMAGE_TYPE_2D;
+			image_info.format    = state.swapchain.surfaceFormat.format;
+			image_info.tiling    = VK_IMAGE_TILING_OPTIMAL;
+			image_info.usage     = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			image_info.samples   = VK_SAMPLE_COUNT_1_BIT;
+
+			image_info.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+			image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			image_info.extent = {state.swapchain.extent.width, state.swapchain.extent.height, 1};
+
+			image_info.mipLevels   = 1;
+			image_info.arrayLayers = 1;
+
+			if (vkCreateImage(state.device, &image_info, nullptr, &state.swapchain.images[i]) != VK_SUCCESS)
+			{
+				std::cout << "[app] - err :: Failed to create offscreen image" << std::endl;
+				return Error::UNKNOWN;
+			}
+
+			VkMemoryRequirements mem_reqs;
+			vkGetImageMemoryRequirements(state.device, state.swapchain.images[i], &mem_reqs);
+
+			state.allocator.Allocate(mem_reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ResourceKind::IMAGE, state.swapchain.imageMemory[i]);
+
+			vkBindImageMemory(state.device, state.swapchain.images[i], state.swapchain.imageMemory[i].memory, state.swapchain.imageMemory[i].offset);
+
+			VkImageViewCreateInfo view_info{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+
+			view_info.image    = state.swapchain.images[i];
+			view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			view_info.format   = state.swapchain.surfaceFormat.format;
+
+			view_info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+			vkCreateImageView(state.device, &view_info, nullptr, &state.swapchain.imageViews[i]);
+		}
+
+		const VkDeviceSize readback_size = 4 * static_cast<VkDeviceSize>(state.swapchain.extent.width) * state.swapchain.extent.height;
+
+		create_buffer(readback_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, state.readback_buffer.buffer, state.readback_buffer.memory);
+	}
+
+	// Create swapchain
+	if (state.HEADLESS == false)
+	{
+		// Enumerate available surface formats
+
+		unsigned int availableFormatCount;
+		vkGetPhysicalDeviceSurfaceFormatsKHR(state.physicalDevice, state.surface, &availableFormatCount, nullptr);
+
+		if (availableFormatCount == 0)
+		{
+			// Surface does not avail any supported pixel formats
+			return Error::NO_SUITABLE_SURFACE;
+		}
+
+		std::vector<VkSurfaceFormatKHR> availableFormats{availableFormatCount};
+		vkGetPhysicalDeviceSurfaceFormatsKHR(state.physicalDevice, state.surface, &availableFormatCount, availableFormats.data());
+
+		// Choose optimal surface format
+
+		if (availableFormats.size() == 1 && availableFormats[0].format == VK_FORMAT_UNDEFINED)
+		{
+			state.swapchain.surfaceFormat = {VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+		}
+
+		for (const auto & availableFormat : availableFormats)
+		{
+			if (availableFormat.format == VK_FORMAT_B8G8R8A8_UNORM && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
+			{
+				state.swapchain.surfaceFormat = availableFormat;
+			}
+		}
+
+		// Enumerate available present modes
+
+		unsigned int availablePresentModeCount;
+		vkGetPhysicalDeviceSurfacePresentModesKHR(state.physicalDevice, state.surface, &availablePresentModeCount, nullptr);
+
+		if (availablePresentModeCount == 0)
+		{
+			// Surface does not avail any supported present modes
+			return Error::NO_SUITABLE_SURFACE;
+		}
+
+		std::vector<VkPresentModeKHR> availablePresentModes{availablePresentModeCount};
+		vkGetPhysicalDeviceSurfacePresentModesKHR(state.physicalDevice, state.surface, &availablePresentModeCount, availablePresentModes.data());
+
+		// Choose optimal present mode
+
+		VkPresentModeKHR bestMode = VK_PRESENT_MODE_FIFO_KHR;
+
+		for (const auto & presentMode : availablePresentModes)
+		{
+			if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+			{
+				state.swapchain.presentMode = presentMode;
+			}
+			else if (presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR)
+			{
+				state.swapchain.presentMode = presentMode;
+			}
+		}
+
+		// Enumerate available swap extents
+
+		VkSurfaceCapabilitiesKHR surfaceCapabilities;
+		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(state.physicalDevice, state.surface, &surfaceCapabilities);
+
+		if (surfaceCapabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
+		{
+			state.swapchain.extent = surfaceCapabilities.currentExtent;
+		}
+		else
+		{
+			int width;
+			int height;
+			glfwGetFramebufferSize(info.window, &width, &height);
+
+			VkExtent2D actualExtent{static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+
+			actualExtent.width  = std::clamp(actualExtent.width, surfaceCapabilities.minImageExtent.width, surfaceCapabilities.maxImageExtent.width);
+			actualExtent.height = std::clamp(actualExtent.height, surfaceCapabilities.minImageExtent.height, surfaceCapabilities.maxImageExtent.height);
+
+			state.swapchain.extent = actualExtent;
+		}
+
+		// Create swapchain
+
+		unsigned int imageCount = info.swapchainSize == 0 ? surfaceCapabilities.minImageCount + 1 : info.swapchainSize;
+
+		if (info.swapchainSize != 0 && surfaceCapabilities.minImageCount > info.swapchainSize)
+		{
+			imageCount = surfaceCapabilities.minImageCount;
+		}
+
+		if (surfaceCapabilities.maxImageCount > 0 && imageCount > surfaceCapabilities.maxImageCount)
+		{
+			imageCount = surfaceCapabilities.maxImageCount;
+		}
+
+		VkSwapchainCreateInfoKHR createInfo{VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR};
+		createInfo.surface          = state.surface;
+		createInfo.minImageCount    = imageCount;
+		createInfo.imageFormat      = state.swapchain.surfaceFormat.format;
+		createInfo.imageColorSpace  = state.swapchain.surfaceFormat.colorSpace;
+		createInfo.imageExtent      = state.swapchain.extent;
+		createInfo.imageArrayLayers = 1;
+		createInfo.imageUsage       = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		createInfo.preTransform     = surfaceCapabilities.currentTransform;
+		createInfo.compositeAlpha   = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+		createInfo.presentMode      = state.swapchain.presentMode;
+		createInfo.clipped          = VK_TRUE;
+
+		if (vkCreateSwapchainKHR(state.device, &createInfo, nullptr, &state.swapchain.swapchain) != VK_SUCCESS)
+		{
+			return Error::NO_SUITABLE_SURFACE;
+		}
+
+		// Retrieve swapchain images
+
+		vkGetSwapchainImagesKHR(state.device, state.swapchain.swapchain, &imageCount, nullptr);
+		state.swapchain.images.resize(imageCount);
+		vkGetSwapchainImagesKHR(state.device, state.swapchain.swapchain, &imageCount, state.swapchain.images.data());
+
+		// Create image views
+
+		state.swapchain.imageViews.resize(state.swapchain.images.size());
+
+		for (unsigned int i = 0; i < state.swapchain.imageViews.size(); ++i)
+		{
+			VkImageViewCreateInfo createInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+
+			createInfo.image    = state.swapchain.images[i];
+			createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			createInfo.format   = state.swapchain.surfaceFormat.format;
+
+			createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+			createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+			createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+			createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+
+			createInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+			createInfo.subresourceRange.baseMipLevel   = 0;
+			createInfo.subresourceRange.levelCount     = 1;
+			createInfo.subresourceRange.baseArrayLayer = 0;
+			createInfo.subresourceRange.layerCount     = 1;
+
+			if (vkCreateImageView(state.device, &createInfo, nullptr, &state.swapchain.imageViews[i]) != VK_SUCCESS)
+			{
+				return Error::NO_SUITABLE_SURFACE;
+			}
+		}
+
+		// Create semaphores
+
+		state.swapchain.imageAvailableSemaphores.resize(info.framesInFlight);
+		state.swapchain.renderFinishedSemaphores.resize(info.framesInFlight);
+
+		for (unsigned char i = 0; i < info.framesInFlight; ++i)
+		{
+			VkSemaphoreCreateInfo semaphoreInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+
+			if (vkCreateSemaphore(state.device, &semaphoreInfo, nullptr, &state.swapchain.imageAvailableSemaphores[i]) != VK_SUCCESS
+				|| vkCreateSemaphore(state.device, &semaphoreInfo, nullptr, &state.swapchain.renderFinishedSemaphores[i]) != VK_SUCCESS)
+			{
+				std::cout << "[app] - err :: Failed to create swapchain semaphores" << std::endl;
+				return Error::UNKNOWN;
+			}
+		}
+	}
+
+	// Create frame timeline
+	{
+		VkSemaphoreTypeCreateInfoKHR type_info{VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR};
+
+		type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+		type_info.initialValue  = 0;
+
+		VkSemaphoreCreateInfo semaphore_info{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+
+		semaphore_info.pNext = &type_info;
+
+		if (vkCreateSemaphore(state.device, &semaphore_info, nullptr, &state.timeline.semaphore) != VK_SUCCESS)
+		{
+			std::cout << "[app] - err :: Failed to create frame timeline" << std::endl;
+			return Error::UNKNOWN;
+		}
+	}
+
+	// Create shader resources
+	{
+		state.traced_images.resize(state.FRAMES_IN_FLIGHT);
+		state.traced_image_memory.resize(state.FRAMES_IN_FLIGHT);
+
+		for (unsigned int i = 0; i < state.FRAMES_IN_FLIGHT; ++i)
+		{
+			VkImageCreateInfo raytrace_image_info{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+
+			raytrace_image_info.imageType = VK_IMAGE_TYPE_2D;
+			raytrace_image_info.format    = VK_FORMAT_R16G16B16A16_SFLOAT;
+			raytrace_image_info.tiling    = VK_IMAGE_TILING_OPTIMAL;
+			raytrace_image_info.usage     = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			raytrace_image_info.samples   = VK_SAMPLE_COUNT_1_BIT;
+
+			raytrace_image_info.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+			raytrace_image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			raytrace_image_info.extent.width  = static_cast<uint32_t>(state.RAYTRACE_RESOLUTION);
+			raytrace_image_info.extent.height = static_cast<uint32_t>(state.RAYTRACE_RESOLUTION);
+			raytrace_image_info.extent.depth  = 1;
+
+			raytrace_image_info.mipLevels   = 1;
+			raytrace_image_info.arrayLayers = 1;
+
+			vkCreateImage(state.device, &raytrace_image_info, nullptr, &state.traced_images[i]);
+
+			VkMemoryRequirements raytrace_image_mem_reqs;
+			vkGetImageMemoryRequirements(state.device, state.traced_images[i], &raytrace_image_mem_reqs);
+
+			state.allocator.Allocate(state.render_target_pool, raytrace_image_mem_reqs, state.traced_image_memory[i]);
+
+			vkBindImageMemory(state.device, state.traced_images[i], state.traced_image_memory[i].memory, state.traced_image_memory[i].offset);
+		}
+
+		// Traced images are half floats, which every device can filter.  The history needs full floats to keep
+		// absorbing frames long after a half would stop changing, as do positions far from the origin.  These are
+		// only ever loaded and stored
+
+		state.accumulation_images.resize(state.FRAMES_IN_FLIGHT);
+
+		for (auto & image : state.accumulation_images)
+		{
+			image = create_image(VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT);
+		}
+
+		state.radiance_image = create_image(VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT);
+		state.position_image = create_image(VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT);
+
+		state.normal_images.resize(state.FRAMES_IN_FLIGHT);
+		state.moment_images.resize(state.FRAMES_IN_FLIGHT);
 
 		for (unsigned int i = 0; i < state.FRAMES_IN_FLIGHT; ++i)
 		{
-			VkImageCreateInfo raytrace_image_info{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+			state.normal_images[i] = create_image(VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT);
+			state.moment_images[i] = create_image(VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT);
+		}
+
+		state.albedo_image = create_image(VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT);
+
+		for (auto & image : state.filter_images)
+		{
+			image = create_image(VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT);
+		}
+
+		VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = state.computeCommandPools[0];
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		vkAllocateCommandBuffers(state.device, &allocInfo, &commandBuffer);
+
+		VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+		// Storage images are only used by the compute queue, so they start out owned by it.  Traced images move
+		// between queues every frame, and are first transitioned by the frame tracing into them
+
+		std::vector<VkImage> storage_images{ state.radiance_image.image, state.position_image.image, state.albedo_image.image, state.filter_images[0].image, state.filter_images[1].image };
+
+		for (unsigned int i = 0; i < state.FRAMES_IN_FLIGHT; ++i)
+		{
+			storage_images.push_back(state.accumulation_images[i].image);
+			storage_images.push_back(state.normal_images[i].image);
+			storage_images.push_back(state.moment_images[i].image);
+		}
+
+		for (const auto image : storage_images)
+		{
+			VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = image;
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+			vkCmdPipelineBarrier(
+				commandBuffer,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0,
+				0, nullptr,
+				0, nullptr,
+				1, &barrier
+			);
+		}
+
+		vkEndCommandBuffer(commandBuffer);
+
+		VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers    = &commandBuffer;
+
+		vkQueueSubmit(state.computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+		vkQueueWaitIdle(state.computeQueue);
+
+		vkFreeCommandBuffers(state.device, state.computeCommandPools[0], 1, &commandBuffer);
+
+		state.traced_image_views.resize(state.FRAMES_IN_FLIGHT);
+
+		for (unsigned int i = 0; i < state.FRAMES_IN_FLIGHT; ++i)
+		{
+			VkImageViewCreateInfo raytrace_image_view_info{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+
+			raytrace_image_view_info.image    = state.traced_images[i];
+			raytrace_image_view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			raytrace_image_view_info.format   = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+			raytrace_image_view_info.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+			raytrace_image_view_info.subresourceRange.baseMipLevel   = 0;
+			raytrace_image_view_info.subresourceRange.levelCount     = 1;
+			raytrace_image_view_info.subresourceRange.baseArrayLayer = 0;
+			raytrace_image_view_info.subresourceRange.layerCount     = 1;
+
+			vkCreateImageView(state.device, &raytrace_image_view_info, nullptr, &state.traced_image_views[i]);
+		}
+
+		VkSamplerCreateInfo raytrace_image_sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+
+		raytrace_image_sampler_info.magFilter = VK_FILTER_LINEAR;
+		raytrace_image_sampler_info.minFilter = VK_FILTER_LINEAR;
+
+		raytrace_image_sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+		raytrace_image_sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+		raytrace_image_sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+
+		raytrace_image_sampler_info.anisotropyEnable = VK_FALSE;
+		raytrace_image_sampler_info.maxAnisotropy    = 1;
+
+		raytrace_image_sampler_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+
+		raytrace_image_sampler_info.unnormalizedCoordinates = VK_FALSE;
+
+		raytrace_image_sampler_info.compareEnable = VK_FALSE;
+		raytrace_image_sampler_info.compareOp     = VK_COMPARE_OP_ALWAYS;
+
+		raytrace_image_sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		raytrace_image_sampler_info.mipLodBias = 0.0f;
+		raytrace_image_sampler_info.minLod     = 0.0f;
+		raytrace_image_sampler_info.maxLod     = 0.0f;
+
+		vkCreateSampler(state.device, &raytrace_image_sampler_info, nullptr, &state.raytrace_storage_image_sampler);
+
+		// Keep host copies of the scene, so updates can refit, rebuild or re-flatten it
+
+		state.meshes.resize(info.mesh_count);
+
+		for (unsigned int i = 0; i < info.mesh_count; ++i)
+		{
+			state.meshes[i].assign(info.meshes[i].triangles, info.meshes[i].triangles + info.meshes[i].triangle_count);
+		}
+
+		state.instances.assign(info.instances, info.instances + info.instance_count);
+
+		const VkMemoryPropertyFlags host_visible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+		// Rays read the scene buffers far more often than anything writes them, so they are device local and filled
+		// through the staging ring.  Each frame in flight traces its own copy, so uploads wait only for the frame that
+		// last read the copy they overwrite
+
+		state.scenes.resize(state.FRAMES_IN_FLIGHT);
+
+		if (info.dynamic_bvh)
+		{
+			// Device-built hierarchies index triangles indirectly, so the flattened scene keeps instance order.  The
+			// bottom-level node buffer is never read, but stays bound
+
+			const std::vector<Triangle> world_tris = flatten_instances();
+
+			state.TRIANGLE_COUNT = static_cast<uint32_t>(world_tris.size());
+
+			create_scene_buffer(sizeof(PrecomputedTriangle) * std::max<size_t>(world_tris.size(), 1), &SceneBuffers::scene_data_buffer);
+			create_scene_buffer(sizeof(glm::vec4) * std::max<size_t>(world_tris.size(), 1), &SceneBuffers::normal_buffer);
+			create_scene_buffer(sizeof(BVHNode), &SceneBuffers::bvh_node_buffer);
+
+			upload_triangles(world_tris);
+		}
+		else
+		{
+			// Every mesh's nodes and triangles are laid out back to back.  Rebuilds triggered by UpdateMesh may change
+			// a mesh's node count, so each gets room for the largest tree over its triangles.  Every wide node stands
+			// for at least one binary interior node, and a leaf root still gets one
+
+			const VkDeviceSize node_size = state.WIDE_BVH ? sizeof(BVH8Node) : sizeof(BVHNode);
+
+			uint32_t node_count = 0;
+			uint32_t tri_count  = 0;
+
+			for (const auto & mesh : state.meshes)
+			{
+				state.blas_node_offsets.push_back(node_count);
+				state.blas_tri_offsets.push_back(tri_count);
+
+				node_count += state.WIDE_BVH
+					? std::max<uint32_t>(static_cast<uint32_t>(mesh.size()), 1)
+					: 2 * std::max<uint32_t>(static_cast<uint32_t>(mesh.size()), 1) - 1;
+				tri_count  += static_cast<uint32_t>(mesh.size());
+			}
+
+			state.TRIANGLE_COUNT = tri_count;
+
+			create_scene_buffer(sizeof(PrecomputedTriangle) * std::max(tri_count, 1u), &SceneBuffers::scene_data_buffer);
+			create_scene_buffer(sizeof(glm::vec4) * std::max(tri_count, 1u), &SceneBuffers::normal_buffer);
+			create_scene_buffer(node_size * std::max(node_count, 1u), &SceneBuffers::bvh_node_buffer);
+
+			for (uint32_t i = 0; i < state.meshes.size(); ++i)
+			{
+				state.blas.push_back(build_bvh(state.meshes[i].data(), state.meshes[i].size()));
+
+				upload_blas(i);
+			}
+		}
+
+		const VkDeviceSize tlas_node_buffer_size = sizeof(BVHNode) * (2 * std::max(info.instance_count, 1u) - 1);
+		const VkDeviceSize instance_buffer_size  = sizeof(InstanceData) * std::max(info.instance_count, 1u);
+
+		create_scene_buffer(tlas_node_buffer_size, &SceneBuffers::tlas_node_buffer);
+		create_scene_buffer(instance_buffer_size, &SceneBuffers::instance_buffer);
+
+		// Always bound, though only the persistent-threads tracer reads it
+		create_buffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, state.work_counter_buffer.buffer, state.work_counter_buffer.memory);
+
+		if (info.dynamic_bvh == false)
+		{
+			upload_tlas();
+		}
+
+		// Each frame in flight copies its traced image into its own slot, so capture never waits on the device
+
+		if (info.capture_frames)
+		{
+			const VkDeviceSize readback_size = 4 * sizeof(uint16_t) * static_cast<VkDeviceSize>(state.RAYTRACE_RESOLUTION) * state.RAYTRACE_RESOLUTION;
+
+			PoolInfo readback_info;
+
+			readback_info.name       = "readback";
+			readback_info.strategy   = AllocationStrategy::POOL;
+			readback_info.properties = host_visible;
+			readback_info.block_size = readback_size * state.FRAMES_IN_FLIGHT;
+			readback_info.slot_size  = readback_size;
+
+			state.readback_pool = state.allocator.CreatePool(readback_info);
+
+			state.readback_ring.resize(state.FRAMES_IN_FLIGHT);
+
+			for (auto & slot : state.readback_ring)
+			{
+				create_buffer(readback_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, host_visible, slot.buffer.buffer, slot.buffer.memory, state.readback_pool);
+
+				slot.mapped = slot.buffer.memory.mapped;
+
+				slot.pending = false;
+			}
+		}
+	}
+
+	// Create graphics descriptors
+	{
+		VkDescriptorSetLayoutBinding blit_sampler_binding{};
+
+		blit_sampler_binding.binding    = 0;
+		blit_sampler_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		blit_sampler_binding.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		blit_sampler_binding.descriptorCount = 1;
+
+		VkDescriptorSetLayoutCreateInfo layout_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+		layout_info.bindingCount = 1;
+		layout_info.pBindings    = &blit_sampler_binding;
+
+		vkCreateDescriptorSetLayout(state.device, &layout_info, nullptr, &state.graphics_descset_layout);
+
+		VkDescriptorPoolSize pool_size{};
+
+		pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+		pool_size.descriptorCount = static_cast<uint32_t>(state.FRAMES_IN_FLIGHT);
+
+		VkDescriptorPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+
+		pool_info.poolSizeCount = 1;
+		pool_info.pPoolSizes    = &pool_size;
+		pool_info.maxSets       = static_cast<uint32_t>(state.FRAMES_IN_FLIGHT);
+
+		vkCreateDescriptorPool(state.device, &pool_info, nullptr, &state.graphics_desc_pool);
+
+		// Each frame in flight displays the image it traced
+
+		state.graphics_descsets.resize(state.FRAMES_IN_FLIGHT);
+
+		const std::vector<VkDescriptorSetLayout> set_layouts(state.FRAMES_IN_FLIGHT, state.graphics_descset_layout);
+
+		VkDescriptorSetAllocateInfo alloc_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+		alloc_info.descriptorPool     = state.graphics_desc_pool;
+		alloc_info.descriptorSetCount = static_cast<uint32_t>(state.FRAMES_IN_FLIGHT);
+		alloc_info.pSetLayouts        = set_layouts.data();
+
+		vkAllocateDescriptorSets(state.device, &alloc_info, state.graphics_descsets.data());
+
+		for (unsigned int i = 0; i < state.FRAMES_IN_FLIGHT; ++i)
+		{
+			VkDescriptorImageInfo image_info{};
+
+			image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+			image_info.imageView = state.traced_image_views[i];
+			image_info.sampler   = state.raytrace_storage_image_sampler;
+
+			VkWriteDescriptorSet descriptor_write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+
+			descriptor_write.dstSet = state.graphics_descsets[i];
+			descriptor_write.dstBinding = 0;
+			descriptor_write.dstArrayElement = 0;
+			descriptor_write.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptor_write.descriptorCount = 1;
+			descriptor_write.pImageInfo = &image_info;
+
+			vkUpdateDescriptorSets(state.device, 1, &descriptor_write, 0, nullptr);
+		}
+	}
+
+	// Create compute descriptors
+	{
+		VkDescriptorSetLayoutBinding storage_sampler_binding{};
+
+		storage_sampler_binding.binding    = 0;
+		storage_sampler_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		storage_sampler_binding.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		storage_sampler_binding.descriptorCount = 1;
+
+		VkDescriptorSetLayoutBinding scene_buffer_binding{};
+
+		scene_buffer_binding.binding    = 1;
+		scene_buffer_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		scene_buffer_binding.descriptorCount = 1;
+		scene_buffer_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+		VkDescriptorSetLayoutBinding bvh_buffer_binding{};
+
+		bvh_buffer_binding.binding    = 2;
+		bvh_buffer_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		bvh_buffer_binding.descriptorCount = 1;
+		bvh_buffer_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+		VkDescriptorSetLayoutBinding lbvh_buffer_binding{};
+
+		lbvh_buffer_binding.binding    = 3;
+		lbvh_buffer_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		lbvh_buffer_binding.descriptorCount = 1;
+		lbvh_buffer_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+		VkDescriptorSetLayoutBinding tlas_buffer_binding{};
+
+		tlas_buffer_binding.binding    = 4;
+		tlas_buffer_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		tlas_buffer_binding.descriptorCount = 1;
+		tlas_buffer_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+		VkDescriptorSetLayoutBinding instance_buffer_binding{};
+
+		instance_buffer_binding.binding    = 5;
+		instance_buffer_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		instance_buffer_binding.descriptorCount = 1;
+		instance_buffer_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+		VkDescriptorSetLayoutBinding normal_buffer_binding{};
+
+		normal_buffer_binding.binding    = 6;
+		normal_buffer_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		normal_buffer_binding.descriptorCount = 1;
+		normal_buffer_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+		VkDescriptorSetLayoutBinding work_counter_binding{};
+
+		work_counter_binding.binding    = 7;
+		work_counter_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		work_counter_binding.descriptorCount = 1;
+		work_counter_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+		std::vector<VkDescriptorSetLayoutBinding> bindings { storage_sampler_binding, scene_buffer_binding, bvh_buffer_binding, lbvh_buffer_binding, tlas_buffer_binding, instance_buffer_binding, normal_buffer_binding, work_counter_binding };
+
+		// Temporal and denoiser images: history, radiance, positions, normals, albedo, moments and filter images
+
+		for (uint32_t binding = 8; binding < 19; ++binding)
+		{
+			VkDescriptorSetLayoutBinding image_binding{};
+
+			image_binding.binding    = binding;
+			image_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+			image_binding.descriptorCount = 1;
+			image_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+			bindings.push_back(image_binding);
+		}
 
-			raytrace_image_info.imageType = VK_IMAGE_TYPE_2D;
-			raytrace_image_info.format    = VK_FORMAT_R8G8B8A8_UNORM;
-			raytrace_image_info.tiling    = VK_IMAGE_TILING_OPTIMAL;
-			raytrace_image_info.usage     = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
-			raytrace_image_info.samples   = VK_SAMPLE_COUNT_1_BIT;
+		VkDescriptorSetLayoutCreateInfo layout_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+		layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+		layout_info.pBindings    = bindings.data();
 
-			raytrace_image_info.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
-			raytrace_image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		vkCreateDescriptorSetLayout(state.device, &layout_info, nullptr, &state.compute_descset_layout);
 
-			raytrace_image_info.extent.width  = static_cast<uint32_t>(state.RAYTRACE_RESOLUTION);
-			raytrace_image_info.extent.height = static_cast<uint32_t>(state.RAYTRACE_RESOLUTION);
-			raytrace_image_info.extent.depth  = 1;
+		VkDescriptorPoolSize pool_size{};
 
-			raytrace_image_info.mipLevels   = 1;
-			raytrace_image_info.arrayLayers = 1;
+		pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 
-			vkCreateImage(state.device, &raytrace_image_info, nullptr, &state.traced_images[i]);
+		pool_size.descriptorCount = static_cast<unsigned int>(12 * state.FRAMES_IN_FLIGHT);
 
-			VkMemoryRequirements raytrace_image_mem_reqs;
-			vkGetImageMemoryRequirements(state.device, state.traced_images[i], &raytrace_image_mem_reqs);
+		VkDescriptorPoolSize scene_buffer_size{};
+		
+		scene_buffer_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 
-			VkMemoryAllocateInfo raytrace_image_alloc_info{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-			raytrace_image_alloc_info.allocationSize  = raytrace_image_mem_reqs.size;
-			raytrace_image_alloc_info.memoryTypeIndex = find_memory_type(raytrace_image_mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		scene_buffer_size.descriptorCount = static_cast<unsigned int>(7 * state.FRAMES_IN_FLIGHT);
 
-			vkAllocateMemory(state.device, &raytrace_image_alloc_info, nullptr, &state.traced_image_memory[i]);
+		const VkDescriptorPoolSize pool_sizes[] { pool_size, scene_buffer_size };
 
-			vkBindImageMemory(state.device, state.traced_images[i], state.traced_image_memory[i], 0);
-		}
+		VkDescriptorPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
 
-		VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandPool = state.commandPools[0];
-		allocInfo.commandBufferCount = 1;
+		pool_info.poolSizeCount = 2;
+		pool_info.pPoolSizes    = pool_sizes;
+		pool_info.maxSets       = static_cast<unsigned int>(state.FRAMES_IN_FLIGHT);
 
-		VkCommandBuffer commandBuffer;
-		vkAllocateCommandBuffers(state.device, &allocInfo, &commandBuffer);
+		vkCreateDescriptorPool(state.device, &pool_info, nullptr, &state.compute_desc_pool);
 
-		VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		state.compute_descsets.resize(state.FRAMES_IN_FLIGHT);
 
-		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		const VkDescriptorSetLayout set_layouts[] = { state.compute_descset_layout, state.compute_descset_layout };
+
+		VkDescriptorSetAllocateInfo alloc_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+		alloc_info.descriptorPool     = state.compute_desc_pool;
+		alloc_info.descriptorSetCount = 2;
+		alloc_info.pSetLayouts        = set_layouts;
+
+		vkAllocateDescriptorSets(state.device, &alloc_info, state.compute_descsets.data());
 
 		for (unsigned int i = 0; i < state.FRAMES_IN_FLIGHT; ++i)
 		{
-			VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
-			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			barrier.image = state.traced_images[i];
-			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			barrier.subresourceRange.baseMipLevel = 0;
-			barrier.subresourceRange.levelCount = 1;
-			barrier.subresourceRange.baseArrayLayer = 0;
-			barrier.subresourceRange.layerCount = 1;
-			barrier.srcAccessMask = 0;
-			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			VkDescriptorImageInfo image_info{};
 
-			vkCmdPipelineBarrier(
-				commandBuffer,
-				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-				0,
-				0, nullptr,
-				0, nullptr,
-				1, &barrier
-			);
+			image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			image_info.imageView = state.traced_image_views[i];
+			image_info.sampler   = state.raytrace_storage_image_sampler;
+
+			VkDescriptorBufferInfo scene_buffer_info{};
+
+			scene_buffer_info.buffer = state.scenes[i].scene_data_buffer.buffer;
+			scene_buffer_info.offset = 0;
+			scene_buffer_info.range  = VK_WHOLE_SIZE;
+
+			VkDescriptorBufferInfo bvh_buffer_info{};
+
+			bvh_buffer_info.buffer = state.scenes[i].bvh_node_buffer.buffer;
+			bvh_buffer_info.offset = 0;
+			bvh_buffer_info.range  = VK_WHOLE_SIZE;
+
+			VkWriteDescriptorSet storage_image_write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+
+			storage_image_write.dstSet = state.compute_descsets[i];
+			storage_image_write.dstBinding = 0;
+			storage_image_write.dstArrayElement = 0;
+			storage_image_write.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			storage_image_write.descriptorCount = 1;
+			storage_image_write.pImageInfo = &image_info;
+
+			VkWriteDescriptorSet scene_buffer_write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+
+			scene_buffer_write.dstSet = state.compute_descsets[i];
+			scene_buffer_write.dstBinding = 1;
+			scene_buffer_write.dstArrayElement = 0;
+			scene_buffer_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			scene_buffer_write.descriptorCount = 1;
+			scene_buffer_write.pBufferInfo = &scene_buffer_info;
+
+			VkWriteDescriptorSet bvh_buffer_write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+
+			bvh_buffer_write.dstSet = state.compute_descsets[i];
+			bvh_buffer_write.dstBinding = 2;
+			bvh_buffer_write.dstArrayElement = 0;
+			bvh_buffer_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bvh_buffer_write.descriptorCount = 1;
+			bvh_buffer_write.pBufferInfo = &bvh_buffer_info;
+
+			const VkWriteDescriptorSet descriptor_writes[] { storage_image_write, scene_buffer_write, bvh_buffer_write };
+
+			vkUpdateDescriptorSets(state.device, 3, descriptor_writes, 0, nullptr);
+
+			write_storage_buffer(state.compute_descsets[i], 4, state.scenes[i].tlas_node_buffer.buffer);
+			write_storage_buffer(state.compute_descsets[i], 5, state.scenes[i].instance_buffer.buffer);
+			write_storage_buffer(state.compute_descsets[i], 6, state.scenes[i].normal_buffer.buffer);
+			write_storage_buffer(state.compute_descsets[i], 7, state.work_counter_buffer.buffer);
+
+			const unsigned int previous = (i + state.FRAMES_IN_FLIGHT - 1) % state.FRAMES_IN_FLIGHT;
+
+			write_storage_image(state.compute_descsets[i], 8, state.accumulation_images[i].view);
+			write_storage_image(state.compute_descsets[i], 9, state.accumulation_images[previous].view);
+			write_storage_image(state.compute_descsets[i], 10, state.radiance_image.view);
+			write_storage_image(state.compute_descsets[i], 11, state.position_image.view);
+			write_storage_image(state.compute_descsets[i], 12, state.normal_images[i].view);
+			write_storage_image(state.compute_descsets[i], 13, state.normal_images[previous].view);
+			write_storage_image(state.compute_descsets[i], 14, state.albedo_image.view);
+			write_storage_image(state.compute_descsets[i], 15, state.moment_images[i].view);
+			write_storage_image(state.compute_descsets[i], 16, state.moment_images[previous].view);
+			write_storage_image(state.compute_descsets[i], 17, state.filter_images[0].view);
+			write_storage_image(state.compute_descsets[i], 18, state.filter_images[1].view);
 		}
+	}
 
-		vkEndCommandBuffer(commandBuffer);
+	// Create device BVH builder
+	if (state.DYNAMIC_BVH)
+	{
+		state.lbvh_builder = create_lbvh_builder(state.TRIANGLE_COUNT);
+		state.lbvh_update  = LBVHUpdate::REBUILD;
 
-		VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers    = &commandBuffer;
+		for (const auto & descset : state.compute_descsets)
+		{
+			write_storage_buffer(descset, 3, state.lbvh_builder.node_buffer.buffer);
+		}
+	}
 
-		vkQueueSubmit(state.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(state.graphicsQueue);
+	// Create render graph
+	{
+		// Filters the traced image onto the backbuffer, then leaves a pass for the UI to draw over it, which shares
+		// the filter's subpass as it draws into the same attachment
 
-		vkFreeCommandBuffers(state.device, state.commandPools[0], 1, &commandBuffer);
+		Renderer::PipelineInfo filter_pipeline{};
 
-		state.traced_image_views.resize(state.FRAMES_IN_FLIGHT);
+		filter_pipeline.shader_count = 2;
+		filter_pipeline.shaders[0]   = { "../Assets/Compiled/Fullscreen.vert.spv", "main", Renderer::PipelineInfo::ShaderInfo::Stage::VERTEX };
+		filter_pipeline.shaders[1]   = { "../Assets/Compiled/Fullscreen.frag.spv", "main", Renderer::PipelineInfo::ShaderInfo::Stage::FRAGMENT };
 
-		for (unsigned int i = 0; i < state.FRAMES_IN_FLIGHT; ++i)
+		Renderer::AttachmentInfo attachments[] { { "backbuffer", Renderer::AttachmentInfo::Source::BACKBUFFER } };
+
+		Renderer::PassInfo passes[2]{};
+
+		passes[0].debug_name         = "filter";
+		passes[0].color_output_count = 1;
+		passes[0].color_outputs[0]   = 0;
+		passes[0].pipeline_count     = 1;
+		passes[0].pipelines          = &filter_pipeline;
+
+		passes[1].debug_name         = "ui";
+		passes[1].color_output_count = 1;
+		passes[1].color_outputs[0]   = 0;
+
+		Renderer::GraphInfo graph_info{};
+
+		graph_info.pass_count             = 2;
+		graph_info.passes                 = passes;
+		graph_info.color_attachment_count = 1;
+		graph_info.color_attachments      = attachments;
+
+		if (create_render_graph(graph_info, state.render_graph) == false)
 		{
-			VkImageViewCreateInfo raytrace_image_view_info{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+			std::cout << "[app] - err :: Failed to compile the render graph" << std::endl;
+			return Error::UNKNOWN;
+		}
+	}
 
-			raytrace_image_view_info.image    = state.traced_images[i];
-			raytrace_image_view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-			raytrace_image_view_info.format   = VK_FORMAT_R8G8B8A8_UNORM;
+	// Create compute pipeline
+	{
+		state.compute_pipeline_layout = create_compute_pipeline_layout(state.compute_descset_layout, sizeof(FrameData));
 
-			raytrace_image_view_info.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-			raytrace_image_view_info.subresourceRange.baseMipLevel   = 0;
-			raytrace_image_view_info.subresourceRange.levelCount     = 1;
-			raytrace_image_view_info.subresourceRange.baseArrayLayer = 0;
-			raytrace_image_view_info.subresourceRange.layerCount     = 1;
+		if (state.WAVEFRONT)
+		{
+			state.wavefront = create_wavefront_tracer(static_cast<uint32_t>(state.RAYTRACE_RESOLUTION) * state.RAYTRACE_RESOLUTION, info.sort_rays);
+		}
 
-			vkCreateImageView(state.device, &raytrace_image_view_info, nullptr, &state.traced_image_views[i]);
+		state.trace_settings = TraceSettings{};
+
+		select_tracer_pipelines();
+
+		state.temporal_pipeline_layout = create_compute_pipeline_layout(state.compute_descset_layout, sizeof(TemporalData));
+		state.temporal_pipeline        = create_compute_pipeline("../Assets/Compiled/Temporal.comp.spv", state.temporal_pipeline_layout);
+
+		if (state.DENOISE)
+		{
+			state.denoise_pipeline_layout = create_compute_pipeline_layout(state.compute_descset_layout, sizeof(AtrousData));
+
+			state.variance_pipeline = create_compute_pipeline("../Assets/Compiled/Variance.comp.spv", state.denoise_pipeline_layout);
+			state.atrous_pipeline   = create_compute_pipeline("../Assets/Compiled/Atrous.comp.spv", state.denoise_pipeline_layout);
 		}
+	}
 
-		VkSamplerCreateInfo raytrace_image_sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+	srand(static_cast<unsigned int>(time(0)));
 
-		raytrace_image_sampler_info.magFilter = VK_FILTER_LINEAR;
-		raytrace_image_sampler_info.minFilter = VK_FILTER_LINEAR;
+	return Error::SUCCESS;
+}
 
-		raytrace_image_sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
-		raytrace_image_sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
-		raytrace_image_sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+GraphicsDevice::Error GraphicsDevice::Destruct()
+{
+ 	vkDeviceWaitIdle(state.device);
 
-		raytrace_image_sampler_info.anisotropyEnable = VK_FALSE;
-		raytrace_image_sampler_info.maxAnisotropy    = 1;
+	state.timeline.completed = state.timeline.submitted;
 
-		raytrace_image_sampler_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	run_deferred_destructions();
 
-		raytrace_image_sampler_info.unnormalizedCoordinates = VK_FALSE;
+	vkDestroySemaphore(state.device, state.timeline.semaphore, nullptr);
 
-		raytrace_image_sampler_info.compareEnable = VK_FALSE;
-		raytrace_image_sampler_info.compareOp     = VK_COMPARE_OP_ALWAYS;
+	for (const auto & semaphore : state.swapchain.imageAvailableSemaphores)
+	{
+		vkDestroySemaphore(state.device, semaphore, nullptr);
+	}
 
-		raytrace_image_sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-		raytrace_image_sampler_info.mipLodBias = 0.0f;
-		raytrace_image_sampler_info.minLod     = 0.0f;
-		raytrace_image_sampler_info.maxLod     = 0.0f;
+	for (const auto & semaphore : state.swapchain.renderFinishedSemaphores)
+	{
+		vkDestroySemaphore(state.device, semaphore, nullptr);
+	}
+
+	if (state.DYNAMIC_BVH)
+	{
+		destroy_lbvh_builder(state.lbvh_builder);
+	}
+
+	if (state.WAVEFRONT)
+	{
+		destroy_wavefront_tracer(state.wavefront);
+	}
+
+	for (const auto & [key, pipeline] : state.pipeline_variants)
+	{
+		vkDestroyPipeline(state.device, pipeline, nullptr);
+	}
+
+	state.pipeline_variants.clear();
+
+	vkDestroyPipeline(state.device, state.temporal_pipeline, nullptr);
+	vkDestroyPipeline(state.device, state.variance_pipeline, nullptr);
+	vkDestroyPipeline(state.device, state.atrous_pipeline, nullptr);
+
+	save_pipeline_cache(state.pipeline_cache);
+
+	vkDestroyPipelineCache(state.device, state.pipeline_cache, nullptr);
+
+	vkDestroyPipelineLayout(state.device, state.compute_pipeline_layout, nullptr);
+	vkDestroyPipelineLayout(state.device, state.temporal_pipeline_layout, nullptr);
+	vkDestroyPipelineLayout(state.device, state.denoise_pipeline_layout, nullptr);
+
+	vkDestroyDescriptorPool(state.device, state.graphics_desc_pool, nullptr);
+	vkDestroyDescriptorPool(state.device, state.compute_desc_pool, nullptr);
+
+	vkDestroyDescriptorSetLayout(state.device, state.graphics_descset_layout, nullptr);
+	vkDestroyDescriptorSetLayout(state.device, state.compute_descset_layout, nullptr);
+
+	for (auto & scene : state.scenes)
+	{
+		destroy_buffer(scene.scene_data_buffer);
+		destroy_buffer(scene.bvh_node_buffer);
+		destroy_buffer(scene.tlas_node_buffer);
+		destroy_buffer(scene.instance_buffer);
+		destroy_buffer(scene.normal_buffer);
+	}
+	destroy_buffer(state.work_counter_buffer);
+
+	destroy_buffer(state.staging.buffer);
+
+	for (const auto & batch : state.staging.batches)
+	{
+		vkDestroyFence(state.device, batch.fence, nullptr);
+	}
+
+	for (const auto & batch : state.staging.spare_batches)
+	{
+		vkDestroyFence(state.device, batch.fence, nullptr);
+	}
+
+	for (const auto & semaphore : state.staging.semaphores)
+	{
+		vkDestroySemaphore(state.device, semaphore, nullptr);
+	}
+
+	vkDestroyCommandPool(state.device, state.staging.command_pool, nullptr);
+
+	if (state.HEADLESS)
+	{
+		destroy_buffer(state.readback_buffer);
+	}
+
+	for (auto & slot : state.readback_ring)
+	{
+		destroy_buffer(slot.buffer);
+	}
+
+	vkDestroySampler(state.device, state.raytrace_storage_image_sampler, nullptr);
+
+	vkDestroyImageView(state.device, state.raytrace_storage_image_view, nullptr);
+
+	for (const auto & image_view : state.traced_image_views)
+	{
+		vkDestroyImageView(state.device, image_view, nullptr);
+	}
+
+	for (auto & image : state.accumulation_images)
+	{
+		destroy_image(image);
+	}
+
+	destroy_image(state.radiance_image);
+	destroy_image(state.position_image);
+	destroy_image(state.albedo_image);
+
+	for (unsigned int i = 0; i < state.FRAMES_IN_FLIGHT; ++i)
+	{
+		destroy_image(state.normal_images[i]);
+		destroy_image(state.moment_images[i]);
+	}
+
+	for (auto & image : state.filter_images)
+	{
+		destroy_image(image);
+	}
+
+	vkDestroyImage(state.device, state.raytrace_storage_image, nullptr);
+
+	vkFreeMemory(state.device, state.raytrace_storage_image_memory, nullptr);
+
+	for (const auto & image : state.traced_images)
+	{
+		vkDestroyImage(state.device, image, nullptr);
+	}
+
+	for (auto & memory : state.traced_image_memory)
+	{
+		state.allocator.Free(memory);
+	}
+
+	destroy_render_graph(state.render_graph);
+
+	for (const auto & imageView : state.swapchain.imageViews)
+	{
+		vkDestroyImageView(state.device, imageView, nullptr);
+	}
+
+	if (state.HEADLESS)
+	{
+		for (unsigned int i = 0; i < state.swapchain.images.size(); ++i)
+		{
+			vkDestroyImage(state.device, state.swapchain.images[i], nullptr);
+			state.allocator.Free(state.swapchain.imageMemory[i]);
+		}
+	}
+
+	vkDestroySwapchainKHR(state.device, state.swapchain.swapchain, nullptr);
+
+	for (const auto & command_pool : state.commandPools)
+	{
+		vkDestroyCommandPool(state.device, command_pool, nullptr);
+	}
+
+	for (const auto & command_pool : state.computeCommandPools)
+	{
+		vkDestroyCommandPool(state.device, command_pool, nullptr);
+	}
+
+	for (const auto & semaphore : state.trace_finished_semaphores)
+	{
+		vkDestroySemaphore(state.device, semaphore, nullptr);
+	}
+
+	state.allocator.Destroy();
+
+	vkDestroyDevice(state.device, nullptr);
+
+	vkDestroyInstance(state.instance, nullptr);
 
-		vkCreateSampler(state.device, &raytrace_image_sampler_info, nullptr, &state.raytrace_storage_image_sampler);
+	return Error::SUCCESS;
+}
+
+uint64_t GraphicsDevice::Draw(const FrameData & frame_data)
+{
+	const uint64_t frame = state.timeline.submitted + 1;
 
-		VkBufferCreateInfo scene_buffer_info{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+	// This frame's command buffers, readback slot and traced image were last used `FRAMES_IN_FLIGHT` frames ago
 
-		scene_buffer_info.size  = sizeof(Triangle) * 1;
-		scene_buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-		
-		scene_buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	wait_for_frame(frame > state.FRAMES_IN_FLIGHT ? frame - state.FRAMES_IN_FLIGHT : 0);
 
-		vkCreateBuffer(state.device, &scene_buffer_info, nullptr, &state.scene_data_buffer);
+	run_deferred_destructions();
 
-		VkMemoryRequirements scene_buffer_mem_reqs;
+	// Scene uploads since the last frame are submitted now, into every frame's copy of the scene.  This frame's copy
+	// was last read by the frame just waited for, so its copies start at once and this frame's compute work waits
+	// only for them.  Copies into the others wait on the device for the frames still tracing against them
 
-		vkGetBufferMemoryRequirements(state.device, state.scene_data_buffer, &scene_buffer_mem_reqs);
+	const bool staged = state.staging.copies.empty() == false || state.staging.submitted;
 
-		VkMemoryAllocateInfo alloc_info{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-		alloc_info.allocationSize = scene_buffer_mem_reqs.size;
-		alloc_info.memoryTypeIndex = find_memory_type(scene_buffer_mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	if (staged)
+	{
+		submit_staging(state.staging.semaphores[state.currentFrame]);
+	}
 
-		vkAllocateMemory(state.device, &alloc_info, nullptr, &state.scene_data_buffer_memory);
+	state.scenes[state.currentFrame].frame = frame;
 
-		vkBindBufferMemory(state.device, state.scene_data_buffer, state.scene_data_buffer_memory, 0);
+	vkResetCommandPool(state.device, state.commandPools[state.currentFrame], 0);
+	vkResetCommandPool(state.device, state.computeCommandPools[state.currentFrame], 0);
 
-		Triangle triangle{ {10.0f, 10.0f, 0.0f}, {0.0f, 20.0f, 0.0f}, {-10.0f, 10.0f, 0.0f} };
+	// The frame just waited for used this frame's readback slot, so its last copy is ready to collect
 
-		void * mapped_buffer_mem;
-		vkMapMemory(state.device, state.scene_data_buffer_memory, 0, VK_WHOLE_SIZE, 0, &mapped_buffer_mem);
-		memcpy(mapped_buffer_mem, &triangle, sizeof(triangle));
-		vkUnmapMemory(state.device, state.scene_data_buffer_memory);
-	}
+	ReadbackSlot * readback = state.readback_ring.empty() ? nullptr : &state.readback_ring[state.currentFrame];
 
-	// Create render pass
+	if (readback && readback->pending)
 	{
-		// Attachments
-
-		VkAttachmentDescription backbuffer_desc{};
+		collect_readback(*readback);
+	}
 
-		backbuffer_desc.format  = state.swapchain.surfaceFormat.format;
-		backbuffer_desc.samples = VK_SAMPLE_COUNT_1_BIT;
+	// Offscreen images belong to frames in flight, so only the swapchain has one to acquire
 
-		backbuffer_desc.loadOp  = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		backbuffer_desc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	uint32_t image_idx = state.currentFrame;
 
-		backbuffer_desc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		backbuffer_desc.finalLayout   = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	if (state.HEADLESS == false)
+	{
+		vkAcquireNextImageKHR(state.device, state.swapchain.swapchain, std::numeric_limits<uint64_t>::max(), state.swapchain.imageAvailableSemaphores[state.currentFrame], VK_NULL_HANDLE, &image_idx);
+	}
 
-		// References
+	// The frame is traced on the compute queue, then composited on the graphics queue.  Only the traced image
+	// changes hands, so the next frame's trace, into the other traced image, runs while this one is presented
 
-		VkAttachmentReference backbuffer_reference{};
+	const auto & compute_command_buffer = state.computeCommandBuffers[state.currentFrame];
 
-		backbuffer_reference.attachment = 0;
+	const VkImage traced_image = state.traced_images[state.currentFrame];
 
-		backbuffer_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	VkCommandBufferBeginInfo begin_info{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
 
-		// Subpasses
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-		VkSubpassDescription filter_subpass_desc{};
+	vkBeginCommandBuffer(compute_command_buffer, &begin_info);
 
-		filter_subpass_desc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	if (state.lbvh_update == LBVHUpdate::REBUILD)
+	{
+		record_lbvh_build(compute_command_buffer, state.lbvh_builder, state.TRIANGLE_COUNT, state.currentFrame);
 
-		filter_subpass_desc.colorAttachmentCount = 1;
-		filter_subpass_desc.pColorAttachments    = &backbuffer_reference;
+		state.lbvh_refit_count = 0;
+	}
+	else if (state.lbvh_update == LBVHUpdate::REFIT)
+	{
+		record_lbvh_refit(compute_command_buffer, state.lbvh_builder, state.TRIANGLE_COUNT, state.currentFrame);
+	}
 
-		VkSubpassDescription ui_subpass_desc{};
+	state.lbvh_update = LBVHUpdate::NONE;
 
-		ui_subpass_desc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	// The frame waited for above also released the traced image from the graphics queue.  The first frame tracing
+	// into it finds it in no layout at all
 
-		ui_subpass_desc.colorAttachmentCount  = 1;
-		ui_subpass_desc.pColorAttachments     = &backbuffer_reference;
+	if (state.frame_count < state.FRAMES_IN_FLIGHT)
+	{
+		transfer_traced_image(
+			compute_command_buffer, traced_image, false,
+			state.computeQueueIndex, state.computeQueueIndex,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+	}
+	else
+	{
+		transfer_traced_image(
+			compute_command_buffer, traced_image, false,
+			state.graphicsQueueIndex, state.computeQueueIndex,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+	}
 
-		const VkSubpassDescription subpass_descs[] { filter_subpass_desc, ui_subpass_desc };
+	VkPipelineStageFlags trace_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 
-		// Dependencies
+	{
+		FrameData frame_data_real = frame_data;
 
-		VkSubpassDependency filter_ui_dependency{};
+		frame_data_real.aspect_ratio = static_cast<float>(state.swapchain.extent.width) / static_cast<float>(state.swapchain.extent.height);
 
-		filter_ui_dependency.srcSubpass    = 0;
-		filter_ui_dependency.srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		filter_ui_dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		frame_data_real.seed = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
 
-		filter_ui_dependency.dstSubpass    = 1;
-		filter_ui_dependency.dstStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		filter_ui_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		// History is blended in unclipped, as a running mean, only while a progressive view holds still.  Otherwise
+		// it is clipped to this frame's neighbourhood, and capped so moving shading fades in within a few frames
 
-		// Render pass
+		const bool still = state.PROGRESSIVE && state.scene_changed == false && same_view(frame_data_real, state.accumulated_view);
 
-		VkRenderPassCreateInfo render_pass_info{VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
+		if (still == false)
+		{
+			state.accumulated_frames = std::min(state.accumulated_frames, TEMPORAL_HISTORY_FRAMES);
+		}
 
-		render_pass_info.attachmentCount = 1;
-		render_pass_info.pAttachments    = &backbuffer_desc;
+		TemporalData temporal_data;
 
-		render_pass_info.subpassCount = 2;
-		render_pass_info.pSubpasses   = subpass_descs;
+		temporal_data.previous_camera = state.accumulated_view.camera;
+		temporal_data.aspect_ratio    = state.accumulated_view.aspect_ratio;
+		temporal_data.history_frames  = state.accumulated_frames++;
+		temporal_data.clip_history    = still ? 0 : 1;
 
-		render_pass_info.dependencyCount = 1;
-		render_pass_info.pDependencies   = &filter_ui_dependency;
+		state.accumulated_view = frame_data_real;
+		state.scene_changed    = false;
 
-		vkCreateRenderPass(state.device, &render_pass_info, nullptr, &state.render_pass);
-	}
+		// The previous frame, whichever images it traced into, may still be reading radiance and positions
 
-	// Create framebuffers
-	{
-		state.swapchain.framebuffers.resize(state.swapchain.imageViews.size());
+		compute_barrier(compute_command_buffer);
 
-		for (unsigned int i = 0; i < state.swapchain.imageViews.size(); ++i)
+		if (state.WAVEFRONT)
 		{
-			VkFramebufferCreateInfo framebufferInfo{VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
+			// The frame just waited for copied its ray count into this frame's slot, which is about to be reused
 
-			framebufferInfo.renderPass = state.render_pass;
+			collect_traced_rays(state.wavefront, state.timeline.completed);
 
-			framebufferInfo.attachmentCount = 1;
-			framebufferInfo.pAttachments    = &state.swapchain.imageViews[i];
+			state.wavefront.stats_frames[state.currentFrame] = frame;
 
-			framebufferInfo.width  = state.swapchain.extent.width;
-			framebufferInfo.height = state.swapchain.extent.height;
-			framebufferInfo.layers = 1;
-
-			vkCreateFramebuffer(state.device, &framebufferInfo, nullptr, &state.swapchain.framebuffers[i]);
+			record_wavefront_trace(compute_command_buffer, state.wavefront, state.compute_descsets[state.currentFrame], frame_data_real);
 		}
-	}
+		else
+		{
+			vkCmdBindPipeline(compute_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.compute_pipeline);
 
-	// Create graphics descriptors
-	{
-		VkDescriptorSetLayoutBinding blit_sampler_binding{};
+			vkCmdBindDescriptorSets(compute_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.compute_pipeline_layout, 0, 1, &state.compute_descsets[state.currentFrame], 0, nullptr);
 
-		blit_sampler_binding.binding    = 0;
-		blit_sampler_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+			vkCmdPushConstants(compute_command_buffer, state.compute_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FrameData), &frame_data_real);
 
-		blit_sampler_binding.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		blit_sampler_binding.descriptorCount = 1;
+			if (state.PERSISTENT_THREADS)
+			{
+				// The previous frame may still be fetching from the counter
 
-		VkDescriptorSetLayoutBinding prev_frame_sampler_binding{};
+				memory_barrier(
+					compute_command_buffer,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+					VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
 
-		prev_frame_sampler_binding.binding    = 1;
-		prev_frame_sampler_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+				vkCmdFillBuffer(compute_command_buffer, state.work_counter_buffer.buffer, 0, sizeof(uint32_t), 0);
 
-		prev_frame_sampler_binding.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		prev_frame_sampler_binding.descriptorCount = 1;
+				memory_barrier(
+					compute_command_buffer,
+					VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
 
-		const VkDescriptorSetLayoutBinding set_bindings[] = { blit_sampler_binding, prev_frame_sampler_binding };
+				const uint32_t pixel_groups = (static_cast<uint32_t>(state.RAYTRACE_RESOLUTION) * state.RAYTRACE_RESOLUTION + 255) / 256;
 
-		VkDescriptorSetLayoutCreateInfo layout_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
-		layout_info.bindingCount = 2;
-		layout_info.pBindings    = set_bindings;
+				vkCmdDispatch(compute_command_buffer, std::min(PERSISTENT_WORKGROUPS, pixel_groups), 1, 1);
+			}
+			else
+			{
+				vkCmdDispatch(compute_command_buffer, state.RAYTRACE_RESOLUTION / 16, state.RAYTRACE_RESOLUTION / 16, 1);
+			}
+		}
 
-		vkCreateDescriptorSetLayout(state.device, &layout_info, nullptr, &state.graphics_descset_layout);
+		// Resolve this frame against the history the previous frame left
 
-		VkDescriptorPoolSize pool_size{};
+		compute_barrier(compute_command_buffer);
 
-		pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		vkCmdBindPipeline(compute_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.temporal_pipeline);
 
-		pool_size.descriptorCount = static_cast<uint32_t>(2 * state.FRAMES_IN_FLIGHT);
+		vkCmdBindDescriptorSets(compute_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.temporal_pipeline_layout, 0, 1, &state.compute_descsets[state.currentFrame], 0, nullptr);
 
-		VkDescriptorPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+		vkCmdPushConstants(compute_command_buffer, state.temporal_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TemporalData), &temporal_data);
 
-		pool_info.poolSizeCount = 1;
-		pool_info.pPoolSizes    = &pool_size;
-		pool_info.maxSets       = static_cast<uint32_t>(state.FRAMES_IN_FLIGHT);
+		vkCmdDispatch(compute_command_buffer, state.RAYTRACE_RESOLUTION / 16, state.RAYTRACE_RESOLUTION / 16, 1);
 
-		vkCreateDescriptorPool(state.device, &pool_info, nullptr, &state.graphics_desc_pool);
+		// Estimate variance, then filter back and forth between the filter images, the last pass writing the traced image
 
-		state.graphics_descsets.resize(1);
+		if (state.DENOISE)
+		{
+			compute_barrier(compute_command_buffer);
 
-		VkDescriptorSetAllocateInfo alloc_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
-		alloc_info.descriptorPool     = state.graphics_desc_pool;
-		alloc_info.descriptorSetCount = 1;
-		alloc_info.pSetLayouts        = &state.graphics_descset_layout;
+			vkCmdBindPipeline(compute_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.variance_pipeline);
 
-		vkAllocateDescriptorSets(state.device, &alloc_info, &state.graphics_descsets[0]);
+			vkCmdBindDescriptorSets(compute_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.denoise_pipeline_layout, 0, 1, &state.compute_descsets[state.currentFrame], 0, nullptr);
 
-		for (unsigned int i = 0; i < 2; ++i)
-		{
-			VkDescriptorImageInfo image_info{};
+			vkCmdDispatch(compute_command_buffer, state.RAYTRACE_RESOLUTION / 16, state.RAYTRACE_RESOLUTION / 16, 1);
 
-			image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			vkCmdBindPipeline(compute_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.atrous_pipeline);
 
-			image_info.imageView = state.traced_image_views[i];
-			image_info.sampler   = state.raytrace_storage_image_sampler;
+			for (uint32_t iteration = 0; iteration < ATROUS_ITERATIONS; ++iteration)
+			{
+				compute_barrier(compute_command_buffer);
 
-			VkWriteDescriptorSet descriptor_write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+				const AtrousData atrous_data{ iteration, ATROUS_ITERATIONS };
 
-			descriptor_write.dstSet = state.graphics_descsets[0];
-			descriptor_write.dstBinding = i;
-			descriptor_write.dstArrayElement = 0;
-			descriptor_write.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptor_write.descriptorCount = 1;
-			descriptor_write.pImageInfo = &image_info;
+				vkCmdPushConstants(compute_command_buffer, state.denoise_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(AtrousData), &atrous_data);
 
-			vkUpdateDescriptorSets(state.device, 1, &descriptor_write, 0, nullptr);
+				vkCmdDispatch(compute_command_buffer, state.RAYTRACE_RESOLUTION / 16, state.RAYTRACE_RESOLUTION / 16, 1);
+			}
 		}
-	}
-
-	// Create compute descriptors
-	{
-		VkDescriptorSetLayoutBinding storage_sampler_binding{};
 
-		storage_sampler_binding.binding    = 0;
-		storage_sampler_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		if (readback)
+		{
+			// Copied out while still in the general layout, then left for the host to collect once the frame finishes
 
-		storage_sampler_binding.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-		storage_sampler_binding.descriptorCount = 1;
+			VkImageMemoryBarrier imageMemoryBarrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
 
-		VkDescriptorSetLayoutBinding scene_buffer_binding{};
+			imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 
-		scene_buffer_binding.binding    = 1;
-		scene_buffer_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
 
-		scene_buffer_binding.descriptorCount = 1;
-		scene_buffer_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			imageMemoryBarrier.image = traced_image;
 
-		const VkDescriptorSetLayoutBinding bindings[] { storage_sampler_binding, scene_buffer_binding };
+			imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+			imageMemoryBarrier.srcAccessMask    = VK_ACCESS_SHADER_WRITE_BIT;
+			imageMemoryBarrier.dstAccessMask    = VK_ACCESS_TRANSFER_READ_BIT;
 
-		VkDescriptorSetLayoutCreateInfo layout_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
-		layout_info.bindingCount = 2;
-		layout_info.pBindings    = bindings;
+			vkCmdPipelineBarrier(
+				compute_command_buffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0,
+				0, nullptr,
+				0, nullptr,
+				1, &imageMemoryBarrier);
 
-		vkCreateDescriptorSetLayout(state.device, &layout_info, nullptr, &state.compute_descset_layout);
+			VkBufferImageCopy region{};
 
-		VkDescriptorPoolSize pool_size{};
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			region.imageExtent      = { state.RAYTRACE_RESOLUTION, state.RAYTRACE_RESOLUTION, 1 };
 
-		pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			vkCmdCopyImageToBuffer(compute_command_buffer, traced_image, VK_IMAGE_LAYOUT_GENERAL, readback->buffer.buffer, 1, &region);
 
-		pool_size.descriptorCount = static_cast<unsigned int>(state.FRAMES_IN_FLIGHT);
+			memory_barrier(
+				compute_command_buffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+				VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
 
-		VkDescriptorPoolSize scene_buffer_size{};
-		
-		scene_buffer_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			readback->frame   = state.frame_count;
+			readback->pending = true;
 
-		scene_buffer_size.descriptorCount = static_cast<unsigned int>(state.FRAMES_IN_FLIGHT);
+			// The release below must also wait for the copy to finish reading
 
-		const VkDescriptorPoolSize pool_sizes[] { pool_size, scene_buffer_size };
+			trace_stages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		}
+	}
 
-		VkDescriptorPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+	transfer_traced_image(
+		compute_command_buffer, traced_image, true,
+		state.computeQueueIndex, state.graphicsQueueIndex,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		trace_stages, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
 
-		pool_info.poolSizeCount = 2;
-		pool_info.pPoolSizes    = pool_sizes;
-		pool_info.maxSets       = static_cast<unsigned int>(state.FRAMES_IN_FLIGHT);
+	vkEndCommandBuffer(compute_command_buffer);
 
-		vkCreateDescriptorPool(state.device, &pool_info, nullptr, &state.compute_desc_pool);
+	{
+		VkSubmitInfo submit_info{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
 
-		state.compute_descsets.resize(state.FRAMES_IN_FLIGHT);
+		const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 
-		const VkDescriptorSetLayout set_layouts[] = { state.compute_descset_layout, state.compute_descset_layout };
+		if (staged)
+		{
+			submit_info.waitSemaphoreCount = 1;
+			submit_info.pWaitSemaphores    = &state.staging.semaphores[state.currentFrame];
+			submit_info.pWaitDstStageMask  = &wait_stage;
+		}
 
-		VkDescriptorSetAllocateInfo alloc_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
-		alloc_info.descriptorPool     = state.compute_desc_pool;
-		alloc_info.descriptorSetCount = 2;
-		alloc_info.pSetLayouts        = set_layouts;
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers    = &compute_command_buffer;
 
-		vkAllocateDescriptorSets(state.device, &alloc_info, state.compute_descsets.data());
+		submit_info.signalSemaphoreCount = 1;
+		submit_info.pSignalSemaphores    = &state.trace_finished_semaphores[state.currentFrame];
 
-		for (unsigned int i = 0; i < state.FRAMES_IN_FLIGHT; ++i)
-		{
-			VkDescriptorImageInfo image_info{};
+		vkQueueSubmit(state.computeQueue, 1, &submit_info, VK_NULL_HANDLE);
+	}
 
-			image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	const auto & command_buffer = state.commandBuffers[state.currentFrame];
 
-			image_info.imageView = state.traced_image_views[i];
-			image_info.sampler   = state.raytrace_storage_image_sampler;
+	vkBeginCommandBuffer(command_buffer, &begin_info);
 
-			VkDescriptorBufferInfo scene_buffer_info{};
+	transfer_traced_image(
+		command_buffer, traced_image, false,
+		state.computeQueueIndex, state.graphicsQueueIndex,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		trace_stages, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
 
-			scene_buffer_info.buffer = state.scene_data_buffer;
-			scene_buffer_info.offset = 0;
-			scene_buffer_info.range  = VK_WHOLE_SIZE;
+	record_render_graph(command_buffer, state.render_graph, image_idx, state.graphics_descsets[state.currentFrame]);
 
-			VkWriteDescriptorSet storage_image_write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+	// Handed back for the frame which next traces into it
 
-			storage_image_write.dstSet = state.compute_descsets[i];
-			storage_image_write.dstBinding = 0;
-			storage_image_write.dstArrayElement = 0;
-			storage_image_write.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-			storage_image_write.descriptorCount = 1;
-			storage_image_write.pImageInfo = &image_info;
+	transfer_traced_image(
+		command_buffer, traced_image, true,
+		state.graphicsQueueIndex, state.computeQueueIndex,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
 
-			VkWriteDescriptorSet scene_buffer_write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+	vkEndCommandBuffer(command_buffer);
 
-			scene_buffer_write.dstSet = state.compute_descsets[i];
-			scene_buffer_write.dstBinding = 1;
-			scene_buffer_write.dstArrayElement = 0;
-			scene_buffer_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-			scene_buffer_write.descriptorCount = 1;
-			scene_buffer_write.pBufferInfo = &scene_buffer_info;
+	VkSubmitInfo submit_info{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
 
-			const VkWriteDescriptorSet descriptor_writes[] { storage_image_write, scene_buffer_write };
+	std::vector<VkSemaphore>          wait_semaphores;
+	std::vector<VkPipelineStageFlags> wait_stages;
 
-			vkUpdateDescriptorSets(state.device, 2, descriptor_writes, 0, nullptr);
-		}
-	}
+	wait_semaphores.push_back(state.trace_finished_semaphores[state.currentFrame]);
+	wait_stages.push_back(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 
-	// Create raster pipelines
+	if (state.HEADLESS == false)
 	{
-		state.filter_pso = create_raster_pipeline("../Assets/Compiled/Fullscreen.vert.spv", "../Assets/Compiled/Fullscreen.frag.spv");
+		wait_semaphores.push_back(state.swapchain.imageAvailableSemaphores[state.currentFrame]);
+		wait_stages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
 	}
 
-	// Create compute pipeline
-	{
-		const auto comp_shader_code = ReadFile("../Assets/Compiled/Tracer.comp.spv");
-
-        VkShaderModuleCreateInfo comp_module_info{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
-        comp_module_info.codeSize = comp_shader_code.size();
-        comp_module_info.pCode    = reinterpret_cast<const uint32_t *>(comp_shader_code.data());
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers    = &command_buffer;
 
-        VkShaderModule comp_shader_module;
-        vkCreateShaderModule(state.device, &comp_module_info, nullptr, &comp_shader_module);
+	submit_info.waitSemaphoreCount = static_cast<uint32_t>(wait_semaphores.size());
+	submit_info.pWaitSemaphores    = wait_semaphores.data();
+	submit_info.pWaitDstStageMask  = wait_stages.data();
 
-		VkPipelineShaderStageCreateInfo compute_shader_info{VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
+	// Binary semaphores ignore the value signalled alongside them
 
-		compute_shader_info.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
-		compute_shader_info.module = comp_shader_module;
-		compute_shader_info.pName  = "main";
+	std::vector<VkSemaphore> signal_semaphores{ state.timeline.semaphore };
+	std::vector<uint64_t>    signal_values{ frame };
 
-		VkPushConstantRange push_constant_range{};
+	if (state.HEADLESS == false)
+	{
+		signal_semaphores.push_back(state.swapchain.renderFinishedSemaphores[state.currentFrame]);
+		signal_values.push_back(0);
+	}
 
-		push_constant_range.offset = 0;
-		push_constant_range.size   = sizeof(FrameData);
+	submit_info.signalSemaphoreCount = static_cast<uint32_t>(signal_semaphores.size());
+	submit_info.pSignalSemaphores    = signal_semaphores.data();
 
-		push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	// The frame's number is signalled here, after the trace it waited for, so finishing it covers both queues
 
-		VkPipelineLayoutCreateInfo compute_pipeline_layout_info{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+	VkTimelineSemaphoreSubmitInfoKHR timeline_info{VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR};
 
-		compute_pipeline_layout_info.setLayoutCount = 1;
-		compute_pipeline_layout_info.pSetLayouts    = &state.compute_descset_layout;
+	timeline_info.signalSemaphoreValueCount = static_cast<uint32_t>(signal_values.size());
+	timeline_info.pSignalSemaphoreValues    = signal_values.data();
 
-		compute_pipeline_layout_info.pushConstantRangeCount = 1;
-		compute_pipeline_layout_info.pPushConstantRanges    = &push_constant_range;
+	submit_info.pNext = &timeline_info;
 
-		vkCreatePipelineLayout(state.device, &compute_pipeline_layout_info, nullptr, &state.compute_pipeline_layout);
+	vkQueueSubmit(state.graphicsQueue, 1, &submit_info, VK_NULL_HANDLE);
 
-		VkComputePipelineCreateInfo compute_pipeline_info{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+	state.timeline.submitted = frame;
 
-		compute_pipeline_info.layout = state.compute_pipeline_layout;
-		compute_pipeline_info.stage  = compute_shader_info;
+	++state.frame_count;
 
-		vkCreateComputePipelines(state.device, VK_NULL_HANDLE, 1, &compute_pipeline_info, nullptr, &state.compute_pipeline);
+	if (state.HEADLESS)
+	{
+		state.currentFrame = (state.currentFrame + 1) % state.FRAMES_IN_FLIGHT;
 
-		vkDestroyShaderModule(state.device, comp_shader_module, nullptr);
+		return frame;
 	}
 
-	srand(static_cast<unsigned int>(time(0)));
+	VkPresentInfoKHR present_info{VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
 
-	return Error::SUCCESS;
-}
+	present_info.waitSemaphoreCount = 1;
+	present_info.pWaitSemaphores    = &state.swapchain.renderFinishedSemaphores[state.currentFrame];
 
-GraphicsDevice::Error GraphicsDevice::Destruct()
-{
- 	vkDeviceWaitIdle(state.device);
+	present_info.swapchainCount = 1;
+	present_info.pSwapchains    = &state.swapchain.swapchain;
+	present_info.pImageIndices  = &image_idx;
 
-	for (unsigned char i = 0; i < state.FRAMES_IN_FLIGHT; ++i)
-	{
-		vkDestroyFence(state.device, state.swapchain.frameFences[i], nullptr);
+	vkQueuePresentKHR(state.presentQueue, &present_info);
 
-		vkDestroySemaphore(state.device, state.swapchain.imageAvailableSemaphores[i], nullptr);
-		vkDestroySemaphore(state.device, state.swapchain.renderFinishedSemaphores[i], nullptr);
-	}
+	state.currentFrame = (state.currentFrame + 1) % state.FRAMES_IN_FLIGHT;
 
-	vkDestroyPipeline(state.device, state.filter_pso.pipeline, nullptr);
-	vkDestroyPipeline(state.device, state.compute_pipeline, nullptr);
+	return frame;
+}
 
-	vkDestroyPipelineLayout(state.device, state.filter_pso.layout, nullptr);
-	vkDestroyPipelineLayout(state.device, state.compute_pipeline_layout, nullptr);
+void GraphicsDevice::UpdateMesh(unsigned int mesh, const Triangle * triangles)
+{
+	auto & tris = state.meshes[mesh];
 
-	vkDestroyDescriptorPool(state.device, state.graphics_desc_pool, nullptr);
-	vkDestroyDescriptorPool(state.device, state.compute_desc_pool, nullptr);
+	if (tris.empty()) return;
 
-	vkDestroyDescriptorSetLayout(state.device, state.graphics_descset_layout, nullptr);
-	vkDestroyDescriptorSetLayout(state.device, state.compute_descset_layout, nullptr);
+	state.scene_changed = true;
 
-	vkDestroyBuffer(state.device, state.scene_data_buffer, nullptr);
+	std::copy(triangles, triangles + tris.size(), tris.begin());
 
-	vkFreeMemory(state.device, state.scene_data_buffer_memory, nullptr);
+	// Device hierarchies index the flattened scene indirectly, so positions upload as-is and the next frame refits
 
-	vkDestroySampler(state.device, state.raytrace_storage_image_sampler, nullptr);
+	if (state.DYNAMIC_BVH)
+	{
+		upload_triangles(flatten_instances());
 
-	vkDestroyImageView(state.device, state.raytrace_storage_image_view, nullptr);
+		if (state.lbvh_update != LBVHUpdate::REBUILD)
+		{
+			state.lbvh_update = ++state.lbvh_refit_count > LBVH_REFITS_PER_REBUILD ? LBVHUpdate::REBUILD : LBVHUpdate::REFIT;
+		}
 
-	for (const auto & image_view : state.traced_image_views)
-	{
-		vkDestroyImageView(state.device, image_view, nullptr);
+		return;
 	}
 
-	vkDestroyImage(state.device, state.raytrace_storage_image, nullptr);
-
-	vkFreeMemory(state.device, state.raytrace_storage_image_memory, nullptr);
+	update_bvh(state.blas[mesh], tris.data(), tris.size());
 
-	for (const auto & image : state.traced_images)
-	{
-		vkDestroyImage(state.device, image, nullptr);
-	}
+	upload_blas(mesh);
 
-	for (const auto & memory : state.traced_image_memory)
-	{
-		vkFreeMemory(state.device, memory, nullptr);
-	}
+	// The mesh's bounds moved, and with them every instance placing it
 
-	for (const auto & framebuffer : state.swapchain.framebuffers)
-	{
-		vkDestroyFramebuffer(state.device, framebuffer, nullptr);
-	}
+	upload_tlas();
+}
 
-	vkDestroyRenderPass(state.device, state.render_pass, nullptr);
+void GraphicsDevice::UpdateInstances(const glm::mat4x3 * transforms)
+{
+	state.scene_changed = true;
 
-	for (const auto & imageView : state.swapchain.imageViews)
+	for (size_t i = 0; i < state.instances.size(); ++i)
 	{
-		vkDestroyImageView(state.device, imageView, nullptr);
+		state.instances[i].transform = transforms[i];
 	}
 
-	vkDestroySwapchainKHR(state.device, state.swapchain.swapchain, nullptr);
+	// Whole objects moving degrade a refitted hierarchy quickly, so device hierarchies are rebuilt outright
 
-	for (const auto & command_pool : state.commandPools)
+	if (state.DYNAMIC_BVH)
 	{
-		vkDestroyCommandPool(state.device, command_pool, nullptr);
-	}
+		upload_triangles(flatten_instances());
 
-	vkDestroyDevice(state.device, nullptr);
+		state.lbvh_update = LBVHUpdate::REBUILD;
 
-	vkDestroyInstance(state.instance, nullptr);
+		return;
+	}
 
-	return Error::SUCCESS;
+	upload_tlas();
 }
 
-void GraphicsDevice::Draw(const FrameData & frame_data)
+void GraphicsDevice::SetTraceSettings(const TraceSettings & settings)
 {
-	vkWaitForFences(state.device, 1, &state.swapchain.frameFences[state.currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
-    vkResetFences(state.device, 1, &state.swapchain.frameFences[state.currentFrame]);
-
-	vkResetCommandPool(state.device, state.commandPools[state.currentFrame], 0);
-
-	uint32_t image_idx;
-    vkAcquireNextImageKHR(state.device, state.swapchain.swapchain, std::numeric_limits<uint64_t>::max(), state.swapchain.imageAvailableSemaphores[state.currentFrame], VK_NULL_HANDLE, &image_idx);
+	TraceSettings clamped = settings;
 
-	const auto & command_buffer = state.commandBuffers[state.currentFrame];
+	clamped.depth        = std::max(clamped.depth, 1u);
+	clamped.samples      = std::max(clamped.samples, 1u);
+	clamped.sphere_count = std::min(clamped.sphere_count, MAX_SPHERES);
+	clamped.plane_count  = std::min(clamped.plane_count, MAX_PLANES);
 
-	VkCommandBufferBeginInfo begin_info{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	state.trace_settings = clamped;
 
-    begin_info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+	select_tracer_pipelines();
 
-    vkBeginCommandBuffer(command_buffer, &begin_info);
+	// The image changes with the settings, so history is clipped as if the scene had moved
 
-	{
-		VkImageMemoryBarrier imageMemoryBarrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+	state.scene_changed = true;
+}
 
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+uint64_t GraphicsDevice::TracedRays()
+{
+	if (state.WAVEFRONT == false) return 0;
 
-		imageMemoryBarrier.image = state.traced_images[state.currentFrame];
+	// Frames still in flight are left out until the timeline passes them
 
-		imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-		imageMemoryBarrier.srcAccessMask    = VK_ACCESS_SHADER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask    = VK_ACCESS_SHADER_READ_BIT;
+	collect_traced_rays(state.wavefront, completed_frame());
 
-		vkCmdPipelineBarrier(
-			command_buffer,
-			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-			0,
-			0, nullptr,
-			0, nullptr,
-			1, &imageMemoryBarrier);
+	return state.wavefront.traced_rays;
+}
 
-		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.compute_pipeline);
+GraphicsDevice::Error GraphicsDevice::ReadFrame(uint8_t * rgba)
+{
+	if (state.HEADLESS == false || state.frame_count == 0)
+	{
+		std::cout << "[app] - err :: Only a headless device which has drawn a frame can read it back" << std::endl;
+		return Error::UNKNOWN;
+	}
 
-		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, state.compute_pipeline_layout, 0, 1, &state.compute_descsets[state.currentFrame], 0, nullptr);
+	wait_for_frame(state.timeline.submitted);
 
-		FrameData frame_data_real = frame_data;
+	const unsigned char frame = (state.currentFrame + state.FRAMES_IN_FLIGHT - 1) % state.FRAMES_IN_FLIGHT;
 
-		frame_data_real.aspect_ratio = static_cast<float>(state.swapchain.extent.width) / static_cast<float>(state.swapchain.extent.height);
+	const VkExtent2D extent = state.swapchain.extent;
 
-		frame_data_real.seed = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+	VkCommandBufferAllocateInfo alloc_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	alloc_info.commandPool = state.commandPools[state.currentFrame];
+	alloc_info.commandBufferCount = 1;
 
-		vkCmdPushConstants(command_buffer, state.compute_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FrameData), &frame_data_real);
+	VkCommandBuffer command_buffer;
+	vkAllocateCommandBuffers(state.device, &alloc_info, &command_buffer);
 
-		vkCmdDispatch(command_buffer, state.RAYTRACE_RESOLUTION / 16, state.RAYTRACE_RESOLUTION / 16, 1);
+	VkCommandBufferBeginInfo begin_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	vkBeginCommandBuffer(command_buffer, &begin_info);
 
-		imageMemoryBarrier.image = state.traced_images[state.currentFrame];
+	// The render graph's external dependency already made the backbuffer's writes visible to transfers
 
-		imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-		imageMemoryBarrier.srcAccessMask    = VK_ACCESS_SHADER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask    = VK_ACCESS_SHADER_READ_BIT;
+	VkBufferImageCopy region{};
 
-		vkCmdPipelineBarrier(
-			command_buffer,
-			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-			0,
-			0, nullptr,
-			0, nullptr,
-			1, &imageMemoryBarrier);
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	region.imageExtent      = { extent.width, extent.height, 1 };
 
-		VkRenderPassBeginInfo pass_begin_info{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+	vkCmdCopyImageToBuffer(command_buffer, state.swapchain.images[frame], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, state.readback_buffer.buffer, 1, &region);
 
-		pass_begin_info.renderPass  = state.render_pass;
-		pass_begin_info.framebuffer = state.swapchain.framebuffers[image_idx];
+	memory_barrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
 
-		pass_begin_info.renderArea.offset = {0, 0};
-		pass_begin_info.renderArea.extent = state.swapchain.extent;
+	vkEndCommandBuffer(command_buffer);
 
-		const VkClearValue clear_colors[] { {1.0f, 0.0f, 0.0f, 1.0f} };
+	VkSubmitInfo submit_info{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers    = &command_buffer;
 
-		pass_begin_info.clearValueCount = 1;
-		pass_begin_info.pClearValues    = clear_colors;
+	vkQueueSubmit(state.graphicsQueue, 1, &submit_info, VK_NULL_HANDLE);
+	vkQueueWaitIdle(state.graphicsQueue);
 
-		vkCmdBeginRenderPass(command_buffer, &pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+	vkFreeCommandBuffers(state.device, state.commandPools[state.currentFrame], 1, &command_buffer);
 
-			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, state.filter_pso.pipeline);
+	const size_t size = 4 * static_cast<size_t>(extent.width) * extent.height;
 
-			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, state.filter_pso.layout, 0, 1, &state.graphics_descsets[0], 0, nullptr);
+	memcpy(rgba, state.readback_buffer.memory.mapped, size);
 
-			vkCmdDraw(command_buffer, 3, 1, 0, 0);
+	return Error::SUCCESS;
+}
 
-			vkCmdNextSubpass(command_buffer, VK_SUBPASS_CONTENTS_INLINE);
+void GraphicsDevice::DumpMemoryStats()
+{
+	state.allocator.DumpStats(std::cout);
+}
 
-		vkCmdEndRenderPass(command_buffer);
-	}
+bool GraphicsDevice::PopCapturedFrame(CapturedFrame & frame)
+{
+	// Slots are collected oldest first, and frames complete in submission order, so the first unfinished one ends
+	// the search
 
-	vkEndCommandBuffer(command_buffer);
+	const uint64_t completed = state.readback_ring.empty() ? 0 : completed_frame();
 
-	VkSubmitInfo submit_info{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+	for (unsigned char i = 0; i < state.readback_ring.size(); ++i)
+	{
+		const unsigned char slot = (state.currentFrame + i) % state.FRAMES_IN_FLIGHT;
 
-	VkPipelineStageFlags wait_stages[]{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+		if (state.readback_ring[slot].pending == false) continue;
 
-	submit_info.waitSemaphoreCount = 1;
-	submit_info.pWaitSemaphores    = &state.swapchain.imageAvailableSemaphores[state.currentFrame];
-	submit_info.pWaitDstStageMask  = wait_stages;
+		// Slots hold the index of the frame which copied into them, one less than its number on the timeline
 
-	submit_info.commandBufferCount = 1;
-	submit_info.pCommandBuffers    = &command_buffer;
+		if (state.readback_ring[slot].frame >= completed) break;
 
-	submit_info.signalSemaphoreCount = 1;
-	submit_info.pSignalSemaphores    = &state.swapchain.renderFinishedSemaphores[state.currentFrame];
+		collect_readback(state.readback_ring[slot]);
+	}
 
-	vkQueueSubmit(state.graphicsQueue, 1, &submit_info, state.swapchain.frameFences[state.currentFrame]);
+	if (state.captured_frames.empty()) return false;
 
-	VkPresentInfoKHR present_info{VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
+	frame = std::move(state.captured_frames.front());
 
-	present_info.waitSemaphoreCount = 1;
-	present_info.pWaitSemaphores    = &state.swapchain.renderFinishedSemaphores[state.currentFrame];
+	state.captured_frames.pop_front();
 
-	present_info.swapchainCount = 1;
-	present_info.pSwapchains    = &state.swapchain.swapchain;
-	present_info.pImageIndices  = &image_idx;
+	return true;
+}
 
-	vkQueuePresentKHR(state.presentQueue, &present_info);
+void GraphicsDevice::WaitForFrame(uint64_t frame)
+{
+	wait_for_frame(std::min(frame, state.timeline.submitted));
+}
 
-	state.currentFrame = (state.currentFrame + 1) % state.FRAMES_IN_FLIGHT;
+uint64_t GraphicsDevice::CompletedFrame()
+{
+	return completed_frame();
 }
 
 void GraphicsDevice::WaitIdle()
 {
 	vkDeviceWaitIdle(state.device);
+
+	state.timeline.completed = state.timeline.submitted;
+
+	run_deferred_destructions();
 }
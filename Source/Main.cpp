@@ -1,9 +1,14 @@
 #include <GraphicsDevice.h>
 #include <Camera.h>
+#include <FrameWriter.h>
 
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <thread>
 #include <vector>
@@ -18,6 +23,13 @@ namespace
 	float last_mouse_y;
 
 	bool locked_to_camera = false;
+
+	FrameWriter frame_writer;
+
+	/// @brief Quality to trace at, handed to the device whenever a key changes it
+	TraceSettings trace_settings;
+
+	bool trace_settings_changed = false;
 }
 
 static void poll_keyboard(GLFWwindow * window, float delta_time)
@@ -61,6 +73,25 @@ static void key_callback(GLFWwindow * window, int key, int scancode, int action,
 	{
 		std::cout << camera.data.pos.x << ", " << camera.data.pos.y << ", " << camera.data.pos.z << " - " << camera.aux.pitch << ", " << camera.aux.yaw << std::endl;
 	}
+
+	// Brackets trade bounces, and minus and equals samples, for frame time
+
+	if (action == GLFW_PRESS)
+	{
+		const TraceSettings previous = trace_settings;
+
+		if (key == GLFW_KEY_LEFT_BRACKET  && trace_settings.depth > 1)   --trace_settings.depth;
+		if (key == GLFW_KEY_RIGHT_BRACKET)                               ++trace_settings.depth;
+		if (key == GLFW_KEY_MINUS         && trace_settings.samples > 1) --trace_settings.samples;
+		if (key == GLFW_KEY_EQUAL)                                       ++trace_settings.samples;
+
+		if (trace_settings.depth != previous.depth || trace_settings.samples != previous.samples)
+		{
+			trace_settings_changed = true;
+
+			std::cout << trace_settings.samples << " samples, " << trace_settings.depth << " bounces" << std::endl;
+		}
+	}
 }
 
 static void mouse_callback(GLFWwindow * window, double pos_x, double pos_y)
@@ -82,23 +113,143 @@ static void mouse_callback(GLFWwindow * window, double pos_x, double pos_y)
 	camera.update();
 }
 
-int main()
+/**
+ * @brief Writes RGBA8 pixels, top row first, as a binary PPM
+ */
+static bool write_frame(const char * path, const uint8_t * rgba, unsigned int width, unsigned int height)
+{
+	FILE * file = std::fopen(path, "wb");
+
+	if (file == nullptr) return false;
+
+	std::fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+	for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i)
+	{
+		std::fwrite(rgba + 4 * i, 1, 3, file);
+	}
+
+	return std::fclose(file) == 0;
+}
+
+/**
+ * @brief Hands every frame the device has finished capturing to the encoder thread
+ */
+static void drain_captured_frames(GraphicsDevice & device)
 {
+	CapturedFrame frame;
+
+	while (device.PopCapturedFrame(frame))
+	{
+		frame_writer.Push(std::move(frame));
+	}
+}
+
+/**
+ * Usage: VulkanToy [--wavefront] [--sort-rays] [--persistent-threads] [--progressive] [--denoise]
+ *                  [--samples n] [--depth n] [--headless frames output.ppm] [--capture pattern] [--memory-stats]
+ *
+ * The wavefront tracer also reports rays per second alongside FPS, so sorting can be compared on and off.  Headless
+ * runs open no window: they draw the opening frame `frames` times offscreen, write the last one out and exit.
+ * Capturing writes every traced frame to a file named by a printf pattern taking the frame index, e.g.
+ * "frame_%04llu.png", encoded as PNG, EXR or raw RGBA by its extension.  Progressive rendering keeps averaging frames
+ * while the camera holds still.  Denoising filters each frame with SVGF before it is displayed.  Samples per pixel and
+ * bounces per path start from the command line, and can be changed while running with - = and [ ].  Memory stats
+ * print every device memory pool once the device is constructed
+ */
+int main(int argc, char ** argv)
+{
+	bool wavefront = false;
+	bool sort_rays = false;
+	bool persistent_threads = false;
+	bool progressive = false;
+	bool denoise = false;
+	bool memory_stats = false;
+
+	unsigned int headless_frames = 0;
+	const char * headless_path   = nullptr;
+
+	const char * capture_pattern = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--wavefront") == 0) wavefront = true;
+		if (std::strcmp(argv[i], "--sort-rays") == 0) sort_rays = true;
+		if (std::strcmp(argv[i], "--persistent-threads") == 0) persistent_threads = true;
+		if (std::strcmp(argv[i], "--progressive") == 0) progressive = true;
+		if (std::strcmp(argv[i], "--denoise") == 0) denoise = true;
+		if (std::strcmp(argv[i], "--memory-stats") == 0) memory_stats = true;
+
+		if (std::strcmp(argv[i], "--headless") == 0 && i + 2 < argc)
+		{
+			headless_frames = std::max(std::atoi(argv[i + 1]), 1);
+			headless_path   = argv[i + 2];
+
+			i += 2;
+		}
+
+		if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+		{
+			capture_pattern = argv[++i];
+		}
+
+		if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+		{
+			trace_settings.samples = std::max(std::atoi(argv[++i]), 1);
+		}
+
+		if (std::strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+		{
+			trace_settings.depth = std::max(std::atoi(argv[++i]), 1);
+		}
+	}
+
+	// The pattern names every captured file, so a bad one fails before anything is traced
+
+	if (capture_pattern && frame_writer.Start(capture_pattern) == false)
+	{
+		std::cout << "[app] - err :: Capture pattern needs exactly one integer conversion for the frame index, e.g. frame_%04llu.png" << std::endl;
+
+		return 1;
+	}
+
+	const bool headless = headless_path != nullptr;
+
 	// Create window
 
-	glfwInit();
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+	GLFWwindow * window = nullptr;
+
+	if (headless == false)
+	{
+		glfwInit();
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-	const auto window = glfwCreateWindow(1024, 768, "Graphics Device", nullptr, nullptr);
+		window = glfwCreateWindow(1024, 768, "Graphics Device", nullptr, nullptr);
 
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-	glfwSetKeyCallback(window, key_callback);
-	glfwSetCursorPosCallback(window, mouse_callback);
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		glfwSetKeyCallback(window, key_callback);
+		glfwSetCursorPosCallback(window, mouse_callback);
+	}
 
 	// Create graphics device
 
 	GraphicsDevice device;
 
+	const Triangle triangles[]
+	{
+		{ {10.0f, 10.0f, 0.0f}, {0.0f, 20.0f, 0.0f}, {-10.0f, 10.0f, 0.0f} }
+	};
+
+	const Mesh meshes[]
+	{
+		{ triangles, sizeof(triangles) / sizeof(triangles[0]) }
+	};
+
+	const Instance instances[]
+	{
+		{ glm::mat4x3(1.0f), 0 }
+	};
+
 	{
 		// Describe graphics device
 
@@ -111,7 +262,26 @@ int main()
 
 			1024,
 
-			false
+			false,
+
+			meshes,
+			sizeof(meshes) / sizeof(meshes[0]),
+
+			instances,
+			sizeof(instances) / sizeof(instances[0]),
+
+			false,
+			false,
+			wavefront,
+			sort_rays,
+			persistent_threads,
+
+			1024,
+			768,
+
+			capture_pattern != nullptr,
+			progressive,
+			denoise
 		};
 
 		// Construct graphics device
@@ -119,15 +289,21 @@ int main()
 		if (const auto res = device.Construct(info); res != GraphicsDevice::Error::SUCCESS)
 		{
 			std::cout << "[app] - err :: Graphics device creation failed :: " << static_cast<unsigned int>(res) << std::endl;
+
+			if (headless) return 1;
 		}
+
+		device.SetTraceSettings(trace_settings);
+
+		if (memory_stats) device.DumpMemoryStats();
 	}
 
 	// Set up main loop
 
-	double previous_time{ glfwGetTime() };
-
 	unsigned int frame_count{ 0 };
 
+	uint64_t previous_rays{ 0 };
+
 	float delta_time = 0.0f;
 	float last_frame = 0.0f;
 
@@ -141,8 +317,53 @@ int main()
 	frame_data.light_pos = glm::vec3(0.0f, 64.0f, 0.0f);
 	frame_data.camera = camera.data;
 
+	// Batch render
+
+	if (headless)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		for (unsigned int i = 0; i < headless_frames; ++i)
+		{
+			device.Draw(frame_data);
+
+			drain_captured_frames(device);
+		}
+
+		std::vector<uint8_t> pixels(4 * 1024 * 768);
+
+		const bool read = device.ReadFrame(pixels.data()) == GraphicsDevice::Error::SUCCESS;
+
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		drain_captured_frames(device);
+
+		device.Destruct();
+
+		if (capture_pattern)
+		{
+			frame_writer.Stop();
+
+			std::cout << frame_writer.Written() << " frames captured, " << frame_writer.Dropped() << " dropped" << std::endl;
+		}
+
+		if (read == false || write_frame(headless_path, pixels.data(), 1024, 768) == false)
+		{
+			std::cout << "[app] - err :: Failed to write " << headless_path << std::endl;
+			return 1;
+		}
+
+		std::cout << headless_frames << " frames in " << seconds * 1e3 << " ms -> " << headless_path << std::endl;
+
+		return 0;
+	}
+
 	device.Draw(frame_data);
 
+	// GLFW is only initialized with a window, so the headless path above times itself with std::chrono
+
+	double previous_time{ glfwGetTime() };
+
 	// Main game loop
 
 	while (glfwWindowShouldClose(window) == false)
@@ -156,10 +377,20 @@ int main()
 
 		if (current_time - previous_time >= 1.0)
 		{
-			std::cout << frame_count << " FPS" << std::endl;
+			const uint64_t traced_rays = device.TracedRays();
+
+			std::cout << frame_count << " FPS";
+
+			if (wavefront)
+			{
+				std::cout << ", " << (traced_rays - previous_rays) / (current_time - previous_time) / 1e6 << " Mrays/s";
+			}
+
+			std::cout << std::endl;
 
 			frame_count = 0;
 			previous_time = current_time;
+			previous_rays = traced_rays;
 		}
 
 		delta_time = current_time - last_frame;
@@ -171,6 +402,13 @@ int main()
 
 		poll_keyboard(window, delta_time);
 
+		if (trace_settings_changed)
+		{
+			device.SetTraceSettings(trace_settings);
+
+			trace_settings_changed = false;
+		}
+
 		// Draw
 
 		frame_data.camera = camera.data;
@@ -179,6 +417,8 @@ int main()
 
 		device.Draw(frame_data);
 
+		drain_captured_frames(device);
+
 		// Swap backbuffer
 
 		glfwSwapBuffers(window);
@@ -199,8 +439,17 @@ int main()
 
 	device.WaitIdle();
 
+	drain_captured_frames(device);
+
 	device.Destruct();
 
+	if (capture_pattern)
+	{
+		frame_writer.Stop();
+
+		std::cout << frame_writer.Written() << " frames captured, " << frame_writer.Dropped() << " dropped" << std::endl;
+	}
+
 	glfwDestroyWindow(window);
 	glfwTerminate();
 }
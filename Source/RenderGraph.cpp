@@ -0,0 +1,290 @@
+#include <RenderGraph.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	using Renderer::AttachmentInfo;
+	using Renderer::GraphInfo;
+	using Renderer::PassInfo;
+
+	bool reads(const PassInfo & pass, unsigned short attachment)
+	{
+		return std::find(pass.color_inputs, pass.color_inputs + pass.color_input_count, attachment) != pass.color_inputs + pass.color_input_count;
+	}
+
+	bool writes(const PassInfo & pass, unsigned short attachment)
+	{
+		return std::find(pass.color_outputs, pass.color_outputs + pass.color_output_count, attachment) != pass.color_outputs + pass.color_output_count;
+	}
+
+	/**
+	 * @brief Whether a pass's index lists fit their arrays and name attachments of the graph
+	 */
+	bool valid_pass(const GraphInfo & info, const PassInfo & pass)
+	{
+		if (pass.color_output_count > 8 || pass.color_input_count > 8) return false;
+
+		if (pass.pipeline_count > 0 && pass.pipelines == nullptr) return false;
+
+		for (unsigned short i = 0; i < pass.color_output_count; ++i)
+		{
+			if (pass.color_outputs[i] >= info.color_attachment_count) return false;
+		}
+
+		for (unsigned short i = 0; i < pass.color_input_count; ++i)
+		{
+			if (pass.color_inputs[i] >= info.color_attachment_count) return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Whether two passes draw into and read from the same attachments, in the same order
+	 */
+	bool same_attachments(const PassInfo & a, const PassInfo & b)
+	{
+		return a.color_output_count == b.color_output_count
+			&& a.color_input_count == b.color_input_count
+			&& std::equal(a.color_outputs, a.color_outputs + a.color_output_count, b.color_outputs)
+			&& std::equal(a.color_inputs, a.color_inputs + a.color_input_count, b.color_inputs);
+	}
+}
+
+namespace Renderer
+{
+	bool CompileGraph(const GraphInfo & info, CompiledGraph & graph)
+	{
+		graph = CompiledGraph{};
+
+		const unsigned short pass_count       = info.pass_count;
+		const unsigned short attachment_count = info.color_attachment_count;
+
+		// Validate
+
+		unsigned short backbuffer_count = 0;
+
+		for (unsigned short a = 0; a < attachment_count; ++a)
+		{
+			if (info.color_attachments[a].source == AttachmentInfo::Source::BACKBUFFER) ++backbuffer_count;
+		}
+
+		if (backbuffer_count > 1)
+		{
+			std::cout << "[app] - err :: Render graph declares more than one backbuffer" << std::endl;
+			return false;
+		}
+
+		for (unsigned short p = 0; p < pass_count; ++p)
+		{
+			const PassInfo & pass = info.passes[p];
+
+			if (valid_pass(info, pass) == false)
+			{
+				std::cout << "[app] - err :: Render pass '" << pass.debug_name << "' names attachments the graph does not have" << std::endl;
+				return false;
+			}
+
+			for (unsigned short i = 0; i < pass.color_input_count; ++i)
+			{
+				const unsigned short a = pass.color_inputs[i];
+
+				// Swapchain images cannot be input attachments, and a pass reading its own output would need a
+				// self-dependency at every pixel
+
+				if (info.color_attachments[a].source == AttachmentInfo::Source::BACKBUFFER || writes(pass, a))
+				{
+					std::cout << "[app] - err :: Render pass '" << pass.debug_name << "' reads '" << info.color_attachments[a].debug_name << "', which it may not" << std::endl;
+					return false;
+				}
+			}
+		}
+
+		// Cull every pass which writes nothing the backbuffer is made from
+
+		std::vector<bool> live_attachments(attachment_count, false);
+		std::vector<bool> live_passes(pass_count, false);
+
+		for (unsigned short a = 0; a < attachment_count; ++a)
+		{
+			live_attachments[a] = info.color_attachments[a].source == AttachmentInfo::Source::BACKBUFFER;
+		}
+
+		for (bool changed = true; changed;)
+		{
+			changed = false;
+
+			for (unsigned short p = 0; p < pass_count; ++p)
+			{
+				const PassInfo & pass = info.passes[p];
+
+				if (live_passes[p]) continue;
+
+				const bool live = std::any_of(pass.color_outputs, pass.color_outputs + pass.color_output_count, [&](unsigned short a) { return live_attachments[a]; });
+
+				if (live == false) continue;
+
+				live_passes[p] = true;
+				changed        = true;
+
+				for (unsigned short i = 0; i < pass.color_input_count; ++i)
+				{
+					live_attachments[pass.color_inputs[i]] = true;
+				}
+			}
+		}
+
+		if (std::find(live_passes.begin(), live_passes.end(), true) == live_passes.end())
+		{
+			std::cout << "[app] - err :: Render graph draws nothing into a backbuffer" << std::endl;
+			return false;
+		}
+
+		// Each pass waits for every writer of what it reads, and writers of one attachment keep their given order
+
+		std::vector<std::vector<unsigned short>> successors(pass_count);
+		std::vector<unsigned short>              predecessor_count(pass_count, 0);
+
+		for (unsigned short a = 0; a < attachment_count; ++a)
+		{
+			int previous_writer = -1;
+
+			for (unsigned short p = 0; p < pass_count; ++p)
+			{
+				if (live_passes[p] == false || writes(info.passes[p], a) == false) continue;
+
+				if (previous_writer >= 0)
+				{
+					successors[previous_writer].push_back(p);
+				}
+
+				previous_writer = p;
+
+				for (unsigned short r = 0; r < pass_count; ++r)
+				{
+					if (live_passes[r] && reads(info.passes[r], a))
+					{
+						successors[p].push_back(r);
+					}
+				}
+			}
+
+			if (previous_writer < 0 && live_attachments[a] && info.color_attachments[a].source == AttachmentInfo::Source::TRANSIENT)
+			{
+				std::cout << "[app] - err :: Render graph reads '" << info.color_attachments[a].debug_name << "' but no pass writes it" << std::endl;
+				return false;
+			}
+		}
+
+		for (auto & next : successors)
+		{
+			std::sort(next.begin(), next.end());
+
+			next.erase(std::unique(next.begin(), next.end()), next.end());
+
+			for (const unsigned short p : next) ++predecessor_count[p];
+		}
+
+		// Kahn's algorithm, taking the earliest declared of the ready passes, so independent passes keep their order
+
+		std::vector<unsigned short> ready;
+
+		for (unsigned short p = 0; p < pass_count; ++p)
+		{
+			if (live_passes[p] && predecessor_count[p] == 0) ready.push_back(p);
+		}
+
+		const auto live_count = static_cast<size_t>(std::count(live_passes.begin(), live_passes.end(), true));
+
+		while (ready.empty() == false)
+		{
+			const auto next = std::min_element(ready.begin(), ready.end());
+
+			const unsigned short p = *next;
+
+			ready.erase(next);
+
+			graph.passes.push_back(p);
+
+			for (const unsigned short s : successors[p])
+			{
+				if (--predecessor_count[s] == 0) ready.push_back(s);
+			}
+		}
+
+		if (graph.passes.size() != live_count)
+		{
+			std::cout << "[app] - err :: Render graph passes depend on each other" << std::endl;
+			return false;
+		}
+
+		// Merge neighbours with the same attachments into one subpass
+
+		for (size_t i = 0; i < graph.passes.size(); ++i)
+		{
+			const PassInfo & pass = info.passes[graph.passes[i]];
+
+			if (i == 0 || same_attachments(pass, info.passes[graph.passes[i - 1]]) == false)
+			{
+				graph.subpass_outputs.emplace_back(pass.color_outputs, pass.color_outputs + pass.color_output_count);
+				graph.subpass_inputs.emplace_back(pass.color_inputs, pass.color_inputs + pass.color_input_count);
+			}
+
+			graph.pass_subpasses.push_back(static_cast<unsigned short>(graph.subpass_outputs.size() - 1));
+		}
+
+		// Attachment lifetimes, and what each subpass must wait for
+
+		graph.attachments.assign(attachment_count, AttachmentUsage{});
+
+		std::vector<int> last_writer(attachment_count, -1);
+
+		for (unsigned short s = 0; s < graph.subpass_outputs.size(); ++s)
+		{
+			SubpassDependency dependencies[8 + 8];
+
+			unsigned short dependency_count = 0;
+
+			const auto depend = [&](unsigned short a, bool read)
+			{
+				AttachmentUsage & usage = graph.attachments[a];
+
+				if (usage.used == false)
+				{
+					usage.used          = true;
+					usage.first_subpass = s;
+				}
+
+				usage.last_subpass = s;
+				usage.read         = usage.read || read;
+
+				if (last_writer[a] < 0) return;
+
+				const auto src = static_cast<unsigned short>(last_writer[a]);
+
+				auto it = std::find_if(dependencies, dependencies + dependency_count, [&](const SubpassDependency & d) { return d.src_subpass == src; });
+
+				if (it == dependencies + dependency_count)
+				{
+					*it = SubpassDependency{ src, s, false, false };
+
+					++dependency_count;
+				}
+
+				(read ? it->read_after_write : it->write_after_write) = true;
+			};
+
+			for (const unsigned short a : graph.subpass_inputs[s])  depend(a, true);
+			for (const unsigned short a : graph.subpass_outputs[s]) depend(a, false);
+
+			for (const unsigned short a : graph.subpass_outputs[s]) last_writer[a] = s;
+
+			graph.dependencies.insert(graph.dependencies.end(), dependencies, dependencies + dependency_count);
+		}
+
+		return true;
+	}
+}
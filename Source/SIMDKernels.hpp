@@ -0,0 +1,443 @@
+/**
+ * @file  SIMDKernels.hpp
+ * @brief Traversal kernels shared by every instruction set, written against a small vector type so each one only
+ *        supplies its wrapper.  Packets vectorize across rays, wide nodes across one ray's child boxes
+ *
+ * Only include from the kernel translation units, each built with its own instruction set enabled.  Everything
+ * they instantiate must have internal linkage: an inline function emitted there with AVX-512 enabled could
+ * otherwise be picked by the linker for callers on CPUs without it.  For the same reason the kernels take raw
+ * pointers, and call nothing from glm or the standard library
+ *
+ * A vector type `Float` provides:
+ *   - `Float::WIDTH`, `Float::Mask`, `Float::load(const float *)`, `Float::broadcast(float)` and `store(float *)`
+ *   - arithmetic `+ - * /`, `min` and `max`
+ *   - comparisons `< <=` returning `Float::Mask`, which supports `&`
+ *   - `select(mask, a, b)` picking `a` where the mask is set, and `bits(mask)` with lane `i` in bit `i`
+ */
+
+#pragma once
+
+#include <BVH.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+	/// @brief Starting distance of unused lanes.  No box entry or hit is ever closer
+	constexpr float DEAD_LANE = -std::numeric_limits<float>::infinity();
+
+	uint32_t lowest_lane(uint32_t lanes)
+	{
+#ifdef _MSC_VER
+		unsigned long idx;
+		_BitScanForward(&idx, lanes);
+		return idx;
+#else
+		return __builtin_ctz(lanes);
+#endif
+	}
+
+	uint32_t lane_count(uint32_t lanes)
+	{
+#ifdef _MSC_VER
+		return __popcnt(lanes);
+#else
+		return __builtin_popcount(lanes);
+#endif
+	}
+
+	template <typename Float>
+	struct Vec3
+	{
+		Float x;
+		Float y;
+		Float z;
+	};
+
+	/// @brief Rounded exactly as the scalar `glm::cross` in `intersect_triangle`, so packets find the same hits.  A fused
+	/// multiply-subtract would skip a rounding and flip hits right on an edge
+	template <typename Float>
+	Vec3<Float> cross(const Vec3<Float> & a, const Vec3<Float> & b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	template <typename Float>
+	Float dot(const Vec3<Float> & a, const Vec3<Float> & b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	template <typename Float>
+	Vec3<Float> broadcast(const glm::vec3 & v)
+	{
+		return { Float::broadcast(v.x), Float::broadcast(v.y), Float::broadcast(v.z) };
+	}
+
+	/**
+	 * @brief Up to `Float::WIDTH` rays in structure-of-arrays form, with the closest hit found so far per lane
+	 */
+	template <typename Float>
+	struct RayPacket
+	{
+		Vec3<Float> origin;
+		Vec3<Float> dir;
+		Vec3<Float> inv_dir;
+
+		Float t;
+
+		uint32_t tri[Float::WIDTH];
+	};
+
+	/**
+	 * @brief Vectorized `intersect_aabb`, testing every lane against one box
+	 *
+	 * Slabs are `(plane - origin) * inv_dir`, as in the scalar test.  Premultiplying the origin by `inv_dir` would
+	 * save a subtraction, but leaves `inf - inf` where a direction component is zero, missing axis-parallel rays
+	 *
+	 * @param t_near  Entry distance per lane, only meaningful where the returned mask is set
+	 */
+	template <typename Float>
+	typename Float::Mask intersect_aabb(const RayPacket<Float> & packet, const BVHNode & node, Float & t_near)
+	{
+		const Float t0x = (Float::broadcast(node.aabb_min.x) - packet.origin.x) * packet.inv_dir.x;
+		const Float t0y = (Float::broadcast(node.aabb_min.y) - packet.origin.y) * packet.inv_dir.y;
+		const Float t0z = (Float::broadcast(node.aabb_min.z) - packet.origin.z) * packet.inv_dir.z;
+		const Float t1x = (Float::broadcast(node.aabb_max.x) - packet.origin.x) * packet.inv_dir.x;
+		const Float t1y = (Float::broadcast(node.aabb_max.y) - packet.origin.y) * packet.inv_dir.y;
+		const Float t1z = (Float::broadcast(node.aabb_max.z) - packet.origin.z) * packet.inv_dir.z;
+
+		t_near = max(max(min(t0x, t1x), min(t0y, t1y)), min(t0z, t1z));
+
+		const Float t_far = min(min(max(t0x, t1x), max(t0y, t1y)), max(t0z, t1z));
+
+		return (t_near <= t_far) & (Float::broadcast(0.0f) < t_far) & (t_near < packet.t + Float::broadcast(RAY_EPSILON));
+	}
+
+	/**
+	 * @brief `intersect_triangle` for a single ray, restated here since the one in Geometry.h is shared inline code
+	 */
+	float intersect_triangle_scalar(const Ray & ray, const PrecomputedTriangle & tri)
+	{
+		const float pvec_x = ray.dir.y * tri.e2.z - ray.dir.z * tri.e2.y;
+		const float pvec_y = ray.dir.z * tri.e2.x - ray.dir.x * tri.e2.z;
+		const float pvec_z = ray.dir.x * tri.e2.y - ray.dir.y * tri.e2.x;
+
+		const float determinant = tri.e1.x * pvec_x + tri.e1.y * pvec_y + tri.e1.z * pvec_z;
+
+		if (determinant < RAY_EPSILON) return -1.0f;
+
+		const float inverse_determinant = 1.0f / determinant;
+
+		const float tvec_x = ray.origin.x - tri.v0.x;
+		const float tvec_y = ray.origin.y - tri.v0.y;
+		const float tvec_z = ray.origin.z - tri.v0.z;
+
+		const float u = (tvec_x * pvec_x + tvec_y * pvec_y + tvec_z * pvec_z) * inverse_determinant;
+
+		if (u < 0.0f || u > 1.0f) return -1.0f;
+
+		const float qvec_x = tvec_y * tri.e1.z - tvec_z * tri.e1.y;
+		const float qvec_y = tvec_z * tri.e1.x - tvec_x * tri.e1.z;
+		const float qvec_z = tvec_x * tri.e1.y - tvec_y * tri.e1.x;
+
+		const float v = (ray.dir.x * qvec_x + ray.dir.y * qvec_y + ray.dir.z * qvec_z) * inverse_determinant;
+
+		if (v < 0.0f || u + v > 1.0f) return -1.0f;
+
+		return (tri.e2.x * qvec_x + tri.e2.y * qvec_y + tri.e2.z * qvec_z) * inverse_determinant;
+	}
+
+	/**
+	 * @brief Vectorized `intersect_triangle`, testing every lane against one triangle and keeping closer hits
+	 */
+	template <typename Float>
+	void intersect_triangle(RayPacket<Float> & packet, const PrecomputedTriangle & tri, uint32_t tri_idx)
+	{
+		const Vec3<Float> e1 = broadcast<Float>(tri.e1);
+		const Vec3<Float> e2 = broadcast<Float>(tri.e2);
+		const Vec3<Float> v0 = broadcast<Float>(tri.v0);
+
+		const Float epsilon = Float::broadcast(RAY_EPSILON);
+		const Float zero    = Float::broadcast(0.0f);
+		const Float one     = Float::broadcast(1.0f);
+
+		const Vec3<Float> pvec = cross(packet.dir, e2);
+
+		const Float determinant         = dot(e1, pvec);
+		const Float inverse_determinant = one / determinant;
+
+		const Vec3<Float> tvec = { packet.origin.x - v0.x, packet.origin.y - v0.y, packet.origin.z - v0.z };
+		const Float       u    = dot(tvec, pvec) * inverse_determinant;
+
+		const Vec3<Float> qvec = cross(tvec, e1);
+		const Float       v    = dot(packet.dir, qvec) * inverse_determinant;
+
+		const Float t = dot(e2, qvec) * inverse_determinant;
+
+		// Same acceptance as the scalar test and `trace_bvh`, with every rejection folded into one mask
+
+		const typename Float::Mask hit =
+			(epsilon <= determinant) &
+			(zero <= u) & (u <= one) &
+			(zero <= v) & (u + v <= one) &
+			(epsilon < t) & (t < packet.t + epsilon);
+
+		uint32_t lanes = bits(hit);
+
+		if (lanes == 0) return;
+
+		packet.t = select(hit, t, packet.t);
+
+		for (; lanes != 0; lanes &= lanes - 1)
+		{
+			packet.tri[lowest_lane(lanes)] = tri_idx;
+		}
+	}
+
+	/**
+	 * @brief Walks the hierarchy once for the whole packet, descending into every node any lane enters
+	 *
+	 * Children are visited in the order most lanes would visit them in.  Unused lanes repeat the first ray with a
+	 * `DEAD_LANE` distance, so they never enter a box or accept a hit
+	 */
+	template <typename Float>
+	void trace_packet(const BVHNode * nodes, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count)
+	{
+		constexpr size_t WIDTH = Float::WIDTH;
+
+		alignas(64) float lanes[7][WIDTH];
+
+		for (size_t i = 0; i < WIDTH; ++i)
+		{
+			const Ray & ray = rays[i < count ? i : 0];
+
+			lanes[0][i] = ray.origin.x;
+			lanes[1][i] = ray.origin.y;
+			lanes[2][i] = ray.origin.z;
+			lanes[3][i] = ray.dir.x;
+			lanes[4][i] = ray.dir.y;
+			lanes[5][i] = ray.dir.z;
+			lanes[6][i] = i < count ? hits[i].t : DEAD_LANE;
+		}
+
+		RayPacket<Float> packet;
+
+		packet.origin = { Float::load(lanes[0]), Float::load(lanes[1]), Float::load(lanes[2]) };
+		packet.dir    = { Float::load(lanes[3]), Float::load(lanes[4]), Float::load(lanes[5]) };
+		packet.t      = Float::load(lanes[6]);
+
+		const Float one = Float::broadcast(1.0f);
+
+		packet.inv_dir = { one / packet.dir.x, one / packet.dir.y, one / packet.dir.z };
+
+		for (size_t i = 0; i < WIDTH; ++i)
+		{
+			packet.tri[i] = UINT32_MAX;
+		}
+
+		Float t_root;
+
+		if (bits(intersect_aabb(packet, nodes[0], t_root)) != 0)
+		{
+			uint32_t stack[64];
+			uint32_t stack_ptr = 0;
+
+			uint32_t node_idx = 0;
+
+			while (true)
+			{
+				const BVHNode & node = nodes[node_idx];
+
+				if (node.tri_count > 0)
+				{
+					for (uint32_t i = node.left_first; i < node.left_first + node.tri_count; ++i)
+					{
+						intersect_triangle(packet, tris[i], i);
+					}
+
+					if (stack_ptr == 0) break;
+
+					node_idx = stack[--stack_ptr];
+					continue;
+				}
+
+				Float t_left;
+				Float t_right;
+
+				const typename Float::Mask hit_left  = intersect_aabb(packet, nodes[node.left_first], t_left);
+				const typename Float::Mask hit_right = intersect_aabb(packet, nodes[node.left_first + 1], t_right);
+
+				const uint32_t left_lanes  = bits(hit_left);
+				const uint32_t right_lanes = bits(hit_right);
+
+				if ((left_lanes | right_lanes) == 0)
+				{
+					if (stack_ptr == 0) break;
+
+					node_idx = stack[--stack_ptr];
+					continue;
+				}
+
+				if (left_lanes == 0 || right_lanes == 0)
+				{
+					node_idx = node.left_first + (left_lanes == 0 ? 1 : 0);
+					continue;
+				}
+
+				// Both children are entered.  Go left first if at least as many lanes reach it first
+
+				const uint32_t left_first_lanes = bits(hit_left & (t_left <= t_right)) | (left_lanes & ~right_lanes);
+
+				const bool left_nearer = 2 * lane_count(left_first_lanes) >= lane_count(left_lanes | right_lanes);
+
+				node_idx = node.left_first + (left_nearer ? 0 : 1);
+
+				if (stack_ptr < 64)
+				{
+					stack[stack_ptr++] = node.left_first + (left_nearer ? 1 : 0);
+				}
+			}
+		}
+
+		alignas(64) float t[WIDTH];
+
+		packet.t.store(t);
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (packet.tri[i] == UINT32_MAX) continue;
+
+			hits[i].t   = t[i];
+			hits[i].tri = packet.tri[i];
+		}
+	}
+
+	template <typename Float>
+	void trace_packets(const BVHNode * nodes, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count)
+	{
+		for (size_t first = 0; first < count; first += Float::WIDTH)
+		{
+			const size_t remaining = count - first;
+
+			trace_packet<Float>(nodes, tris, rays + first, hits + first, remaining < Float::WIDTH ? remaining : Float::WIDTH);
+		}
+	}
+
+	/**
+	 * @brief Walks a wide hierarchy with one ray, testing all of a node's child boxes in one go
+	 *
+	 * Leaf triangles are tested as soon as their box is hit, and interior children are pushed far to near, as in
+	 * the scalar `trace_bvh`
+	 *
+	 * @param hit  On entry, `t` is the ray's maximum distance
+	 */
+	template <typename Float, size_t N>
+	void trace_wide(const WideBVHNode<N> * nodes, const PrecomputedTriangle * tris, const Ray & ray, Hit & hit)
+	{
+		static_assert(Float::WIDTH == N, "One lane per child");
+
+		const Float one = Float::broadcast(1.0f);
+
+		const Vec3<Float> origin  = broadcast<Float>(ray.origin);
+		const Vec3<Float> inv_dir = { one / Float::broadcast(ray.dir.x), one / Float::broadcast(ray.dir.y), one / Float::broadcast(ray.dir.z) };
+
+		uint32_t stack[64];
+		uint32_t stack_ptr = 0;
+
+		uint32_t node_idx = 0;
+
+		while (true)
+		{
+			const WideBVHNode<N> & node = nodes[node_idx];
+
+			const Float t0x = (Float::load(node.lo_x) - origin.x) * inv_dir.x;
+			const Float t0y = (Float::load(node.lo_y) - origin.y) * inv_dir.y;
+			const Float t0z = (Float::load(node.lo_z) - origin.z) * inv_dir.z;
+			const Float t1x = (Float::load(node.hi_x) - origin.x) * inv_dir.x;
+			const Float t1y = (Float::load(node.hi_y) - origin.y) * inv_dir.y;
+			const Float t1z = (Float::load(node.hi_z) - origin.z) * inv_dir.z;
+
+			const Float t_near = max(max(min(t0x, t1x), min(t0y, t1y)), min(t0z, t1z));
+			const Float t_far  = min(min(max(t0x, t1x), max(t0y, t1y)), max(t0z, t1z));
+
+			uint32_t lanes = bits((t_near <= t_far) & (Float::broadcast(0.0f) < t_far) & (t_near < Float::broadcast(hit.t + RAY_EPSILON)));
+
+			alignas(64) float t_box[N];
+
+			t_near.store(t_box);
+
+			// Interior children hit by the ray, kept sorted nearest first
+
+			uint32_t child_idx[N];
+			float    child_t[N];
+			int      child_count = 0;
+
+			for (; lanes != 0; lanes &= lanes - 1)
+			{
+				const uint32_t i = lowest_lane(lanes);
+
+				if (node.count[i] == 0)
+				{
+					int j = child_count++;
+
+					for (; j > 0 && child_t[j - 1] > t_box[i]; --j)
+					{
+						child_idx[j] = child_idx[j - 1];
+						child_t[j]   = child_t[j - 1];
+					}
+
+					child_idx[j] = node.child[i];
+					child_t[j]   = t_box[i];
+
+					continue;
+				}
+
+				for (uint32_t k = node.child[i]; k < node.child[i] + node.count[i]; ++k)
+				{
+					const float t = intersect_triangle_scalar(ray, tris[k]);
+
+					if (t > RAY_EPSILON && t < hit.t + RAY_EPSILON)
+					{
+						hit.t   = t;
+						hit.tri = k;
+					}
+				}
+			}
+
+			for (int j = child_count; j-- > 0;)
+			{
+				if (stack_ptr < 64)
+				{
+					stack[stack_ptr++] = child_idx[j];
+				}
+			}
+
+			if (stack_ptr == 0) break;
+
+			node_idx = stack[--stack_ptr];
+		}
+	}
+
+	template <typename Float, size_t N>
+	void trace_wide(const WideBVHNode<N> * nodes, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			Hit hit;
+
+			hit.t   = hits[i].t;
+			hit.tri = UINT32_MAX;
+
+			trace_wide<Float, N>(nodes, tris, rays[i], hit);
+
+			if (hit.tri != UINT32_MAX) hits[i] = hit;
+		}
+	}
+}
@@ -0,0 +1,59 @@
+/**
+ * @file  SIMDKernelsAVX2.cpp
+ * @brief Eight-ray packets and eight-wide nodes.  Built with AVX2 and FMA enabled, and only called once CPUID reports
+ *        both
+ */
+
+#include "SIMDKernels.hpp"
+
+#include <immintrin.h>
+
+namespace
+{
+	struct Mask8
+	{
+		__m256 v;
+	};
+
+	struct Float8
+	{
+		static constexpr size_t WIDTH = 8;
+
+		using Mask = Mask8;
+
+		__m256 v;
+
+		static Float8 load(const float * p) { return { _mm256_load_ps(p) }; }
+
+		static Float8 broadcast(float f) { return { _mm256_set1_ps(f) }; }
+
+		void store(float * p) const { _mm256_store_ps(p, v); }
+	};
+
+	Float8 operator+(Float8 a, Float8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+	Float8 operator-(Float8 a, Float8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+	Float8 operator*(Float8 a, Float8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+	Float8 operator/(Float8 a, Float8 b) { return { _mm256_div_ps(a.v, b.v) }; }
+
+	Float8 min(Float8 a, Float8 b) { return { _mm256_min_ps(a.v, b.v) }; }
+	Float8 max(Float8 a, Float8 b) { return { _mm256_max_ps(a.v, b.v) }; }
+
+	Mask8 operator<(Float8 a, Float8 b)  { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+	Mask8 operator<=(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+
+	Mask8 operator&(Mask8 a, Mask8 b) { return { _mm256_and_ps(a.v, b.v) }; }
+
+	Float8 select(Mask8 m, Float8 a, Float8 b) { return { _mm256_blendv_ps(b.v, a.v, m.v) }; }
+
+	uint32_t bits(Mask8 m) { return static_cast<uint32_t>(_mm256_movemask_ps(m.v)); }
+}
+
+void trace_bvh_packets_avx2(const BVHNode * nodes, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count)
+{
+	trace_packets<Float8>(nodes, tris, rays, hits, count);
+}
+
+void trace_wide_bvh8_avx2(const WideBVHNode<8> * nodes, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count)
+{
+	trace_wide<Float8, 8>(nodes, tris, rays, hits, count);
+}
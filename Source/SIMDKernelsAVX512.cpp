@@ -0,0 +1,54 @@
+/**
+ * @file  SIMDKernelsAVX512.cpp
+ * @brief Sixteen-ray packets.  Built with AVX-512F enabled, and only called once CPUID reports it.  Wide nodes have
+ *        at most eight children, so they use the AVX2 kernel instead
+ */
+
+#include "SIMDKernels.hpp"
+
+#include <immintrin.h>
+
+namespace
+{
+	struct Mask16
+	{
+		__mmask16 v;
+	};
+
+	struct Float16
+	{
+		static constexpr size_t WIDTH = 16;
+
+		using Mask = Mask16;
+
+		__m512 v;
+
+		static Float16 load(const float * p) { return { _mm512_load_ps(p) }; }
+
+		static Float16 broadcast(float f) { return { _mm512_set1_ps(f) }; }
+
+		void store(float * p) const { _mm512_store_ps(p, v); }
+	};
+
+	Float16 operator+(Float16 a, Float16 b) { return { _mm512_add_ps(a.v, b.v) }; }
+	Float16 operator-(Float16 a, Float16 b) { return { _mm512_sub_ps(a.v, b.v) }; }
+	Float16 operator*(Float16 a, Float16 b) { return { _mm512_mul_ps(a.v, b.v) }; }
+	Float16 operator/(Float16 a, Float16 b) { return { _mm512_div_ps(a.v, b.v) }; }
+
+	Float16 min(Float16 a, Float16 b) { return { _mm512_min_ps(a.v, b.v) }; }
+	Float16 max(Float16 a, Float16 b) { return { _mm512_max_ps(a.v, b.v) }; }
+
+	Mask16 operator<(Float16 a, Float16 b)  { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+	Mask16 operator<=(Float16 a, Float16 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ) }; }
+
+	Mask16 operator&(Mask16 a, Mask16 b) { return { static_cast<__mmask16>(a.v & b.v) }; }
+
+	Float16 select(Mask16 m, Float16 a, Float16 b) { return { _mm512_mask_blend_ps(m.v, b.v, a.v) }; }
+
+	uint32_t bits(Mask16 m) { return m.v; }
+}
+
+void trace_bvh_packets_avx512(const BVHNode * nodes, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count)
+{
+	trace_packets<Float16>(nodes, tris, rays, hits, count);
+}
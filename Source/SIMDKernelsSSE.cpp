@@ -0,0 +1,61 @@
+/**
+ * @file  SIMDKernelsSSE.cpp
+ * @brief Four-ray packets and four-wide nodes.  Needs only SSE2, which every x86-64 CPU has, so it is built without
+ *        extra flags and always available there
+ */
+
+#include "SIMDKernels.hpp"
+
+#include <emmintrin.h>
+
+namespace
+{
+	struct Mask4
+	{
+		__m128 v;
+	};
+
+	struct Float4
+	{
+		static constexpr size_t WIDTH = 4;
+
+		using Mask = Mask4;
+
+		__m128 v;
+
+		static Float4 load(const float * p) { return { _mm_load_ps(p) }; }
+
+		static Float4 broadcast(float f) { return { _mm_set1_ps(f) }; }
+
+		void store(float * p) const { _mm_store_ps(p, v); }
+	};
+
+	Float4 operator+(Float4 a, Float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+	Float4 operator-(Float4 a, Float4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+	Float4 operator*(Float4 a, Float4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+	Float4 operator/(Float4 a, Float4 b) { return { _mm_div_ps(a.v, b.v) }; }
+
+	Float4 min(Float4 a, Float4 b) { return { _mm_min_ps(a.v, b.v) }; }
+	Float4 max(Float4 a, Float4 b) { return { _mm_max_ps(a.v, b.v) }; }
+
+	Mask4 operator<(Float4 a, Float4 b)  { return { _mm_cmplt_ps(a.v, b.v) }; }
+	Mask4 operator<=(Float4 a, Float4 b) { return { _mm_cmple_ps(a.v, b.v) }; }
+
+	Mask4 operator&(Mask4 a, Mask4 b) { return { _mm_and_ps(a.v, b.v) }; }
+
+	// No blend before SSE4.1
+
+	Float4 select(Mask4 m, Float4 a, Float4 b) { return { _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)) }; }
+
+	uint32_t bits(Mask4 m) { return static_cast<uint32_t>(_mm_movemask_ps(m.v)); }
+}
+
+void trace_bvh_packets_sse(const BVHNode * nodes, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count)
+{
+	trace_packets<Float4>(nodes, tris, rays, hits, count);
+}
+
+void trace_wide_bvh4_sse(const WideBVHNode<4> * nodes, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count)
+{
+	trace_wide<Float4, 4>(nodes, tris, rays, hits, count);
+}
@@ -0,0 +1,179 @@
+#include <SIMDTraversal.h>
+
+#ifdef SIMD_KERNELS
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+/**
+ * @brief Kernels, each defined in a translation unit built for its instruction set
+ *
+ * @see SIMDKernels.hpp
+ */
+void trace_bvh_packets_sse(const BVHNode * nodes, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count);
+
+void trace_bvh_packets_avx2(const BVHNode * nodes, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count);
+
+void trace_bvh_packets_avx512(const BVHNode * nodes, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count);
+
+void trace_wide_bvh4_sse(const WideBVHNode<4> * nodes, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count);
+
+void trace_wide_bvh8_avx2(const WideBVHNode<8> * nodes, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count);
+
+#endif
+
+namespace
+{
+#ifdef SIMD_KERNELS
+
+	void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4])
+	{
+#ifdef _MSC_VER
+		int r[4];
+		__cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+
+		for (int i = 0; i < 4; ++i) regs[i] = static_cast<unsigned int>(r[i]);
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	/**
+	 * @brief Register state the OS saves on context switches.  Only valid once CPUID reports OSXSAVE
+	 */
+	uint64_t xgetbv()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		uint32_t lo;
+		uint32_t hi;
+
+		__asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+
+		return (static_cast<uint64_t>(hi) << 32) | lo;
+#endif
+	}
+
+	SIMDLevel query_simd_level()
+	{
+		unsigned int regs[4];
+
+		cpuid(0, 0, regs);
+
+		// SSE2 is part of x86-64 itself
+
+		if (regs[0] < 7) return SIMDLevel::SSE;
+
+		cpuid(1, 0, regs);
+
+		const bool osxsave = (regs[2] & (1u << 27)) != 0;
+		const bool fma     = (regs[2] & (1u << 12)) != 0;
+
+		if (osxsave == false) return SIMDLevel::SSE;
+
+		cpuid(7, 0, regs);
+
+		const bool avx2    = (regs[1] & (1u << 5)) != 0;
+		const bool avx512f = (regs[1] & (1u << 16)) != 0;
+
+		// The CPU supporting an extension is not enough, the OS must also save its registers: XMM and YMM state for
+		// AVX2, plus the opmask and both halves of ZMM state for AVX-512
+
+		const uint64_t xcr0 = xgetbv();
+
+		const bool ymm_state = (xcr0 & 0x06) == 0x06;
+		const bool zmm_state = (xcr0 & 0xE6) == 0xE6;
+
+		if (avx2 == false || fma == false || ymm_state == false) return SIMDLevel::SSE;
+
+		return avx512f && zmm_state ? SIMDLevel::AVX512 : SIMDLevel::AVX2;
+	}
+
+#endif
+}
+
+SIMDLevel detect_simd_level()
+{
+#ifdef SIMD_KERNELS
+	static const SIMDLevel level = query_simd_level();
+
+	return level;
+#else
+	return SIMDLevel::SCALAR;
+#endif
+}
+
+const char * simd_level_name(SIMDLevel level)
+{
+	switch (level)
+	{
+		case SIMDLevel::SSE:    return "sse";
+		case SIMDLevel::AVX2:   return "avx2";
+		case SIMDLevel::AVX512: return "avx512";
+		default:                return "scalar";
+	}
+}
+
+void trace_bvh_packets(const BVH & bvh, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count, SIMDLevel level)
+{
+	// The packet box test skips the inverted-box check, so an empty hierarchy's root must not reach it
+
+	if (bvh.tri_indices.empty()) return;
+
+#ifdef SIMD_KERNELS
+	switch (level)
+	{
+		case SIMDLevel::AVX512: trace_bvh_packets_avx512(bvh.nodes.data(), tris, rays, hits, count); return;
+		case SIMDLevel::AVX2:   trace_bvh_packets_avx2(bvh.nodes.data(), tris, rays, hits, count);   return;
+		case SIMDLevel::SSE:    trace_bvh_packets_sse(bvh.nodes.data(), tris, rays, hits, count);    return;
+		default: break;
+	}
+#endif
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Hit hit = trace_bvh(bvh, tris, rays[i], hits[i].t);
+
+		if (hit.tri != UINT32_MAX) hits[i] = hit;
+	}
+}
+
+void trace_wide_bvh(const WideBVH<4> & bvh, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count, SIMDLevel level)
+{
+#ifdef SIMD_KERNELS
+	if (level >= SIMDLevel::SSE)
+	{
+		trace_wide_bvh4_sse(bvh.nodes.data(), tris, rays, hits, count);
+		return;
+	}
+#endif
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Hit hit = trace_bvh(bvh, tris, rays[i], hits[i].t);
+
+		if (hit.tri != UINT32_MAX) hits[i] = hit;
+	}
+}
+
+void trace_wide_bvh(const WideBVH<8> & bvh, const PrecomputedTriangle * tris, const Ray * rays, Hit * hits, size_t count, SIMDLevel level)
+{
+#ifdef SIMD_KERNELS
+	if (level >= SIMDLevel::AVX2)
+	{
+		trace_wide_bvh8_avx2(bvh.nodes.data(), tris, rays, hits, count);
+		return;
+	}
+#endif
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Hit hit = trace_bvh(bvh, tris, rays[i], hits[i].t);
+
+		if (hit.tri != UINT32_MAX) hits[i] = hit;
+	}
+}
@@ -8,8 +8,20 @@
 
 #include <vulkan/vulkan.h>
 
+#include "DeviceAllocator.h"
+
+#include <BVH.h>
+#include <GraphicsDevice.h>
+#include <RenderGraph.h>
+#include <Scene.h>
+#include <Util.hpp>
+
 #include <glm/glm.hpp>
 
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 struct Swapchain
@@ -26,18 +38,18 @@ struct Swapchain
 	/// @brief Swapchain dimentions
 	VkExtent2D extent;
 
+	/// @brief Binary, as acquiring and presenting take no timeline semaphores
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	std::vector<VkSemaphore> renderFinishedSemaphores;
 
-	std::vector<VkFence> frameFences;
-
-	/// @brief Swapchain images
+	/// @brief Swapchain images, or one offscreen image per frame in flight when headless
 	std::vector<VkImage> images;
 
+	/// @brief Backing memory of the offscreen images.  Empty unless headless, as the swapchain owns its images
+	std::vector<DeviceAllocation> imageMemory;
+
 	/// @brief Image views into swapchain images
 	std::vector<VkImageView> imageViews;
-
-	std::vector<VkFramebuffer> framebuffers;
 };
 
 struct RasterPipeline
@@ -46,6 +58,300 @@ struct RasterPipeline
 	VkPipeline pipeline;
 };
 
+struct Buffer
+{
+	VkBuffer buffer;
+	DeviceAllocation memory;
+};
+
+struct Image
+{
+	VkImage image;
+	DeviceAllocation memory;
+	VkImageView view;
+};
+
+/**
+ * @brief Key/value radix sort running entirely on the device
+ *
+ * @see RadixSort.glsl
+ */
+struct RadixSorter
+{
+	VkDescriptorSetLayout descset_layout;
+	VkDescriptorPool      desc_pool;
+	VkDescriptorSet       descset;
+
+	VkPipelineLayout pipeline_layout;
+
+	VkPipeline histogram_pipeline;
+	VkPipeline scan_pipeline;
+	VkPipeline scatter_pipeline;
+
+	Buffer histogram_buffer;
+
+	/// @brief Keys to sort, after the indirect dispatch of one workgroup per 256 of them
+	Buffer count_buffer;
+
+	/// @brief Most keys sorted at once, which is also the size of each half of the key and value buffers
+	uint32_t capacity;
+};
+
+/**
+ * @brief Builds a linear BVH over the scene triangles on the device, and refits it when they move
+ *
+ * @see LBVH.glsl
+ */
+struct LBVHBuilder
+{
+	VkDescriptorSetLayout descset_layout;
+
+	/// @brief One per frame in flight, reading that frame's copy of the scene
+	std::vector<VkDescriptorPool> desc_pools;
+	std::vector<VkDescriptorSet>  descsets;
+
+	VkPipelineLayout pipeline_layout;
+
+	VkPipeline bounds_pipeline;
+	VkPipeline morton_pipeline;
+	VkPipeline hierarchy_pipeline;
+	VkPipeline fit_pipeline;
+
+	Buffer state_buffer;
+	Buffer key_buffer;
+	Buffer value_buffer;
+	Buffer node_buffer;
+	Buffer parent_buffer;
+	Buffer flag_buffer;
+
+	RadixSorter sorter;
+};
+
+/**
+ * @brief Path tracer split into generate, extend, shade and connect kernels, which pass paths between each other
+ *        through queues rather than running whole paths in one invocation
+ *
+ * @see Wavefront.glsl
+ */
+struct WavefrontTracer
+{
+	VkDescriptorSetLayout descset_layout;
+	VkDescriptorPool      desc_pool;
+	VkDescriptorSet       descset;
+
+	/// @brief Scene set at 0 and queue set at 1, with FrameData and the pass indices pushed
+	VkPipelineLayout pipeline_layout;
+
+	/// @brief Variants for the current trace settings, owned by `VulkanState::pipeline_variants`
+	VkPipeline generate_pipeline;
+	VkPipeline extend_pipeline;
+	VkPipeline shade_pipeline;
+	VkPipeline connect_pipeline;
+	VkPipeline resolve_pipeline;
+
+	VkPipeline sort_keys_pipeline;
+
+	/// @brief One PathState per pixel
+	Buffer path_buffer;
+
+	/// @brief Queue counters, which are also the indirect dispatch arguments of the kernels draining them
+	Buffer queue_buffer;
+
+	/// @brief Path indices of every queue
+	Buffer item_buffer;
+
+	/// @brief Keys and path indices of the queue being sorted, in the two-half layout `sorter` expects
+	Buffer key_buffer;
+	Buffer value_buffer;
+
+	/// @brief 64-bit count of rays traced by the frame being traced, shadow rays included
+	Buffer stats_buffer;
+
+	/// @brief Host-visible copy of `stats_buffer` for each frame in flight, taken at the end of its frame
+	std::vector<Buffer> stats_readbacks;
+
+	/// @brief Frame copied into each of `stats_readbacks`, or zero once it has been added to `traced_rays`
+	std::vector<uint64_t> stats_frames;
+
+	/// @brief Rays traced by every frame collected from `stats_readbacks`
+	uint64_t traced_rays;
+
+	RadixSorter sorter;
+
+	/// @brief Reorder queues for coherence before extension and shading
+	bool sort_rays;
+};
+
+/**
+ * @brief Host-visible copy of one frame in flight's traced image
+ */
+struct ReadbackSlot
+{
+	Buffer buffer;
+
+	/// @brief Persistently mapped
+	void * mapped;
+
+	/// @brief Index of the frame whose image was copied in, if `pending`.  One less than that frame's value on the
+	///        timeline semaphore, so the copy is complete once the semaphore exceeds it
+	uint64_t frame;
+
+	/// @brief A copy was submitted and has not been collected
+	bool pending;
+};
+
+/**
+ * @brief Copy out of the staging ring, recorded when the data was written in and submitted with the next batch
+ */
+struct StagingCopy
+{
+	VkBuffer dst;
+
+	/// @brief Index into `VulkanState::scenes` of the copy `dst` belongs to
+	uint32_t scene;
+
+	VkBufferCopy region;
+};
+
+/**
+ * @brief Device-local copy of the scene traced by one frame in flight, so uploads never overwrite what another frame
+ *        is still reading.  Written only through the staging ring, which updates every copy
+ */
+struct SceneBuffers
+{
+	Buffer scene_data_buffer;
+	Buffer bvh_node_buffer;
+	Buffer tlas_node_buffer;
+	Buffer instance_buffer;
+
+	/// @brief Face normal of each triangle in `scene_data_buffer`, kept apart so traversal never fetches them
+	Buffer normal_buffer;
+
+	/// @brief Timeline value of the last frame traced against this copy, the only one copies into it wait for
+	uint64_t frame = 0;
+};
+
+/**
+ * @brief One submission of staging copies to the transfer queue
+ */
+struct StagingBatch
+{
+	VkCommandBuffer command_buffer;
+	VkFence         fence;
+
+	/// @brief `StagingRing::head` when submitted.  Everything before it is free again once `fence` signals
+	uint64_t head;
+};
+
+/**
+ * @brief Persistently mapped ring of host-visible memory which scene uploads are written into, then copied from into
+ *        device-local buffers on the transfer queue
+ */
+struct StagingRing
+{
+	Buffer buffer;
+
+	VkDeviceSize capacity;
+
+	/// @brief Bytes ever reserved and ever released.  Their difference is in use, and `head` modulo `capacity` is
+	/// where the next upload goes
+	uint64_t head;
+	uint64_t tail;
+
+	/// @brief Written into the ring since the last submission
+	std::vector<StagingCopy> copies;
+
+	VkCommandPool command_pool;
+
+	/// @brief Submitted batches whose copies may still be reading the ring, oldest first, and finished ones to reuse
+	std::deque<StagingBatch>  batches;
+	std::vector<StagingBatch> spare_batches;
+
+	/// @brief One per frame in flight, signalled by the batch filling that frame's scene copy, which the frame waits on
+	std::vector<VkSemaphore> semaphores;
+
+	/// @brief Batches were submitted since the last frame, so it has to wait on them
+	bool submitted;
+};
+
+/**
+ * @brief A `Renderer::GraphInfo` built into one render pass, with its attachments and pipelines.  See
+ *        `create_render_graph`
+ */
+struct RenderGraph
+{
+	Renderer::CompiledGraph compiled;
+
+	VkRenderPass render_pass;
+
+	/// @brief One per swapchain image
+	std::vector<VkFramebuffer> framebuffers;
+
+	/// @brief Images of the transient attachments used, by index into `GraphInfo::color_attachments`.  Null for the
+	/// rest
+	std::vector<Image> attachments;
+
+	/// @brief Per render pass attachment
+	std::vector<VkClearValue> clear_values;
+
+	/// @brief Per pass in `compiled.passes`
+	std::vector<std::vector<RasterPipeline>> pipelines;
+
+	/// @brief Per pass in `compiled.passes`, its input attachments, bound as set 1.  Null if it reads none
+	std::vector<VkDescriptorSetLayout> input_layouts;
+	std::vector<VkDescriptorSet>       input_sets;
+
+	VkDescriptorPool input_pool;
+};
+
+/**
+ * @brief Hashes map keys with `string_hash`.  Keys still compare whole, so a collision only costs a probe
+ */
+struct StringHash
+{
+	size_t operator()(const std::string & key) const
+	{
+		return static_cast<size_t>(string_hash(key.c_str()));
+	}
+};
+
+/**
+ * @brief Destruction of a resource which frames still on the device may use
+ */
+struct DeferredDestruction
+{
+	/// @brief Frame after which nothing uses the resource
+	uint64_t frame;
+
+	std::function<void()> destroy;
+};
+
+/**
+ * @brief Paces frames on one timeline semaphore, which each frame's graphics submission signals with the frame's
+ *        number, counting from one.  Waiting for a frame also waits for every frame before it
+ */
+struct FrameTimeline
+{
+	VkSemaphore semaphore;
+
+	/// @brief Last frame submitted, and last frame seen finished
+	uint64_t submitted;
+	uint64_t completed;
+
+	/// @brief Oldest first, so those whose frame has finished are at the front
+	std::deque<DeferredDestruction> destructions;
+};
+
+/**
+ * @brief Device BVH work recorded into the next frame
+ */
+enum class LBVHUpdate
+{
+	NONE,    //< Hierarchy is up to date
+	REFIT,   //< Vertices moved.  Only bounds are recomputed
+	REBUILD  //< Morton codes, sort, hierarchy and bounds are all recomputed
+};
+
 /**
  * @brief Full state of vulkan backend
  *
@@ -70,19 +376,52 @@ struct VulkanState
 	/// @note Single GPU
 	VkDevice device;
 
-	VkRenderPass render_pass;
+	/// @brief Backs every buffer and image but the swapchain's
+	DeviceAllocator allocator;
+
+	/// @brief Linear pool of the images sized to the traced resolution, which live exactly as long as the device
+	uint32_t render_target_pool;
+
+	/// @brief Pool of equal slots for `readback_ring`.  Unused unless capturing frames
+	uint32_t readback_pool;
 
+	/// @brief Every pipeline is built through this, loaded at construction and saved at destruction
+	VkPipelineCache pipeline_cache;
+
+	/// @brief Megakernel variant for the current `trace_settings`, owned by `pipeline_variants`
 	VkPipeline compute_pipeline;
 
-	RasterPipeline filter_pso;
+	/// @brief Every specialization of a tracer kernel built so far, keyed by its path and settings
+	std::unordered_map<std::string, VkPipeline, StringHash> pipeline_variants;
+
+	/// @brief Composites the traced image onto the backbuffer
+	RenderGraph render_graph;
 
 	VkPipelineLayout compute_pipeline_layout;
 
+	/// @brief Resolves each frame's radiance against the reprojected history.  See Temporal.comp
+	VkPipeline       temporal_pipeline;
+	VkPipelineLayout temporal_pipeline_layout;
+
+	/// @brief Variance estimate and à-trous iterations filtering the temporal pass's output.  See Atrous.comp
+	VkPipeline       variance_pipeline;
+	VkPipeline       atrous_pipeline;
+	VkPipelineLayout denoise_pipeline_layout;
+
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
 
+	/// @brief Queue scene uploads are copied on.  The graphics queue unless the device has a transfer-only family
+	VkQueue transferQueue;
+
+	/// @brief Queue frames are traced and filtered on.  The graphics queue unless the device has a compute family
+	/// without graphics, in which case the next frame's trace overlaps this one's composite and present
+	VkQueue computeQueue;
+
 	int graphicsQueueIndex;
 	int presentQueueIndex;
+	int transferQueueIndex;
+	int computeQueueIndex;
 
 	VkDescriptorSetLayout graphics_descset_layout;
 	VkDescriptorSetLayout compute_descset_layout;
@@ -98,14 +437,51 @@ struct VulkanState
 
 	VkSampler raytrace_storage_image_sampler;
 
-	VkBuffer scene_data_buffer;
+	/// @brief One per frame in flight, bound in its `compute_descsets`
+	std::vector<SceneBuffers> scenes;
+
+	/// @brief Next pixel for the persistent-threads tracer to fetch
+	Buffer work_counter_buffer;
+
+	/// @brief Source of every write to the device-local scene buffers
+	StagingRing staging;
 
-	VkDeviceMemory scene_data_buffer_memory;
+	/// @brief Host-visible copy of an offscreen image, filled by `ReadFrame`.  Only created when headless
+	Buffer readback_buffer;
+
+	/// @brief One per frame in flight, each ready to collect once `timeline` has passed the frame recorded in its
+	///        `ReadbackSlot::frame`.  Empty unless capturing frames
+	std::vector<ReadbackSlot> readback_ring;
+
+	/// @brief Frames collected from `readback_ring`, oldest first
+	std::deque<CapturedFrame> captured_frames;
+
+	LBVHBuilder lbvh_builder;
+
+	WavefrontTracer wavefront;
 	VkDeviceMemory raytrace_storage_image_memory;
 
+	/// @brief History resolved by each frame in flight.  Each frame reads the previous frame's as it writes its own
+	std::vector<Image> accumulation_images;
+
+	/// @brief Radiance traced this frame, and the world-space position of each pixel's primary hit
+	Image radiance_image;
+	Image position_image;
+
+	/// @brief Normal and depth of each frame in flight's primary hits, which the next frame checks its history
+	/// against, and luminance moments resolved alongside `accumulation_images`
+	std::vector<Image> normal_images;
+	std::vector<Image> moment_images;
+
+	/// @brief Albedo of each pixel's primary hit, divided out of radiance while it is filtered
+	Image albedo_image;
+
+	/// @brief Radiance and variance passed back and forth between à-trous iterations
+	Image filter_images[2];
+
 	std::vector<VkImage>        traced_images; // 0 is current, 1 is previous
 	std::vector<VkImageView>    traced_image_views;
-	std::vector<VkDeviceMemory> traced_image_memory;
+	std::vector<DeviceAllocation> traced_image_memory;
 
 	std::vector<VkDescriptorSet> graphics_descsets;
 	std::vector<VkDescriptorSet> compute_descsets;
@@ -114,13 +490,82 @@ struct VulkanState
 
 	std::vector<VkCommandBuffer> commandBuffers;
 
+	/// @brief Per frame in flight, on `computeQueueIndex`.  Record the trace, temporal and denoise passes
+	std::vector<VkCommandPool>   computeCommandPools;
+	std::vector<VkCommandBuffer> computeCommandBuffers;
+
+	FrameTimeline timeline;
+
+	/// @brief VK_KHR_timeline_semaphore entry points, which the loader does not export
+	PFN_vkWaitSemaphoresKHR           wait_semaphores;
+	PFN_vkGetSemaphoreCounterValueKHR get_semaphore_counter_value;
+
+	/// @brief Per frame in flight.  Signalled by the compute submission once `traced_images` is released to the
+	/// graphics queue, and waited on before it is composited
+	std::vector<VkSemaphore> trace_finished_semaphores;
+
 	// IMMUTABLE STATE //
 
 	unsigned char FRAMES_IN_FLIGHT = 2;
 
 	unsigned short RAYTRACE_RESOLUTION;
 
+	uint32_t TRIANGLE_COUNT;
+
+	bool DYNAMIC_BVH;
+
+	/// @brief Bottom-level nodes are uploaded as BVH8Node rather than BVHNode
+	bool WIDE_BVH;
+
+	/// @brief Paths are traced by the wavefront kernels rather than `compute_pipeline`
+	bool WAVEFRONT;
+
+	/// @brief `compute_pipeline` is the persistent-threads variant, launched at a fixed size
+	bool PERSISTENT_THREADS;
+
+	/// @brief No window was given.  `swapchain` holds offscreen images, and nothing is acquired or presented
+	bool HEADLESS;
+
+	/// @brief Frames keep accumulating while the view is unchanged
+	bool PROGRESSIVE;
+
+	/// @brief The temporal pass's output is filtered by the variance and à-trous passes before it is displayed
+	bool DENOISE;
+
 	// MUTABLE STATE //
 
 	unsigned char currentFrame;
+
+	/// @brief Frames submitted by `Draw` so far
+	uint64_t frame_count;
+
+	/// @brief Specialization constants the tracer pipelines in use were built with
+	TraceSettings trace_settings;
+
+	/// @brief Frames blended into the latest of `accumulation_images`, and the view the latest was traced from
+	uint32_t  accumulated_frames;
+	FrameData accumulated_view;
+
+	/// @brief Set by scene updates, so the next frame clips its history even if the view held still
+	bool scene_changed;
+
+	/// @brief Host copies of every mesh, in their original order.  Flattened again when a device BVH is in use
+	std::vector<std::vector<Triangle>> meshes;
+
+	std::vector<Instance> instances;
+
+	/// @brief One hierarchy per mesh, refitted in place when its triangles move
+	std::vector<BVH> blas;
+
+	/// @brief Where each mesh's nodes and triangles start in `bvh_node_buffer` and `scene_data_buffer`
+	std::vector<uint32_t> blas_node_offsets;
+	std::vector<uint32_t> blas_tri_offsets;
+
+	/// @brief Hierarchy over instance bounds, mirrored in `tlas_node_buffer`
+	BVH tlas;
+
+	LBVHUpdate lbvh_update;
+
+	/// @brief Device refits since the last full device rebuild
+	unsigned int lbvh_refit_count;
 };